@@ -25,6 +25,10 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /** \cond We don't really need to have these in our docs */
 /* EPS command values */
 #define PING                1
@@ -66,6 +70,17 @@ typedef struct
     uint8_t addr;                           /**< EPS I2C slave address */
 } KEPSConf;
 
+/**
+ * Adaptive watchdog settings (see ::k_eps_watchdog_start_adaptive). Zero fields take their default.
+ */
+typedef struct
+{
+    uint32_t gnd_timeout;                   /**< Ground watchdog period [seconds] (default 172800) */
+    uint32_t gnd_margin;                    /**< Kick the ground watchdog once less than this is left [seconds] (default 3600) */
+    uint32_t i2c_timeout;                   /**< I2C watchdog period [seconds] (default 0, not tracked) */
+    uint32_t i2c_margin;                    /**< Ping once less than this is left on the I2C watchdog [seconds] (default i2c_timeout / 3) */
+} eps_watchdog_config_t;
+
 /**
  * Response header structure
  */
@@ -134,6 +149,11 @@ typedef struct
     uint16_t reserved2;                     /**< Reserved */
 } __attribute__((packed)) eps_hk_t;
 
+/**
+ * Topic on which every ::eps_hk_t read by ::k_eps_get_housekeeping is published (see ::k_pubsub_find)
+ */
+#define EPS_HK_TOPIC "p31u-hk"
+
 /*
  * Public Functions
  */
@@ -248,6 +268,11 @@ KEPSStatus k_eps_reset_battery_config(void);
 KEPSStatus k_eps_reset_counters(void);
 /**
  * Get system housekeeping data
+ *
+ * The converted data is also published on ::EPS_HK_TOPIC, which the HAL
+ * polling governor follows, so its battery mode becomes the power mode
+ * that the device APIs' background threads are paced by.
+ *
  * @param [out] buff Pointer to storage structure
  * @return KEPSStatus EPS_OK if OK, error otherwise
  */
@@ -284,6 +309,20 @@ KEPSStatus k_eps_watchdog_kick(void);
  * @return KEPSStatus `EPS_OK` if OK, error otherwise
  */
 KEPSStatus k_eps_watchdog_start(uint32_t interval);
+/**
+ * Start a thread which only kicks the EPS's watchdogs when they need it
+ *
+ * The time left on the ground and I2C watchdogs is taken from every housekeeping read (::k_eps_get_housekeeping),
+ * and any command sent to the EPS counts as an I2C watchdog kick. The thread sleeps until one of them is within its
+ * margin of expiring; only then does it fetch housekeeping to confirm, and kick the ground watchdog or ping the EPS.
+ * When the time left is not yet known the first wakeup does this at once.
+ *
+ * @note Like ::k_eps_watchdog_start, ground watchdog kicks write to EEPROM; this mode keeps them to one per
+ * `gnd_timeout - gnd_margin` at most.
+ * @param [in] config Watchdog settings, or NULL for the defaults
+ * @return KEPSStatus `EPS_OK` if OK, error otherwise
+ */
+KEPSStatus k_eps_watchdog_start_adaptive(const eps_watchdog_config_t * config);
 /**
  * Stop the watchdog thread
  * @return KEPSStatus `EPS_OK` if OK, error otherwise
@@ -315,4 +354,15 @@ KEPSStatus k_eps_passthrough(const uint8_t * tx, int tx_len, uint8_t * rx,
 KEPSStatus kprv_eps_transfer(const uint8_t * tx, int tx_len, uint8_t * rx,
                              int rx_len);
 
+/**
+ * Convert a housekeeping response body from the EPS' big endian byte order
+ * @param [in]  body    Housekeeping as received
+ * @param [out] buff    Pointer to storage for the converted housekeeping
+ */
+void kprv_eps_decode_housekeeping(const eps_hk_t * body, eps_hk_t * buff);
+
+#ifdef __cplusplus
+}
+#endif
+
 /* @} */
@@ -14,15 +14,78 @@
  * limitations under the License.
  */
 
+#include <bus-budget.h>
+#include <bus-worker.h>
+#include <clock.h>
+#include <device-policy.h>
+#include <governor.h>
+#include <metrics.h>
 #include <gomspace-p31u-api.h>
+#include <pthread.h>
+#include <pubsub.h>
 #include <stdio.h>
 #include <string.h>
+#include <thread-policy.h>
+#include <thread-stats.h>
+#include <watchdog.h>
 #include <time.h>
 #include <unistd.h>
 
 static int eps_bus = 0;
 static uint8_t eps_addr = 0;
 
+/* Bus and protocol failures are counted per command */
+static int eps_metrics = -1;
+
+/*
+ * Bus budgets: passthrough traffic gets a share of the bus, watchdog kicks
+ * are never held back
+ */
+static int bulk_budget = -1;
+static int watchdog_budget = -1;
+static const k_budget_config watchdog_budget_config = {.critical = true };
+
+/* Watchdog trackers for the adaptive watchdog thread, -1 when not running */
+static int wdt_gnd = -1;
+static int wdt_i2c = -1;
+
+static void kprv_eps_wdt_report(int wdt, uint32_t seconds)
+{
+    if (wdt < 0)
+    {
+        return;
+    }
+
+    if (seconds > UINT32_MAX / 1000)
+    {
+        seconds = UINT32_MAX / 1000;
+    }
+
+    k_wdt_report(wdt, seconds * 1000);
+}
+
+/* Housekeeping is shared with subscribers through a topic */
+#define HK_TOPIC_DEPTH 8
+static int hk_topic = -1;
+static uint64_t hk_topic_storage[K_PUBSUB_STORAGE(sizeof(eps_hk_t),
+                                                  HK_TOPIC_DEPTH)];
+
+/*
+ * Health probe used while the EPS's circuit breaker is open
+ */
+static void kprv_eps_probe(void)
+{
+    k_eps_ping();
+}
+
+/* Battery modes are numbered the same as the governor's power modes */
+static int kprv_eps_gov_mode(const void * data, uint32_t len)
+{
+    const eps_hk_t * hk = data;
+
+    return (len == sizeof(*hk)) ? hk->batt_mode : -1;
+}
+
 KEPSStatus k_eps_init(KEPSConf config)
 {
     if (config.bus == NULL || config.addr == 0)
@@ -46,11 +109,34 @@ KEPSStatus k_eps_init(KEPSConf config)
         return EPS_ERROR;
     }
 
+    /* Retry NACKs, and stop spending bus time on the EPS if it dies */
+    k_policy_attach("p31u", eps_bus, eps_addr, NULL, kprv_eps_probe);
+
+    k_bus_attach("p31u", config.bus);
+
+    if (k_metrics_device("p31u", &eps_metrics) == METRICS_OK)
+    {
+        k_metrics_attach(eps_metrics, eps_bus, eps_addr);
+    }
+
+    k_budget_register("p31u-bulk", NULL, &bulk_budget);
+    k_budget_register("p31u-watchdog", &watchdog_budget_config,
+                      &watchdog_budget);
+    k_pubsub_topic(EPS_HK_TOPIC, sizeof(eps_hk_t), HK_TOPIC_DEPTH,
+                   hk_topic_storage,
+                   K_PUBSUB_STORAGE(sizeof(eps_hk_t), HK_TOPIC_DEPTH),
+                   &hk_topic);
+
+    /* Polling elsewhere slows down as the battery runs low */
+    k_gov_follow(hk_topic, sizeof(eps_hk_t), kprv_eps_gov_mode);
+
     return EPS_OK;
 }
 
 void k_eps_terminate()
 {
+    k_policy_detach(eps_bus, eps_addr);
+    k_gov_unfollow();
     k_i2c_terminate(&eps_bus);
 
     eps_bus = 0;
@@ -417,27 +503,8 @@ KEPSStatus k_eps_reset_counters()
     return EPS_OK;
 }
 
-KEPSStatus k_eps_get_housekeeping(eps_hk_t * buff)
+void kprv_eps_decode_housekeeping(const eps_hk_t * body, eps_hk_t * buff)
 {
-    KEPSStatus status;
-    uint8_t packet[] = { GET_HOUSEKEEPING, 0 }; 
-    uint8_t response[sizeof(eps_resp_header) + sizeof(eps_hk_t)] = { 0 };
-
-    if (buff == NULL)
-    {
-        return EPS_ERROR_CONFIG;
-    }
-
-    status = kprv_eps_transfer(packet, sizeof(packet), response,
-                               sizeof(response));
-    if (status != EPS_OK)
-    {
-        fprintf(stderr, "Failed to get EPS housekeeping data: %d\n", status);
-        return status;
-    }
-
-    eps_hk_t * body = (eps_hk_t *) (response + sizeof(eps_resp_header));
-
     /* Convert big endian to host endianness for multi-byte fields */
     buff->vboost[0] = be16toh(body->vboost[0]);
     buff->vboost[1] = be16toh(body->vboost[1]);
@@ -484,6 +551,34 @@ KEPSStatus k_eps_get_housekeeping(eps_hk_t * buff)
     buff->boot_cause = body->boot_cause;
     buff->batt_mode = body->batt_mode;
     buff->ppt_mode = body->ppt_mode;
+}
+
+KEPSStatus k_eps_get_housekeeping(eps_hk_t * buff)
+{
+    KEPSStatus status;
+    uint8_t packet[] = { GET_HOUSEKEEPING, 0 }; 
+    uint8_t response[sizeof(eps_resp_header) + sizeof(eps_hk_t)] = { 0 };
+
+    if (buff == NULL)
+    {
+        return EPS_ERROR_CONFIG;
+    }
+
+    status = kprv_eps_transfer(packet, sizeof(packet), response,
+                               sizeof(response));
+    if (status != EPS_OK)
+    {
+        fprintf(stderr, "Failed to get EPS housekeeping data: %d\n", status);
+        return status;
+    }
+
+    kprv_eps_decode_housekeeping(
+        (eps_hk_t *) (response + sizeof(eps_resp_header)), buff);
+
+    kprv_eps_wdt_report(wdt_gnd, buff->wdt_gnd_time_left);
+    kprv_eps_wdt_report(wdt_i2c, buff->wdt_i2c_time_left);
+
+    k_pubsub_publish(hk_topic, buff, sizeof(*buff));
 
     return EPS_OK;
 }
@@ -610,23 +705,183 @@ KEPSStatus k_eps_watchdog_kick()
     return EPS_OK;
 }
 
-pthread_t handle_watchdog = { 0 };
-uint32_t watchdog_interval = 0;
+static pthread_t handle_watchdog = { 0 };
+static uint32_t watchdog_interval = 0;
+
+static void kprv_eps_wdt_detach(void)
+{
+    k_wdt_detach(wdt_gnd);
+    k_wdt_detach(wdt_i2c);
+    wdt_gnd = -1;
+    wdt_i2c = -1;
+}
 
 void * kprv_eps_watchdog_thread(void * args)
 {
     KEPSStatus status;
+    int        gov;
+
+    k_thread_stats_register("eps-watchdog", watchdog_interval * 1000);
+    /* The interval is the caller's margin, so it isn't stretched by default */
+    if (k_gov_register("eps-watchdog", watchdog_interval * 1000,
+                       watchdog_interval * 1000, &gov)
+        != GOV_OK)
+    {
+        gov = -1;
+    }
+    pthread_cleanup_push(k_thread_stats_unregister, NULL);
+    k_budget_enter(watchdog_budget);
 
     while (1)
     {
+        k_thread_stats_wakeup();
+
         k_eps_watchdog_kick();
 
-        sleep(watchdog_interval);
+        if (gov < 0)
+        {
+            k_clock_sleep((uint64_t) watchdog_interval * K_CLOCK_NS_PER_SEC);
+        }
+        else
+        {
+            k_gov_sleep(gov);
+        }
     }
 
+    pthread_cleanup_pop(1);
+
     return NULL;
 }
 
+/* Retry interval after a failed adaptive kick [seconds] */
+#define EPS_WDT_RETRY 10
+
+void * kprv_eps_watchdog_adaptive_thread(void * args)
+{
+    eps_hk_t hk;
+    uint64_t now;
+    uint64_t next;
+
+    /* No fixed period: the wakeups follow the watchdogs */
+    k_thread_stats_register("eps-watchdog", 0);
+    pthread_cleanup_push(k_thread_stats_unregister, NULL);
+    k_budget_enter(watchdog_budget);
+
+    while (1)
+    {
+        k_thread_stats_wakeup();
+
+        now = k_clock_now();
+
+        /* Check the EPS's own count before spending an EEPROM write */
+        if (k_wdt_due(wdt_gnd) <= now
+            || (wdt_i2c >= 0 && k_wdt_due(wdt_i2c) <= now))
+        {
+            k_eps_get_housekeeping(&hk);
+        }
+
+        if (k_wdt_due(wdt_gnd) <= now && k_eps_watchdog_kick() == EPS_OK)
+        {
+            k_wdt_kicked(wdt_gnd);
+        }
+
+        /* Any command kicks the I2C watchdog, and a ping is the cheapest */
+        if (wdt_i2c >= 0 && k_wdt_due(wdt_i2c) <= now)
+        {
+            k_eps_ping();
+        }
+
+        next = k_wdt_due(wdt_gnd);
+        if (wdt_i2c >= 0 && k_wdt_due(wdt_i2c) < next)
+        {
+            next = k_wdt_due(wdt_i2c);
+        }
+        if (next <= now)
+        {
+            next = now + (uint64_t) EPS_WDT_RETRY * K_CLOCK_NS_PER_SEC;
+        }
+
+        k_clock_sleep_until(next);
+    }
+
+    pthread_cleanup_pop(1);
+
+    return NULL;
+}
+
+KEPSStatus k_eps_watchdog_start_adaptive(const eps_watchdog_config_t * config)
+{
+    eps_watchdog_config_t settings
+        = {.gnd_timeout = 172800, .gnd_margin = 3600 };
+    k_wdt_config gnd = {.implicit = false };
+    k_wdt_config i2c = {.implicit = true };
+
+    if (config != NULL)
+    {
+        if (config->gnd_timeout != 0)
+        {
+            settings.gnd_timeout = config->gnd_timeout;
+        }
+        if (config->gnd_margin != 0)
+        {
+            settings.gnd_margin = config->gnd_margin;
+        }
+        settings.i2c_timeout = config->i2c_timeout;
+        settings.i2c_margin = (config->i2c_margin != 0)
+                                  ? config->i2c_margin
+                                  : config->i2c_timeout / 3;
+    }
+
+    if (settings.gnd_margin >= settings.gnd_timeout
+        || settings.gnd_timeout > UINT32_MAX / 1000
+        || settings.i2c_timeout > UINT32_MAX / 1000
+        || (settings.i2c_timeout != 0
+            && settings.i2c_margin >= settings.i2c_timeout))
+    {
+        return EPS_ERROR_CONFIG;
+    }
+
+    if (handle_watchdog != 0)
+    {
+        fprintf(stderr, "EPS watchdog thread already started\n");
+        return EPS_OK;
+    }
+
+    gnd.timeout_ms = settings.gnd_timeout * 1000;
+    gnd.margin_ms = settings.gnd_margin * 1000;
+    if (k_wdt_attach("p31u-gnd", eps_bus, eps_addr, &gnd, &wdt_gnd) != WDT_OK)
+    {
+        fprintf(stderr, "Failed to track EPS ground watchdog\n");
+        wdt_gnd = -1;
+        return EPS_ERROR;
+    }
+
+    if (settings.i2c_timeout != 0)
+    {
+        i2c.timeout_ms = settings.i2c_timeout * 1000;
+        i2c.margin_ms = settings.i2c_margin * 1000;
+        if (k_wdt_attach("p31u-i2c", eps_bus, eps_addr, &i2c, &wdt_i2c)
+            != WDT_OK)
+        {
+            fprintf(stderr, "Failed to track EPS I2C watchdog\n");
+            kprv_eps_wdt_detach();
+            return EPS_ERROR;
+        }
+    }
+
+    if (k_thread_create("eps-watchdog", &handle_watchdog,
+                        kprv_eps_watchdog_adaptive_thread, NULL)
+        != THREAD_POLICY_OK)
+    {
+        perror("Failed to create EPS watchdog thread");
+        handle_watchdog = 0;
+        kprv_eps_wdt_detach();
+        return EPS_ERROR;
+    }
+
+    return EPS_OK;
+}
+
 KEPSStatus k_eps_watchdog_start(uint32_t interval)
 {
     if (interval == 0)
@@ -642,8 +897,9 @@ KEPSStatus k_eps_watchdog_start(uint32_t interval)
 
     watchdog_interval = interval;
 
-    if (pthread_create(&handle_watchdog, NULL, kprv_eps_watchdog_thread, NULL)
-        != 0)
+    if (k_thread_create("eps-watchdog", &handle_watchdog,
+                        kprv_eps_watchdog_thread, NULL)
+        != THREAD_POLICY_OK)
     {
         perror("Failed to create EPS watchdog thread");
         handle_watchdog = 0;
@@ -678,6 +934,7 @@ KEPSStatus k_eps_watchdog_stop()
 
     handle_watchdog = 0;
     watchdog_interval = 0;
+    kprv_eps_wdt_detach();
 
     return EPS_OK;
 }
@@ -690,15 +947,22 @@ KEPSStatus k_eps_passthrough(const uint8_t * tx, int tx_len, uint8_t * rx,
         return EPS_ERROR_CONFIG;
     }
 
+    KEPSStatus status;
+    int        previous = k_budget_enter(bulk_budget);
+
     if (rx == NULL)
     {
         eps_resp_header hdr = { 0 };
-        return kprv_eps_transfer(tx, tx_len, (uint8_t *) &hdr, sizeof(hdr));
+        status = kprv_eps_transfer(tx, tx_len, (uint8_t *) &hdr, sizeof(hdr));
     }
     else
     {
-        return kprv_eps_transfer(tx, tx_len, rx, rx_len);
+        status = kprv_eps_transfer(tx, tx_len, rx, rx_len);
     }
+
+    k_budget_leave(previous);
+
+    return status;
 }
 
 KEPSStatus kprv_eps_transfer(const uint8_t * tx, int tx_len, uint8_t * rx,
@@ -735,6 +999,7 @@ KEPSStatus kprv_eps_transfer(const uint8_t * tx, int tx_len, uint8_t * rx,
         /* Echoed command should match command requested */
         fprintf(stderr, "Command mismatch - Sent: %d Received: %d\n", tx[0],
                 response.cmd);
+        k_metrics_record(eps_metrics, tx[0], METRIC_ECHO_MISMATCH);
         return EPS_ERROR;
     }
 
@@ -743,6 +1008,7 @@ KEPSStatus kprv_eps_transfer(const uint8_t * tx, int tx_len, uint8_t * rx,
     {
         fprintf(stderr, "EPS returned an error (%d): %d\n", tx[0],
                 response.status);
+        k_metrics_record(eps_metrics, tx[0], METRIC_DEVICE_ERROR);
         return EPS_ERROR_INTERNAL;
     }
 
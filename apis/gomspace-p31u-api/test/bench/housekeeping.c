@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Housekeeping decode benchmark
+ *
+ * Times kprv_eps_decode_housekeeping (the byte order conversion done on every
+ * k_eps_get_housekeeping) over recorded frames, and checks each decoded frame
+ * against its expected field values.
+ *
+ * Usage: gomspace-p31u-api-bench [iterations]
+ * Exits non-zero if any check fails.
+ */
+
+#include <gomspace-p31u-api.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_ITERATIONS 1000000
+
+/* Recorded housekeeping, as decoded */
+static const eps_hk_t frames[] = {
+    {
+        .vboost = { 387, 378, 386 },
+        .vbatt = 7200,
+        .curin = { 77, 24, 23 },
+        .cursun = 30,
+        .cursys = 47,
+        .curout = { 1, 2, 3, 4, 5, 6 },
+        .output = { 0, 1, 0, 1, 0, 1, 0, 1 },
+        .output_on_delta = { 1, 2, 3, 4, 5, 6, 7, 8 },
+        .output_off_delta = { 21, 22, 23, 24, 25, 26, 27, 28 },
+        .latchup = { 1, 2, 3, 4, 5, 6 },
+        .wdt_i2c_time_left = 9600,
+        .wdt_gnd_time_left = 4321,
+        .wdt_csp_pings_left = { 4, 5 },
+        .counter_wdt_i2c = 3210,
+        .counter_wdt_gnd = 123456789,
+        .counter_wdt_csp = { 6543, 76543210 },
+        .counter_boot = 9,
+        .temp = { 23, 24, 25, 26, 27, 28 },
+        .boot_cause = 2,
+        .batt_mode = 3,
+        .ppt_mode = 1,
+    },
+    {
+        .vboost = { 4210, 0, 3987 },
+        .vbatt = 8105,
+        .curin = { 412, 0, 388 },
+        .cursun = 795,
+        .cursys = 610,
+        .curout = { 120, 0, 245, 0, 15, 980 },
+        .output = { 1, 0, 1, 0, 1, 1, 0, 0 },
+        .output_off_delta = { 0, 0, 0, 0, 0, 0, 600, 0 },
+        .latchup = { 0, 0, 0, 0, 0, 65535 },
+        .wdt_i2c_time_left = 86400,
+        .wdt_gnd_time_left = 172800,
+        .wdt_csp_pings_left = { 10, 10 },
+        .counter_wdt_gnd = 2,
+        .counter_boot = 4294967295,
+        .temp = { -12, -8, 5, 31, -40, 85 },
+        .boot_cause = 7,
+        .batt_mode = 4,
+        .ppt_mode = 2,
+    },
+};
+
+#define NUM_FRAMES (sizeof(frames) / sizeof(frames[0]))
+
+/* Multi-byte fields, which travel big endian */
+static const struct {
+    size_t offset;
+    size_t width;
+    size_t count;
+} fields[] = {
+    { offsetof(eps_hk_t, vboost), 2, 3 },
+    { offsetof(eps_hk_t, vbatt), 2, 1 },
+    { offsetof(eps_hk_t, curin), 2, 3 },
+    { offsetof(eps_hk_t, cursun), 2, 1 },
+    { offsetof(eps_hk_t, cursys), 2, 1 },
+    { offsetof(eps_hk_t, curout), 2, 6 },
+    { offsetof(eps_hk_t, output_on_delta), 2, 8 },
+    { offsetof(eps_hk_t, output_off_delta), 2, 8 },
+    { offsetof(eps_hk_t, latchup), 2, 6 },
+    { offsetof(eps_hk_t, wdt_i2c_time_left), 4, 1 },
+    { offsetof(eps_hk_t, wdt_gnd_time_left), 4, 1 },
+    { offsetof(eps_hk_t, counter_wdt_i2c), 4, 1 },
+    { offsetof(eps_hk_t, counter_wdt_gnd), 4, 1 },
+    { offsetof(eps_hk_t, counter_wdt_csp), 4, 2 },
+    { offsetof(eps_hk_t, counter_boot), 4, 1 },
+    { offsetof(eps_hk_t, temp), 2, 6 },
+};
+
+#define NUM_FIELDS (sizeof(fields) / sizeof(fields[0]))
+
+/* Keeps the compiler from dropping the timed decodes */
+static volatile uint16_t sink;
+
+/* Build the frame as the EPS sends it, one byte at a time */
+static void encode(const eps_hk_t * frame, eps_hk_t * wire)
+{
+    const uint8_t * in  = (const uint8_t *) frame;
+    uint8_t *       out = (uint8_t *) wire;
+
+    memcpy(out, in, sizeof(eps_hk_t));
+
+    for (int i = 0; i < NUM_FIELDS; i++)
+    {
+        for (int n = 0; n < fields[i].count; n++)
+        {
+            size_t offset = fields[i].offset + n * fields[i].width;
+            size_t width  = fields[i].width;
+            uint32_t value = 0;
+
+            memcpy(&value, in + offset, width);
+            for (int b = 0; b < width; b++)
+            {
+                out[offset + b] = value >> (8 * (width - 1 - b));
+            }
+        }
+    }
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char * argv[])
+{
+    long     iterations = DEFAULT_ITERATIONS;
+    eps_hk_t wire[NUM_FRAMES];
+    eps_hk_t decoded;
+    int      failures = 0;
+    int      conversions = 0;
+    double   start;
+
+    if (argc > 1)
+    {
+        iterations = strtol(argv[1], NULL, 0);
+    }
+
+    for (int i = 0; i < NUM_FIELDS; i++)
+    {
+        conversions += fields[i].count;
+    }
+
+    for (int i = 0; i < NUM_FRAMES; i++)
+    {
+        encode(&frames[i], &wire[i]);
+
+        memset(&decoded, 0, sizeof(decoded));
+        kprv_eps_decode_housekeeping(&wire[i], &decoded);
+        if (memcmp(&decoded, &frames[i], sizeof(decoded)) != 0)
+        {
+            printf("FAIL: frame %d did not decode to the recorded values\n", i);
+            failures++;
+        }
+    }
+
+    start = now_ns();
+    for (long n = 0; n < iterations; n++)
+    {
+        for (int i = 0; i < NUM_FRAMES; i++)
+        {
+            kprv_eps_decode_housekeeping(&wire[i], &decoded);
+            sink = decoded.vbatt;
+        }
+    }
+    double frame_ns = (now_ns() - start) / ((double) iterations * NUM_FRAMES);
+
+    printf("%-22s %12s %12s\n", "frame", "ns/frame", "ns/field");
+    printf("%-22s %12.2f %12.2f\n", "eps_hk_t", frame_ns,
+           frame_ns / conversions);
+
+    if (failures != 0)
+    {
+        printf("\n%d check(s) failed\n", failures);
+        return 1;
+    }
+
+    printf("\nAll frames match the recorded values\n");
+
+    return 0;
+}
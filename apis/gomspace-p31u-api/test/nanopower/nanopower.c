@@ -17,6 +17,8 @@
 
 #include <gomspace-p31u-api.h>
 #include <cmocka.h>
+#include <string.h>
+#include <watchdog.h>
 
 /* Test Data */
 eps_resp_header response = { 0 };
@@ -614,6 +616,104 @@ static void test_watchdog_thread_twice(void ** arg)
     assert_int_equal(stop_ret, EPS_OK);
 }
 
+static k_wdt_stats find_wdt(const char * name)
+{
+    k_wdt_stats buffer[K_WDT_MAX];
+    int         count = 0;
+
+    assert_int_equal(k_wdt_snapshot(buffer, K_WDT_MAX, &count), WDT_OK);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(buffer[i].name, name) == 0)
+        {
+            return buffer[i];
+        }
+    }
+
+    fail_msg("No record for %s", name);
+
+    k_wdt_stats empty = { 0 };
+    return empty;
+}
+
+static void test_watchdog_adaptive_bad(void ** arg)
+{
+    eps_watchdog_config_t config = {.gnd_timeout = 100, .gnd_margin = 100 };
+
+    assert_int_equal(k_eps_watchdog_start_adaptive(&config), EPS_ERROR_CONFIG);
+
+    config.gnd_margin = 10;
+    config.i2c_timeout = 60;
+    config.i2c_margin = 60;
+    assert_int_equal(k_eps_watchdog_start_adaptive(&config), EPS_ERROR_CONFIG);
+}
+
+static void test_watchdog_adaptive_skip(void ** arg)
+{
+    uint8_t test_response[sizeof(eps_hk_t) + sizeof(eps_resp_header)] = { 0 };
+    eps_watchdog_config_t config = {
+        .gnd_timeout = 172800,
+        .gnd_margin  = 3600,
+        .i2c_timeout = 10000,
+        .i2c_margin  = 1000,
+    };
+
+    memcpy(test_response + sizeof(eps_resp_header), &hk_be, sizeof(eps_hk_t));
+
+    /* 4321s and 9600s left: housekeeping only, no kick and no ping */
+    expect_value(__wrap_write, cmd, GET_HOUSEKEEPING);
+    expect_value(__wrap_read, len, sizeof(test_response));
+    will_return(__wrap_read, test_response);
+
+    assert_int_equal(k_eps_watchdog_start_adaptive(&config), EPS_OK);
+
+    const struct timespec delay = {.tv_sec = 0, .tv_nsec = 20000001 };
+
+    nanosleep(&delay, NULL);
+
+    k_wdt_stats gnd = find_wdt("p31u-gnd");
+    k_wdt_stats i2c = find_wdt("p31u-i2c");
+
+    assert_int_equal(k_eps_watchdog_stop(), EPS_OK);
+
+    assert_int_equal(gnd.kicks, 0);
+    assert_int_equal(gnd.reports, 1);
+    assert_true(gnd.time_left_ms > 4300000 && gnd.time_left_ms <= 4321000);
+    assert_int_equal(i2c.reports, 1);
+    assert_true(i2c.time_left_ms > 9500000 && i2c.time_left_ms <= 9600000);
+    assert_false(find_wdt("p31u-gnd").active);
+}
+
+static void test_watchdog_adaptive_kick(void ** arg)
+{
+    uint8_t test_response[sizeof(eps_hk_t) + sizeof(eps_resp_header)] = { 0 };
+    eps_watchdog_config_t config = {.gnd_margin = 5000 };
+
+    memcpy(test_response + sizeof(eps_resp_header), &hk_be, sizeof(eps_hk_t));
+
+    /* 4321s left is inside the margin: kick */
+    expect_value(__wrap_write, cmd, GET_HOUSEKEEPING);
+    expect_value(__wrap_read, len, sizeof(test_response));
+    will_return(__wrap_read, test_response);
+    expect_value(__wrap_write, cmd, RESET_WDT);
+    expect_value(__wrap_read, len, sizeof(eps_resp_header));
+    will_return(__wrap_read, &response);
+
+    assert_int_equal(k_eps_watchdog_start_adaptive(&config), EPS_OK);
+
+    const struct timespec delay = {.tv_sec = 0, .tv_nsec = 20000001 };
+
+    nanosleep(&delay, NULL);
+
+    k_wdt_stats gnd = find_wdt("p31u-gnd");
+
+    assert_int_equal(k_eps_watchdog_stop(), EPS_OK);
+
+    assert_int_equal(gnd.kicks, 1);
+    assert_true(gnd.time_left_ms > 172700000);
+}
+
 static void test_watchdog_stop_no_start(void ** arg)
 {
     KEPSStatus ret;
@@ -839,6 +939,9 @@ int main(void)
         cmocka_unit_test_setup_teardown(test_watchdog_kick, init, term),
         cmocka_unit_test_setup_teardown(test_watchdog_thread, init, term),
         cmocka_unit_test_setup_teardown(test_watchdog_thread_twice, init, term),
+        cmocka_unit_test_setup_teardown(test_watchdog_adaptive_bad, init, term),
+        cmocka_unit_test_setup_teardown(test_watchdog_adaptive_skip, init, term),
+        cmocka_unit_test_setup_teardown(test_watchdog_adaptive_kick, init, term),
         cmocka_unit_test_setup_teardown(test_watchdog_stop_no_start, init, term),
         cmocka_unit_test_setup_teardown(test_passthrough_null_tx, init, term),
         cmocka_unit_test_setup_teardown(test_passthrough_zero_tx_len, init, term),
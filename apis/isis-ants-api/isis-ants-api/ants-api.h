@@ -25,6 +25,10 @@
 #include <stdint.h>
 #include <i2c.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /** \cond WE DO NOT WANT TO HAVE THESE IN OUR GENERATED DOCS */
 /* AntS command values */
 #define SYSTEM_RESET                0xAA
@@ -119,6 +123,11 @@ typedef struct
     uint32_t uptime;        /**< System uptime (in seconds) */
 } __attribute__((packed)) ants_telemetry;
 
+/**
+ * Topic on which every ::ants_telemetry read by ::k_ants_get_system_telemetry is published (see ::k_pubsub_find)
+ */
+#define ANTS_TELEMETRY_TOPIC "ants-telem"
+
 /*
  * Public Functions
  */
@@ -193,6 +202,9 @@ KANTSStatus k_ants_get_deploy_status(uint16_t * resp);
 KANTSStatus k_ants_get_uptime(uint32_t * uptime);
 /**
  * Get the current system telemetry
+ *
+ * The telemetry, including the deployment status, is also published on ::ANTS_TELEMETRY_TOPIC.
+ *
  * @param [out] telem Pointer to ::ants_telemetry structure
  * @return KANTSStatus `ANTS_OK` if OK, error otherwise
  */
@@ -240,4 +252,8 @@ KANTSStatus k_ants_watchdog_stop(void);
 KANTSStatus k_ants_passthrough(const uint8_t * tx, int tx_len, uint8_t * rx,
                                int rx_len);
 
+#ifdef __cplusplus
+}
+#endif
+
 /* @} */
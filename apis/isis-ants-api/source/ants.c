@@ -15,8 +15,17 @@
  */
 
 #include <ants-api.h>
+#include <bus-budget.h>
+#include <bus-worker.h>
+#include <clock.h>
+#include <device-policy.h>
+#include <governor.h>
 #include <i2c.h>
+#include <metrics.h>
+#include <pubsub.h>
 #include <stdio.h>
+#include <thread-policy.h>
+#include <thread-stats.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -27,6 +36,20 @@ static uint8_t ants_addr = 0; /* Address of the antenna microcontroller commands
 static uint8_t ant_count = 0;
 static uint8_t ants_wd_timeout = 0;
 
+/*
+ * Bus budgets: passthrough traffic gets a share of the bus, watchdog kicks
+ * are never held back
+ */
+static int bulk_budget = -1;
+static int watchdog_budget = -1;
+static const k_budget_config watchdog_budget_config = {.critical = true };
+
+/* System telemetry is shared with subscribers through a topic */
+#define TELEMETRY_TOPIC_DEPTH 8
+static int telemetry_topic = -1;
+static uint64_t telemetry_topic_storage[K_PUBSUB_STORAGE(
+    sizeof(ants_telemetry), TELEMETRY_TOPIC_DEPTH)];
+
 /* Handle for watchdog thread */
 static pthread_t handle_watchdog = { 0 };
 
@@ -36,6 +59,26 @@ static pthread_t handle_watchdog = { 0 };
  */
 const struct timespec TRANSFER_DELAY = {.tv_sec = 0, .tv_nsec = 1000001 };
 
+/*
+ * Health probes used while a controller's circuit breaker is open
+ */
+static void kprv_ants_probe(uint8_t addr)
+{
+    uint8_t cmd = WATCHDOG_RESET;
+
+    k_i2c_write(ants_bus, addr, &cmd, 1);
+}
+
+static void kprv_ants_probe_primary(void)
+{
+    kprv_ants_probe(ants_primary);
+}
+
+static void kprv_ants_probe_secondary(void)
+{
+    kprv_ants_probe(ants_secondary);
+}
+
 KANTSStatus k_ants_init(char * bus, uint8_t primary, uint8_t secondary, uint8_t count, uint32_t timeout)
 {
     /* Save internal configuration values */
@@ -55,11 +98,46 @@ KANTSStatus k_ants_init(char * bus, uint8_t primary, uint8_t secondary, uint8_t
     /* Set default I2C slave address */
     ants_addr = ants_primary;
 
+    /*
+     * Each controller gets its own policy, so a dead one doesn't stop
+     * commands to the other
+     */
+    k_policy_attach("ants-primary", ants_bus, ants_primary, NULL,
+                    kprv_ants_probe_primary);
+    if (ants_secondary != 0)
+    {
+        k_policy_attach("ants-secondary", ants_bus, ants_secondary, NULL,
+                        kprv_ants_probe_secondary);
+    }
+
+    k_bus_attach("ants", bus);
+
+    int metrics;
+    if (k_metrics_device("ants", &metrics) == METRICS_OK)
+    {
+        k_metrics_attach(metrics, ants_bus, ants_primary);
+        if (ants_secondary != 0)
+        {
+            k_metrics_attach(metrics, ants_bus, ants_secondary);
+        }
+    }
+
+    k_budget_register("ants-bulk", NULL, &bulk_budget);
+    k_budget_register("ants-watchdog", &watchdog_budget_config,
+                      &watchdog_budget);
+    k_pubsub_topic(ANTS_TELEMETRY_TOPIC, sizeof(ants_telemetry),
+                   TELEMETRY_TOPIC_DEPTH, telemetry_topic_storage,
+                   K_PUBSUB_STORAGE(sizeof(ants_telemetry),
+                                    TELEMETRY_TOPIC_DEPTH),
+                   &telemetry_topic);
+
     return ANTS_OK;
 }
 
 void k_ants_terminate()
 {
+    k_policy_detach(ants_bus, ants_primary);
+    k_policy_detach(ants_bus, ants_secondary);
     ants_addr = 0;
     k_i2c_terminate(&ants_bus);
 
@@ -92,7 +170,7 @@ KANTSStatus k_ants_configure(KANTSController config)
         return ANTS_ERROR_CONFIG;
     }
 
-    nanosleep(&TRANSFER_DELAY, NULL);
+    k_clock_nanosleep(&TRANSFER_DELAY);
 
     return status;
 }
@@ -122,7 +200,7 @@ KANTSStatus k_ants_reset()
         }
     }
 
-    nanosleep(&TRANSFER_DELAY, NULL);
+    k_clock_nanosleep(&TRANSFER_DELAY);
 
     return ret;
 }
@@ -139,7 +217,7 @@ KANTSStatus k_ants_arm()
         return ANTS_ERROR;
     }
 
-    nanosleep(&TRANSFER_DELAY, NULL);
+    k_clock_nanosleep(&TRANSFER_DELAY);
 
     return ANTS_OK;
 }
@@ -156,7 +234,7 @@ KANTSStatus k_ants_disarm()
         return ANTS_ERROR;
     }
 
-    nanosleep(&TRANSFER_DELAY, NULL);
+    k_clock_nanosleep(&TRANSFER_DELAY);
 
     return ANTS_OK;
 }
@@ -228,7 +306,7 @@ KANTSStatus k_ants_deploy(KANTSAnt antenna, bool override, uint8_t timeout)
         return ANTS_ERROR;
     }
 
-    nanosleep(&TRANSFER_DELAY, NULL);
+    k_clock_nanosleep(&TRANSFER_DELAY);
 
     return ANTS_OK;
 }
@@ -248,7 +326,7 @@ KANTSStatus k_ants_auto_deploy(uint8_t timeout)
         return ANTS_ERROR;
     }
 
-    nanosleep(&TRANSFER_DELAY, NULL);
+    k_clock_nanosleep(&TRANSFER_DELAY);
 
     return ANTS_OK;
 }
@@ -265,7 +343,7 @@ KANTSStatus k_ants_cancel_deploy()
         return ANTS_ERROR;
     }
 
-    nanosleep(&TRANSFER_DELAY, NULL);
+    k_clock_nanosleep(&TRANSFER_DELAY);
 
     return ANTS_OK;
 }
@@ -295,7 +373,7 @@ KANTSStatus k_ants_get_deploy_status(uint16_t * resp)
         return ANTS_ERROR;
     }
 
-    nanosleep(&TRANSFER_DELAY, NULL);
+    k_clock_nanosleep(&TRANSFER_DELAY);
 
     return ANTS_OK;
 }
@@ -324,7 +402,7 @@ KANTSStatus k_ants_get_uptime(uint32_t * uptime)
         return ANTS_ERROR;
     }
 
-    nanosleep(&TRANSFER_DELAY, NULL);
+    k_clock_nanosleep(&TRANSFER_DELAY);
 
     return ANTS_OK;
 }
@@ -354,7 +432,9 @@ KANTSStatus k_ants_get_system_telemetry(ants_telemetry * telem)
         return ANTS_ERROR;
     }
 
-    nanosleep(&TRANSFER_DELAY, NULL);
+    k_pubsub_publish(telemetry_topic, telem, sizeof(*telem));
+
+    k_clock_nanosleep(&TRANSFER_DELAY);
 
     return ANTS_OK;
 }
@@ -387,7 +467,7 @@ KANTSStatus k_ants_get_activation_count(KANTSAnt antenna, uint8_t * count)
         return ANTS_ERROR;
     }
 
-    nanosleep(&TRANSFER_DELAY, NULL);
+    k_clock_nanosleep(&TRANSFER_DELAY);
 
     return ANTS_OK;
 }
@@ -420,7 +500,7 @@ KANTSStatus k_ants_get_activation_time(KANTSAnt antenna, uint16_t * time)
         return ANTS_ERROR;
     }
 
-    nanosleep(&TRANSFER_DELAY, NULL);
+    k_clock_nanosleep(&TRANSFER_DELAY);
 
     return ANTS_OK;
 }
@@ -454,14 +534,38 @@ KANTSStatus k_ants_watchdog_kick()
 void * kprv_ants_watchdog_thread(void * args)
 {
     KANTSStatus status;
+    int         gov;
+
+    k_thread_stats_register("ants-watchdog",
+                            (uint32_t) (ants_wd_timeout / 3) * 1000);
+    /* Kicks may slow down in low power modes, but stay well inside the timeout */
+    if (k_gov_register("ants-watchdog", (uint32_t) (ants_wd_timeout / 3) * 1000,
+                       (uint32_t) ants_wd_timeout * 1000 / 2, &gov)
+        != GOV_OK)
+    {
+        gov = -1;
+    }
+    pthread_cleanup_push(k_thread_stats_unregister, NULL);
+    k_budget_enter(watchdog_budget);
 
     while (1)
     {
+        k_thread_stats_wakeup();
+
         k_ants_watchdog_kick();
 
-        sleep(ants_wd_timeout / 3);
+        if (gov < 0)
+        {
+            k_clock_sleep((uint64_t) (ants_wd_timeout / 3) * K_CLOCK_NS_PER_SEC);
+        }
+        else
+        {
+            k_gov_sleep(gov);
+        }
     }
 
+    pthread_cleanup_pop(1);
+
     return NULL;
 }
 
@@ -481,8 +585,9 @@ KANTSStatus k_ants_watchdog_start()
         return ANTS_OK;
     }
 
-    if (pthread_create(&handle_watchdog, NULL, kprv_ants_watchdog_thread, NULL)
-        != 0)
+    if (k_thread_create("ants-watchdog", &handle_watchdog,
+                        kprv_ants_watchdog_thread, NULL)
+        != THREAD_POLICY_OK)
     {
         perror("Failed to create AntS watchdog thread");
         handle_watchdog = 0;
@@ -519,14 +624,9 @@ KANTSStatus k_ants_watchdog_stop()
     return ANTS_OK;
 }
 
-KANTSStatus k_ants_passthrough(const uint8_t * tx, int tx_len, uint8_t * rx,
-                               int rx_len)
+static KANTSStatus kprv_ants_passthrough(const uint8_t * tx, int tx_len,
+                                         uint8_t * rx, int rx_len)
 {
-    if (tx == NULL || tx_len < 1 || (rx == NULL && rx_len != 0) || (rx != NULL && rx_len == 0))
-    {
-        return ANTS_ERROR_CONFIG;
-    }
-
     KI2CStatus status;
 
     status = k_i2c_write(ants_bus, ants_addr, (uint8_t *) tx, tx_len);
@@ -547,7 +647,23 @@ KANTSStatus k_ants_passthrough(const uint8_t * tx, int tx_len, uint8_t * rx,
         }
     }
 
-    nanosleep(&TRANSFER_DELAY, NULL);
+    k_clock_nanosleep(&TRANSFER_DELAY);
 
     return ANTS_OK;
 }
+
+KANTSStatus k_ants_passthrough(const uint8_t * tx, int tx_len, uint8_t * rx,
+                               int rx_len)
+{
+    if (tx == NULL || tx_len < 1 || (rx == NULL && rx_len != 0) || (rx != NULL && rx_len == 0))
+    {
+        return ANTS_ERROR_CONFIG;
+    }
+
+    int         previous = k_budget_enter(bulk_budget);
+    KANTSStatus status   = kprv_ants_passthrough(tx, tx_len, rx, rx_len);
+
+    k_budget_leave(previous);
+
+    return status;
+}
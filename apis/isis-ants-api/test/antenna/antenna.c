@@ -16,6 +16,7 @@
  */
 
 #include <ants-api.h>
+#include <clock.h>
 #include <cmocka.h>
 
 /* Test Data */
@@ -739,5 +740,8 @@ int main(void)
         cmocka_unit_test_setup_teardown(test_passthrough, init, term),
     };
 
+    /* Transfer delays and the self-test wait take no real time */
+    k_clock_use_virtual(0);
+
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -22,6 +22,10 @@
 
 #include <json.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /** \cond WE DO NOT WANT TO HAVE THESE IN OUR GENERATED DOCS */
 /* Configuration Commands */
 #define GET_PARAM               0x81
@@ -193,6 +197,14 @@ typedef struct {
 /* Configuration Commands */
 /**
  * Configure the ADCS
+ *
+ * Only reads `config`, so a frozen document (see ::json_freeze) shared with
+ * other threads can be passed as it is.
+ *
+ * When built with `KUBOS_FIXED_POINT`, floating point parameters must be
+ * JSON integers in 1/::IMTQ_NUMBER_SCALE of their units, and are converted
+ * without floating point arithmetic.
+ *
  * @param [in] config ADCS configuration structure
  * @return KADCSStatus ADCS_OK if OK, error otherwise
  */
@@ -225,4 +237,8 @@ KADCSStatus k_imtq_set_param(uint16_t param, const imtq_config_value * value,
  */
 KADCSStatus k_imtq_reset_param(uint16_t param, imtq_config_resp * response);
 
+#ifdef __cplusplus
+}
+#endif
+
 /* @} */
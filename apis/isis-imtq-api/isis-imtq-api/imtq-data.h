@@ -22,6 +22,10 @@
 
 #include <json.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /** \cond WE DO NOT WANT TO HAVE THESE IN OUR GENERATED DOCS */
 /* Data Request Commands */
 #define GET_STATE       0x41
@@ -91,6 +95,19 @@ typedef struct {
     uint8_t act_status;          /**< Coils actuation status during measurement. 0 - Not actuating, 1 - Actuating */
 } __attribute__((packed)) imtq_mtm_msg;
 
+/**
+ * Topic on which every ::imtq_mtm_msg read by ::k_imtq_get_calib_mtm is published (see ::k_pubsub_find)
+ */
+#define IMTQ_MTM_TOPIC "imtq-mtm"
+
+/**
+ * When built with `KUBOS_FIXED_POINT`, fractional telemetry values (floating point configuration parameters and the
+ * spin and orientation estimates) are reported as JSON integers in 1/`IMTQ_NUMBER_SCALE` of their units, so that
+ * building telemetry needs no floating point. Status telemetry then includes a `number_scale` member.
+ * ::k_adcs_configure takes floating point parameters in the same units.
+ */
+#define IMTQ_NUMBER_SCALE 1000000
+
 /**
  * Generic structure for messages relating to the axes
  */
@@ -248,6 +265,9 @@ KADCSStatus k_imtq_get_raw_mtm(imtq_mtm_msg * data);
  * Get calibrated data values from MTM
  *
  * Measurement units are in [10<sup>-9</sup> T]
+ *
+ * The measurement is also published on ::IMTQ_MTM_TOPIC.
+ *
  * @note The ::k_imtq_start_measurement function must have been called in
  * order for this function to be able to retrieve data
  * @param [out] data Pointer to storage for data
@@ -310,6 +330,52 @@ KADCSStatus k_imtq_get_raw_housekeeping(imtq_housekeeping_raw * data);
  */
 KADCSStatus k_imtq_get_eng_housekeeping(imtq_housekeeping_eng * data);
 
+/**
+ *  @name Incremental Debug Telemetry Defaults
+ */
+/**@{*/
+/** Time between refresh cycles in [ms] */
+#define IMTQ_DEBUG_PERIOD_MS 1000
+/** Bus time each refresh cycle may use in [us] (a parameter read takes about 2.5ms) */
+#define IMTQ_DEBUG_BUDGET_US 10000
+/**@}*/
+
+/**
+ * Incremental debug telemetry settings
+ */
+typedef struct {
+    uint32_t period_ms;     /**< Time between refresh cycles in [ms]; 0 for no thread (cycles are run with ::k_imtq_debug_refresh) */
+    uint32_t budget_us;     /**< Bus time each refresh cycle may use in [us] */
+} imtq_debug_config;
+
+/**
+ * Serve debug telemetry from a table of configuration parameters which is refreshed in the background
+ *
+ * A full `DEBUG` telemetry request reads every configuration parameter, each with its own transfer and the 1ms gap
+ * the iMTQ needs, which holds the bus for well over 100ms. Once started, a thread instead walks the parameter list
+ * round-robin, reading only as many parameters per cycle as fit in `budget_us`. Debug telemetry then reports the
+ * last value read for each parameter, with its age as an extra `<param>_age_ms` member; parameters which haven't
+ * been read yet are left out. The self-test results are still read live.
+ *
+ * @param [in] config Refresh settings, or NULL for ::IMTQ_DEBUG_PERIOD_MS and ::IMTQ_DEBUG_BUDGET_US
+ * @return KADCSStatus `ADCS_OK` if OK, error otherwise
+ */
+KADCSStatus k_imtq_debug_start(const imtq_debug_config * config);
+/**
+ * Stop the debug refresh thread and go back to reading every parameter for each debug telemetry request
+ * @return KADCSStatus `ADCS_OK` if OK, error otherwise
+ */
+KADCSStatus k_imtq_debug_stop(void);
+/**
+ * Run one refresh cycle: read parameters, continuing from where the last cycle stopped, until `budget_us` has been
+ * used. At least one parameter is read, and none twice.
+ * @note Only one thread should run refresh cycles
+ * @param [in] budget_us Bus time to use in [us]
+ * @param [out] count Number of parameters refreshed (may be NULL)
+ * @return KADCSStatus `ADCS_OK` if OK, `ADCS_ERROR` if any parameter couldn't be read
+ */
+KADCSStatus k_imtq_debug_refresh(uint32_t budget_us, int * count);
+
 /* Private functions */
 /**
  * Get the current system status and add it to the telemetry JSON
@@ -329,6 +395,59 @@ KADCSStatus kprv_adcs_get_nominal_telemetry(JsonNode * buffer);
  * @return KADCSStatus `ADCS_OK` if OK, error otherwise
  */
 KADCSStatus kprv_adcs_get_debug_telemetry(JsonNode * buffer);
+/**
+ * Add a configuration parameter's value to a telemetry JSON structure
+ * @param [out] buffer Pointer to telemetry JSON structure
+ * @param [in] key Member name
+ * @param [in] param ID of the parameter (its top nibble gives the value's type)
+ * @param [in] value Parameter value
+ * @return KADCSStatus `ADCS_OK` if OK, `ADCS_ERROR` if the parameter's type is unknown
+ */
+KADCSStatus kprv_adcs_append_param(JsonNode * buffer, const char * key, uint16_t param,
+                                   const imtq_config_value * value);
+/**
+ * Convert a float to integer 1/::IMTQ_NUMBER_SCALE units from its bits, without floating point arithmetic
+ * (`KUBOS_FIXED_POINT` builds only)
+ * @param [in] value Value to convert
+ * @return int64_t Value * ::IMTQ_NUMBER_SCALE, rounded and saturated
+ */
+int64_t kprv_imtq_scale_float(float value);
+/**
+ * Convert a double to integer 1/::IMTQ_NUMBER_SCALE units from its bits, without floating point arithmetic
+ * (`KUBOS_FIXED_POINT` builds only)
+ * @param [in] value Value to convert
+ * @return int64_t Value * ::IMTQ_NUMBER_SCALE, rounded and saturated
+ */
+int64_t kprv_imtq_scale_double(double value);
+/**
+ * Convert integer 1/::IMTQ_NUMBER_SCALE units to the nearest float, building its bits without floating point
+ * arithmetic (`KUBOS_FIXED_POINT` builds only)
+ * @param [in] scaled Value * ::IMTQ_NUMBER_SCALE
+ * @return float Value
+ */
+float kprv_imtq_unscale_float(int64_t scaled);
+/**
+ * Convert integer 1/::IMTQ_NUMBER_SCALE units to the nearest double, building its bits without floating point
+ * arithmetic (`KUBOS_FIXED_POINT` builds only)
+ * @param [in] scaled Value * ::IMTQ_NUMBER_SCALE
+ * @return double Value
+ */
+double kprv_imtq_unscale_double(int64_t scaled);
+/**
+ * Format the debug telemetry keys of the configuration parameters
+ */
+void kprv_imtq_debug_init(void);
+/**
+ * Add the refreshed configuration parameters and their ages to the telemetry JSON
+ * @param [out] buffer Pointer to telemetry JSON structure
+ * @return KADCSStatus `ADCS_OK` if OK, error otherwise
+ */
+KADCSStatus kprv_imtq_debug_append_cache(JsonNode * buffer);
+/**
+ * Thread which runs a refresh cycle every configured period
+ * @param [in] args Unused
+ */
+void * kprv_imtq_debug_thread(void * args);
 /**
  * Add a self-test result to the requested JSON structure
  * @param [out] parent Pointer to JSON structure results should be added to
@@ -337,4 +456,8 @@ KADCSStatus kprv_adcs_get_debug_telemetry(JsonNode * buffer);
  */
 void kprv_adcs_process_test(JsonNode * parent, imtq_test_result test);
 
+#ifdef __cplusplus
+}
+#endif
+
 /* @} */
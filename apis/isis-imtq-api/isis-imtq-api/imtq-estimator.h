@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @addtogroup IMTQ_API
+ * @{
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  @name Estimator Settings
+ */
+/**@{*/
+/** Time constant of the spin rate low-pass filter in [s] */
+#define IMTQ_EST_SPIN_TAU       10.0f
+/** Attitude correction gain in [rad/s] per unit of field direction error */
+#define IMTQ_EST_ATTITUDE_GAIN  0.2f
+/** Longest gap between samples which still gives a rate in [s] */
+#define IMTQ_EST_MAX_GAP        30.0f
+/** Weakest field which is used in [nT] */
+#define IMTQ_EST_MIN_FIELD      1000
+/**@}*/
+
+/**
+ * Feed a calibrated magnetometer sample to the estimator
+ *
+ * The spin rate perpendicular to the field is taken from the angle the field
+ * turned through since the previous sample, and low-pass filtered. If a
+ * position has been given with ::k_imtq_estimator_set_position, the attitude
+ * is then propagated with that rate and pulled towards agreement with the
+ * field model.
+ *
+ * Samples taken while the coils were actuating should not be used.
+ * ::k_adcs_get_spin, ::k_adcs_get_orientation and nominal telemetry
+ * requests feed the estimator themselves.
+ *
+ * @param [in] field Calibrated MTM measurement in [10<sup>-9</sup> T]
+ * @param [in] time_us Monotonic time the sample was taken in [us]
+ * @return KADCSStatus `ADCS_OK` if the sample was used, `ADCS_ERROR` if it was too weak, error otherwise
+ */
+KADCSStatus k_imtq_estimator_update(const imtq_mtm_data * field, uint64_t time_us);
+/**
+ * Set the satellite position used by the attitude field model
+ * @param [in] ecef Earth-fixed position in [m], or NULL to disable the attitude estimate
+ * @return KADCSStatus `ADCS_OK` if OK, `ADCS_ERROR_CONFIG` if the position is not above the Earth's surface
+ */
+KADCSStatus k_imtq_estimator_set_position(const int32_t ecef[3]);
+/**
+ * Discard all estimator state (the position is kept)
+ */
+void k_imtq_estimator_reset(void);
+/**
+ * Read the current spin estimate without taking a new sample
+ * @param [out] data Pointer to storage for the estimate
+ * @return KADCSStatus `ADCS_OK` if OK, `ADCS_ERROR` if there is no estimate yet
+ */
+KADCSStatus k_imtq_estimator_get_spin(adcs_spin * data);
+/**
+ * Read the current attitude estimate without taking a new sample
+ * @param [out] data Pointer to storage for the estimate
+ * @return KADCSStatus `ADCS_OK` if OK, `ADCS_ERROR_CONFIG` if no position is set, `ADCS_ERROR` if there is no estimate yet
+ */
+KADCSStatus k_imtq_estimator_get_orientation(adcs_orient * data);
+/**
+ * Feed a calibrated MTM measurement to the estimator, timestamped now
+ *
+ * The sample is dropped if the coils were actuating.
+ *
+ * @param [in] sample Measurement from ::k_imtq_get_calib_mtm
+ */
+void kprv_imtq_estimator_feed(const imtq_mtm_msg * sample);
+/**
+ * Take a calibrated MTM measurement and feed it to the estimator
+ *
+ * The sample is dropped (without error) if the coils were actuating.
+ *
+ * @return KADCSStatus `ADCS_OK` if OK, error otherwise
+ */
+KADCSStatus kprv_imtq_estimator_sample(void);
+/**
+ * Tilted dipole model of the geomagnetic field (IGRF-13, epoch 2020)
+ *
+ * Integer-only, for processors without an FPU.
+ *
+ * @param [in] ecef Earth-fixed position in [m]
+ * @param [out] field Model field in the Earth-fixed frame in [10<sup>-9</sup> T]
+ * @return KADCSStatus `ADCS_OK` if OK, `ADCS_ERROR_CONFIG` if the position is not above the Earth's surface
+ */
+KADCSStatus kprv_imtq_field_model(const int32_t ecef[3], int32_t field[3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* @} */
@@ -22,6 +22,10 @@
 
 #include <json.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /** \cond WE DO NOT WANT TO HAVE THESE IN OUR GENERATED DOCS */
 /* Operational Commands */
 #define RESET_MTQ       0xAAA5 /* Reset has a two-byte command code */
@@ -159,4 +163,8 @@ KADCSStatus k_imtq_start_test(ADCSTestType axis);
  */
 KADCSStatus k_imtq_start_detumble(uint16_t time);
 
+#ifdef __cplusplus
+}
+#endif
+
 /* @} */
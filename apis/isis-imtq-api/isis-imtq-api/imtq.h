@@ -24,6 +24,10 @@
 #include <stdint.h>
 #include <i2c.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
  *  @name Command Response Flags
  */
@@ -95,12 +99,31 @@ typedef enum {
     DETUMBLE        /**< Detumble mode */
 } ADCSMode;
 
+/**
+ * Estimated attitude returned by ::k_adcs_get_orientation
+ *
+ * Quaternion giving the body frame's orientation in the Earth-fixed (ECEF)
+ * frame. Rotation about the local field line cannot be observed with a
+ * magnetometer alone, so that component follows the spin estimate only.
+ */
 typedef struct {
-    /* Not an implemented structure/function. Need for compliance with generic API */
+    float w;                    /**< Scalar part */
+    float x;                    /**< X-axis vector part */
+    float y;                    /**< Y-axis vector part */
+    float z;                    /**< Z-axis vector part */
 } adcs_orient;
 
+/**
+ * Estimated body spin returned by ::k_adcs_get_spin
+ *
+ * Only the rate perpendicular to the local magnetic field is observable, so
+ * these are the components of that part of the spin.
+ */
 typedef struct {
-    /* Not an implemented structure/function. Need for compliance with generic API */
+    float x;                    /**< X-axis rate in [rad/s] */
+    float y;                    /**< Y-axis rate in [rad/s] */
+    float z;                    /**< Z-axis rate in [rad/s] */
+    float rate;                 /**< Magnitude in [rad/s] */
 } adcs_spin;
 
 /*
@@ -111,12 +134,23 @@ typedef struct {
 #include "imtq-config.h"
 #include "imtq-data.h"
 #include "imtq-ops.h"
+#include "imtq-estimator.h"
 
 /**
  * System mutex to preserve iMTQ command/response ordering
  */
 extern pthread_mutex_t imtq_mutex;
 
+/**
+ * Bus budget charged by passthrough commands and debug telemetry requests
+ */
+extern int imtq_bulk_budget;
+
+/**
+ * Topic id for ::IMTQ_MTM_TOPIC
+ */
+extern int imtq_mtm_topic;
+
 /* Public Functions */
 /**
  * Initialize the ADCS interface
@@ -132,7 +166,10 @@ KADCSStatus k_adcs_init(char * bus, uint16_t addr, int timeout);
 void k_adcs_terminate(void);
 /**
  * Start a thread to kick the iMTQ's watchdog at an interval of
- * `(timeout/3)` seconds (`timeout` specified in `k_adcs_init`)
+ * `(timeout/3)` seconds (`timeout` specified in `k_adcs_init`).
+ * Any command sent to the iMTQ resets its watchdog, so the interval is
+ * counted from the last command sent by any thread and a busy iMTQ is
+ * never kicked.
  * @return KADCSStatus `ADCS_OK` if OK, error otherwise
  */
 KADCSStatus k_imtq_watchdog_start(void);
@@ -171,12 +208,36 @@ KADCSStatus k_adcs_passthrough(const uint8_t * tx, int tx_len, uint8_t * rx, int
  */
 KADCSStatus kprv_imtq_transfer(const uint8_t * tx, int tx_len, uint8_t * rx,
                                int rx_len, const struct timespec * delay);
+/**
+ * Send an iMTQ request without waiting for the response
+ *
+ * First half of ::kprv_imtq_transfer. The caller must hold ::imtq_mutex and
+ * wait at least 1ms before calling ::kprv_imtq_receive.
+ * @param [in] tx Pointer to data to send
+ * @param [in] tx_len Length of data to send
+ * @return KADCSStatus `ADCS_OK` if OK, error otherwise
+ */
+KADCSStatus kprv_imtq_send(const uint8_t * tx, int tx_len);
+/**
+ * Fetch and check the response to a request sent with ::kprv_imtq_send
+ *
+ * Second half of ::kprv_imtq_transfer. The caller must hold ::imtq_mutex.
+ * @param [in] cmd Command byte of the request
+ * @param [out] rx Pointer to buffer for response data
+ * @param [in] rx_len Length of data to read for response
+ * @return KADCSStatus `ADCS_OK` if OK, error otherwise
+ */
+KADCSStatus kprv_imtq_receive(uint8_t cmd, uint8_t * rx, int rx_len);
 /**
  * Extract the return code in a response status byte
  * @param [in] status A ::imtq_resp_header.status byte returned in a response
  * message structure
  * @return Converted ::KIMTQStatus value
  */
-static inline KIMTQStatus kprv_imtq_check_error(uint8_t status) { return (KIMTQStatus) status & 0x0F; }
+static inline KIMTQStatus kprv_imtq_check_error(uint8_t status) { return (KIMTQStatus) (status & 0x0F); }
+
+#ifdef __cplusplus
+}
+#endif
 
 /* @} */
@@ -37,7 +37,14 @@ KADCSStatus k_adcs_configure(const JsonNode * config)
 
     json_foreach(entry, config)
     {
-        if (entry->tag != JSON_NUMBER)
+        /*
+         * Integers keep all 64 bits; anything else (fractions, or values
+         * beyond int64_t) is truncated from the double as before
+         */
+        double  number = 0;
+        int64_t integer;
+        bool    is_int = json_get_int(entry, &integer);
+        if (!is_int && !json_get_number(entry, &number))
         {
             fprintf(stderr,
                     "Skipping non-numeric iMTQ configuration entry: %.10s\n",
@@ -59,38 +66,67 @@ KADCSStatus k_adcs_configure(const JsonNode * config)
 
         param = (uint16_t) strtol(entry->key, NULL, 16);
 
+        if (!is_int)
+        {
+            integer = (int64_t) number;
+        }
+
+#ifdef KUBOS_FIXED_POINT
+        /*
+         * Fractional parameters are given in 1/IMTQ_NUMBER_SCALE units, as
+         * telemetry reports them, and converted without floating point
+         */
+        if (((param >> 12) == 0x7 || (param >> 12) == 0xA) && !is_int)
+        {
+            fprintf(stderr,
+                    "Skipping non-integer iMTQ configuration value: %.10s\n",
+                    entry->key);
+            status = ADCS_ERROR;
+            continue;
+        }
+#endif
+
         /* Store the param value appropriately based on its actual size */
         switch (param >> 12)
         {
             case 0x1:
-                value.int8_val = (int8_t) entry->number_;
+                value.int8_val = (int8_t) integer;
                 break;
             case 0x2:
-                value.uint8_val = (uint8_t) entry->number_;
+                value.uint8_val = (uint8_t) integer;
                 break;
             case 0x3:
-                value.int16_val = (int16_t) entry->number_;
+                value.int16_val = (int16_t) integer;
                 break;
             case 0x4:
-                value.uint16_val = (uint16_t) entry->number_;
+                value.uint16_val = (uint16_t) integer;
                 break;
             case 0x5:
-                value.int32_val = (int32_t) entry->number_;
+                value.int32_val = (int32_t) integer;
                 break;
             case 0x6:
-                value.uint32_val = (uint32_t) entry->number_;
+                value.uint32_val = (uint32_t) integer;
                 break;
             case 0x7:
-                value.float_val = (float) entry->number_;
+#ifdef KUBOS_FIXED_POINT
+                value.float_val = kprv_imtq_unscale_float(integer);
+#else
+                value.float_val = is_int ? (float) integer : (float) number;
+#endif
                 break;
             case 0x8:
-                value.int64_val = (int64_t) entry->number_;
+                value.int64_val = (int64_t) integer;
                 break;
             case 0x9:
-                value.uint64_val = (uint64_t) entry->number_;
+                value.uint64_val = is_int ? (uint64_t) integer
+                                          : (uint64_t) number;
                 break;
             case 0xA:
-                value.double_val = entry->number_;
+#ifdef KUBOS_FIXED_POINT
+                value.double_val = kprv_imtq_unscale_double(integer);
+#else
+                value.double_val = is_int ? (double) integer : number;
+#endif
                 break;
             default:
                 fprintf(
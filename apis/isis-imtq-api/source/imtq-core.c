@@ -17,7 +17,16 @@
  */
 
 #include <imtq.h>
+#include <bus-budget.h>
+#include <bus-worker.h>
+#include <clock.h>
+#include <device-policy.h>
 #include <i2c.h>
+#include <metrics.h>
+#include <pubsub.h>
+#include <thread-policy.h>
+#include <thread-stats.h>
+#include <watchdog.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <sys/syscall.h>
@@ -41,6 +50,34 @@ static uint16_t imqt_addr = 0x10;
  */
 static int wd_timeout = 60;
 
+/*
+ * Bus budgets: passthrough and debug telemetry traffic gets a share of the
+ * bus, watchdog kicks are never held back
+ */
+int imtq_bulk_budget = -1;
+static int watchdog_budget = -1;
+static const k_budget_config watchdog_budget_config = {.critical = true };
+
+/* Watchdog tracker while the watchdog thread runs, -1 otherwise */
+static int imtq_wdt = -1;
+
+/* Bus and protocol failures are counted per command */
+static int imtq_metrics = -1;
+
+/* Calibrated MTM measurements are shared with subscribers through a topic */
+#define MTM_TOPIC_DEPTH 16
+int imtq_mtm_topic = -1;
+static uint64_t mtm_topic_storage[K_PUBSUB_STORAGE(sizeof(imtq_mtm_msg),
+                                                   MTM_TOPIC_DEPTH)];
+
+/*
+ * Health probe used while the iMTQ's circuit breaker is open
+ */
+static void kprv_imtq_probe(void)
+{
+    k_adcs_noop();
+}
+
 KADCSStatus k_adcs_init(char * bus, uint16_t addr, int timeout)
 {
     imqt_addr = addr;
@@ -54,6 +91,24 @@ KADCSStatus k_adcs_init(char * bus, uint16_t addr, int timeout)
         return ADCS_ERROR;
     }
 
+    /* Retry NACKs, and stop spending bus time on the iMTQ if it dies */
+    k_policy_attach("imtq", i2c_bus, imqt_addr, NULL, kprv_imtq_probe);
+
+    k_bus_attach("imtq", bus);
+
+    if (k_metrics_device("imtq", &imtq_metrics) == METRICS_OK)
+    {
+        k_metrics_attach(imtq_metrics, i2c_bus, imqt_addr);
+    }
+
+    k_budget_register("imtq-bulk", NULL, &imtq_bulk_budget);
+    k_budget_register("imtq-watchdog", &watchdog_budget_config,
+                      &watchdog_budget);
+    k_pubsub_topic(IMTQ_MTM_TOPIC, sizeof(imtq_mtm_msg), MTM_TOPIC_DEPTH,
+                   mtm_topic_storage,
+                   K_PUBSUB_STORAGE(sizeof(imtq_mtm_msg), MTM_TOPIC_DEPTH),
+                   &imtq_mtm_topic);
+
     pthread_mutexattr_t mutex_attr;
     if (pthread_mutexattr_settype(&mutex_attr, PTHREAD_MUTEX_ERRORCHECK) != 0)
     {
@@ -86,6 +141,12 @@ void k_adcs_terminate(void)
 {
     const struct timespec MUTEX_TIMEOUT = {.tv_sec = 1, .tv_nsec = 0 };
 
+    /* A background probe uses the bus and mutex too */
+    k_policy_detach(i2c_bus, imqt_addr);
+
+    /* The debug refresher uses the bus and mutex */
+    k_imtq_debug_stop();
+
     /* Destroy the mutex */
     if (pthread_mutex_timedlock(&imtq_mutex, &MUTEX_TIMEOUT) != 0)
     {
@@ -115,7 +176,12 @@ void k_adcs_terminate(void)
 KADCSStatus k_adcs_passthrough(const uint8_t * tx, int tx_len, uint8_t * rx,
                                int rx_len, const struct timespec * delay)
 {
-    return kprv_imtq_transfer(tx, tx_len, rx, rx_len, delay);
+    int         previous = k_budget_enter(imtq_bulk_budget);
+    KADCSStatus status   = kprv_imtq_transfer(tx, tx_len, rx, rx_len, delay);
+
+    k_budget_leave(previous);
+
+    return status;
 }
 
 /*
@@ -125,19 +191,44 @@ KADCSStatus k_adcs_passthrough(const uint8_t * tx, int tx_len, uint8_t * rx,
 
 void * kprv_imtq_watchdog_thread(void * args)
 {
-    KADCSStatus status;
+    uint64_t kick_ns = (uint64_t) wd_timeout * K_CLOCK_NS_PER_SEC / 3;
+    uint64_t now;
+    uint64_t next;
+
+    /* No fixed period: traffic from other threads pushes the kicks back */
+    k_thread_stats_register("imtq-watchdog", 0);
+    pthread_cleanup_push(k_thread_stats_unregister, NULL);
+    k_budget_enter(watchdog_budget);
 
     while (1)
     {
-        k_adcs_noop();
+        k_thread_stats_wakeup();
+
+        /*
+         * Every command resets the iMTQ's watchdog, so only kick once the
+         * bus has been quiet for a third of the timeout
+         */
+        now = k_clock_now();
+        if (k_wdt_due(imtq_wdt) <= now)
+        {
+            k_adcs_noop();
+        }
 
-        sleep(wd_timeout / 3);
+        next = k_wdt_due(imtq_wdt);
+        if (next <= now)
+        {
+            next = now + kick_ns;
+        }
+
+        k_clock_sleep_until(next);
     }
 
+    pthread_cleanup_pop(1);
+
     return NULL;
 }
 
-pthread_t handle_watchdog = { 0 };
+static pthread_t handle_watchdog = { 0 };
 
 KADCSStatus k_imtq_watchdog_start(void)
 {
@@ -155,11 +246,27 @@ KADCSStatus k_imtq_watchdog_start(void)
         return ADCS_OK;
     }
 
-    if (pthread_create(&handle_watchdog, NULL, kprv_imtq_watchdog_thread, NULL)
-        != 0)
+    /* Kick when two thirds of the timeout are left, as the fixed interval did */
+    const k_wdt_config config = {
+        .timeout_ms = (uint32_t) wd_timeout * 1000,
+        .margin_ms  = (uint32_t) wd_timeout * 2000 / 3,
+        .implicit   = true,
+    };
+
+    if (k_wdt_attach("imtq", i2c_bus, imqt_addr, &config, &imtq_wdt) != WDT_OK)
+    {
+        fprintf(stderr, "Failed to track ADCS watchdog\n");
+        return ADCS_ERROR;
+    }
+
+    if (k_thread_create("imtq-watchdog", &handle_watchdog,
+                        kprv_imtq_watchdog_thread, NULL)
+        != THREAD_POLICY_OK)
     {
         perror("Failed to create ADCS watchdog thread");
         handle_watchdog = 0;
+        k_wdt_detach(imtq_wdt);
+        imtq_wdt = -1;
         return ADCS_ERROR;
     }
 
@@ -189,6 +296,8 @@ KADCSStatus k_imtq_watchdog_stop(void)
     }
 
     handle_watchdog = 0;
+    k_wdt_detach(imtq_wdt);
+    imtq_wdt = -1;
 
     return ADCS_OK;
 }
@@ -201,7 +310,7 @@ KADCSStatus k_imtq_reset(void)
 KADCSStatus kprv_imtq_transfer(const uint8_t * tx, int tx_len, uint8_t * rx,
                                int rx_len, const struct timespec * delay)
 {
-    KI2CStatus status;
+    KADCSStatus status;
 
     const struct timespec MUTEX_TIMEOUT = {.tv_sec = 1, .tv_nsec = 0 };
 
@@ -218,43 +327,67 @@ KADCSStatus kprv_imtq_transfer(const uint8_t * tx, int tx_len, uint8_t * rx,
         return ADCS_ERROR_MUTEX;
     }
 
-    status = k_i2c_write(i2c_bus, imqt_addr, (uint8_t *) tx, tx_len);
-    if (status != I2C_OK)
+    status = kprv_imtq_send(tx, tx_len);
+    if (status == ADCS_OK)
     {
-        fprintf(stderr, "Failed to send MTQ command: %d\n", status);
-        if (pthread_mutex_unlock(&imtq_mutex) != 0)
+        if (delay == NULL)
         {
-            perror("Failed to unlock MTQ mutex");
-            fprintf(stderr, "PID: %d TID: %ld", getpid(), syscall(SYS_gettid));
+            /* There must be at least a 1ms delay in-between each I2C transfer */
+            const struct timespec TRANSFER_DELAY
+                = {.tv_sec = 0, .tv_nsec = 1000001 };
+
+            k_clock_nanosleep(&TRANSFER_DELAY);
         }
-        return ADCS_ERROR;
+        else
+        {
+            /* Wait the requested amount of time before fetching the response */
+            k_clock_nanosleep(delay);
+        }
+
+        status = kprv_imtq_receive(tx[0], rx, rx_len);
     }
 
-    if (delay == NULL)
+    if (pthread_mutex_unlock(&imtq_mutex) != 0)
     {
-        /* There must be at least a 1ms delay in-between each I2C transfer */
-        const struct timespec TRANSFER_DELAY
-            = {.tv_sec = 0, .tv_nsec = 1000001 };
+        perror("Failed to unlock MTQ mutex");
+        fprintf(stderr, "PID: %d TID: %ld", getpid(), syscall(SYS_gettid));
+    }
+
+    return status;
+}
+
+KADCSStatus kprv_imtq_send(const uint8_t * tx, int tx_len)
+{
+    KI2CStatus status;
 
-        nanosleep(&TRANSFER_DELAY, NULL);
+    if (tx == NULL || tx_len < 1)
+    {
+        return ADCS_ERROR_CONFIG;
     }
-    else
+
+    status = k_i2c_write(i2c_bus, imqt_addr, (uint8_t *) tx, tx_len);
+    if (status != I2C_OK)
     {
-        /* Wait the requested amount of time before fetching the response */
-        nanosleep(delay, NULL);
+        fprintf(stderr, "Failed to send MTQ command: %d\n", status);
+        return ADCS_ERROR;
     }
 
-    status = k_i2c_read(i2c_bus, imqt_addr, rx, rx_len);
+    return ADCS_OK;
+}
 
-    if (pthread_mutex_unlock(&imtq_mutex) != 0)
+KADCSStatus kprv_imtq_receive(uint8_t cmd, uint8_t * rx, int rx_len)
+{
+    KI2CStatus status;
+
+    if (rx == NULL || rx_len < (int) sizeof(imtq_resp_header))
     {
-        perror("Failed to unlock MTQ mutex");
-        fprintf(stderr, "PID: %d TID: %ld", getpid(), syscall(SYS_gettid));
+        return ADCS_ERROR_CONFIG;
     }
 
+    status = k_i2c_read(i2c_bus, imqt_addr, rx, rx_len);
     if (status != I2C_OK)
     {
-        fprintf(stderr, "Failed to read MTQ response (%x): %d\n", tx[0],
+        fprintf(stderr, "Failed to read MTQ response (%x): %d\n", cmd,
                 status);
         return ADCS_ERROR;
     }
@@ -267,13 +400,15 @@ KADCSStatus kprv_imtq_transfer(const uint8_t * tx, int tx_len, uint8_t * rx,
          * This isn't always an error, so we'll let the caller decide whether
          * or not to print an error message
          */
+        k_metrics_record(imtq_metrics, cmd, METRIC_TIMEOUT);
         return ADCS_ERROR_NO_RESPONSE;
     }
-    else if (response.cmd != tx[0])
+    else if (response.cmd != cmd)
     {
         /* Echoed command should match command requested */
-        fprintf(stderr, "Command mismatch - Sent: %x Received: %x\n", tx[0],
+        fprintf(stderr, "Command mismatch - Sent: %x Received: %x\n", cmd,
                 response.cmd);
+        k_metrics_record(imtq_metrics, cmd, METRIC_ECHO_MISMATCH);
         return ADCS_ERROR;
     }
 
@@ -281,8 +416,9 @@ KADCSStatus kprv_imtq_transfer(const uint8_t * tx, int tx_len, uint8_t * rx,
     KIMTQStatus imtq_status = kprv_imtq_check_error(response.status);
     if (imtq_status != IMTQ_OK)
     {
-        fprintf(stderr, "iMTQ returned an error (%x): %d\n", tx[0],
+        fprintf(stderr, "iMTQ returned an error (%x): %d\n", cmd,
                 imtq_status);
+        k_metrics_record(imtq_metrics, cmd, METRIC_DEVICE_ERROR);
         return ADCS_ERROR_INTERNAL;
     }
 
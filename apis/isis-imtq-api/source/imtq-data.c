@@ -17,8 +17,16 @@
  */
 
 #include <imtq.h>
+#include <bus-budget.h>
+#include <clock.h>
+#include <governor.h>
+#include <pthread.h>
+#include <pubsub.h>
 #include <stdio.h>
 #include <string.h>
+#include <thread-policy.h>
+#include <thread-stats.h>
+#include <time.h>
 
 /*
  * Array of all possible iMTQ configuration parameters. Used for fetching the
@@ -49,6 +57,28 @@ const uint16_t adcs_config_params[] = {
         HW_CONFIG, WATCHDOG_TIMEOUT, SLAVE_ADDRESS, SOFTWARE_VERSION
 };
 
+#define NUM_CONFIG_PARAMS \
+    ((int) (sizeof(adcs_config_params) / sizeof(adcs_config_params[0])))
+
+/*
+ * Configuration parameters as last read by the incremental refresher, which
+ * debug telemetry is served from while it's running
+ */
+typedef struct {
+    char              key[7];       /* "%#x" of the parameter ID */
+    char              age_key[14];  /* key + "_age_ms" */
+    imtq_config_value value;
+    uint64_t          time_ms;      /* When it was read; 0 if never */
+} debug_entry;
+
+static debug_entry     debug_cache[NUM_CONFIG_PARAMS];
+static pthread_once_t  debug_once   = PTHREAD_ONCE_INIT;
+static pthread_mutex_t debug_mutex  = PTHREAD_MUTEX_INITIALIZER;
+static int             debug_cursor = 0;
+static bool            debug_incremental = false;
+static pthread_t       debug_thread = 0;
+static imtq_debug_config debug_config;
+
 /* Human-readable names for the axis tested in a self-test step */
 const char test_step[8][5] = {
         "init",
@@ -61,6 +91,223 @@ const char test_step[8][5] = {
         "fina"
 };
 
+#ifdef KUBOS_FIXED_POINT
+/*
+ * Scale mantissa * 2^exponent by IMTQ_NUMBER_SCALE, rounding to the nearest
+ * integer and saturating
+ */
+static int64_t kprv_imtq_scale(uint64_t mantissa, int exponent, bool negative)
+{
+    uint64_t scaled;
+
+    /* IMTQ_NUMBER_SCALE < 2^20, so the product stays below 2^64 */
+    while (mantissa >= (1ULL << 44))
+    {
+        mantissa = (mantissa + 1) >> 1;
+        exponent++;
+    }
+
+    scaled = mantissa * IMTQ_NUMBER_SCALE;
+
+    if (exponent >= 0)
+    {
+        if (scaled != 0 && (exponent >= 63 || scaled > ((uint64_t) INT64_MAX >> exponent)))
+        {
+            scaled = INT64_MAX;
+        }
+        else
+        {
+            scaled <<= exponent;
+        }
+    }
+    else if (exponent > -64)
+    {
+        /* Round half away from zero */
+        scaled = ((scaled >> (-exponent - 1)) + 1) >> 1;
+    }
+    else
+    {
+        scaled = 0;
+    }
+
+    if (scaled > INT64_MAX)
+    {
+        scaled = INT64_MAX;
+    }
+
+    return negative ? -(int64_t) scaled : (int64_t) scaled;
+}
+
+int64_t kprv_imtq_scale_float(float value)
+{
+    uint32_t bits;
+    int      exponent;
+    uint64_t mantissa;
+
+    memcpy(&bits, &value, sizeof(bits));
+
+    exponent = (bits >> 23) & 0xFF;
+    mantissa = bits & 0x7FFFFF;
+
+    if (exponent == 0xFF)
+    {
+        /* Infinity saturates, NaN has no better value than 0 */
+        mantissa = (mantissa == 0) ? UINT32_MAX : 0;
+        exponent = 0xFF + 23;
+    }
+    else if (exponent == 0)
+    {
+        /* Subnormal */
+        exponent = 1;
+    }
+    else
+    {
+        mantissa |= 1 << 23;
+    }
+
+    return kprv_imtq_scale(mantissa, exponent - 127 - 23, bits >> 31);
+}
+
+int64_t kprv_imtq_scale_double(double value)
+{
+    uint64_t bits;
+    int      exponent;
+    uint64_t mantissa;
+
+    memcpy(&bits, &value, sizeof(bits));
+
+    exponent = (bits >> 52) & 0x7FF;
+    mantissa = bits & 0xFFFFFFFFFFFFFULL;
+
+    if (exponent == 0x7FF)
+    {
+        mantissa = (mantissa == 0) ? UINT32_MAX : 0;
+        exponent = 0x7FF + 52;
+    }
+    else if (exponent == 0)
+    {
+        exponent = 1;
+    }
+    else
+    {
+        mantissa |= 1ULL << 52;
+    }
+
+    return kprv_imtq_scale(mantissa, exponent - 1023 - 52, bits >> 63);
+}
+
+/*
+ * Divide a magnitude by IMTQ_NUMBER_SCALE into a mantissa of `bits`
+ * significant bits, rounded to nearest even, and its power of two
+ */
+static uint64_t kprv_imtq_unscale(uint64_t magnitude, int bits, int * exponent)
+{
+    uint64_t mantissa = magnitude / IMTQ_NUMBER_SCALE;
+    uint64_t rem      = magnitude % IMTQ_NUMBER_SCALE;
+    bool     sticky   = false;
+    int      e        = 0;
+
+    /* One bit more than needed, to round with */
+    while (mantissa < (1ULL << bits))
+    {
+        rem <<= 1;
+        mantissa <<= 1;
+        if (rem >= IMTQ_NUMBER_SCALE)
+        {
+            rem -= IMTQ_NUMBER_SCALE;
+            mantissa |= 1;
+        }
+        e--;
+    }
+    while (mantissa >= (2ULL << bits))
+    {
+        sticky = sticky || (mantissa & 1);
+        mantissa >>= 1;
+        e++;
+    }
+    sticky = sticky || (rem != 0);
+
+    bool guard = mantissa & 1;
+    mantissa >>= 1;
+    e++;
+    if (guard && (sticky || (mantissa & 1)))
+    {
+        mantissa++;
+        if (mantissa == (1ULL << bits))
+        {
+            mantissa >>= 1;
+            e++;
+        }
+    }
+
+    *exponent = e;
+
+    return mantissa;
+}
+
+float kprv_imtq_unscale_float(int64_t scaled)
+{
+    uint64_t magnitude = (scaled < 0) ? -(uint64_t) scaled : (uint64_t) scaled;
+    uint32_t bits      = (scaled < 0) ? 1U << 31 : 0;
+    float    value;
+
+    if (magnitude != 0)
+    {
+        int      exponent;
+        uint64_t mantissa = kprv_imtq_unscale(magnitude, 24, &exponent);
+
+        /* Always a normal number: 1e-6 <= |value| < 2^44 */
+        bits |= (uint32_t) (exponent + 23 + 127) << 23;
+        bits |= (uint32_t) mantissa & 0x7FFFFF;
+    }
+
+    memcpy(&value, &bits, sizeof(value));
+
+    return value;
+}
+
+double kprv_imtq_unscale_double(int64_t scaled)
+{
+    uint64_t magnitude = (scaled < 0) ? -(uint64_t) scaled : (uint64_t) scaled;
+    uint64_t bits      = (scaled < 0) ? 1ULL << 63 : 0;
+    double   value;
+
+    if (magnitude != 0)
+    {
+        int      exponent;
+        uint64_t mantissa = kprv_imtq_unscale(magnitude, 53, &exponent);
+
+        bits |= (uint64_t) (exponent + 52 + 1023) << 52;
+        bits |= mantissa & 0xFFFFFFFFFFFFFULL;
+    }
+
+    memcpy(&value, &bits, sizeof(value));
+
+    return value;
+}
+
+/* Fractional values go into telemetry as integers, in 1/IMTQ_NUMBER_SCALE units */
+static JsonNode * kprv_imtq_mkfloat(float value)
+{
+    return json_mkint(kprv_imtq_scale_float(value));
+}
+
+static JsonNode * kprv_imtq_mkdouble(double value)
+{
+    return json_mkint(kprv_imtq_scale_double(value));
+}
+#else
+static JsonNode * kprv_imtq_mkfloat(float value)
+{
+    return json_mknumber((double) value);
+}
+
+static JsonNode * kprv_imtq_mkdouble(double value)
+{
+    return json_mknumber(value);
+}
+#endif
+
 /* ADCS API Functions */
 
 KADCSStatus k_adcs_get_mode(ADCSMode * mode)
@@ -124,7 +371,10 @@ KADCSStatus k_adcs_get_telemetry(ADCSTelemType type, JsonNode * buffer)
 
     if (type == DEBUG)
     {
+        /* ~85 transfers, so it's held to the bulk share of the bus */
+        int previous = k_budget_enter(imtq_bulk_budget);
         status = kprv_adcs_get_debug_telemetry(buffer);
+        k_budget_leave(previous);
     }
     else if (type == NOMINAL)
     {
@@ -141,12 +391,38 @@ KADCSStatus k_adcs_get_telemetry(ADCSTelemType type, JsonNode * buffer)
 
 KADCSStatus k_adcs_get_orientation(adcs_orient * data)
 {
-    return ADCS_ERROR_NOT_IMPLEMENTED;
+    KADCSStatus status;
+
+    if (data == NULL)
+    {
+        return ADCS_ERROR_CONFIG;
+    }
+
+    status = kprv_imtq_estimator_sample();
+    if (status != ADCS_OK)
+    {
+        return status;
+    }
+
+    return k_imtq_estimator_get_orientation(data);
 }
 
 KADCSStatus k_adcs_get_spin(adcs_spin * data)
 {
-    return ADCS_ERROR_NOT_IMPLEMENTED;
+    KADCSStatus status;
+
+    if (data == NULL)
+    {
+        return ADCS_ERROR_CONFIG;
+    }
+
+    status = kprv_imtq_estimator_sample();
+    if (status != ADCS_OK)
+    {
+        return status;
+    }
+
+    return k_imtq_estimator_get_spin(data);
 }
 
 KADCSStatus kprv_adcs_get_status_telemetry(JsonNode * buffer)
@@ -177,7 +453,10 @@ KADCSStatus kprv_adcs_get_status_telemetry(JsonNode * buffer)
 
         json_append_member(buffer, "system_error", json_mkstring((state.error) ? "yes" : "no"));
         json_append_member(buffer, "system_configured", json_mkstring((state.config) ? "yes" : "no"));
-        json_append_member(buffer, "system_uptime", json_mknumber((double) state.uptime));
+        json_append_member(buffer, "system_uptime", json_mkint(state.uptime));
+#ifdef KUBOS_FIXED_POINT
+        json_append_member(buffer, "number_scale", json_mkint(IMTQ_NUMBER_SCALE));
+#endif
 
 
     }
@@ -185,7 +464,7 @@ KADCSStatus kprv_adcs_get_status_telemetry(JsonNode * buffer)
     {
         /* Assume system is offline, so uptime is zero */
         json_append_member(buffer, "system_mode", json_mkstring("OFFLINE"));
-        json_append_member(buffer, "system_uptime", json_mknumber(0));
+        json_append_member(buffer, "system_uptime", json_mkint(0));
     }
 
     return status;
@@ -203,6 +482,8 @@ KADCSStatus kprv_adcs_get_nominal_telemetry(JsonNode * buffer)
     imtq_mtm_msg          mtm_raw   = { 0 };
     imtq_mtm_msg          mtm_calib = { 0 };
     imtq_dipole           dipole    = { 0 };
+    adcs_spin             spin;
+    adcs_orient           orient;
 
     if (buffer == NULL)
     {
@@ -219,30 +500,30 @@ KADCSStatus kprv_adcs_get_nominal_telemetry(JsonNode * buffer)
     else
     {
         /* Raw ADC values */
-        json_append_member(buffer, "supply_voltage_digital_raw", json_mknumber((double) house_raw.voltage_d));
-        json_append_member(buffer, "supply_voltage_analog_raw", json_mknumber((double) house_raw.voltage_a));
-        json_append_member(buffer, "supply_current_digital_raw", json_mknumber((double) house_raw.current_d));
-        json_append_member(buffer, "supply_current_analog_raw", json_mknumber((double) house_raw.current_a));
-        json_append_member(buffer, "coil_current_x_raw", json_mknumber((double) house_raw.coil_current.x));
-        json_append_member(buffer, "coil_current_y_raw", json_mknumber((double) house_raw.coil_current.y));
-        json_append_member(buffer, "coil_current_z_raw", json_mknumber((double) house_raw.coil_current.z));
-        json_append_member(buffer, "coil_temp_x_raw", json_mknumber((double) house_raw.coil_temp.x));
-        json_append_member(buffer, "coil_temp_y_raw", json_mknumber((double) house_raw.coil_temp.y));
-        json_append_member(buffer, "coil_temp_z_raw", json_mknumber((double) house_raw.coil_temp.z));
-        json_append_member(buffer, "mcu_temp_raw", json_mknumber((double) house_raw.mcu_temp));
+        json_append_member(buffer, "supply_voltage_digital_raw", json_mkint(house_raw.voltage_d));
+        json_append_member(buffer, "supply_voltage_analog_raw", json_mkint(house_raw.voltage_a));
+        json_append_member(buffer, "supply_current_digital_raw", json_mkint(house_raw.current_d));
+        json_append_member(buffer, "supply_current_analog_raw", json_mkint(house_raw.current_a));
+        json_append_member(buffer, "coil_current_x_raw", json_mkint(house_raw.coil_current.x));
+        json_append_member(buffer, "coil_current_y_raw", json_mkint(house_raw.coil_current.y));
+        json_append_member(buffer, "coil_current_z_raw", json_mkint(house_raw.coil_current.z));
+        json_append_member(buffer, "coil_temp_x_raw", json_mkint(house_raw.coil_temp.x));
+        json_append_member(buffer, "coil_temp_y_raw", json_mkint(house_raw.coil_temp.y));
+        json_append_member(buffer, "coil_temp_z_raw", json_mkint(house_raw.coil_temp.z));
+        json_append_member(buffer, "mcu_temp_raw", json_mkint(house_raw.mcu_temp));
 
         /* Converted values */
-        json_append_member(buffer, "supply_voltage_digital_eng", json_mknumber((double) house_eng.voltage_d));
-        json_append_member(buffer, "supply_voltage_analog_eng", json_mknumber((double) house_eng.voltage_a));
-        json_append_member(buffer, "supply_current_digital_eng", json_mknumber((double) house_eng.current_d));
-        json_append_member(buffer, "supply_current_analog_eng", json_mknumber((double) house_eng.current_a));
-        json_append_member(buffer, "coil_current_x_eng", json_mknumber((double) house_eng.coil_current.x));
-        json_append_member(buffer, "coil_current_y_eng", json_mknumber((double) house_eng.coil_current.y));
-        json_append_member(buffer, "coil_current_z_eng", json_mknumber((double) house_eng.coil_current.z));
-        json_append_member(buffer, "coil_temp_x_eng", json_mknumber((double) house_eng.coil_temp.x));
-        json_append_member(buffer, "coil_temp_y_eng", json_mknumber((double) house_eng.coil_temp.y));
-        json_append_member(buffer, "coil_temp_z_eng", json_mknumber((double) house_eng.coil_temp.z));
-        json_append_member(buffer, "mcu_temp_eng", json_mknumber((double) house_eng.mcu_temp));
+        json_append_member(buffer, "supply_voltage_digital_eng", json_mkint(house_eng.voltage_d));
+        json_append_member(buffer, "supply_voltage_analog_eng", json_mkint(house_eng.voltage_a));
+        json_append_member(buffer, "supply_current_digital_eng", json_mkint(house_eng.current_d));
+        json_append_member(buffer, "supply_current_analog_eng", json_mkint(house_eng.current_a));
+        json_append_member(buffer, "coil_current_x_eng", json_mkint(house_eng.coil_current.x));
+        json_append_member(buffer, "coil_current_y_eng", json_mkint(house_eng.coil_current.y));
+        json_append_member(buffer, "coil_current_z_eng", json_mkint(house_eng.coil_current.z));
+        json_append_member(buffer, "coil_temp_x_eng", json_mkint(house_eng.coil_temp.x));
+        json_append_member(buffer, "coil_temp_y_eng", json_mkint(house_eng.coil_temp.y));
+        json_append_member(buffer, "coil_temp_z_eng", json_mkint(house_eng.coil_temp.z));
+        json_append_member(buffer, "mcu_temp_eng", json_mkint(house_eng.mcu_temp));
     }
 
     /* Data during last detumble loop */
@@ -253,24 +534,24 @@ KADCSStatus kprv_adcs_get_nominal_telemetry(JsonNode * buffer)
     }
     else
     {
-        json_append_member(buffer, "detumble_calib_mtm_x", json_mknumber((double) detumble.mtm_calib.x));
-        json_append_member(buffer, "detumble_calib_mtm_y", json_mknumber((double) detumble.mtm_calib.y));
-        json_append_member(buffer, "detumble_calib_mtm_z", json_mknumber((double) detumble.mtm_calib.z));
-        json_append_member(buffer, "detumble_filter_mtm_x", json_mknumber((double) detumble.mtm_filter.x));
-        json_append_member(buffer, "detumble_filter_mtm_y", json_mknumber((double) detumble.mtm_filter.y));
-        json_append_member(buffer, "detumble_filter_mtm_z", json_mknumber((double) detumble.mtm_filter.z));
-        json_append_member(buffer, "detumble_bdot_x", json_mknumber((double) detumble.bdot.x));
-        json_append_member(buffer, "detumble_bdot_y", json_mknumber((double) detumble.bdot.y));
-        json_append_member(buffer, "detumble_bdot_z", json_mknumber((double) detumble.bdot.z));
-        json_append_member(buffer, "detumble_dipole_x", json_mknumber((double) detumble.dipole.x));
-        json_append_member(buffer, "detumble_dipole_y", json_mknumber((double) detumble.dipole.y));
-        json_append_member(buffer, "detumble_dipole_z", json_mknumber((double) detumble.dipole.z));
-        json_append_member(buffer, "detumble_cmd_current_x", json_mknumber((double) detumble.cmd_current.x));
-        json_append_member(buffer, "detumble_cmd_current_y", json_mknumber((double) detumble.cmd_current.y));
-        json_append_member(buffer, "detumble_cmd_current_z", json_mknumber((double) detumble.cmd_current.z));
-        json_append_member(buffer, "detumble_coil_current_x", json_mknumber((double) detumble.coil_current.x));
-        json_append_member(buffer, "detumble_coil_current_y", json_mknumber((double) detumble.coil_current.y));
-        json_append_member(buffer, "detumble_coil_current_z", json_mknumber((double) detumble.coil_current.z));
+        json_append_member(buffer, "detumble_calib_mtm_x", json_mkint(detumble.mtm_calib.x));
+        json_append_member(buffer, "detumble_calib_mtm_y", json_mkint(detumble.mtm_calib.y));
+        json_append_member(buffer, "detumble_calib_mtm_z", json_mkint(detumble.mtm_calib.z));
+        json_append_member(buffer, "detumble_filter_mtm_x", json_mkint(detumble.mtm_filter.x));
+        json_append_member(buffer, "detumble_filter_mtm_y", json_mkint(detumble.mtm_filter.y));
+        json_append_member(buffer, "detumble_filter_mtm_z", json_mkint(detumble.mtm_filter.z));
+        json_append_member(buffer, "detumble_bdot_x", json_mkint(detumble.bdot.x));
+        json_append_member(buffer, "detumble_bdot_y", json_mkint(detumble.bdot.y));
+        json_append_member(buffer, "detumble_bdot_z", json_mkint(detumble.bdot.z));
+        json_append_member(buffer, "detumble_dipole_x", json_mkint(detumble.dipole.x));
+        json_append_member(buffer, "detumble_dipole_y", json_mkint(detumble.dipole.y));
+        json_append_member(buffer, "detumble_dipole_z", json_mkint(detumble.dipole.z));
+        json_append_member(buffer, "detumble_cmd_current_x", json_mkint(detumble.cmd_current.x));
+        json_append_member(buffer, "detumble_cmd_current_y", json_mkint(detumble.cmd_current.y));
+        json_append_member(buffer, "detumble_cmd_current_z", json_mkint(detumble.cmd_current.z));
+        json_append_member(buffer, "detumble_coil_current_x", json_mkint(detumble.coil_current.x));
+        json_append_member(buffer, "detumble_coil_current_y", json_mkint(detumble.coil_current.y));
+        json_append_member(buffer, "detumble_coil_current_z", json_mkint(detumble.coil_current.z));
     }
 
     /* Current magnetometer measurements */
@@ -284,7 +565,7 @@ KADCSStatus kprv_adcs_get_nominal_telemetry(JsonNode * buffer)
         const struct timespec TRANSFER_DELAY
             = {.tv_sec = 0, .tv_nsec = 1000001 };
 
-        nanosleep(&TRANSFER_DELAY, NULL);
+        k_clock_nanosleep(&TRANSFER_DELAY);
 
         nom_status = k_imtq_get_raw_mtm(&mtm_raw);
         nom_status |= k_imtq_get_calib_mtm(&mtm_calib);
@@ -296,15 +577,34 @@ KADCSStatus kprv_adcs_get_nominal_telemetry(JsonNode * buffer)
         else
         {
             json_append_member(buffer, "mtm_actuating", json_mkstring((mtm_raw.act_status) ? "yes" : "no"));
-            json_append_member(buffer, "mtm_x_raw", json_mknumber((double) mtm_raw.data.x));
-            json_append_member(buffer, "mtm_y_raw", json_mknumber((double) mtm_raw.data.y));
-            json_append_member(buffer, "mtm_z_raw", json_mknumber((double) mtm_raw.data.z));
-            json_append_member(buffer, "mtm_x_calib", json_mknumber((double) mtm_calib.data.x));
-            json_append_member(buffer, "mtm_y_calib", json_mknumber((double) mtm_calib.data.y));
-            json_append_member(buffer, "mtm_z_calib", json_mknumber((double) mtm_calib.data.z));
+            json_append_member(buffer, "mtm_x_raw", json_mkint(mtm_raw.data.x));
+            json_append_member(buffer, "mtm_y_raw", json_mkint(mtm_raw.data.y));
+            json_append_member(buffer, "mtm_z_raw", json_mkint(mtm_raw.data.z));
+            json_append_member(buffer, "mtm_x_calib", json_mkint(mtm_calib.data.x));
+            json_append_member(buffer, "mtm_y_calib", json_mkint(mtm_calib.data.y));
+            json_append_member(buffer, "mtm_z_calib", json_mkint(mtm_calib.data.z));
+
+            kprv_imtq_estimator_feed(&mtm_calib);
         }
     }
 
+    /* Onboard estimates, so the raw MTM stream needn't be downlinked */
+    if (k_imtq_estimator_get_spin(&spin) == ADCS_OK)
+    {
+        json_append_member(buffer, "spin_x", kprv_imtq_mkfloat(spin.x));
+        json_append_member(buffer, "spin_y", kprv_imtq_mkfloat(spin.y));
+        json_append_member(buffer, "spin_z", kprv_imtq_mkfloat(spin.z));
+        json_append_member(buffer, "spin_rate", kprv_imtq_mkfloat(spin.rate));
+    }
+
+    if (k_imtq_estimator_get_orientation(&orient) == ADCS_OK)
+    {
+        json_append_member(buffer, "orient_w", kprv_imtq_mkfloat(orient.w));
+        json_append_member(buffer, "orient_x", kprv_imtq_mkfloat(orient.x));
+        json_append_member(buffer, "orient_y", kprv_imtq_mkfloat(orient.y));
+        json_append_member(buffer, "orient_z", kprv_imtq_mkfloat(orient.z));
+    }
+
     /* Commanded actuation dipole */
     nom_status = k_imtq_get_dipole(&dipole);
     if (nom_status != ADCS_OK)
@@ -313,9 +613,9 @@ KADCSStatus kprv_adcs_get_nominal_telemetry(JsonNode * buffer)
     }
     else
     {
-        json_append_member(buffer, "dipole_x", json_mknumber((double) dipole.data.x));
-        json_append_member(buffer, "dipole_y", json_mknumber((double) dipole.data.y));
-        json_append_member(buffer, "dipole_z", json_mknumber((double) dipole.data.z));
+        json_append_member(buffer, "dipole_x", json_mkint(dipole.data.x));
+        json_append_member(buffer, "dipole_y", json_mkint(dipole.data.y));
+        json_append_member(buffer, "dipole_z", json_mkint(dipole.data.z));
     }
 
     return status;
@@ -332,64 +632,38 @@ KADCSStatus kprv_adcs_get_debug_telemetry(JsonNode * buffer)
         return ADCS_ERROR_CONFIG;
     }
 
-    /* Get all of the configuration values */
-    int num_config_params
-        = sizeof(adcs_config_params) / sizeof(adcs_config_params[0]);
-    for (int i = 0; i < num_config_params; i++)
+    pthread_once(&debug_once, kprv_imtq_debug_init);
+
+    if (__atomic_load_n(&debug_incremental, __ATOMIC_ACQUIRE))
     {
-        debug_status = k_imtq_get_param(adcs_config_params[i], &config_data);
-        if (debug_status == ADCS_OK)
+        /* Serve the configuration from the refreshed table */
+        status = kprv_imtq_debug_append_cache(buffer);
+    }
+    else
+    {
+        /* Get all of the configuration values */
+        for (int i = 0; i < NUM_CONFIG_PARAMS; i++)
         {
-            char param[7] = { 0 };
-            sprintf(param, "%#x", adcs_config_params[i]);
-
-            /* Convert the param value to a double and add a new JSON element
-             * to the return buffer */
-            switch (adcs_config_params[i] >> 12)
+            debug_status
+                = k_imtq_get_param(adcs_config_params[i], &config_data);
+            if (debug_status == ADCS_OK)
             {
-                case 0x1:
-                    json_append_member(buffer, param, json_mknumber((double) config_data.value.int8_val));
-                    break;
-                case 0x2:
-                    json_append_member(buffer, param, json_mknumber((double) config_data.value.uint8_val));
-                    break;
-                case 0x3:
-                    json_append_member(buffer, param, json_mknumber((double) config_data.value.int16_val));
-                    break;
-                case 0x4:
-                    json_append_member(buffer, param, json_mknumber((double) config_data.value.uint16_val));
-                    break;
-                case 0x5:
-                    json_append_member(buffer, param, json_mknumber((double) config_data.value.int32_val));
-                    break;
-                case 0x6:
-                    json_append_member(buffer, param, json_mknumber((double) config_data.value.uint32_val));
-                    break;
-                case 0x7:
-                    json_append_member(buffer, param, json_mknumber((double) config_data.value.float_val));
-                    break;
-                case 0x8:
-                    json_append_member(buffer, param, json_mknumber((double) config_data.value.int64_val));
-                    break;
-                case 0x9:
-                    json_append_member(buffer, param, json_mknumber((double) config_data.value.uint64_val));
-                    break;
-                case 0xA:
-                    json_append_member(buffer, param, json_mknumber(config_data.value.double_val));
-                    break;
-                default:
-                    /* We shouldn't ever get here... */
-                    fprintf(stderr, "Unknown iMTQ configuration parameter "
-                                    "type passed: %s\n",
-                            param);
+                /* The response is packed, so the value is copied out */
+                imtq_config_value value = config_data.value;
+
+                if (kprv_adcs_append_param(buffer, debug_cache[i].key,
+                                           adcs_config_params[i], &value)
+                    != ADCS_OK)
+                {
                     status = ADCS_ERROR;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "Failed to fetch iMTQ param %#x: %d\n",
+                        adcs_config_params[i], debug_status);
+                status = ADCS_ERROR;
             }
-        }
-        else
-        {
-            fprintf(stderr, "Failed to fetch iMTQ param %#x: %d\n", adcs_config_params[i], status);
-            status = ADCS_ERROR;
-            continue;
         }
     }
 
@@ -425,6 +699,71 @@ KADCSStatus kprv_adcs_get_debug_telemetry(JsonNode * buffer)
     return status;
 }
 
+KADCSStatus kprv_adcs_append_param(JsonNode * buffer, const char * key,
+                                   uint16_t param,
+                                   const imtq_config_value * value)
+{
+    /* Convert the param value to a JSON number and add a new JSON
+     * element to the return buffer */
+    switch (param >> 12)
+    {
+        case 0x1:
+            json_append_member(buffer, key, json_mkint(value->int8_val));
+            break;
+        case 0x2:
+            json_append_member(buffer, key, json_mkint(value->uint8_val));
+            break;
+        case 0x3:
+            json_append_member(buffer, key, json_mkint(value->int16_val));
+            break;
+        case 0x4:
+            json_append_member(buffer, key, json_mkint(value->uint16_val));
+            break;
+        case 0x5:
+            json_append_member(buffer, key, json_mkint(value->int32_val));
+            break;
+        case 0x6:
+            json_append_member(buffer, key, json_mkint(value->uint32_val));
+            break;
+        case 0x7:
+            json_append_member(buffer, key, kprv_imtq_mkfloat(value->float_val));
+            break;
+        case 0x8:
+            json_append_member(buffer, key, json_mkint(value->int64_val));
+            break;
+        case 0x9:
+            if (value->uint64_val <= INT64_MAX)
+            {
+                json_append_member(buffer, key, json_mkint((int64_t) value->uint64_val));
+            }
+            else
+            {
+#ifdef KUBOS_FIXED_POINT
+                /* Beyond int64_t: the exact digits, as converting to double would need soft-float */
+                char digits[21];
+
+                snprintf(digits, sizeof(digits), "%llu",
+                         (unsigned long long) value->uint64_val);
+                json_append_member(buffer, key, json_mkstring(digits));
+#else
+                json_append_member(buffer, key, json_mknumber((double) value->uint64_val));
+#endif
+            }
+            break;
+        case 0xA:
+            json_append_member(buffer, key, kprv_imtq_mkdouble(value->double_val));
+            break;
+        default:
+            /* We shouldn't ever get here... */
+            fprintf(stderr, "Unknown iMTQ configuration parameter "
+                            "type passed: %s\n",
+                    key);
+            return ADCS_ERROR;
+    }
+
+    return ADCS_OK;
+}
+
 void kprv_adcs_process_test(JsonNode * parent, imtq_test_result test)
 {
     if (parent == NULL)
@@ -477,19 +816,237 @@ void kprv_adcs_process_test(JsonNode * parent, imtq_test_result test)
     sprintf(coil_temp_y, "tr_%s_coil_temp_y", step);
     sprintf(coil_temp_z, "tr_%s_coil_temp_z", step);
 
-    json_append_member(parent, error, json_mknumber((double) test.error));
-    json_append_member(parent, mtm_raw_x, json_mknumber((double) test.mtm_raw.x));
-    json_append_member(parent, mtm_raw_y, json_mknumber((double) test.mtm_raw.y));
-    json_append_member(parent, mtm_raw_z, json_mknumber((double) test.mtm_raw.z));
-    json_append_member(parent, mtm_calib_x, json_mknumber((double) test.mtm_calib.x));
-    json_append_member(parent, mtm_calib_y, json_mknumber((double) test.mtm_calib.y));
-    json_append_member(parent, mtm_calib_z, json_mknumber((double) test.mtm_calib.z));
-    json_append_member(parent, coil_current_x, json_mknumber((double) test.coil_current.x));
-    json_append_member(parent, coil_current_y, json_mknumber((double) test.coil_current.y));
-    json_append_member(parent, coil_current_z, json_mknumber((double) test.coil_current.z));
-    json_append_member(parent, coil_temp_x, json_mknumber((double) test.coil_temp.x));
-    json_append_member(parent, coil_temp_y, json_mknumber((double) test.coil_temp.y));
-    json_append_member(parent, coil_temp_z, json_mknumber((double) test.coil_temp.z));
+    json_append_member(parent, error, json_mkint(test.error));
+    json_append_member(parent, mtm_raw_x, json_mkint(test.mtm_raw.x));
+    json_append_member(parent, mtm_raw_y, json_mkint(test.mtm_raw.y));
+    json_append_member(parent, mtm_raw_z, json_mkint(test.mtm_raw.z));
+    json_append_member(parent, mtm_calib_x, json_mkint(test.mtm_calib.x));
+    json_append_member(parent, mtm_calib_y, json_mkint(test.mtm_calib.y));
+    json_append_member(parent, mtm_calib_z, json_mkint(test.mtm_calib.z));
+    json_append_member(parent, coil_current_x, json_mkint(test.coil_current.x));
+    json_append_member(parent, coil_current_y, json_mkint(test.coil_current.y));
+    json_append_member(parent, coil_current_z, json_mkint(test.coil_current.z));
+    json_append_member(parent, coil_temp_x, json_mkint(test.coil_temp.x));
+    json_append_member(parent, coil_temp_y, json_mkint(test.coil_temp.y));
+    json_append_member(parent, coil_temp_z, json_mkint(test.coil_temp.z));
+}
+
+/* Incremental debug telemetry */
+
+static uint64_t kprv_imtq_debug_now_ms(void)
+{
+    return k_clock_now() / 1000000;
+}
+
+static uint64_t kprv_imtq_debug_now_us(void)
+{
+    return k_clock_now() / 1000;
+}
+
+void kprv_imtq_debug_init(void)
+{
+    /* The JSON keys are formatted once, rather than on every request */
+    for (int i = 0; i < NUM_CONFIG_PARAMS; i++)
+    {
+        snprintf(debug_cache[i].key, sizeof(debug_cache[i].key), "%#x",
+                 adcs_config_params[i]);
+        snprintf(debug_cache[i].age_key, sizeof(debug_cache[i].age_key),
+                 "%#x_age_ms", adcs_config_params[i]);
+    }
+}
+
+KADCSStatus kprv_imtq_debug_append_cache(JsonNode * buffer)
+{
+    KADCSStatus status = ADCS_OK;
+    debug_entry snapshot[NUM_CONFIG_PARAMS];
+    uint64_t    now;
+
+    /* Take a consistent copy so the refresher is never held up by JSON */
+    pthread_mutex_lock(&debug_mutex);
+    memcpy(snapshot, debug_cache, sizeof(snapshot));
+    pthread_mutex_unlock(&debug_mutex);
+
+    now = kprv_imtq_debug_now_ms();
+
+    for (int i = 0; i < NUM_CONFIG_PARAMS; i++)
+    {
+        if (snapshot[i].time_ms == 0)
+        {
+            /* Not read yet */
+            continue;
+        }
+
+        if (kprv_adcs_append_param(buffer, snapshot[i].key,
+                                   adcs_config_params[i], &snapshot[i].value)
+            != ADCS_OK)
+        {
+            status = ADCS_ERROR;
+            continue;
+        }
+
+        json_append_member(buffer, snapshot[i].age_key,
+                           json_mkint(now - snapshot[i].time_ms));
+    }
+
+    return status;
+}
+
+KADCSStatus k_imtq_debug_refresh(uint32_t budget_us, int * count)
+{
+    KADCSStatus      status = ADCS_OK;
+    imtq_config_resp config_data;
+    uint64_t         start;
+    int              refreshed = 0;
+    int              attempts  = 0;
+
+    pthread_once(&debug_once, kprv_imtq_debug_init);
+
+    int previous = k_budget_enter(imtq_bulk_budget);
+
+    start = kprv_imtq_debug_now_us();
+
+    /*
+     * Pick up where the last cycle stopped. At least one parameter is read
+     * each cycle, and never more than the whole list.
+     */
+    do
+    {
+        pthread_mutex_lock(&debug_mutex);
+        int i = debug_cursor;
+        debug_cursor = (debug_cursor + 1) % NUM_CONFIG_PARAMS;
+        pthread_mutex_unlock(&debug_mutex);
+
+        attempts++;
+
+        if (k_imtq_get_param(adcs_config_params[i], &config_data) != ADCS_OK)
+        {
+            /* Keep the old value; its age shows it's going stale */
+            status = ADCS_ERROR;
+            continue;
+        }
+
+        pthread_mutex_lock(&debug_mutex);
+        debug_cache[i].value   = config_data.value;
+        debug_cache[i].time_ms = kprv_imtq_debug_now_ms();
+        pthread_mutex_unlock(&debug_mutex);
+
+        refreshed++;
+    } while (kprv_imtq_debug_now_us() - start < budget_us
+             && attempts < NUM_CONFIG_PARAMS);
+
+    k_budget_leave(previous);
+
+    if (count != NULL)
+    {
+        *count = refreshed;
+    }
+
+    return status;
+}
+
+void * kprv_imtq_debug_thread(void * args)
+{
+    int state;
+    int gov;
+
+    (void) args;
+
+    k_thread_stats_register("imtq-debug", debug_config.period_ms);
+    if (k_gov_register("imtq-debug", debug_config.period_ms, 0, &gov) != GOV_OK)
+    {
+        gov = -1;
+    }
+    pthread_cleanup_push(k_thread_stats_unregister, NULL);
+
+    while (1)
+    {
+        k_thread_stats_wakeup();
+
+        /* Don't get cancelled while holding the iMTQ mutex */
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+        k_imtq_debug_refresh(debug_config.budget_us, NULL);
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &state);
+
+        if (gov < 0)
+        {
+            k_clock_sleep((uint64_t) debug_config.period_ms * 1000000);
+        }
+        else
+        {
+            k_gov_sleep(gov);
+        }
+    }
+
+    pthread_cleanup_pop(1);
+
+    return NULL;
+}
+
+KADCSStatus k_imtq_debug_start(const imtq_debug_config * config)
+{
+    if (debug_thread != 0)
+    {
+        fprintf(stderr, "iMTQ debug refresh thread already started\n");
+        return ADCS_OK;
+    }
+
+    debug_config.period_ms = IMTQ_DEBUG_PERIOD_MS;
+    debug_config.budget_us = IMTQ_DEBUG_BUDGET_US;
+    if (config != NULL)
+    {
+        debug_config = *config;
+    }
+
+    /* Nothing is read ahead of time until the first cycle */
+    pthread_mutex_lock(&debug_mutex);
+    for (int i = 0; i < NUM_CONFIG_PARAMS; i++)
+    {
+        debug_cache[i].time_ms = 0;
+    }
+    debug_cursor = 0;
+    pthread_mutex_unlock(&debug_mutex);
+
+    if (debug_config.period_ms != 0
+        && k_thread_create("imtq-debug", &debug_thread,
+                           kprv_imtq_debug_thread, NULL)
+               != THREAD_POLICY_OK)
+    {
+        perror("Failed to create iMTQ debug refresh thread");
+        debug_thread = 0;
+        return ADCS_ERROR;
+    }
+
+    __atomic_store_n(&debug_incremental, true, __ATOMIC_RELEASE);
+
+    return ADCS_OK;
+}
+
+KADCSStatus k_imtq_debug_stop(void)
+{
+    __atomic_store_n(&debug_incremental, false, __ATOMIC_RELEASE);
+
+    if (debug_thread == 0)
+    {
+        return ADCS_OK;
+    }
+
+    /* Send the cancel request */
+    if (pthread_cancel(debug_thread) != 0)
+    {
+        perror("Failed to cancel iMTQ debug refresh thread");
+        return ADCS_ERROR;
+    }
+
+    /* Wait for the cancellation to complete */
+    if (pthread_join(debug_thread, NULL) != 0)
+    {
+        perror("Failed to rejoin iMTQ debug refresh thread");
+        return ADCS_ERROR;
+    }
+
+    debug_thread = 0;
+
+    return ADCS_OK;
 }
 
 /* iMTQ-specific functions */
@@ -554,6 +1111,8 @@ KADCSStatus k_imtq_get_calib_mtm(imtq_mtm_msg * data)
         return status;
     }
 
+    k_pubsub_publish(imtq_mtm_topic, data, sizeof(*data));
+
     return ADCS_OK;
 }
 
@@ -0,0 +1,472 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ISIS iMTQ API - Spin and Attitude Estimator
+ */
+
+#include <imtq.h>
+#include <clock.h>
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+/* Fixed-point scale used by the field model */
+#define Q30 (1LL << 30)
+
+/* IGRF reference radius in [m] */
+#define EARTH_RADIUS 6371200LL
+
+/* Dipole strength in [nT]: |(g11, h11, g10)| for IGRF-13 at 2020.0 */
+#define DIPOLE_FIELD 29806LL
+
+/* Dipole moment direction in ECEF, (g11, h11, g10) normalized, Q30 */
+static const int64_t dipole_axis[3] = {
+    -52267864LL,    /* -0.04868 */
+    167603721LL,    /*  0.15609 */
+    -1059291540LL   /* -0.98654 */
+};
+
+static pthread_mutex_t est_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Estimator state. Fixed size: nothing is kept per sample.
+ */
+static struct {
+    bool     have_sample;   /* prev_field/prev_time are valid */
+    bool     have_spin;     /* spin has been set at least once */
+    bool     have_attitude; /* attitude has been initialized */
+    bool     have_position; /* reference is valid */
+    float    prev_field[3]; /* Previous sample, unit vector */
+    uint64_t prev_time;     /* Previous sample time in [us] */
+    float    spin[3];       /* Filtered body rate in [rad/s] */
+    float    q[4];          /* Body attitude in ECEF (w, x, y, z) */
+    float    reference[3];  /* Model field at the current position, unit vector */
+} est;
+
+static float vec_dot(const float a[3], const float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void vec_cross(const float a[3], const float b[3], float out[3])
+{
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static void quat_normalize(float q[4])
+{
+    float norm = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+
+    q[0] /= norm;
+    q[1] /= norm;
+    q[2] /= norm;
+    q[3] /= norm;
+}
+
+/* Rotate an ECEF vector into the body frame: q* v q */
+static void quat_to_body(const float q[4], const float v[3], float out[3])
+{
+    float t[3];
+    float u[3] = { -q[1], -q[2], -q[3] };
+
+    /* v' = v + 2w(u x v) + 2u x (u x v), with u the conjugate's vector part */
+    vec_cross(u, v, t);
+    t[0] *= 2.0f;
+    t[1] *= 2.0f;
+    t[2] *= 2.0f;
+    vec_cross(u, t, out);
+    out[0] += v[0] + q[0] * t[0];
+    out[1] += v[1] + q[0] * t[1];
+    out[2] += v[2] + q[0] * t[2];
+}
+
+/* q = q (x) exp(rotation / 2), for a body-frame rotation vector in [rad] */
+static void quat_rotate(float q[4], const float rotation[3])
+{
+    float angle = sqrtf(vec_dot(rotation, rotation));
+    float d[4];
+    float r[4];
+
+    if (angle < 1e-9f)
+    {
+        return;
+    }
+
+    d[0] = cosf(angle / 2.0f);
+    d[1] = sinf(angle / 2.0f) * rotation[0] / angle;
+    d[2] = sinf(angle / 2.0f) * rotation[1] / angle;
+    d[3] = sinf(angle / 2.0f) * rotation[2] / angle;
+
+    r[0] = q[0] * d[0] - q[1] * d[1] - q[2] * d[2] - q[3] * d[3];
+    r[1] = q[0] * d[1] + q[1] * d[0] + q[2] * d[3] - q[3] * d[2];
+    r[2] = q[0] * d[2] - q[1] * d[3] + q[2] * d[0] + q[3] * d[1];
+    r[3] = q[0] * d[3] + q[1] * d[2] - q[2] * d[1] + q[3] * d[0];
+
+    memcpy(q, r, sizeof(r));
+    quat_normalize(q);
+}
+
+/* Shortest rotation taking the body vector `from` onto the ECEF vector `to` */
+static void quat_align(const float from[3], const float to[3], float q[4])
+{
+    float axis[3];
+    float dot = vec_dot(from, to);
+
+    vec_cross(from, to, axis);
+    if (dot < -0.999999f)
+    {
+        /* Opposite: turn half way round any perpendicular axis */
+        float other[3] = { 1.0f, 0.0f, 0.0f };
+        if (fabsf(from[0]) > 0.9f)
+        {
+            other[0] = 0.0f;
+            other[1] = 1.0f;
+        }
+        vec_cross(from, other, axis);
+        q[0] = 0.0f;
+    }
+    else
+    {
+        q[0] = 1.0f + dot;
+    }
+
+    q[1] = axis[0];
+    q[2] = axis[1];
+    q[3] = axis[2];
+    quat_normalize(q);
+}
+
+static uint64_t isqrt64(uint64_t n)
+{
+    uint64_t root = 0;
+    uint64_t bit  = 1ULL << 62;
+
+    while (bit > n)
+    {
+        bit >>= 2;
+    }
+
+    while (bit != 0)
+    {
+        if (n >= root + bit)
+        {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return root;
+}
+
+KADCSStatus kprv_imtq_field_model(const int32_t ecef[3], int32_t field[3])
+{
+    int64_t radius;
+    int64_t unit[3];
+    int64_t scale;
+    int64_t strength;
+    int64_t dot = 0;
+
+    if (ecef == NULL || field == NULL)
+    {
+        return ADCS_ERROR_CONFIG;
+    }
+
+    /* Each square is below 2^62, so the sum can't overflow unsigned */
+    radius = (int64_t) isqrt64((uint64_t) ((int64_t) ecef[0] * ecef[0])
+                               + (uint64_t) ((int64_t) ecef[1] * ecef[1])
+                               + (uint64_t) ((int64_t) ecef[2] * ecef[2]));
+    if (radius < EARTH_RADIUS * 9 / 10)
+    {
+        return ADCS_ERROR_CONFIG;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        unit[i] = ((int64_t) ecef[i] * Q30) / radius;
+        dot += (dipole_axis[i] * unit[i]) >> 30;
+    }
+
+    /* B0 (a/r)^3 */
+    scale    = (EARTH_RADIUS * Q30) / radius;
+    scale    = (((scale * scale) >> 30) * scale) >> 30;
+    strength = (DIPOLE_FIELD * scale) >> 30;
+
+    /* B = B0 (a/r)^3 (3 (m.r) r - m) */
+    for (int i = 0; i < 3; i++)
+    {
+        int64_t term = ((3 * dot * unit[i]) >> 30) - dipole_axis[i];
+        field[i] = (int32_t) ((strength * term) >> 30);
+    }
+
+    return ADCS_OK;
+}
+
+KADCSStatus k_imtq_estimator_set_position(const int32_t ecef[3])
+{
+    int32_t     field[3];
+    KADCSStatus status = ADCS_OK;
+
+    if (ecef != NULL)
+    {
+        status = kprv_imtq_field_model(ecef, field);
+        if (status != ADCS_OK)
+        {
+            return status;
+        }
+    }
+
+    pthread_mutex_lock(&est_mutex);
+
+    if (ecef == NULL)
+    {
+        est.have_position = false;
+        est.have_attitude = false;
+    }
+    else
+    {
+        float norm = sqrtf((float) field[0] * field[0]
+                           + (float) field[1] * field[1]
+                           + (float) field[2] * field[2]);
+
+        est.reference[0]  = field[0] / norm;
+        est.reference[1]  = field[1] / norm;
+        est.reference[2]  = field[2] / norm;
+        est.have_position = true;
+    }
+
+    pthread_mutex_unlock(&est_mutex);
+
+    return status;
+}
+
+void k_imtq_estimator_reset(void)
+{
+    pthread_mutex_lock(&est_mutex);
+
+    est.have_sample   = false;
+    est.have_spin     = false;
+    est.have_attitude = false;
+    memset(est.spin, 0, sizeof(est.spin));
+
+    pthread_mutex_unlock(&est_mutex);
+}
+
+KADCSStatus k_imtq_estimator_update(const imtq_mtm_data * field,
+                                    uint64_t               time_us)
+{
+    float measured[3];
+    float norm;
+
+    if (field == NULL)
+    {
+        return ADCS_ERROR_CONFIG;
+    }
+
+    measured[0] = (float) field->x;
+    measured[1] = (float) field->y;
+    measured[2] = (float) field->z;
+
+    norm = sqrtf(vec_dot(measured, measured));
+    if (norm < IMTQ_EST_MIN_FIELD)
+    {
+        return ADCS_ERROR;
+    }
+
+    measured[0] /= norm;
+    measured[1] /= norm;
+    measured[2] /= norm;
+
+    pthread_mutex_lock(&est_mutex);
+
+    float dt = est.have_sample && time_us > est.prev_time
+                   ? (float) (time_us - est.prev_time) / 1e6f
+                   : 0.0f;
+
+    if (dt > 0.0f && dt <= IMTQ_EST_MAX_GAP)
+    {
+        /*
+         * In the body frame the field turns at -w, so the rate perpendicular
+         * to the field is the angle turned about -(b1 x b2), over dt
+         */
+        float axis[3];
+        float rate[3] = { 0 };
+        float sine;
+
+        vec_cross(est.prev_field, measured, axis);
+        sine = sqrtf(vec_dot(axis, axis));
+        if (sine > 1e-9f)
+        {
+            float angle = atan2f(sine, vec_dot(est.prev_field, measured));
+            float scale = -angle / (sine * dt);
+
+            rate[0] = axis[0] * scale;
+            rate[1] = axis[1] * scale;
+            rate[2] = axis[2] * scale;
+        }
+
+        if (est.have_spin)
+        {
+            float alpha = dt / (IMTQ_EST_SPIN_TAU + dt);
+
+            for (int i = 0; i < 3; i++)
+            {
+                est.spin[i] += alpha * (rate[i] - est.spin[i]);
+            }
+        }
+        else
+        {
+            memcpy(est.spin, rate, sizeof(rate));
+            est.have_spin = true;
+        }
+    }
+
+    if (est.have_position)
+    {
+        if (!est.have_attitude || dt <= 0.0f || dt > IMTQ_EST_MAX_GAP)
+        {
+            quat_align(measured, est.reference, est.q);
+            est.have_attitude = true;
+        }
+        else
+        {
+            /* Propagate with the spin, plus a correction towards the model */
+            float predicted[3];
+            float error[3];
+            float rotation[3];
+
+            quat_to_body(est.q, est.reference, predicted);
+            vec_cross(measured, predicted, error);
+
+            for (int i = 0; i < 3; i++)
+            {
+                rotation[i] = (est.spin[i] + IMTQ_EST_ATTITUDE_GAIN * error[i]) * dt;
+            }
+
+            quat_rotate(est.q, rotation);
+        }
+    }
+
+    memcpy(est.prev_field, measured, sizeof(measured));
+    est.prev_time   = time_us;
+    est.have_sample = true;
+
+    pthread_mutex_unlock(&est_mutex);
+
+    return ADCS_OK;
+}
+
+void kprv_imtq_estimator_feed(const imtq_mtm_msg * sample)
+{
+    /* The coils swamp the magnetometer while they're driven */
+    if (sample == NULL || sample->act_status != 0)
+    {
+        return;
+    }
+
+    k_imtq_estimator_update(&sample->data, k_clock_now() / 1000);
+}
+
+KADCSStatus kprv_imtq_estimator_sample(void)
+{
+    const struct timespec MEASURE_DELAY = {.tv_sec = 0, .tv_nsec = 1000001 };
+    imtq_mtm_msg          sample;
+    KADCSStatus           status;
+
+    status = k_imtq_start_measurement();
+    if (status != ADCS_OK)
+    {
+        return status;
+    }
+
+    k_clock_nanosleep(&MEASURE_DELAY);
+
+    status = k_imtq_get_calib_mtm(&sample);
+    if (status != ADCS_OK)
+    {
+        return status;
+    }
+
+    kprv_imtq_estimator_feed(&sample);
+
+    return ADCS_OK;
+}
+
+KADCSStatus k_imtq_estimator_get_spin(adcs_spin * data)
+{
+    KADCSStatus status = ADCS_OK;
+
+    if (data == NULL)
+    {
+        return ADCS_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&est_mutex);
+
+    if (!est.have_spin)
+    {
+        status = ADCS_ERROR;
+    }
+    else
+    {
+        data->x    = est.spin[0];
+        data->y    = est.spin[1];
+        data->z    = est.spin[2];
+        data->rate = sqrtf(vec_dot(est.spin, est.spin));
+    }
+
+    pthread_mutex_unlock(&est_mutex);
+
+    return status;
+}
+
+KADCSStatus k_imtq_estimator_get_orientation(adcs_orient * data)
+{
+    KADCSStatus status = ADCS_OK;
+
+    if (data == NULL)
+    {
+        return ADCS_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&est_mutex);
+
+    if (!est.have_position)
+    {
+        status = ADCS_ERROR_CONFIG;
+    }
+    else if (!est.have_attitude)
+    {
+        status = ADCS_ERROR;
+    }
+    else
+    {
+        data->w = est.q[0];
+        data->x = est.q[1];
+        data->y = est.q[2];
+        data->z = est.q[3];
+    }
+
+    pthread_mutex_unlock(&est_mutex);
+
+    return status;
+}
@@ -17,6 +17,7 @@
  */
 
 #include <imtq.h>
+#include <clock.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -128,7 +129,7 @@ KADCSStatus k_adcs_run_test(ADCSTestType axis, adcs_test_results buffer)
     /* Wait an appropriate time for the test to finish */
     const struct timespec TRANSFER_DELAY = {.tv_sec = 1, .tv_nsec = 300000000 };
 
-    nanosleep(&TRANSFER_DELAY, NULL);
+    k_clock_nanosleep(&TRANSFER_DELAY);
 
     if (axis == TEST_ALL)
     {
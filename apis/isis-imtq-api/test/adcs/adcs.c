@@ -18,6 +18,7 @@
  */
 
 #include <imtq.h>
+#include <clock.h>
 #include <cmocka.h>
 
 static char * bus = "/dev/i2c-1";
@@ -50,6 +51,10 @@ imtq_dipole           dipole    = { 0 };
 /* Debug telemetry structs */
 imtq_config_resp config_resp = { 0 };
 
+/* Heap use counted by the malloc wrappers in sysfs.c */
+extern bool heap_trap;
+extern int  heap_calls;
+
 static void test_init(void ** arg)
 {
     KADCSStatus ret;
@@ -229,7 +234,7 @@ static void test_get_orientation(void ** arg)
 
     ret = k_adcs_get_orientation(NULL);
 
-    assert_int_equal(ret, ADCS_ERROR_NOT_IMPLEMENTED);
+    assert_int_equal(ret, ADCS_ERROR_CONFIG);
 }
 
 static void test_get_spin(void ** arg)
@@ -238,7 +243,7 @@ static void test_get_spin(void ** arg)
 
     ret = k_adcs_get_spin(NULL);
 
-    assert_int_equal(ret, ADCS_ERROR_NOT_IMPLEMENTED);
+    assert_int_equal(ret, ADCS_ERROR_CONFIG);
 }
 
 static void test_get_telemetry_nominal(void ** arg)
@@ -291,6 +296,71 @@ static void test_get_telemetry_nominal(void ** arg)
     assert_true(json_ret);
 }
 
+static void test_get_telemetry_arena(void ** arg)
+{
+    KADCSStatus ret;
+    static char buffer[16384];
+    JsonArena   arena;
+    JsonArena * previous;
+
+    json_arena_init(&arena, buffer, sizeof(buffer));
+    previous = json_arena_use(&arena);
+
+    JsonNode * results = json_mkobject();
+
+    /* System State */
+    expect_value(__wrap_write, cmd, GET_STATE);
+    expect_value(__wrap_read, len, sizeof(imtq_state));
+    will_return(__wrap_read, &state);
+
+    /* Nominal Telemetry: */
+    /* Raw Housekeeping */
+    expect_value(__wrap_write, cmd, GET_HOUSE_RAW);
+    expect_value(__wrap_read, len, sizeof(house_raw));
+    will_return(__wrap_read, &house_raw);
+    /* Engineering Housekeeping */
+    expect_value(__wrap_write, cmd, GET_HOUSE_ENG);
+    expect_value(__wrap_read, len, sizeof(house_eng));
+    will_return(__wrap_read, &house_eng);
+    /* Last Detumble Data */
+    expect_value(__wrap_write, cmd, GET_DETUMBLE);
+    expect_value(__wrap_read, len, sizeof(detumble));
+    will_return(__wrap_read, &detumble);
+    /* (Prep for measurement requests) */
+    expect_value(__wrap_write, cmd, START_MEASURE);
+    expect_value(__wrap_read, len, sizeof(imtq_resp_header));
+    will_return(__wrap_read, &response);
+    /* Current Raw MTM Measurement */
+    expect_value(__wrap_write, cmd, GET_MTM_RAW);
+    expect_value(__wrap_read, len, sizeof(mtm));
+    will_return(__wrap_read, &mtm);
+    /* Current Calibrated MTM Measurement */
+    expect_value(__wrap_write, cmd, GET_MTM_CALIB);
+    expect_value(__wrap_read, len, sizeof(mtm));
+    will_return(__wrap_read, &mtm);
+    /* Last Dipole Data */
+    expect_value(__wrap_write, cmd, GET_DIPOLE);
+    expect_value(__wrap_read, len, sizeof(dipole));
+    will_return(__wrap_read, &dipole);
+
+    /* Steady-state telemetry must be built without touching the heap */
+    heap_calls = 0;
+    heap_trap  = true;
+    ret = k_adcs_get_telemetry(NOMINAL, results);
+    char * encoded = json_encode(results);
+    heap_trap  = false;
+
+    int json_ret = json_check(results, NULL);
+    json_free(encoded);
+    json_arena_reset(&arena);
+    json_arena_use(previous);
+
+    assert_int_equal(ret, ADCS_OK);
+    assert_true(json_ret);
+    assert_non_null(encoded);
+    assert_int_equal(heap_calls, 0);
+}
+
 static void test_get_telemetry_debug(void ** arg)
 {
     KADCSStatus ret;
@@ -323,6 +393,124 @@ static void test_get_telemetry_debug(void ** arg)
     assert_true(json_ret);
 }
 
+#ifdef KUBOS_FIXED_POINT
+static void test_scale_number(void ** arg)
+{
+    assert_int_equal(kprv_imtq_scale_float(0.0f), 0);
+    assert_int_equal(kprv_imtq_scale_float(1.0f), 1000000);
+    assert_int_equal(kprv_imtq_scale_float(-2.5f), -2500000);
+    assert_int_equal(kprv_imtq_scale_float(0.1f), 100000);
+    assert_int_equal(kprv_imtq_scale_float(1e-9f), 0);
+    assert_int_equal(kprv_imtq_scale_float(12345.5f), 12345500000);
+    assert_int_equal(kprv_imtq_scale_float(1e30f), INT64_MAX);
+    assert_int_equal(kprv_imtq_scale_float(-1e30f), -INT64_MAX);
+
+    assert_int_equal(kprv_imtq_scale_double(0.0), 0);
+    assert_int_equal(kprv_imtq_scale_double(-0.000001), -1);
+    assert_int_equal(kprv_imtq_scale_double(3.14159265358979), 3141593);
+    assert_int_equal(kprv_imtq_scale_double(-123456.7890125), -123456789013);
+    assert_int_equal(kprv_imtq_scale_double(5e-324), 0);
+    assert_int_equal(kprv_imtq_scale_double(1e300), INT64_MAX);
+
+    /* Back again, to the nearest value */
+    assert_true(kprv_imtq_unscale_float(0) == 0.0f);
+    assert_true(kprv_imtq_unscale_float(1000000) == 1.0f);
+    assert_true(kprv_imtq_unscale_float(-2500000) == -2.5f);
+    assert_true(kprv_imtq_unscale_float(100000) == 0.1f);
+    assert_true(kprv_imtq_unscale_float(1) == 0.000001f);
+    assert_true(kprv_imtq_unscale_float(12345500000) == 12345.5f);
+    assert_true(kprv_imtq_unscale_float(INT64_MAX) == 9223372036854.775807f);
+
+    assert_true(kprv_imtq_unscale_double(3141593) == 3.141593);
+    assert_true(kprv_imtq_unscale_double(-123456789013) == -123456.789013);
+    assert_true(kprv_imtq_unscale_double(-1) == -0.000001);
+    assert_true(kprv_imtq_unscale_double(INT64_MIN) == -9223372036854.775808);
+}
+
+static void test_configure_fixed_point(void ** arg)
+{
+    KADCSStatus ret;
+
+    /* A float parameter in millionths, and a fraction which is refused */
+    JsonNode * config = json_decode("{\"0x7001\": 2500000, \"0xA001\": 0.5}");
+
+    expect_value(__wrap_write, cmd, SET_PARAM);
+    expect_value(__wrap_read, len, sizeof(imtq_resp_header));
+    will_return(__wrap_read, &response);
+
+    ret = k_adcs_configure(config);
+
+    json_delete(config);
+
+    assert_int_equal(ret, ADCS_ERROR);
+}
+#endif
+
+static void test_debug_refresh(void ** arg)
+{
+    KADCSStatus ret;
+    int         count;
+
+    /* A cycle reads at least one parameter, even without bus time */
+    expect_value(__wrap_write, cmd, GET_PARAM);
+    expect_value(__wrap_read, len, sizeof(config_resp));
+    will_return(__wrap_read, &config_resp);
+
+    ret = k_imtq_debug_refresh(0, &count);
+
+    assert_int_equal(ret, ADCS_OK);
+    assert_int_equal(count, 1);
+
+    /* ...and never reads any parameter twice */
+    expect_value_count(__wrap_write, cmd, GET_PARAM, NUM_CONFIG_PARAMS);
+    expect_value_count(__wrap_read, len, sizeof(config_resp),
+                       NUM_CONFIG_PARAMS);
+    will_return_count(__wrap_read, &config_resp, NUM_CONFIG_PARAMS);
+
+    ret = k_imtq_debug_refresh(UINT32_MAX, &count);
+
+    assert_int_equal(ret, ADCS_OK);
+    assert_int_equal(count, NUM_CONFIG_PARAMS);
+}
+
+static void test_get_telemetry_debug_incremental(void ** arg)
+{
+    const imtq_debug_config config = {.period_ms = 0 };
+    KADCSStatus ret;
+
+    JsonNode * results = json_mkobject();
+
+    assert_int_equal(k_imtq_debug_start(&config), ADCS_OK);
+
+    /* One refresh cycle reads the first parameter */
+    expect_value(__wrap_write, cmd, GET_PARAM);
+    expect_value(__wrap_read, len, sizeof(config_resp));
+    will_return(__wrap_read, &config_resp);
+    k_imtq_debug_refresh(0, NULL);
+
+    /* System State */
+    expect_value(__wrap_write, cmd, GET_STATE);
+    expect_value(__wrap_read, len, sizeof(imtq_state));
+    will_return(__wrap_read, &state);
+
+    /* No configuration reads: only the last test results */
+    expect_value(__wrap_write, cmd, GET_TEST);
+    expect_value(__wrap_read, len, sizeof(test_results_all));
+    will_return(__wrap_read, &test_results_all);
+
+    ret = k_adcs_get_telemetry(DEBUG, results);
+
+    assert_int_equal(ret, ADCS_OK);
+    assert_true(json_check(results, NULL));
+    assert_non_null(json_find_member(results, "0x2002"));
+    assert_non_null(json_find_member(results, "0x2002_age_ms"));
+    assert_null(json_find_member(results, "0x2003"));
+
+    json_delete(results);
+
+    assert_int_equal(k_imtq_debug_stop(), ADCS_OK);
+}
+
 static void test_passthrough(void ** arg)
 {
     KADCSStatus ret;
@@ -376,9 +564,19 @@ int main(void)
         cmocka_unit_test_setup_teardown(test_get_orientation, init, term),
         cmocka_unit_test_setup_teardown(test_get_spin, init, term),
         cmocka_unit_test_setup_teardown(test_get_telemetry_nominal, init, term),
+        cmocka_unit_test_setup_teardown(test_get_telemetry_arena, init, term),
         cmocka_unit_test_setup_teardown(test_get_telemetry_debug, init, term),
+#ifdef KUBOS_FIXED_POINT
+        cmocka_unit_test(test_scale_number),
+        cmocka_unit_test_setup_teardown(test_configure_fixed_point, init, term),
+#endif
+        cmocka_unit_test_setup_teardown(test_debug_refresh, init, term),
+        cmocka_unit_test_setup_teardown(test_get_telemetry_debug_incremental, init, term),
         cmocka_unit_test_setup_teardown(test_passthrough, init, term),
     };
 
+    /* Transfer delays and the self-test wait take no real time */
+    k_clock_use_virtual(0);
+
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
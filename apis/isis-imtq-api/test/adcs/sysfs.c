@@ -17,11 +17,51 @@
 #include <imtq.h>
 #include <cmocka.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 uint8_t  last_cmd;
 uint16_t last_param;
 
+/* While set, every heap allocation is counted in heap_calls */
+bool heap_trap  = false;
+int  heap_calls = 0;
+
+void * __real_malloc(size_t size);
+void * __real_calloc(size_t count, size_t size);
+void * __real_realloc(void * ptr, size_t size);
+
+void * __wrap_malloc(size_t size)
+{
+    if (heap_trap)
+    {
+        heap_calls++;
+    }
+
+    return __real_malloc(size);
+}
+
+void * __wrap_calloc(size_t count, size_t size)
+{
+    if (heap_trap)
+    {
+        heap_calls++;
+    }
+
+    return __real_calloc(count, size);
+}
+
+void * __wrap_realloc(void * ptr, size_t size)
+{
+    if (heap_trap)
+    {
+        heap_calls++;
+    }
+
+    return __real_realloc(ptr, size);
+}
+
 /* Returns a file descriptor or -1 on failure */
 int __wrap_open(const char * filename, int flags)
 {
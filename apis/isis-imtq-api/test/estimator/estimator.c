@@ -0,0 +1,216 @@
+/*
+ * Kubos iMTQ API
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Unit tests for the spin and attitude estimator
+ */
+
+#include <imtq.h>
+#include <cmocka.h>
+#include <math.h>
+
+/* 500km above the equator, on the prime meridian */
+static const int32_t equator[3] = { 6878137, 0, 0 };
+
+/* Field rotating about the body Z-axis at -rate, as seen by a spinning body */
+static imtq_mtm_data spin_sample(double rate, double time)
+{
+    imtq_mtm_data sample = {
+        .x = (int32_t) (30000 * cos(-rate * time)),
+        .y = (int32_t) (30000 * sin(-rate * time)),
+        .z = 0
+    };
+
+    return sample;
+}
+
+/* Rotate an ECEF vector into the body frame: q* v q */
+static void to_body(const adcs_orient * q, const double v[3], double out[3])
+{
+    double u[3] = { -q->x, -q->y, -q->z };
+    double t[3] = { 2 * (u[1] * v[2] - u[2] * v[1]),
+                    2 * (u[2] * v[0] - u[0] * v[2]),
+                    2 * (u[0] * v[1] - u[1] * v[0]) };
+
+    out[0] = v[0] + q->w * t[0] + u[1] * t[2] - u[2] * t[1];
+    out[1] = v[1] + q->w * t[1] + u[2] * t[0] - u[0] * t[2];
+    out[2] = v[2] + q->w * t[2] + u[0] * t[1] - u[1] * t[0];
+}
+
+static void test_field_model(void ** arg)
+{
+    int32_t field[3];
+    double  g10 = -29404.8, g11 = -1450.9, h11 = 4652.5;
+    double  r   = 6878137.0;
+    double  s   = pow(6371200.0 / r, 3);
+
+    /* B = (a/r)^3 (3 (m.r) r - m), m = (g11, h11, g10); here r = x */
+    double expected[3] = { s * (3 * g11 - g11), s * -h11, s * -g10 };
+
+    assert_int_equal(kprv_imtq_field_model(equator, field), ADCS_OK);
+
+    for (int i = 0; i < 3; i++)
+    {
+        assert_true(fabs(field[i] - expected[i]) < 2.0);
+    }
+
+    /* The field points down (south) near the north pole */
+    const int32_t pole[3] = { 0, 0, 6878137 };
+    assert_int_equal(kprv_imtq_field_model(pole, field), ADCS_OK);
+    assert_true(field[2] < -40000);
+}
+
+static void test_field_model_bad_position(void ** arg)
+{
+    int32_t       field[3];
+    const int32_t inside[3] = { 1000, 2000, 3000 };
+
+    assert_int_equal(kprv_imtq_field_model(inside, field), ADCS_ERROR_CONFIG);
+    assert_int_equal(kprv_imtq_field_model(NULL, field), ADCS_ERROR_CONFIG);
+    assert_int_equal(k_imtq_estimator_set_position(inside), ADCS_ERROR_CONFIG);
+}
+
+static void test_spin_rate(void ** arg)
+{
+    adcs_spin     spin;
+    imtq_mtm_data sample;
+    double        rate = 0.05;
+
+    k_imtq_estimator_reset();
+
+    assert_int_equal(k_imtq_estimator_get_spin(&spin), ADCS_ERROR);
+
+    for (int i = 0; i < 20; i++)
+    {
+        sample = spin_sample(rate, i);
+        assert_int_equal(k_imtq_estimator_update(&sample, i * 1000000ULL),
+                         ADCS_OK);
+    }
+
+    assert_int_equal(k_imtq_estimator_get_spin(&spin), ADCS_OK);
+    assert_true(fabs(spin.z - rate) < 1e-3);
+    assert_true(fabs(spin.x) < 1e-3);
+    assert_true(fabs(spin.y) < 1e-3);
+    assert_true(fabs(spin.rate - rate) < 1e-3);
+
+    /* Spinning the other way flips the sign */
+    k_imtq_estimator_reset();
+    for (int i = 0; i < 20; i++)
+    {
+        sample = spin_sample(-rate, i);
+        k_imtq_estimator_update(&sample, i * 1000000ULL);
+    }
+
+    assert_int_equal(k_imtq_estimator_get_spin(&spin), ADCS_OK);
+    assert_true(fabs(spin.z + rate) < 1e-3);
+}
+
+static void test_spin_gap(void ** arg)
+{
+    adcs_spin     spin;
+    imtq_mtm_data sample;
+
+    k_imtq_estimator_reset();
+
+    /* Samples too far apart can't give a rate */
+    sample = spin_sample(0.05, 0);
+    k_imtq_estimator_update(&sample, 0);
+    sample = spin_sample(0.05, 100);
+    k_imtq_estimator_update(&sample, 100 * 1000000ULL);
+
+    assert_int_equal(k_imtq_estimator_get_spin(&spin), ADCS_ERROR);
+}
+
+static void test_weak_field(void ** arg)
+{
+    imtq_mtm_data sample = { .x = 10, .y = 20, .z = 30 };
+
+    assert_int_equal(k_imtq_estimator_update(&sample, 0), ADCS_ERROR);
+    assert_int_equal(k_imtq_estimator_update(NULL, 0), ADCS_ERROR_CONFIG);
+}
+
+static void test_orientation(void ** arg)
+{
+    adcs_orient   orient;
+    int32_t       field[3];
+    double        reference[3];
+    double        body[3];
+    double        norm;
+    imtq_mtm_data sample;
+
+    /* Body rotated 90 degrees about Z from ECEF */
+    adcs_orient truth = { .w = sqrt(0.5), .x = 0, .y = 0, .z = sqrt(0.5) };
+
+    k_imtq_estimator_reset();
+    assert_int_equal(k_imtq_estimator_set_position(NULL), ADCS_OK);
+    assert_int_equal(k_imtq_estimator_get_orientation(&orient),
+                     ADCS_ERROR_CONFIG);
+
+    assert_int_equal(k_imtq_estimator_set_position(equator), ADCS_OK);
+    assert_int_equal(k_imtq_estimator_get_orientation(&orient), ADCS_ERROR);
+
+    kprv_imtq_field_model(equator, field);
+    for (int i = 0; i < 3; i++)
+    {
+        reference[i] = field[i];
+    }
+    to_body(&truth, reference, body);
+
+    sample.x = (int32_t) body[0];
+    sample.y = (int32_t) body[1];
+    sample.z = (int32_t) body[2];
+
+    for (int i = 0; i < 10; i++)
+    {
+        k_imtq_estimator_update(&sample, i * 1000000ULL);
+    }
+
+    assert_int_equal(k_imtq_estimator_get_orientation(&orient), ADCS_OK);
+
+    /* The estimate must put the model field where it was measured */
+    to_body(&orient, reference, reference);
+    norm = sqrt(body[0] * body[0] + body[1] * body[1] + body[2] * body[2]);
+    for (int i = 0; i < 3; i++)
+    {
+        assert_true(fabs(reference[i] - body[i]) / norm < 1e-3);
+    }
+
+    assert_true(fabs(orient.w * orient.w + orient.x * orient.x
+                     + orient.y * orient.y + orient.z * orient.z - 1)
+                < 1e-4);
+
+    k_imtq_estimator_set_position(NULL);
+}
+
+static void test_null_args(void ** arg)
+{
+    assert_int_equal(k_imtq_estimator_get_spin(NULL), ADCS_ERROR_CONFIG);
+    assert_int_equal(k_imtq_estimator_get_orientation(NULL), ADCS_ERROR_CONFIG);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_field_model),
+        cmocka_unit_test(test_field_model_bad_position),
+        cmocka_unit_test(test_spin_rate),
+        cmocka_unit_test(test_spin_gap),
+        cmocka_unit_test(test_weak_field),
+        cmocka_unit_test(test_orientation),
+        cmocka_unit_test(test_null_args),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -16,6 +16,7 @@
  */
 
 #include <imtq.h>
+#include <clock.h>
 #include <cmocka.h>
 
 static char * bus = "/dev/i2c-1";
@@ -819,6 +820,26 @@ static int term(void ** state)
     return 0;
 }
 
+/*
+ * The watchdog thread's kick waits out the transfer delay while the test
+ * sleeps, so these tests run in real time
+ */
+static int init_real_time(void ** state)
+{
+    k_clock_set(NULL);
+
+    return init(state);
+}
+
+static int term_real_time(void ** state)
+{
+    int ret = term(state);
+
+    k_clock_use_virtual(0);
+
+    return ret;
+}
+
 int main(void)
 {
     const struct CMUnitTest tests[] = {
@@ -880,8 +901,8 @@ int main(void)
             cmocka_unit_test_setup_teardown(test_get_debug_telemetry_null, init, term),
 
             /* Core Tests */
-            cmocka_unit_test_setup_teardown(test_watchdog, init, term),
-            cmocka_unit_test_setup_teardown(test_watchdog_twice, init, term),
+            cmocka_unit_test_setup_teardown(test_watchdog, init_real_time, term_real_time),
+            cmocka_unit_test_setup_teardown(test_watchdog_twice, init_real_time, term_real_time),
             cmocka_unit_test_setup_teardown(test_watchdog_stop_no_start, init, term),
             cmocka_unit_test_setup_teardown(test_transfer_null_tx, init, term),
             cmocka_unit_test_setup_teardown(test_transfer_zero_tx_len, init, term),
@@ -893,5 +914,8 @@ int main(void)
             cmocka_unit_test_setup_teardown(test_transfer_error, init, term),
     };
 
+    /* Transfer delays and the self-test wait take no real time */
+    k_clock_use_virtual(0);
+
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
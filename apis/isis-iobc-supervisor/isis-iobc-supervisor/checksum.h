@@ -27,6 +27,10 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
  * Generate a LUT for CRC 8 calculations with a certain polynomial
  *
@@ -67,4 +71,8 @@ uint8_t checksum_calculate_CRC8(const uint8_t * data, unsigned int length, uint8
  */
 uint8_t supervisor_calculate_CRC(const uint8_t * data, unsigned int length);
 
+#ifdef __cplusplus
+}
+#endif
+
 /* @} */
\ No newline at end of file
@@ -26,6 +26,10 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /** Length of emergency reset. */
 #define LENGTH_EMERGENCY_RESET 10
 /** Length of reset the IOBC PCU. */
@@ -290,4 +294,8 @@ bool supervisor_get_version(supervisor_version_t * version);
  */
 bool supervisor_get_housekeeping(supervisor_housekeeping_t * housekeeping);
 
+#ifdef __cplusplus
+}
+#endif
+
 /* @} */
\ No newline at end of file
@@ -16,10 +16,17 @@
  */
 
 #include <checksum.h>
+#include <pthread.h>
 
 #define CRC8_POLYNOMIAL 0x07
 
 static uint8_t supervisor_crctable[256];
+static pthread_once_t supervisor_crctable_once = PTHREAD_ONCE_INIT;
+
+static void supervisor_prepare_crctable(void)
+{
+    checksum_prepare_LUTCRC8(CRC8_POLYNOMIAL, supervisor_crctable);
+}
 
 void checksum_prepare_LUTCRC8(uint8_t polynomial, uint8_t * LUT)
 {
@@ -111,7 +118,9 @@ uint8_t supervisor_calculate_CRC(const uint8_t * data, unsigned int length)
 {
     unsigned int i = 0;
     uint8_t crcvalue = 0;
-    checksum_prepare_LUTCRC8(CRC8_POLYNOMIAL, supervisor_crctable);
+
+    /* Built once, so the CRC is cheap and can run on several threads */
+    pthread_once(&supervisor_crctable_once, supervisor_prepare_crctable);
 
     for (i = 0; i < length; i++)
     {
@@ -16,8 +16,11 @@
 
 #include <supervisor.h>
 #include <checksum.h>
+#include <clock.h>
 #include <fcntl.h>
 #include <linux/spi/spidev.h>
+#include <metrics.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/ioctl.h>
@@ -86,7 +89,7 @@ static bool spi_comms(const uint8_t * tx_buffer, uint8_t * rx_buffer, uint16_t t
             perror("Can't send spi message ");
             return false;
         }
-        usleep(1000);
+        k_clock_sleep(1000000);
     }
 
     /**
@@ -111,10 +114,25 @@ static bool spi_comms(const uint8_t * tx_buffer, uint8_t * rx_buffer, uint16_t t
     return true;
 }
 
-static bool verify_checksum(const uint8_t * buffer, int buffer_length)
+/* Responses and checksum failures are counted per command */
+static int supervisor_metrics = -1;
+static pthread_once_t supervisor_metrics_once = PTHREAD_ONCE_INIT;
+
+static void supervisor_metrics_register(void)
+{
+    k_metrics_device("supervisor", &supervisor_metrics);
+}
+
+static bool verify_checksum(uint8_t cmd, const uint8_t * buffer, int buffer_length)
 {
     uint8_t checksum = supervisor_calculate_CRC(buffer + 1, buffer_length - 2);
-    return true ? (checksum == buffer[buffer_length - 1]) : false;
+    bool valid = (checksum == buffer[buffer_length - 1]);
+
+    pthread_once(&supervisor_metrics_once, supervisor_metrics_register);
+    k_metrics_record(supervisor_metrics, cmd,
+                     valid ? METRIC_SUCCESS : METRIC_CHECKSUM);
+
+    return valid;
 }
 
 bool supervisor_get_version(supervisor_version_t * version)
@@ -130,7 +148,7 @@ bool supervisor_get_version(supervisor_version_t * version)
         return false;
     }
 
-    usleep(10000);
+    k_clock_sleep(10000000);
 
     if (!spi_comms(bytesToSendObtainVersion, bytesToReceiveObtainVersion, LENGTH_TELEMETRY_GET_VERSION))
     {
@@ -138,7 +156,7 @@ bool supervisor_get_version(supervisor_version_t * version)
         return false;
     }
 
-    if (!verify_checksum(bytesToReceiveObtainVersion, LENGTH_TELEMETRY_GET_VERSION))
+    if (!verify_checksum(CMD_SUPERVISOR_OBTAIN_VERSION_CONFIG, bytesToReceiveObtainVersion, LENGTH_TELEMETRY_GET_VERSION))
     {
         printf("Checksum failed\n");
         return false;
@@ -162,7 +180,7 @@ bool supervisor_get_housekeeping(supervisor_housekeeping_t * housekeeping)
         return false;
     }
 
-    usleep(10000);
+    k_clock_sleep(10000000);
 
     if (!spi_comms(bytesToSendObtainHousekeepingTelemetry, bytesToReceiveObtainHousekeepingTelemetry, LENGTH_TELEMETRY_HOUSEKEEPING))
     {
@@ -170,7 +188,7 @@ bool supervisor_get_housekeeping(supervisor_housekeeping_t * housekeeping)
         return false;
     }
 
-    if (!verify_checksum(bytesToReceiveObtainHousekeepingTelemetry, LENGTH_TELEMETRY_HOUSEKEEPING))
+    if (!verify_checksum(CMD_SUPERVISOR_OBTAIN_HK_TELEMETRY, bytesToReceiveObtainHousekeepingTelemetry, LENGTH_TELEMETRY_HOUSEKEEPING))
     {
         printf("Checksum failed\n");
         return false;
@@ -22,6 +22,11 @@
 #pragma once
 
 #include <math.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /** \cond WE DO NOT WANT TO HAVE THESE IN OUR GENERATED DOCS */
 /* Radio command values */
@@ -48,6 +53,15 @@
 #define WATCHDOG_RESET              0xCC
 /** \endcond */
 
+/** Largest frame message the transmitter accepts, in bytes */
+#define RADIO_TX_MAX_SIZE 235
+/** Largest frame message the receiver delivers, in bytes */
+#define RADIO_RX_MAX_SIZE 200
+/** Received frames kept on ::RADIO_RX_TOPIC for subscribers which fall behind */
+#define RADIO_RX_TOPIC_DEPTH 16
+/** Number of call-sign pairs which can be registered with ::k_radio_callsigns_register */
+#define RADIO_CALLSIGN_PAIRS 8
+
 /**
  * Radio function return values
  */
@@ -122,7 +136,7 @@ typedef enum {
 typedef struct
 {
     uint8_t addr;       /**< I2C address of component */
-    uint16_t max_size;  /**< Maximum frame message size */
+    uint16_t max_size;  /**< Maximum frame message size (up to ::RADIO_TX_MAX_SIZE or ::RADIO_RX_MAX_SIZE) */
     uint16_t max_frames; /**< Maximum number of frames that can be in the buffer */
 } trx_prop;
 
@@ -154,6 +168,36 @@ typedef struct
     uint8_t ssid;
 } ax25_callsign;
 
+/** Longest encoded TX frame header: the command byte plus two AX.25 call-signs */
+#define RADIO_TX_HEADER_MAX (1 + 2 * sizeof(ax25_callsign))
+
+/**
+ * Pre-encoded TX frame header, built once with ::k_radio_tx_header and reused for every frame with the same call-signs
+ */
+typedef struct
+{
+    uint8_t len;                        /**< Encoded length */
+    uint8_t data[RADIO_TX_HEADER_MAX];  /**< Send command, then the override call-signs if any */
+} radio_tx_header;
+
+/**
+ * Frame for ::k_radio_send_frames
+ */
+typedef struct
+{
+    const radio_tx_header * header;     /**< Encoded header, or NULL for the default call-signs */
+    const uint8_t *         payload;    /**< Frame message */
+    int                     len;        /**< Message length, up to the transmitter's `max_size` */
+} radio_tx_frame;
+
+/**
+ * TRXVU microcontroller addressed by ::k_radio_passthrough
+ */
+typedef enum {
+    RADIO_MCU_TX,   /**< Transmitter */
+    RADIO_MCU_RX    /**< Receiver */
+} RadioMCU;
+
 /**
  * Receiver raw telemetry fields returned from ::RADIO_RX_TELEM_ALL telemetry request
  */
@@ -167,6 +211,34 @@ typedef struct
     uint16_t inst_signal_strength;  /**< Instantaneous signal strength of the signal at the receiver */
 } trxvu_rx_telem_raw;
 
+/**
+ * Transmitter telemetry in integer engineering units, from ::k_radio_tx_telem_eng
+ */
+typedef struct
+{
+    int32_t  reflected_mdbm;        /**< RF reflected power [10<sup>-3</sup> dBm] */
+    int32_t  forward_mdbm;          /**< RF forward power [10<sup>-3</sup> dBm] */
+    uint32_t reflected_nw;          /**< RF reflected power [nW] */
+    uint32_t forward_nw;            /**< RF forward power [nW] */
+    int32_t  supply_voltage_mv;     /**< Power bus voltage [mV] */
+    int32_t  supply_current_ua;     /**< Total supply current [uA] */
+    int32_t  temp_power_amp_mdegc;  /**< Power amplifier temperature [10<sup>-3</sup> degC] */
+    int32_t  temp_oscillator_mdegc; /**< Local oscillator temperature [10<sup>-3</sup> degC] */
+} trxvu_tx_telem_eng;
+
+/**
+ * Receiver telemetry in integer engineering units, from ::k_radio_rx_telem_eng
+ */
+typedef struct
+{
+    int32_t doppler_offset_hz;      /**< Doppler offset [Hz] */
+    int32_t supply_current_ua;      /**< Total supply current [uA] */
+    int32_t supply_voltage_mv;      /**< Power bus voltage [mV] */
+    int32_t temp_oscillator_mdegc;  /**< Local oscillator temperature [10<sup>-3</sup> degC] */
+    int32_t temp_power_amp_mdegc;   /**< Power amplifier temperature [10<sup>-3</sup> degC] */
+    int32_t signal_strength_mdbm;   /**< Signal strength [10<sup>-3</sup> dBm] */
+} trxvu_rx_telem_eng;
+
 /**
  * Transmitter or receiver uptime value (in seconds)
  */
@@ -215,6 +287,21 @@ typedef struct
     uint16_t signal_strength;       /**< ADC value of signal strength at receive time (convert with ::get_signal_strength)*/
 } radio_rx_header;
 
+/**
+ * Topic on which every frame taken by ::k_radio_recv is published, as a ::radio_rx_frame
+ * (see ::k_pubsub_find)
+ */
+#define RADIO_RX_TOPIC "trxvu-rx"
+
+/**
+ * Received frame as published on ::RADIO_RX_TOPIC. Only `header.msg_size` bytes of the message are sent.
+ */
+typedef struct
+{
+    radio_rx_header header;                     /**< Frame properties */
+    uint8_t         message[RADIO_RX_MAX_SIZE]; /**< Frame payload */
+} radio_rx_frame;
+
 /*
  * Public Functions
  */
@@ -246,6 +333,41 @@ KRadioStatus k_radio_watchdog_stop(void);
  */
 KRadioStatus k_radio_send_override(ax25_callsign to, ax25_callsign from, char * buffer, int len, uint8_t * response);
 
+/**
+ * Encode a TX frame header once, to be shared by any number of ::radio_tx_frame
+ * @param [out] header Header to fill in
+ * @param [in] to AX.25 call-sign for message sender, or NULL for the defaults
+ * @param [in] from AX.25 call-sign for message destination, or NULL for the defaults
+ * @return KRadioStatus `RADIO_OK` on success, `RADIO_ERROR_CONFIG` if only one call-sign is given
+ */
+KRadioStatus k_radio_tx_header(radio_tx_header * header, const ax25_callsign * to, const ax25_callsign * from);
+
+/**
+ * Send a batch of frames to the transmit buffer
+ *
+ * Frames go out back to back, each as a single bus write of its header and payload. The transmitter reports its free
+ * buffer slots after every frame, and the batch stops early once they run out, so bulk downlink can be queued at line
+ * rate by calling again with the unsent frames.
+ *
+ * @param [in] frames Frames to send, in order
+ * @param [in] count Number of frames
+ * @param [out] sent Number of frames accepted by the transmitter
+ * @param [out] remaining Free TX buffer slots after the last frame sent (may be NULL)
+ * @return KRadioStatus `RADIO_OK` if the batch went out or the buffer filled up, otherwise error
+ */
+KRadioStatus k_radio_send_frames(const radio_tx_frame * frames, int count, int * sent, uint8_t * remaining);
+
+/**
+ * Pass a raw command through to the transmitter or receiver
+ * @param [in] mcu Microcontroller to address
+ * @param [in] tx Command packet to send
+ * @param [in] tx_len Length of command packet
+ * @param [out] rx Storage for the response (may be NULL if `rx_len` is 0)
+ * @param [in] rx_len Expected response length
+ * @return KRadioStatus `RADIO_OK` on success, otherwise error
+ */
+KRadioStatus k_radio_passthrough(RadioMCU mcu, const uint8_t * tx, int tx_len, uint8_t * rx, int rx_len);
+
 /**
  * Set the automatic periodic beacon, but use the specified call-signs instead of the defaults
  * @param [in] to AX.25 call-sign for message sender
@@ -255,6 +377,52 @@ KRadioStatus k_radio_send_override(ax25_callsign to, ax25_callsign from, char *
  */
 KRadioStatus k_radio_set_beacon_override(ax25_callsign to, ax25_callsign from, radio_tx_beacon beacon);
 
+/**
+ * Register a pair of override call-signs for repeated use
+ *
+ * The pair is encoded once into a send header. Frames and beacons sent with the returned handle copy that header as
+ * is, rather than repacking the call-signs on every call. Registering a pair which is already known returns its
+ * existing handle.
+ *
+ * @param [in] to AX.25 call-sign for message sender
+ * @param [in] from AX.25 call-sign for message destination
+ * @param [out] handle Handle for the pair
+ * @return KRadioStatus `RADIO_OK` on success, `RADIO_ERROR` if all ::RADIO_CALLSIGN_PAIRS are in use
+ */
+KRadioStatus k_radio_callsigns_register(const ax25_callsign * to, const ax25_callsign * from, int * handle);
+
+/**
+ * Copy out the encoded header of a registered call-sign pair, for use in a ::radio_tx_frame
+ * @param [in] handle Handle from ::k_radio_callsigns_register
+ * @param [out] header Storage for the header
+ * @return KRadioStatus `RADIO_OK` on success, `RADIO_ERROR_CONFIG` if the handle is not registered
+ */
+KRadioStatus k_radio_callsigns_header(int handle, radio_tx_header * header);
+
+/**
+ * Forget all registered call-sign pairs. Existing handles become invalid, and stay invalid once pairs are registered
+ * again.
+ */
+void k_radio_callsigns_clear(void);
+
+/**
+ * Send a message to the transmit buffer using a registered call-sign pair
+ * @param [in] handle Handle from ::k_radio_callsigns_register
+ * @param [in] buffer Pointer to message to send
+ * @param [in] len Length of message to send
+ * @param [out] response Pointer to storage area for response byte
+ * @return KRadioStatus `RADIO_OK` on success, otherwise error
+ */
+KRadioStatus k_radio_send_callsigns(int handle, char * buffer, int len, uint8_t * response);
+
+/**
+ * Set the automatic periodic beacon using a registered call-sign pair
+ * @param [in] handle Handle from ::k_radio_callsigns_register
+ * @param [in] beacon ::radio_tx_beacon to send
+ * @return KRadioStatus `RADIO_OK` on success, otherwise error
+ */
+KRadioStatus k_radio_set_beacon_callsigns(int handle, radio_tx_beacon beacon);
+
 /**
  * Clear/deactivate the automatic periodic beacon
  * @return KRadioStatus `RADIO_OK` on success, otherwise error
@@ -264,8 +432,12 @@ KRadioStatus k_radio_clear_beacon(void);
 /**
  *  @name Telemetry Conversion Functions
  *  Convert raw ADC values into human-readable units
+ *
+ *  The integer variants give the same values in smaller units, and need no floating point. When built with
+ *  `KUBOS_FIXED_POINT` (for processors without an FPU) only the integer variants are available.
  */
 /**@{*/
+#ifndef KUBOS_FIXED_POINT
 /**
  * @param [in] raw Raw ADC value
  * @return Voltage in volts
@@ -301,6 +473,54 @@ float get_rf_power_dbm(uint16_t raw);
  * @return RF reflected power in milliwatts
  */
 float get_rf_power_mw(uint16_t raw);
+#endif
+/**
+ * @param [in] raw Raw ADC value
+ * @return Voltage in millivolts
+ */
+int32_t get_voltage_mv(uint16_t raw);
+/**
+ * @param [in] raw Raw ADC value
+ * @return Current in microamps
+ */
+int32_t get_current_ua(uint16_t raw);
+/**
+ * @param [in] raw Raw ADC value
+ * @return Temperature in thousandths of a degree Celsius
+ */
+int32_t get_temperature_mdegc(uint16_t raw);
+/**
+ * @param [in] raw Raw ADC value
+ * @return Doppler shift in hertz
+ */
+int32_t get_doppler_offset_hz(uint16_t raw);
+/**
+ * @param [in] raw Raw ADC value
+ * @return Received signal strength power in thousandths of a decibel-milliwatt
+ */
+int32_t get_signal_strength_mdbm(uint16_t raw);
+/**
+ * @param [in] raw Raw ADC value
+ * @return RF reflected power in thousandths of a decibel-milliwatt (`INT32_MIN` for no power)
+ */
+int32_t get_rf_power_mdbm(uint16_t raw);
+/**
+ * @param [in] raw Raw ADC value
+ * @return RF reflected power in nanowatts
+ */
+uint32_t get_rf_power_nw(uint16_t raw);
+/**
+ * Convert all transmitter telemetry to engineering units, with integer arithmetic only
+ * @param [in] raw Raw telemetry
+ * @param [out] eng Converted telemetry
+ */
+void k_radio_tx_telem_eng(const trxvu_tx_telem_raw * raw, trxvu_tx_telem_eng * eng);
+/**
+ * Convert all receiver telemetry to engineering units, with integer arithmetic only
+ * @param [in] raw Raw telemetry
+ * @param [out] eng Converted telemetry
+ */
+void k_radio_rx_telem_eng(const trxvu_rx_telem_raw * raw, trxvu_rx_telem_eng * eng);
 /**@}*/
 
 /*
@@ -309,6 +529,10 @@ float get_rf_power_mw(uint16_t raw);
 
 /**
  * Initialize the radio interface
+ *
+ * Frames are staged in fixed buffers sized for the largest frame each side
+ * supports, so sending and receiving never allocate memory.
+ *
  * @param [in] bus The I2C bus device the radio is connected to
  * @param [in] tx The transmitter's properties
  * @param [in] rx The receiver's properties
@@ -344,6 +568,9 @@ KRadioStatus k_radio_reset(KRadioReset type);
 KRadioStatus k_radio_send(char * buffer, int len, uint8_t * response);
 /**
  * Receive a message from the radio's receive buffer
+ *
+ * The frame is also published on ::RADIO_RX_TOPIC, so any number of consumers in the process can share one read.
+ *
  * @param [out] frame Pointer where the header properties should be stored
  * @param [out] message Pointer to where the message payload should be stored
  * @param [out] len Length of the received message
@@ -466,14 +693,31 @@ KRadioStatus kprv_radio_rx_reset(KRadioReset type);
 /**
  * File descriptor for the radio's I2C bus
  */
-int radio_bus;
+extern int radio_bus;
 /**
  * Radio transmitter properties
  */
-trx_prop radio_tx;
+extern trx_prop radio_tx;
 /**
  * Radio receiver properties
  */
-trx_prop radio_rx;
+extern trx_prop radio_rx;
+/**
+ * Critical bus budget charged while draining received frames and kicking
+ * the watchdogs, so bulk traffic on the bus can't delay them
+ */
+extern int radio_critical_budget;
+/**
+ * Bus budget charged by passthrough commands
+ */
+extern int radio_bulk_budget;
+/**
+ * Topic id for ::RADIO_RX_TOPIC
+ */
+extern int radio_rx_topic;
+
+#ifdef __cplusplus
+}
+#endif
 
 /* @} */
@@ -14,19 +14,49 @@
  * limitations under the License.
  */
 
+#include <bus-budget.h>
+#include <bus-worker.h>
+#include <clock.h>
+#include <device-policy.h>
+#include <governor.h>
 #include <i2c.h>
+#include <metrics.h>
+#include <pubsub.h>
 #include <trxvu.h>
 #include <stdio.h>
+#include <thread-policy.h>
+#include <thread-stats.h>
 #include <unistd.h>
 
 int radio_bus = 0;
-uint16_t wd_timeout = 0;
+static uint16_t wd_timeout = 0;
 trx_prop radio_tx;
 trx_prop radio_rx;
+int radio_critical_budget = -1;
+int radio_bulk_budget = -1;
+int radio_rx_topic = -1;
+static uint64_t rx_topic_storage[K_PUBSUB_STORAGE(sizeof(radio_rx_frame),
+                                                  RADIO_RX_TOPIC_DEPTH)];
+static const k_budget_config critical_budget_config = {.critical = true };
+
+/*
+ * Health probes used while the transmitter's or receiver's circuit breaker
+ * is open
+ */
+static void kprv_radio_tx_probe(void)
+{
+    kprv_radio_tx_watchdog_kick();
+}
+
+static void kprv_radio_rx_probe(void)
+{
+    kprv_radio_rx_watchdog_kick();
+}
 
 KRadioStatus k_radio_init(char * bus, trx_prop tx, trx_prop rx, uint16_t timeout)
 {
-    if (bus == NULL)
+    if (bus == NULL || tx.max_size > RADIO_TX_MAX_SIZE
+        || rx.max_size > RADIO_RX_MAX_SIZE)
     {
         return RADIO_ERROR_CONFIG;
     }
@@ -43,11 +73,38 @@ KRadioStatus k_radio_init(char * bus, trx_prop tx, trx_prop rx, uint16_t timeout
     radio_tx = tx;
     radio_rx = rx;
 
+    /* The transmitter and receiver are separate I2C devices */
+    k_policy_attach("trxvu-tx", radio_bus, radio_tx.addr, NULL,
+                    kprv_radio_tx_probe);
+    k_policy_attach("trxvu-rx", radio_bus, radio_rx.addr, NULL,
+                    kprv_radio_rx_probe);
+
+    k_bus_attach("trxvu", bus);
+
+    int metrics;
+    if (k_metrics_device("trxvu", &metrics) == METRICS_OK)
+    {
+        k_metrics_attach(metrics, radio_bus, radio_tx.addr);
+        k_metrics_attach(metrics, radio_bus, radio_rx.addr);
+    }
+
+    k_budget_register("trxvu", &critical_budget_config,
+                      &radio_critical_budget);
+    k_budget_register("trxvu-bulk", NULL, &radio_bulk_budget);
+
+    k_pubsub_topic(RADIO_RX_TOPIC, sizeof(radio_rx_frame),
+                   RADIO_RX_TOPIC_DEPTH, rx_topic_storage,
+                   K_PUBSUB_STORAGE(sizeof(radio_rx_frame),
+                                    RADIO_RX_TOPIC_DEPTH),
+                   &radio_rx_topic);
+
     return RADIO_OK;
 }
 
 void k_radio_terminate()
 {
+    k_policy_detach(radio_bus, radio_tx.addr);
+    k_policy_detach(radio_bus, radio_rx.addr);
     k_i2c_terminate(&radio_bus);
 
     return;
@@ -108,19 +165,43 @@ KRadioStatus k_radio_watchdog_kick()
 void * kprv_radio_watchdog_thread(void * args)
 {
     KRadioStatus status;
+    int          gov;
+
+    k_thread_stats_register("trxvu-watchdog",
+                            (uint32_t) (wd_timeout / 3) * 1000);
+    /* Kicks may slow down in low power modes, but stay well inside the timeout */
+    if (k_gov_register("trxvu-watchdog", (uint32_t) (wd_timeout / 3) * 1000,
+                       (uint32_t) wd_timeout * 1000 / 2, &gov)
+        != GOV_OK)
+    {
+        gov = -1;
+    }
+    pthread_cleanup_push(k_thread_stats_unregister, NULL);
+    k_budget_enter(radio_critical_budget);
 
     while (1)
     {
+        k_thread_stats_wakeup();
+
         kprv_radio_tx_watchdog_kick();
         kprv_radio_rx_watchdog_kick();
 
-        sleep(wd_timeout / 3);
+        if (gov < 0)
+        {
+            k_clock_sleep((uint64_t) (wd_timeout / 3) * K_CLOCK_NS_PER_SEC);
+        }
+        else
+        {
+            k_gov_sleep(gov);
+        }
     }
 
+    pthread_cleanup_pop(1);
+
     return NULL;
 }
 
-pthread_t handle_watchdog = { 0 };
+static pthread_t handle_watchdog = { 0 };
 
 KRadioStatus k_radio_watchdog_start()
 {
@@ -138,8 +219,9 @@ KRadioStatus k_radio_watchdog_start()
         return RADIO_OK;
     }
 
-    if (pthread_create(&handle_watchdog, NULL, kprv_radio_watchdog_thread, NULL)
-        != 0)
+    if (k_thread_create("trxvu-watchdog", &handle_watchdog,
+                        kprv_radio_watchdog_thread, NULL)
+        != THREAD_POLICY_OK)
     {
         perror("Failed to create TRXVU watchdog thread");
         handle_watchdog = 0;
@@ -203,6 +285,7 @@ KRadioStatus k_radio_get_telemetry(radio_telem * buffer, RadioTelemType type)
     }
 }
 
+#ifndef KUBOS_FIXED_POINT
 float get_voltage(uint16_t raw) {return raw * 0.00488;}
 
 float get_current(uint16_t raw) {return raw * 0.16643964;}
@@ -215,4 +298,114 @@ float get_signal_strength(uint16_t raw) {return raw * 0.03 - 152;}
 
 float get_rf_power_dbm(uint16_t raw) {return 20 * log10(raw * 0.00767);}
 
-float get_rf_power_mw(uint16_t raw) {return raw * raw * powf(10, -2) * 0.00005887;}
+float get_rf_power_mw(uint16_t raw) {return raw * (double) raw * powf(10, -2) * 0.00005887;}
+#endif
+
+/*
+ * Integer conversions. Each scale factor is a fixed-point constant folded at
+ * compile time, so these only use integer multiplies and shifts.
+ */
+#define RADIO_Q16(x) ((int64_t) ((x) * 65536.0 + ((x) < 0 ? -0.5 : 0.5)))
+#define RADIO_Q32(x) ((int64_t) ((x) * 4294967296.0 + ((x) < 0 ? -0.5 : 0.5)))
+
+/* Scale a raw value and add an offset (both Q32.32 in the result's units), rounding */
+static inline int32_t kprv_radio_scale(uint32_t raw, int64_t scale_q32,
+                                       int64_t offset_q32)
+{
+    return (int32_t) ((raw * scale_q32 + offset_q32 + (1LL << 31)) >> 32);
+}
+
+/* log2 in Q16.16 of a non-zero value, one fraction bit per squaring */
+static int32_t kprv_radio_log2_q16(uint32_t x)
+{
+    int      msb    = 31 - __builtin_clz(x);
+    int32_t  result = msb << 16;
+    uint64_t y;
+
+    /* x / 2^msb, which is in [1, 2), as Q2.30 */
+    y = (uint64_t) x << (30 - msb);
+
+    for (int32_t bit = 1 << 15; bit != 0; bit >>= 1)
+    {
+        y = (y * y) >> 30;
+        if (y >= (2ULL << 30))
+        {
+            y >>= 1;
+            result += bit;
+        }
+    }
+
+    return result;
+}
+
+int32_t get_voltage_mv(uint16_t raw)
+{
+    return kprv_radio_scale(raw, RADIO_Q32(4.88), 0);
+}
+
+int32_t get_current_ua(uint16_t raw)
+{
+    return kprv_radio_scale(raw, RADIO_Q32(166.43964), 0);
+}
+
+int32_t get_temperature_mdegc(uint16_t raw)
+{
+    return kprv_radio_scale(raw, RADIO_Q32(-76.69), RADIO_Q32(195603.7));
+}
+
+int32_t get_doppler_offset_hz(uint16_t raw)
+{
+    return kprv_radio_scale(raw, RADIO_Q32(13.352), RADIO_Q32(-22300.0));
+}
+
+int32_t get_signal_strength_mdbm(uint16_t raw)
+{
+    return raw * 30 - 152000;
+}
+
+int32_t get_rf_power_mdbm(uint16_t raw)
+{
+    if (raw == 0)
+    {
+        return INT32_MIN;
+    }
+
+    /* 20 log10(raw * 0.00767) = 20 log10(2) log2(raw) + 20 log10(0.00767) */
+    return (int32_t) (((int64_t) kprv_radio_log2_q16(raw)
+                           * RADIO_Q16(6020.599913279624)
+                       + RADIO_Q32(-42304.09272102039)
+                       + (1LL << 31))
+                      >> 32);
+}
+
+uint32_t get_rf_power_nw(uint16_t raw)
+{
+    /* Unsigned, since raw^2 * 0.5887 as Q32.32 needs all 64 bits */
+    return (uint32_t) (((uint64_t) raw * raw * (uint64_t) RADIO_Q32(0.5887)
+                        + (1ULL << 31))
+                       >> 32);
+}
+
+void k_radio_tx_telem_eng(const trxvu_tx_telem_raw * raw,
+                          trxvu_tx_telem_eng * eng)
+{
+    eng->reflected_mdbm        = get_rf_power_mdbm(raw->inst_RF_reflected);
+    eng->forward_mdbm          = get_rf_power_mdbm(raw->inst_RF_forward);
+    eng->reflected_nw          = get_rf_power_nw(raw->inst_RF_reflected);
+    eng->forward_nw            = get_rf_power_nw(raw->inst_RF_forward);
+    eng->supply_voltage_mv     = get_voltage_mv(raw->supply_voltage);
+    eng->supply_current_ua     = get_current_ua(raw->supply_current);
+    eng->temp_power_amp_mdegc  = get_temperature_mdegc(raw->temp_power_amp);
+    eng->temp_oscillator_mdegc = get_temperature_mdegc(raw->temp_oscillator);
+}
+
+void k_radio_rx_telem_eng(const trxvu_rx_telem_raw * raw,
+                          trxvu_rx_telem_eng * eng)
+{
+    eng->doppler_offset_hz     = get_doppler_offset_hz(raw->inst_doppler_offset);
+    eng->supply_current_ua     = get_current_ua(raw->supply_current);
+    eng->supply_voltage_mv     = get_voltage_mv(raw->supply_voltage);
+    eng->temp_oscillator_mdegc = get_temperature_mdegc(raw->temp_oscillator);
+    eng->temp_power_amp_mdegc  = get_temperature_mdegc(raw->temp_power_amp);
+    eng->signal_strength_mdbm  = get_signal_strength_mdbm(raw->inst_signal_strength);
+}
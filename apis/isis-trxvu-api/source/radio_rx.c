@@ -14,18 +14,16 @@
  * limitations under the License.
  */
 
+#include <bus-budget.h>
 #include <i2c.h>
+#include <pubsub.h>
 #include <trxvu.h>
 #include <stdio.h>
 #include <string.h>
 
-KRadioStatus k_radio_recv(radio_rx_header * frame, uint8_t * message, uint8_t * len)
+static KRadioStatus kprv_radio_recv(radio_rx_header * frame, uint8_t * message,
+                                    uint8_t * len)
 {
-    if (frame == NULL || message == NULL)
-    {
-        return RADIO_ERROR_CONFIG;
-    }
-
     KRadioStatus status = RADIO_OK;
     uint16_t     count  = 0;
 
@@ -61,6 +59,28 @@ KRadioStatus k_radio_recv(radio_rx_header * frame, uint8_t * message, uint8_t *
         return status;
     }
 
+    radio_rx_frame copy;
+
+    copy.header = *frame;
+    memcpy(copy.message, message, frame->msg_size);
+    k_pubsub_publish(radio_rx_topic, &copy,
+                     sizeof(radio_rx_header) + frame->msg_size);
+
+    return status;
+}
+
+KRadioStatus k_radio_recv(radio_rx_header * frame, uint8_t * message, uint8_t * len)
+{
+    if (frame == NULL || message == NULL)
+    {
+        return RADIO_ERROR_CONFIG;
+    }
+
+    int          previous = k_budget_enter(radio_critical_budget);
+    KRadioStatus status   = kprv_radio_recv(frame, message, len);
+
+    k_budget_leave(previous);
+
     return status;
 }
 
@@ -216,22 +236,28 @@ KRadioStatus kprv_radio_rx_get_frame(radio_rx_header * frame, uint8_t * message,
         return RADIO_ERROR;
     }
 
-    uint8_t * buffer = malloc(sizeof(radio_rx_header) + radio_rx.max_size);
+    uint8_t buffer[sizeof(radio_rx_header) + RADIO_RX_MAX_SIZE];
 
     status = k_i2c_read(radio_bus, radio_rx.addr, (char *) buffer,
             sizeof(radio_rx_header) + radio_rx.max_size);
     if (status != I2C_OK)
     {
         fprintf(stderr, "Failed to read radio RX frame: %d\n", status);
-        free(buffer);
         return RADIO_ERROR;
     }
 
-    radio_rx_header * temp = (radio_rx_header *) buffer;
+    radio_rx_header temp;
+    memcpy(&temp, buffer, sizeof(temp));
+
+    /* Never copy out more than was read */
+    if (temp.msg_size > radio_rx.max_size)
+    {
+        temp.msg_size = radio_rx.max_size;
+    }
 
-    frame->msg_size = temp->msg_size;
-    frame->doppler_offset = temp->doppler_offset;
-    frame->signal_strength = temp->signal_strength;
+    frame->msg_size = temp.msg_size;
+    frame->doppler_offset = temp.doppler_offset;
+    frame->signal_strength = temp.signal_strength;
 
     memcpy(message, buffer+sizeof(radio_rx_header), frame->msg_size);
 
@@ -240,6 +266,5 @@ KRadioStatus kprv_radio_rx_get_frame(radio_rx_header * frame, uint8_t * message,
         *len = frame->msg_size;
     }
 
-    free(buffer);
     return RADIO_OK;
 }
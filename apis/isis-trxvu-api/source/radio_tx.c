@@ -14,29 +14,45 @@
  * limitations under the License.
  */
 
+#include <bus-budget.h>
 #include <i2c.h>
 #include <trxvu.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 
-/* Public functions */
+/* Header for frames using the default call-signs */
+static const radio_tx_header default_header = {.len = 1, .data = { SEND_FRAME } };
 
-/* Send a message to the transmission buffer */
-KRadioStatus k_radio_send(char * buffer, int len, uint8_t * response)
-{
-    if (buffer == NULL || len < 1 || len > radio_tx.max_size || response == NULL)
-    {
-        return RADIO_ERROR_CONFIG;
-    }
+/*
+ * Registered call-sign pairs, encoded as override send headers. A handle is
+ * the slot plus the generation times RADIO_CALLSIGN_PAIRS; clearing moves to
+ * the next generation, so handles from before then stop working even once
+ * their slots are reused.
+ */
+#define CALLSIGN_GENERATIONS (INT_MAX / RADIO_CALLSIGN_PAIRS)
 
-    char * packet   = malloc(len + 1);
-    packet[0]       = SEND_FRAME;
+static radio_tx_header callsign_pairs[RADIO_CALLSIGN_PAIRS];
+static int             callsign_count      = 0;
+static int             callsign_generation = 0;
+static pthread_mutex_t callsign_lock       = PTHREAD_MUTEX_INITIALIZER;
 
-    memcpy(packet + 1, buffer, len);
+/*
+ * Write one frame (header and payload in a single transfer, as the
+ * transmitter requires) and read back the number of TX buffer slots left
+ */
+static KRadioStatus kprv_radio_tx_frame(const radio_tx_header * header,
+                                        const uint8_t * payload, int len,
+                                        uint8_t * remaining)
+{
+    uint8_t packet[RADIO_TX_HEADER_MAX + RADIO_TX_MAX_SIZE];
 
-    KI2CStatus status = k_i2c_write(radio_bus, radio_tx.addr, packet, len + 1);
-    free(packet);
+    memcpy(packet, header->data, header->len);
+    memcpy(packet + header->len, payload, len);
 
+    KI2CStatus status = k_i2c_write(radio_bus, radio_tx.addr, packet,
+                                    header->len + len);
     if (status != I2C_OK)
     {
         fprintf(stderr, "Failed to send radio TX frame: %d\n", status);
@@ -44,7 +60,7 @@ KRadioStatus k_radio_send(char * buffer, int len, uint8_t * response)
     }
 
     /* Read number of remaining TX buffer slots available */
-    status = k_i2c_read(radio_bus, radio_tx.addr, response, 1);
+    status = k_i2c_read(radio_bus, radio_tx.addr, remaining, 1);
     if (status != I2C_OK)
     {
         fprintf(stderr, "Failed to read radio TX slots remaining: %d\n",
@@ -55,71 +71,140 @@ KRadioStatus k_radio_send(char * buffer, int len, uint8_t * response)
     return RADIO_OK;
 }
 
+/* Public functions */
+
+/* Send a message to the transmission buffer */
+KRadioStatus k_radio_send(char * buffer, int len, uint8_t * response)
+{
+    if (buffer == NULL || len < 1 || len > radio_tx.max_size || response == NULL)
+    {
+        return RADIO_ERROR_CONFIG;
+    }
+
+    return kprv_radio_tx_frame(&default_header, (uint8_t *) buffer, len,
+                               response);
+}
+
 /* Send a message to the transmit buffer, but use non-default AX.25 call-signs
  */
 KRadioStatus k_radio_send_override(ax25_callsign to, ax25_callsign from,
                                    char * buffer, int len, uint8_t * response)
 {
+    radio_tx_header header;
 
     if (buffer == NULL || len < 1 || len > radio_tx.max_size || response == NULL)
     {
         return RADIO_ERROR_CONFIG;
     }
 
-    char * packet   = malloc(len + 15);
-    packet[0]       = SEND_AX25_OVERRIDE;
+    k_radio_tx_header(&header, &to, &from);
 
-    memcpy(packet + 1, &to, sizeof(ax25_callsign));
-    memcpy(packet + 8, &from, sizeof(ax25_callsign));
-    memcpy(packet + 15, buffer, len);
-
-    KI2CStatus status = k_i2c_write(radio_bus, radio_tx.addr, packet,
-                                    len + sizeof(ax25_callsign) * 2 + 1);
-    free(packet);
+    return kprv_radio_tx_frame(&header, (uint8_t *) buffer, len, response);
+}
 
-    if (status != I2C_OK)
+KRadioStatus k_radio_tx_header(radio_tx_header * header,
+                               const ax25_callsign * to,
+                               const ax25_callsign * from)
+{
+    if (header == NULL || (to == NULL) != (from == NULL))
     {
-        fprintf(stderr, "Failed to send radio TX frame (override): %d\n",
-                status);
-        return RADIO_ERROR;
+        return RADIO_ERROR_CONFIG;
     }
 
-    /* Read number of remaining TX buffer slots available */
-    status = k_i2c_read(radio_bus, radio_tx.addr, response, 1);
-    if (status != I2C_OK)
+    if (to == NULL)
     {
-        fprintf(stderr, "Failed to read radio TX slots remaining: %d\n",
-                status);
-        return RADIO_ERROR;
+        *header = default_header;
+        return RADIO_OK;
     }
 
+    header->data[0] = SEND_AX25_OVERRIDE;
+    memcpy(header->data + 1, to, sizeof(ax25_callsign));
+    memcpy(header->data + 1 + sizeof(ax25_callsign), from,
+           sizeof(ax25_callsign));
+    header->len = RADIO_TX_HEADER_MAX;
+
     return RADIO_OK;
 }
 
-/* Set automatic beacon message + rate (override callsigns) */
-KRadioStatus k_radio_set_beacon_override(ax25_callsign to, ax25_callsign from,
-                                         radio_tx_beacon beacon)
+KRadioStatus k_radio_send_frames(const radio_tx_frame * frames, int count,
+                                 int * sent, uint8_t * remaining)
+{
+    KRadioStatus status = RADIO_OK;
+    uint8_t      slots  = 0;
+    int          i;
+
+    if (frames == NULL || count < 0 || sent == NULL)
+    {
+        return RADIO_ERROR_CONFIG;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        const radio_tx_frame *  frame  = &frames[i];
+        const radio_tx_header * header = frame->header;
+
+        if (header == NULL)
+        {
+            header = &default_header;
+        }
+
+        if (frame->payload == NULL || frame->len < 1
+            || frame->len > radio_tx.max_size || header->len < 1
+            || header->len > RADIO_TX_HEADER_MAX)
+        {
+            status = RADIO_ERROR_CONFIG;
+            break;
+        }
+
+        status = kprv_radio_tx_frame(header, frame->payload, frame->len,
+                                     &slots);
+        if (status != RADIO_OK)
+        {
+            break;
+        }
+
+        if (slots == 0)
+        {
+            /* Buffer full: the rest waits for the next call */
+            i++;
+            break;
+        }
+    }
+
+    *sent = i;
+    if (remaining != NULL)
+    {
+        *remaining = slots;
+    }
+
+    return status;
+}
+
+/*
+ * Set the beacon using the call-signs encoded in an override header
+ * (the same order as SET_AX25_BEACON_OVERRIDE expects, after the interval)
+ */
+static KRadioStatus kprv_radio_tx_beacon_override(const radio_tx_header * header,
+                                                  radio_tx_beacon beacon)
 {
     /* Max rate of 3000 is specified in TRXVU datasheet */
-    if (beacon.interval > 3000 || beacon.msg == NULL || beacon.len < 1)
+    if (beacon.interval > 3000 || beacon.msg == NULL || beacon.len < 1
+        || beacon.len > RADIO_TX_MAX_SIZE)
     {
         return RADIO_ERROR_CONFIG;
     }
 
     KI2CStatus status;
-    char * packet   = malloc(beacon.len + sizeof(ax25_callsign) * 2 + 3);
+    char packet[RADIO_TX_MAX_SIZE + sizeof(ax25_callsign) * 2 + 3];
     packet[0] = SET_AX25_BEACON_OVERRIDE;
 
     memcpy(packet + 1, (void *) &beacon.interval, sizeof(beacon.interval));
-    memcpy(packet + 3, &to, sizeof(ax25_callsign));
-    memcpy(packet + 10, &from, sizeof(ax25_callsign));
+    memcpy(packet + 3, header->data + 1, sizeof(ax25_callsign) * 2);
     memcpy(packet + 17, beacon.msg, beacon.len);
 
     status = k_i2c_write(radio_bus, radio_tx.addr, packet,
                          beacon.len + sizeof(ax25_callsign) * 2 + 3);
 
-    free(packet);
-
     if (status != I2C_OK)
     {
         fprintf(stderr, "Failed to set radio TX beacon (override): %d\n",
@@ -130,6 +215,126 @@ KRadioStatus k_radio_set_beacon_override(ax25_callsign to, ax25_callsign from,
     return RADIO_OK;
 }
 
+/* Set automatic beacon message + rate (override callsigns) */
+KRadioStatus k_radio_set_beacon_override(ax25_callsign to, ax25_callsign from,
+                                         radio_tx_beacon beacon)
+{
+    radio_tx_header header;
+
+    k_radio_tx_header(&header, &to, &from);
+
+    return kprv_radio_tx_beacon_override(&header, beacon);
+}
+
+KRadioStatus k_radio_callsigns_register(const ax25_callsign * to,
+                                        const ax25_callsign * from,
+                                        int * handle)
+{
+    radio_tx_header header;
+    KRadioStatus    status = RADIO_OK;
+    int             i;
+
+    if (to == NULL || from == NULL || handle == NULL)
+    {
+        return RADIO_ERROR_CONFIG;
+    }
+
+    k_radio_tx_header(&header, to, from);
+
+    pthread_mutex_lock(&callsign_lock);
+
+    for (i = 0; i < callsign_count; i++)
+    {
+        if (memcmp(callsign_pairs[i].data, header.data, header.len) == 0)
+        {
+            break;
+        }
+    }
+
+    if (i == callsign_count)
+    {
+        if (callsign_count == RADIO_CALLSIGN_PAIRS)
+        {
+            status = RADIO_ERROR;
+        }
+        else
+        {
+            callsign_pairs[i] = header;
+            callsign_count++;
+        }
+    }
+
+    if (status == RADIO_OK)
+    {
+        *handle = callsign_generation * RADIO_CALLSIGN_PAIRS + i;
+    }
+
+    pthread_mutex_unlock(&callsign_lock);
+
+    return status;
+}
+
+KRadioStatus k_radio_callsigns_header(int handle, radio_tx_header * header)
+{
+    KRadioStatus status = RADIO_OK;
+
+    if (handle < 0 || header == NULL)
+    {
+        return RADIO_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&callsign_lock);
+
+    if (handle / RADIO_CALLSIGN_PAIRS != callsign_generation
+        || handle % RADIO_CALLSIGN_PAIRS >= callsign_count)
+    {
+        status = RADIO_ERROR_CONFIG;
+    }
+    else
+    {
+        *header = callsign_pairs[handle % RADIO_CALLSIGN_PAIRS];
+    }
+
+    pthread_mutex_unlock(&callsign_lock);
+
+    return status;
+}
+
+void k_radio_callsigns_clear(void)
+{
+    pthread_mutex_lock(&callsign_lock);
+    callsign_count      = 0;
+    callsign_generation = (callsign_generation + 1) % CALLSIGN_GENERATIONS;
+    pthread_mutex_unlock(&callsign_lock);
+}
+
+KRadioStatus k_radio_send_callsigns(int handle, char * buffer, int len,
+                                    uint8_t * response)
+{
+    radio_tx_header header;
+
+    if (k_radio_callsigns_header(handle, &header) != RADIO_OK
+        || buffer == NULL || len < 1 || len > radio_tx.max_size
+        || response == NULL)
+    {
+        return RADIO_ERROR_CONFIG;
+    }
+
+    return kprv_radio_tx_frame(&header, (uint8_t *) buffer, len, response);
+}
+
+KRadioStatus k_radio_set_beacon_callsigns(int handle, radio_tx_beacon beacon)
+{
+    radio_tx_header header;
+
+    if (k_radio_callsigns_header(handle, &header) != RADIO_OK)
+    {
+        return RADIO_ERROR_CONFIG;
+    }
+
+    return kprv_radio_tx_beacon_override(&header, beacon);
+}
+
 /* Stop/clear the automatic periodic beacon */
 KRadioStatus k_radio_clear_beacon(void)
 {
@@ -248,21 +453,19 @@ KRadioStatus kprv_radio_tx_reset(KRadioReset type)
 KRadioStatus kprv_radio_tx_set_beacon(uint16_t rate, char * buffer, int len)
 {
     /* Max rate of 3000 is specified in TRXVU datasheet */
-    if (rate > 3000 || buffer == NULL || len < 1)
+    if (rate > 3000 || buffer == NULL || len < 1 || len > RADIO_TX_MAX_SIZE)
     {
         return RADIO_ERROR_CONFIG;
     }
 
-    char * packet   = malloc(len + 3);
-    packet[0]       = SET_BEACON;
+    char packet[RADIO_TX_MAX_SIZE + 3];
+    packet[0] = SET_BEACON;
 
     memcpy(packet + 1, (void *) &rate, 2);
     memcpy(packet + 3, buffer, len);
 
     KI2CStatus status = k_i2c_write(radio_bus, radio_tx.addr, packet, len + 3);
 
-    free(packet);
-
     if (status != I2C_OK)
     {
         fprintf(stderr, "Failed to set radio TX beacon: %d\n", status);
@@ -355,3 +558,63 @@ KRadioStatus kprv_radio_tx_set_rate(RadioTXRate rate)
 
     return RADIO_OK;
 }
+
+static KRadioStatus kprv_radio_passthrough(uint8_t addr, const uint8_t * tx,
+                                           int tx_len, uint8_t * rx,
+                                           int rx_len)
+{
+    KI2CStatus status;
+
+    status = k_i2c_write(radio_bus, addr, (uint8_t *) tx, tx_len);
+    if (status != I2C_OK)
+    {
+        fprintf(stderr, "Failed to send radio passthrough packet: %d\n",
+                status);
+        return RADIO_ERROR;
+    }
+
+    if (rx_len != 0)
+    {
+        status = k_i2c_read(radio_bus, addr, rx, rx_len);
+        if (status != I2C_OK)
+        {
+            fprintf(stderr, "Failed to read radio passthrough response: %d\n",
+                    status);
+            return RADIO_ERROR;
+        }
+    }
+
+    return RADIO_OK;
+}
+
+KRadioStatus k_radio_passthrough(RadioMCU mcu, const uint8_t * tx, int tx_len,
+                                 uint8_t * rx, int rx_len)
+{
+    uint8_t addr;
+
+    if (tx == NULL || tx_len < 1 || (rx == NULL && rx_len != 0)
+        || (rx != NULL && rx_len == 0))
+    {
+        return RADIO_ERROR_CONFIG;
+    }
+
+    switch (mcu)
+    {
+        case RADIO_MCU_TX:
+            addr = radio_tx.addr;
+            break;
+        case RADIO_MCU_RX:
+            addr = radio_rx.addr;
+            break;
+        default:
+            return RADIO_ERROR_CONFIG;
+    }
+
+    int          previous = k_budget_enter(radio_bulk_budget);
+    KRadioStatus status
+        = kprv_radio_passthrough(addr, tx, tx_len, rx, rx_len);
+
+    k_budget_leave(previous);
+
+    return status;
+}
@@ -0,0 +1,492 @@
+/*
+ * Kubos TRXVU API
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Telemetry conversion benchmark
+ *
+ * Times the raw-to-engineering conversions over recorded telemetry frames and
+ * cross-checks them two ways:
+ *  - against the engineering values expected for each recorded frame
+ *  - for every possible raw value, bit for bit against the reference
+ *    conversions below (float variants), or to within one unit of them
+ *    (integer variants), so a faster implementation can be shown to change
+ *    nothing
+ *
+ * Usage: isis-trxvu-api-bench [iterations]
+ * Exits non-zero if any check fails.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <trxvu.h>
+
+#define DEFAULT_ITERATIONS 100000
+
+typedef float (*conversion)(uint16_t raw);
+typedef int64_t (*int_conversion)(uint16_t raw);
+typedef double (*int_reference)(uint16_t raw);
+
+#ifndef KUBOS_FIXED_POINT
+/* Reference conversions, from the TRXVU datasheet as first implemented */
+static float ref_voltage(uint16_t raw) {return raw * 0.00488;}
+static float ref_current(uint16_t raw) {return raw * 0.16643964;}
+static float ref_temperature(uint16_t raw) {return raw * -0.07669 + 195.6037;}
+static float ref_doppler_offset(uint16_t raw) {return raw * 13.352 - 22300;}
+static float ref_signal_strength(uint16_t raw) {return raw * 0.03 - 152;}
+static float ref_rf_power_dbm(uint16_t raw) {return 20 * log10(raw * 0.00767);}
+static float ref_rf_power_mw(uint16_t raw) {return raw * (double) raw * powf(10, -2) * 0.00005887;}
+
+static const struct {
+    const char * name;
+    conversion   convert;
+    conversion   reference;
+} conversions[] = {
+    { "get_voltage", get_voltage, ref_voltage },
+    { "get_current", get_current, ref_current },
+    { "get_temperature", get_temperature, ref_temperature },
+    { "get_doppler_offset", get_doppler_offset, ref_doppler_offset },
+    { "get_signal_strength", get_signal_strength, ref_signal_strength },
+    { "get_rf_power_dbm", get_rf_power_dbm, ref_rf_power_dbm },
+    { "get_rf_power_mw", get_rf_power_mw, ref_rf_power_mw },
+};
+
+#define NUM_CONVERSIONS (sizeof(conversions) / sizeof(conversions[0]))
+#endif
+
+/* The integer variants, and the same conversions in their units */
+static int64_t int_voltage(uint16_t raw) {return get_voltage_mv(raw);}
+static int64_t int_current(uint16_t raw) {return get_current_ua(raw);}
+static int64_t int_temperature(uint16_t raw) {return get_temperature_mdegc(raw);}
+static int64_t int_doppler_offset(uint16_t raw) {return get_doppler_offset_hz(raw);}
+static int64_t int_signal_strength(uint16_t raw) {return get_signal_strength_mdbm(raw);}
+static int64_t int_rf_power_dbm(uint16_t raw) {return get_rf_power_mdbm(raw);}
+static int64_t int_rf_power_mw(uint16_t raw) {return get_rf_power_nw(raw);}
+
+static double ref_voltage_mv(uint16_t raw) {return raw * 4.88;}
+static double ref_current_ua(uint16_t raw) {return raw * 166.43964;}
+static double ref_temperature_mdegc(uint16_t raw) {return raw * -76.69 + 195603.7;}
+static double ref_doppler_offset_hz(uint16_t raw) {return raw * 13.352 - 22300;}
+static double ref_signal_strength_mdbm(uint16_t raw) {return raw * 30.0 - 152000;}
+static double ref_rf_power_mdbm(uint16_t raw) {return 20000 * log10(raw * 0.00767);}
+static double ref_rf_power_nw(uint16_t raw) {return raw * (double) raw * 0.5887;}
+
+static const struct {
+    const char *   name;
+    int_conversion convert;
+    int_reference  reference;
+} int_conversions[] = {
+    { "get_voltage_mv", int_voltage, ref_voltage_mv },
+    { "get_current_ua", int_current, ref_current_ua },
+    { "get_temperature_mdegc", int_temperature, ref_temperature_mdegc },
+    { "get_doppler_offset_hz", int_doppler_offset, ref_doppler_offset_hz },
+    { "get_signal_strength_mdbm", int_signal_strength, ref_signal_strength_mdbm },
+    { "get_rf_power_mdbm", int_rf_power_dbm, ref_rf_power_mdbm },
+    { "get_rf_power_nw", int_rf_power_mw, ref_rf_power_nw },
+};
+
+#define NUM_INT_CONVERSIONS (sizeof(int_conversions) / sizeof(int_conversions[0]))
+
+/* Recorded frames, with the engineering values the datasheet gives for them */
+static const struct {
+    trxvu_tx_telem_raw raw;
+    float reflected_dbm, forward_mw, voltage, current, temp_pa, temp_osc;
+} tx_frames[] = {
+    { { 63, 72, 1634, 290, 2228, 2224 },
+      -6.31728, 0.00305182, 7.97392, 48.2675, 24.7384, 25.0451 },
+    { { 0, 1450, 1650, 410, 2150, 2190 },
+      -INFINITY, 1.23774, 8.052, 68.2403, 30.7202, 27.6526 },
+    { { 120, 2890, 1620, 620, 2010, 2105 },
+      -0.720468, 4.91688, 7.9056, 103.193, 41.4568, 34.1713 },
+};
+
+static const struct {
+    trxvu_rx_telem_raw raw;
+    float doppler, current, voltage, temp_osc, temp_pa, signal;
+} rx_frames[] = {
+    { { 2069, 288, 1634, 2240, 2245, 1153 },
+      5325.29, 47.9346, 7.97392, 23.8181, 23.4347, -117.41 },
+    { { 1700, 150, 1640, 2230, 2235, 3400 },
+      398.4, 24.9659, 8.0032, 24.585, 24.2016, -50.0 },
+    { { 1, 140, 1660, 2210, 2250, 4095 },
+      -22286.6, 23.3015, 8.1008, 26.1188, 23.0512, -29.15 },
+};
+
+#define NUM_TX_FRAMES (sizeof(tx_frames) / sizeof(tx_frames[0]))
+#define NUM_RX_FRAMES (sizeof(rx_frames) / sizeof(rx_frames[0]))
+
+/* Keep the compiler from dropping the timed conversions */
+static volatile float   sink;
+static volatile int64_t int_sink;
+
+static int failures = 0;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void check_value(const char * what, int frame, float actual,
+                        float expected)
+{
+    if (isinf(expected) ? actual == expected
+                        : fabsf(actual - expected)
+                              <= fmaxf(fabsf(expected) * 1e-5f, 1e-4f))
+    {
+        return;
+    }
+
+    printf("FAIL: %s frame %d: %g, expected %g\n", what, frame, actual,
+           expected);
+    failures++;
+}
+
+/* Integer results are in 1/scale of the expected value's units */
+static void check_int_value(const char * what, int frame, int64_t actual,
+                            float expected, double scale)
+{
+    double scaled = expected * scale;
+
+    if (isinf(expected) ? actual == INT32_MIN
+                        : fabs(actual - scaled) <= 1 + fabs(scaled) * 1e-5)
+    {
+        return;
+    }
+
+    printf("FAIL: %s frame %d: %lld, expected %g\n", what, frame,
+           (long long) actual, scaled);
+    failures++;
+}
+
+static void check_frames(void)
+{
+    trxvu_tx_telem_eng tx_eng;
+    trxvu_rx_telem_eng rx_eng;
+
+    for (int i = 0; i < NUM_TX_FRAMES; i++)
+    {
+        const trxvu_tx_telem_raw * raw = &tx_frames[i].raw;
+
+#ifndef KUBOS_FIXED_POINT
+        check_value("TX reflected", i, get_rf_power_dbm(raw->inst_RF_reflected),
+                    tx_frames[i].reflected_dbm);
+        check_value("TX forward", i, get_rf_power_mw(raw->inst_RF_forward),
+                    tx_frames[i].forward_mw);
+        check_value("TX voltage", i, get_voltage(raw->supply_voltage),
+                    tx_frames[i].voltage);
+        check_value("TX current", i, get_current(raw->supply_current),
+                    tx_frames[i].current);
+        check_value("TX PA temp", i, get_temperature(raw->temp_power_amp),
+                    tx_frames[i].temp_pa);
+        check_value("TX osc temp", i, get_temperature(raw->temp_oscillator),
+                    tx_frames[i].temp_osc);
+#endif
+
+        k_radio_tx_telem_eng(raw, &tx_eng);
+        check_int_value("TX reflected (int)", i, tx_eng.reflected_mdbm,
+                        tx_frames[i].reflected_dbm, 1000);
+        check_int_value("TX forward (int)", i, tx_eng.forward_nw,
+                        tx_frames[i].forward_mw, 1e6);
+        check_int_value("TX voltage (int)", i, tx_eng.supply_voltage_mv,
+                        tx_frames[i].voltage, 1000);
+        check_int_value("TX current (int)", i, tx_eng.supply_current_ua,
+                        tx_frames[i].current, 1000);
+        check_int_value("TX PA temp (int)", i, tx_eng.temp_power_amp_mdegc,
+                        tx_frames[i].temp_pa, 1000);
+        check_int_value("TX osc temp (int)", i, tx_eng.temp_oscillator_mdegc,
+                        tx_frames[i].temp_osc, 1000);
+    }
+
+    for (int i = 0; i < NUM_RX_FRAMES; i++)
+    {
+        const trxvu_rx_telem_raw * raw = &rx_frames[i].raw;
+
+#ifndef KUBOS_FIXED_POINT
+        check_value("RX doppler", i, get_doppler_offset(raw->inst_doppler_offset),
+                    rx_frames[i].doppler);
+        check_value("RX current", i, get_current(raw->supply_current),
+                    rx_frames[i].current);
+        check_value("RX voltage", i, get_voltage(raw->supply_voltage),
+                    rx_frames[i].voltage);
+        check_value("RX osc temp", i, get_temperature(raw->temp_oscillator),
+                    rx_frames[i].temp_osc);
+        check_value("RX PA temp", i, get_temperature(raw->temp_power_amp),
+                    rx_frames[i].temp_pa);
+        check_value("RX signal", i,
+                    get_signal_strength(raw->inst_signal_strength),
+                    rx_frames[i].signal);
+#endif
+
+        k_radio_rx_telem_eng(raw, &rx_eng);
+        check_int_value("RX doppler (int)", i, rx_eng.doppler_offset_hz,
+                        rx_frames[i].doppler, 1);
+        check_int_value("RX current (int)", i, rx_eng.supply_current_ua,
+                        rx_frames[i].current, 1000);
+        check_int_value("RX voltage (int)", i, rx_eng.supply_voltage_mv,
+                        rx_frames[i].voltage, 1000);
+        check_int_value("RX osc temp (int)", i, rx_eng.temp_oscillator_mdegc,
+                        rx_frames[i].temp_osc, 1000);
+        check_int_value("RX PA temp (int)", i, rx_eng.temp_power_amp_mdegc,
+                        rx_frames[i].temp_pa, 1000);
+        check_int_value("RX signal (int)", i, rx_eng.signal_strength_mdbm,
+                        rx_frames[i].signal, 1000);
+    }
+}
+
+#ifndef KUBOS_FIXED_POINT
+/* Every raw value must convert to exactly the reference's bits */
+static void check_exhaustive(void)
+{
+    for (int c = 0; c < NUM_CONVERSIONS; c++)
+    {
+        int mismatches = 0;
+
+        for (uint32_t raw = 0; raw <= UINT16_MAX; raw++)
+        {
+            float actual   = conversions[c].convert(raw);
+            float expected = conversions[c].reference(raw);
+
+            if (memcmp(&actual, &expected, sizeof(float)) != 0)
+            {
+                if (mismatches == 0)
+                {
+                    printf("FAIL: %s(%u) = %a, reference %a\n",
+                           conversions[c].name, raw, actual, expected);
+                }
+                mismatches++;
+            }
+        }
+
+        if (mismatches != 0)
+        {
+            printf("FAIL: %s differs from the reference for %d raw values\n",
+                   conversions[c].name, mismatches);
+            failures++;
+        }
+    }
+}
+#endif
+
+/* Every raw value must convert to within one unit of the reference */
+static void check_exhaustive_int(void)
+{
+    for (int c = 0; c < NUM_INT_CONVERSIONS; c++)
+    {
+        int    mismatches = 0;
+        double worst      = 0;
+
+        for (uint32_t raw = 0; raw <= UINT16_MAX; raw++)
+        {
+            int64_t actual   = int_conversions[c].convert(raw);
+            double  expected = int_conversions[c].reference(raw);
+            double  error    = isinf(expected)
+                                   ? (actual == INT32_MIN ? 0 : INFINITY)
+                                   : fabs(actual - expected);
+
+            if (error > worst)
+            {
+                worst = error;
+            }
+
+            if (error > 1)
+            {
+                if (mismatches == 0)
+                {
+                    printf("FAIL: %s(%u) = %lld, reference %f\n",
+                           int_conversions[c].name, raw, (long long) actual,
+                           expected);
+                }
+                mismatches++;
+            }
+        }
+
+        printf("%-26s worst error %.3f units\n", int_conversions[c].name,
+               worst);
+
+        if (mismatches != 0)
+        {
+            printf("FAIL: %s is off by more than one unit for %d raw values\n",
+                   int_conversions[c].name, mismatches);
+            failures++;
+        }
+    }
+}
+
+static void bench_conversions(long iterations)
+{
+    uint16_t raw[NUM_TX_FRAMES * 6 + NUM_RX_FRAMES * 6];
+    int      count = 0;
+
+    /* Every raw field of the recorded frames */
+    for (int i = 0; i < NUM_TX_FRAMES; i++)
+    {
+        memcpy(raw + count, &tx_frames[i].raw, sizeof(trxvu_tx_telem_raw));
+        count += 6;
+    }
+    for (int i = 0; i < NUM_RX_FRAMES; i++)
+    {
+        memcpy(raw + count, &rx_frames[i].raw, sizeof(trxvu_rx_telem_raw));
+        count += 6;
+    }
+
+    printf("%-26s %12s\n", "conversion", "ns/call");
+
+#ifndef KUBOS_FIXED_POINT
+    for (int c = 0; c < NUM_CONVERSIONS; c++)
+    {
+        conversion convert = conversions[c].convert;
+        double     start   = now_ns();
+
+        for (long n = 0; n < iterations; n++)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                sink = convert(raw[i]);
+            }
+        }
+
+        printf("%-26s %12.2f\n", conversions[c].name,
+               (now_ns() - start) / ((double) iterations * count));
+    }
+#endif
+
+    for (int c = 0; c < NUM_INT_CONVERSIONS; c++)
+    {
+        int_conversion convert = int_conversions[c].convert;
+        double         start   = now_ns();
+
+        for (long n = 0; n < iterations; n++)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                int_sink = convert(raw[i]);
+            }
+        }
+
+        printf("%-26s %12.2f\n", int_conversions[c].name,
+               (now_ns() - start) / ((double) iterations * count));
+    }
+}
+
+static void bench_frames(long iterations)
+{
+    trxvu_tx_telem_eng tx_eng;
+    trxvu_rx_telem_eng rx_eng;
+    double             start;
+    double             ns;
+
+    printf("\n%-26s %12s %12s\n", "frame", "ns/frame", "ns/field");
+
+#ifndef KUBOS_FIXED_POINT
+    start = now_ns();
+    for (long n = 0; n < iterations; n++)
+    {
+        for (int i = 0; i < NUM_TX_FRAMES; i++)
+        {
+            const trxvu_tx_telem_raw * raw = &tx_frames[i].raw;
+
+            sink = get_rf_power_dbm(raw->inst_RF_reflected);
+            sink = get_rf_power_dbm(raw->inst_RF_forward);
+            sink = get_rf_power_mw(raw->inst_RF_reflected);
+            sink = get_rf_power_mw(raw->inst_RF_forward);
+            sink = get_voltage(raw->supply_voltage);
+            sink = get_current(raw->supply_current);
+            sink = get_temperature(raw->temp_power_amp);
+            sink = get_temperature(raw->temp_oscillator);
+        }
+    }
+    ns = (now_ns() - start) / ((double) iterations * NUM_TX_FRAMES);
+    printf("%-26s %12.2f %12.2f\n", "trxvu_tx_telem_raw", ns, ns / 8);
+
+    start = now_ns();
+    for (long n = 0; n < iterations; n++)
+    {
+        for (int i = 0; i < NUM_RX_FRAMES; i++)
+        {
+            const trxvu_rx_telem_raw * raw = &rx_frames[i].raw;
+
+            sink = get_doppler_offset(raw->inst_doppler_offset);
+            sink = get_current(raw->supply_current);
+            sink = get_voltage(raw->supply_voltage);
+            sink = get_temperature(raw->temp_oscillator);
+            sink = get_temperature(raw->temp_power_amp);
+            sink = get_signal_strength(raw->inst_signal_strength);
+        }
+    }
+    ns = (now_ns() - start) / ((double) iterations * NUM_RX_FRAMES);
+    printf("%-26s %12.2f %12.2f\n", "trxvu_rx_telem_raw", ns, ns / 6);
+#endif
+
+    start = now_ns();
+    for (long n = 0; n < iterations; n++)
+    {
+        for (int i = 0; i < NUM_TX_FRAMES; i++)
+        {
+            k_radio_tx_telem_eng(&tx_frames[i].raw, &tx_eng);
+            int_sink = tx_eng.supply_voltage_mv;
+        }
+    }
+    ns = (now_ns() - start) / ((double) iterations * NUM_TX_FRAMES);
+    printf("%-26s %12.2f %12.2f\n", "k_radio_tx_telem_eng", ns, ns / 8);
+
+    start = now_ns();
+    for (long n = 0; n < iterations; n++)
+    {
+        for (int i = 0; i < NUM_RX_FRAMES; i++)
+        {
+            k_radio_rx_telem_eng(&rx_frames[i].raw, &rx_eng);
+            int_sink = rx_eng.supply_voltage_mv;
+        }
+    }
+    ns = (now_ns() - start) / ((double) iterations * NUM_RX_FRAMES);
+    printf("%-26s %12.2f %12.2f\n", "k_radio_rx_telem_eng", ns, ns / 6);
+}
+
+int main(int argc, char * argv[])
+{
+    long iterations = DEFAULT_ITERATIONS;
+
+    if (argc > 1)
+    {
+        iterations = strtol(argv[1], NULL, 0);
+    }
+
+    check_frames();
+#ifndef KUBOS_FIXED_POINT
+    check_exhaustive();
+#endif
+    check_exhaustive_int();
+
+    bench_conversions(iterations);
+    bench_frames(iterations);
+
+    if (failures != 0)
+    {
+        printf("\n%d check(s) failed\n", failures);
+        return 1;
+    }
+
+    printf("\nAll conversions match the reference values\n");
+
+    return 0;
+}
@@ -16,6 +16,8 @@
  */
 
 #include <cmocka.h>
+#include <pubsub.h>
+#include <stdbool.h>
 #include <trxvu.h>
 
 #define TX_SIZE 100
@@ -48,6 +50,10 @@ trxvu_rx_telem_raw rx_telem = {.inst_doppler_offset  = 2069,
 
 trxvu_uptime uptime = 3456;
 
+/* Heap use counted by the malloc wrappers in sysfs.c */
+extern bool heap_trap;
+extern int  heap_calls;
+
 uint8_t tx_state = RADIO_STATE_IDLE_ON | RADIO_STATE_BEACON_ACTIVE
                    | (RADIO_STATE_RATE_4800 << 2);
 /* End of Test Data */
@@ -94,6 +100,17 @@ static void test_send_resp_null(void ** arg)
     assert_int_equal(ret, RADIO_ERROR_CONFIG);
 }
 
+static void test_send_max_size(void ** arg)
+{
+    char         data[TX_SIZE + 1] = { 0 };
+    uint8_t      resp;
+    KRadioStatus ret;
+
+    ret = k_radio_send(data, sizeof(data), &resp);
+
+    assert_int_equal(ret, RADIO_ERROR_CONFIG);
+}
+
 static void test_send_override(void ** arg)
 {
     char          data = 'A';
@@ -110,6 +127,121 @@ static void test_send_override(void ** arg)
     assert_int_equal(ret, RADIO_OK);
 }
 
+static void test_tx_header(void ** arg)
+{
+    ax25_callsign   to   = {.ascii = "GROUND", .ssid = 0 };
+    ax25_callsign   from = {.ascii = "SAT", .ssid = 1 };
+    radio_tx_header header;
+
+    assert_int_equal(k_radio_tx_header(&header, NULL, NULL), RADIO_OK);
+    assert_int_equal(header.len, 1);
+    assert_int_equal(header.data[0], SEND_FRAME);
+
+    assert_int_equal(k_radio_tx_header(&header, &to, &from), RADIO_OK);
+    assert_int_equal(header.len, RADIO_TX_HEADER_MAX);
+    assert_int_equal(header.data[0], SEND_AX25_OVERRIDE);
+    assert_memory_equal(header.data + 1, &to, sizeof(to));
+    assert_memory_equal(header.data + 1 + sizeof(to), &from, sizeof(from));
+
+    assert_int_equal(k_radio_tx_header(&header, &to, NULL),
+                     RADIO_ERROR_CONFIG);
+    assert_int_equal(k_radio_tx_header(NULL, NULL, NULL), RADIO_ERROR_CONFIG);
+}
+
+static void test_send_frames(void ** arg)
+{
+    ax25_callsign   to   = {.ascii = "GROUND", .ssid = 0 };
+    ax25_callsign   from = {.ascii = "SAT", .ssid = 1 };
+    radio_tx_header header;
+    uint8_t         full = 0;
+    uint8_t         slots;
+    int             sent;
+    KRadioStatus    ret;
+
+    radio_tx_frame frames[3]
+        = { {.header = NULL, .payload = (uint8_t *) test_message, .len = 8 },
+            {.header = &header, .payload = (uint8_t *) test_message, .len = 2 },
+            {.header = NULL, .payload = (uint8_t *) test_message, .len = 1 } };
+
+    k_radio_tx_header(&header, &to, &from);
+
+    expect_value(__wrap_write, cmd, SEND_FRAME);
+    will_return(__wrap_read, 1);
+    will_return(__wrap_read, &remaining);
+
+    /* The transmit buffer fills up after the second frame */
+    expect_value(__wrap_write, cmd, SEND_AX25_OVERRIDE);
+    will_return(__wrap_read, 1);
+    will_return(__wrap_read, &full);
+
+    heap_trap  = true;
+    heap_calls = 0;
+    ret = k_radio_send_frames(frames, 3, &sent, &slots);
+    heap_trap = false;
+
+    assert_int_equal(ret, RADIO_OK);
+    assert_int_equal(sent, 2);
+    assert_int_equal(slots, 0);
+    assert_int_equal(heap_calls, 0);
+}
+
+static void test_send_frames_bad(void ** arg)
+{
+    uint8_t      data[TX_SIZE + 1] = { 0 };
+    int          sent;
+    KRadioStatus ret;
+
+    radio_tx_frame frames[2]
+        = { {.header = NULL, .payload = data, .len = 1 },
+            {.header = NULL, .payload = data, .len = sizeof(data) } };
+
+    expect_value(__wrap_write, cmd, SEND_FRAME);
+    will_return(__wrap_read, 1);
+    will_return(__wrap_read, &remaining);
+
+    ret = k_radio_send_frames(frames, 2, &sent, NULL);
+
+    assert_int_equal(ret, RADIO_ERROR_CONFIG);
+    assert_int_equal(sent, 1);
+
+    assert_int_equal(k_radio_send_frames(NULL, 1, &sent, NULL),
+                     RADIO_ERROR_CONFIG);
+    assert_int_equal(k_radio_send_frames(frames, 1, NULL, NULL),
+                     RADIO_ERROR_CONFIG);
+}
+
+static void test_passthrough(void ** arg)
+{
+    uint8_t      cmd = GET_RX_FRAME_COUNT;
+    uint16_t     count;
+    KRadioStatus ret;
+
+    expect_value(__wrap_write, cmd, GET_RX_FRAME_COUNT);
+    will_return(__wrap_read, 2);
+    will_return(__wrap_read, &frame_count);
+
+    ret = k_radio_passthrough(RADIO_MCU_RX, &cmd, 1, (uint8_t *) &count,
+                              sizeof(count));
+
+    assert_int_equal(ret, RADIO_OK);
+    assert_int_equal(count, frame_count);
+}
+
+static void test_passthrough_null(void ** arg)
+{
+    uint8_t cmd = GET_RX_FRAME_COUNT;
+    uint8_t rx;
+
+    assert_int_equal(k_radio_passthrough(RADIO_MCU_TX, NULL, 1, NULL, 0),
+                     RADIO_ERROR_CONFIG);
+    assert_int_equal(k_radio_passthrough(RADIO_MCU_TX, &cmd, 1, NULL, 1),
+                     RADIO_ERROR_CONFIG);
+    assert_int_equal(k_radio_passthrough(RADIO_MCU_TX, &cmd, 1, &rx, 0),
+                     RADIO_ERROR_CONFIG);
+    assert_int_equal(k_radio_passthrough(2, &cmd, 1, NULL, 0),
+                     RADIO_ERROR_CONFIG);
+}
+
 static void test_recv(void ** arg)
 {
     radio_rx_header header = { 0 };
@@ -168,6 +300,89 @@ static void test_recv_len(void ** arg)
     assert_int_equal(len, header.msg_size);
 }
 
+static void test_recv_published(void ** arg)
+{
+    radio_rx_header header = { 0 };
+    uint8_t         buffer[RX_SIZE] = { 0 };
+    radio_rx_frame  published;
+    k_pubsub_sub    sub;
+    int             topic;
+    uint32_t        len;
+
+    assert_int_equal(k_pubsub_find(RADIO_RX_TOPIC, &topic), PUBSUB_OK);
+    assert_int_equal(k_pubsub_subscribe(topic, &sub), PUBSUB_OK);
+
+    expect_value(__wrap_write, cmd, GET_RX_FRAME_COUNT);
+    will_return(__wrap_read, 2);
+    will_return(__wrap_read, &frame_count);
+    expect_value(__wrap_write, cmd, GET_RX_FRAME);
+    will_return(__wrap_read, sizeof(radio_rx_header) + RX_SIZE);
+    will_return(__wrap_read, &test_header);
+    expect_value(__wrap_write, cmd, REMOVE_RX_FRAME);
+
+    assert_int_equal(k_radio_recv(&header, buffer, NULL), RADIO_OK);
+
+    /* Subscribers get the same frame without another bus read */
+    assert_int_equal(k_pubsub_read(&sub, &published, &len, NULL), PUBSUB_OK);
+    assert_int_equal(len, sizeof(radio_rx_header) + header.msg_size);
+    assert_int_equal(published.header.msg_size, header.msg_size);
+    assert_int_equal(published.header.signal_strength, header.signal_strength);
+    assert_memory_equal(published.message, buffer, header.msg_size);
+    assert_int_equal(k_pubsub_read(&sub, &published, &len, NULL), PUBSUB_EMPTY);
+
+    k_pubsub_unsubscribe(&sub);
+}
+
+static void test_no_heap(void ** arg)
+{
+    char            data[TX_SIZE] = { 0 };
+    uint8_t         resp;
+    radio_rx_header header = { 0 };
+    uint8_t         buffer[RX_SIZE] = { 0 };
+    KRadioStatus    send_ret;
+    KRadioStatus    recv_ret;
+
+    expect_value(__wrap_write, cmd, SEND_FRAME);
+    will_return(__wrap_read, 1);
+    will_return(__wrap_read, &remaining);
+
+    expect_value(__wrap_write, cmd, GET_RX_FRAME_COUNT);
+    will_return(__wrap_read, 2);
+    will_return(__wrap_read, &frame_count);
+    expect_value(__wrap_write, cmd, GET_RX_FRAME);
+    will_return(__wrap_read, sizeof(radio_rx_header) + RX_SIZE);
+    will_return(__wrap_read, &test_header);
+    expect_value(__wrap_write, cmd, REMOVE_RX_FRAME);
+
+    /* Sending and receiving a full-size frame must not touch the heap */
+    heap_calls = 0;
+    heap_trap  = true;
+    send_ret   = k_radio_send(data, sizeof(data), &resp);
+    recv_ret   = k_radio_recv(&header, buffer, NULL);
+    heap_trap  = false;
+
+    assert_int_equal(send_ret, RADIO_OK);
+    assert_int_equal(recv_ret, RADIO_OK);
+    assert_int_equal(heap_calls, 0);
+}
+
+static void test_init_max_size(void ** arg)
+{
+    trx_prop tx = {
+            .addr = 0x60,
+            .max_size = RADIO_TX_MAX_SIZE + 1,
+            .max_frames = 40,
+    };
+    trx_prop rx = {
+                .addr = 0x61,
+                .max_size = RX_SIZE,
+                .max_frames = 40,
+    };
+
+    assert_int_equal(k_radio_init("/dev/i2c-0", tx, rx, 10),
+                     RADIO_ERROR_CONFIG);
+}
+
 static void test_config_null(void ** arg)
 {
     assert_int_equal(k_radio_configure(NULL), RADIO_ERROR_CONFIG);
@@ -207,6 +422,106 @@ static void test_set_beacon_override(void ** arg)
     assert_int_equal(ret, RADIO_OK);
 }
 
+static void test_callsigns_register(void ** arg)
+{
+    ax25_callsign   to   = {.ascii = "GROUND", .ssid = 0 };
+    ax25_callsign   from = {.ascii = "SAT", .ssid = 1 };
+    radio_tx_header header;
+    int             first;
+    int             handle;
+    int             i;
+
+    k_radio_callsigns_clear();
+
+    assert_int_equal(k_radio_callsigns_register(&to, &from, &first), RADIO_OK);
+    assert_int_equal(k_radio_callsigns_header(first, &header), RADIO_OK);
+    assert_memory_equal(header.data + 1, &to, sizeof(to));
+
+    /* The same pair gets the same handle */
+    assert_int_equal(k_radio_callsigns_register(&to, &from, &handle), RADIO_OK);
+    assert_int_equal(handle, first);
+
+    for (i = 1; i < RADIO_CALLSIGN_PAIRS; i++)
+    {
+        to.ssid = i;
+        assert_int_equal(k_radio_callsigns_register(&to, &from, &handle),
+                         RADIO_OK);
+        assert_int_not_equal(handle, first);
+    }
+
+    to.ssid = RADIO_CALLSIGN_PAIRS;
+    assert_int_equal(k_radio_callsigns_register(&to, &from, &handle),
+                     RADIO_ERROR);
+    assert_int_equal(k_radio_callsigns_register(NULL, &from, &handle),
+                     RADIO_ERROR_CONFIG);
+
+    k_radio_callsigns_clear();
+    assert_int_equal(k_radio_callsigns_header(first, &header),
+                     RADIO_ERROR_CONFIG);
+
+    /* A handle from before the clear doesn't pick up the slot's new pair */
+    to.ssid = 0;
+    from.ssid = 2;
+    assert_int_equal(k_radio_callsigns_register(&to, &from, &handle), RADIO_OK);
+    assert_int_not_equal(handle, first);
+    assert_int_equal(k_radio_callsigns_header(first, &header),
+                     RADIO_ERROR_CONFIG);
+    assert_int_equal(k_radio_callsigns_header(handle, &header), RADIO_OK);
+    assert_int_equal(header.data[1 + 2 * sizeof(to) - 1], from.ssid);
+}
+
+static void test_send_callsigns(void ** arg)
+{
+    ax25_callsign to   = {.ascii = "GROUND", .ssid = 0 };
+    ax25_callsign from = {.ascii = "SAT", .ssid = 1 };
+    char          data = 'A';
+    uint8_t       resp;
+    int           handle;
+    KRadioStatus  ret;
+
+    k_radio_callsigns_clear();
+    k_radio_callsigns_register(&to, &from, &handle);
+
+    expect_value(__wrap_write, cmd, SEND_AX25_OVERRIDE);
+    will_return(__wrap_read, 1);
+    will_return(__wrap_read, &remaining);
+
+    heap_trap  = true;
+    heap_calls = 0;
+    ret = k_radio_send_callsigns(handle, &data, 1, &resp);
+    heap_trap = false;
+
+    assert_int_equal(ret, RADIO_OK);
+    assert_int_equal(resp, remaining);
+    assert_int_equal(heap_calls, 0);
+
+    /* Unregistered handle */
+    ret = k_radio_send_callsigns(handle + 1, &data, 1, &resp);
+    assert_int_equal(ret, RADIO_ERROR_CONFIG);
+}
+
+static void test_set_beacon_callsigns(void ** arg)
+{
+    ax25_callsign   to   = {.ascii = "GROUND", .ssid = 0 };
+    ax25_callsign   from = {.ascii = "SAT", .ssid = 1 };
+    int             handle;
+    KRadioStatus    ret;
+    radio_tx_beacon beacon = { 0 };
+
+    char beacon_msg[] = "Radio Beacon Message";
+    beacon.interval   = 5;
+    beacon.msg        = beacon_msg;
+    beacon.len        = sizeof(beacon_msg);
+
+    k_radio_callsigns_clear();
+    k_radio_callsigns_register(&to, &from, &handle);
+
+    expect_value(__wrap_write, cmd, SET_AX25_BEACON_OVERRIDE);
+    ret = k_radio_set_beacon_callsigns(handle, beacon);
+
+    assert_int_equal(ret, RADIO_OK);
+}
+
 static void test_clear_beacon(void ** arg)
 {
     ax25_callsign to;
@@ -334,12 +649,14 @@ static void test_telem_tx_all(void ** arg)
 
     assert_int_equal(ret, RADIO_OK);
 
+#ifndef KUBOS_FIXED_POINT
     assert_int_equal(get_rf_power_dbm(telem.tx_telem.inst_RF_reflected), -6);
     assert_int_equal(get_rf_power_mw(telem.tx_telem.inst_RF_forward), 0);
     assert_int_equal(get_voltage(telem.tx_telem.supply_voltage), 7);
     assert_int_equal(get_current(telem.tx_telem.supply_current), 48);
     assert_int_equal(get_temperature(telem.tx_telem.temp_power_amp), 24);
     assert_int_equal(get_temperature(telem.tx_telem.temp_oscillator), 25);
+#endif
 }
 
 static void test_telem_tx_last(void ** arg)
@@ -354,12 +671,14 @@ static void test_telem_tx_last(void ** arg)
 
     assert_int_equal(ret, RADIO_OK);
 
+#ifndef KUBOS_FIXED_POINT
     assert_int_equal(get_rf_power_dbm(telem.tx_telem.inst_RF_reflected), -6);
     assert_int_equal(get_rf_power_mw(telem.tx_telem.inst_RF_forward), 0);
     assert_int_equal(get_voltage(telem.tx_telem.supply_voltage), 7);
     assert_int_equal(get_current(telem.tx_telem.supply_current), 48);
     assert_int_equal(get_temperature(telem.tx_telem.temp_power_amp), 24);
     assert_int_equal(get_temperature(telem.tx_telem.temp_oscillator), 25);
+#endif
 }
 
 static void test_telem_tx_state(void ** arg)
@@ -401,6 +720,7 @@ static void test_telem_rx_all(void ** arg)
     ret = k_radio_get_telemetry(&telem, RADIO_RX_TELEM_ALL);
 
     assert_int_equal(ret, RADIO_OK);
+#ifndef KUBOS_FIXED_POINT
     assert_int_equal(get_doppler_offset(telem.rx_telem.inst_doppler_offset),
                      5325);
     assert_int_equal(get_signal_strength(telem.rx_telem.inst_signal_strength),
@@ -409,6 +729,37 @@ static void test_telem_rx_all(void ** arg)
     assert_int_equal(get_current(telem.rx_telem.supply_current), 47);
     assert_int_equal(get_temperature(telem.rx_telem.temp_power_amp), 23);
     assert_int_equal(get_temperature(telem.rx_telem.temp_oscillator), 23);
+#endif
+}
+
+static void test_telem_tx_eng(void ** arg)
+{
+    trxvu_tx_telem_eng eng;
+
+    k_radio_tx_telem_eng(&tx_telem, &eng);
+
+    assert_int_equal(eng.reflected_mdbm, -6317);
+    assert_int_equal(eng.forward_nw, 3052);
+    assert_int_equal(eng.supply_voltage_mv, 7974);
+    assert_int_equal(eng.supply_current_ua, 48267);
+    assert_int_equal(eng.temp_power_amp_mdegc, 24738);
+    assert_int_equal(eng.temp_oscillator_mdegc, 25045);
+
+    assert_int_equal(get_rf_power_mdbm(0), INT32_MIN);
+}
+
+static void test_telem_rx_eng(void ** arg)
+{
+    trxvu_rx_telem_eng eng;
+
+    k_radio_rx_telem_eng(&rx_telem, &eng);
+
+    assert_int_equal(eng.doppler_offset_hz, 5325);
+    assert_int_equal(eng.signal_strength_mdbm, -117410);
+    assert_int_equal(eng.supply_voltage_mv, 7974);
+    assert_int_equal(eng.supply_current_ua, 47935);
+    assert_int_equal(eng.temp_power_amp_mdegc, 23435);
+    assert_int_equal(eng.temp_oscillator_mdegc, 23818);
 }
 
 static void test_telem_rx_uptime(void ** arg)
@@ -460,13 +811,25 @@ int main(void)
         cmocka_unit_test_setup_teardown(test_send, init, term),
         cmocka_unit_test_setup_teardown(test_send_null, init, term),
         cmocka_unit_test_setup_teardown(test_send_resp_null, init, term),
+        cmocka_unit_test_setup_teardown(test_send_max_size, init, term),
         cmocka_unit_test_setup_teardown(test_send_override, init, term),
+        cmocka_unit_test_setup_teardown(test_tx_header, init, term),
+        cmocka_unit_test_setup_teardown(test_send_frames, init, term),
+        cmocka_unit_test_setup_teardown(test_send_frames_bad, init, term),
+        cmocka_unit_test_setup_teardown(test_passthrough, init, term),
+        cmocka_unit_test_setup_teardown(test_passthrough_null, init, term),
         cmocka_unit_test_setup_teardown(test_recv, init, term),
         cmocka_unit_test_setup_teardown(test_recv_null, init, term),
         cmocka_unit_test_setup_teardown(test_recv_len, init, term),
+        cmocka_unit_test_setup_teardown(test_recv_published, init, term),
+        cmocka_unit_test_setup_teardown(test_no_heap, init, term),
+        cmocka_unit_test(test_init_max_size),
         cmocka_unit_test_setup_teardown(test_config_null, init, term),
         cmocka_unit_test_setup_teardown(test_set_beacon, init, term),
         cmocka_unit_test_setup_teardown(test_set_beacon_override, init, term),
+        cmocka_unit_test_setup_teardown(test_callsigns_register, init, term),
+        cmocka_unit_test_setup_teardown(test_send_callsigns, init, term),
+        cmocka_unit_test_setup_teardown(test_set_beacon_callsigns, init, term),
         cmocka_unit_test_setup_teardown(test_clear_beacon, init, term),
         cmocka_unit_test_setup_teardown(test_set_to, init, term),
         cmocka_unit_test_setup_teardown(test_set_from, init, term),
@@ -482,6 +845,8 @@ int main(void)
         cmocka_unit_test_setup_teardown(test_telem_tx_state, init, term),
         cmocka_unit_test_setup_teardown(test_telem_tx_uptime, init, term),
         cmocka_unit_test_setup_teardown(test_telem_rx_all, init, term),
+        cmocka_unit_test(test_telem_tx_eng),
+        cmocka_unit_test(test_telem_rx_eng),
         cmocka_unit_test_setup_teardown(test_telem_rx_uptime, init, term),
     };
 
@@ -5,4 +5,7 @@ set_target_properties(isis-trxvu-api-test-radio
          -Wl,--wrap=close \
          -Wl,--wrap=ioctl \
          -Wl,--wrap=write \
-         -Wl,--wrap=read")
\ No newline at end of file
+         -Wl,--wrap=read \
+         -Wl,--wrap=malloc \
+         -Wl,--wrap=calloc \
+         -Wl,--wrap=realloc")
\ No newline at end of file
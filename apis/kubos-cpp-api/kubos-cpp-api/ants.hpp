@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @addtogroup KUBOS_CPP_API
+ * @{
+ */
+
+#pragma once
+
+#include <ants-api.h>
+
+#include "frame.hpp"
+#include "handle.hpp"
+#include "result.hpp"
+#include "span.hpp"
+
+namespace kubos {
+namespace ants {
+
+/** Result type returned by every antenna call */
+template <typename T>
+using result = kubos::result<T, KANTSStatus>;
+
+/**
+ * Typed telemetry selectors for ::kubos::ants::device::get
+ */
+namespace telemetry {
+
+/** System telemetry (temperature, deployment status, uptime) */
+struct system
+{
+    using type = ants_telemetry;
+    static KANTSStatus read(type * data)
+    {
+        return k_ants_get_system_telemetry(data);
+    }
+};
+
+/** Deployment status flags */
+struct deploy_status
+{
+    using type = uint16_t;
+    static KANTSStatus read(type * data)
+    {
+        return k_ants_get_deploy_status(data);
+    }
+};
+
+/** System uptime in seconds */
+struct uptime
+{
+    using type = uint32_t;
+    static KANTSStatus read(type * data) { return k_ants_get_uptime(data); }
+};
+
+} // namespace telemetry
+
+/**
+ * Compile-time command frame builders
+ */
+namespace encode {
+
+/** @return Arm command */
+constexpr frame<1> arm() noexcept { return { { ARM_ANTS } }; }
+
+/** @return Disarm command */
+constexpr frame<1> disarm() noexcept { return { { DISARM_ANTS } }; }
+
+/**
+ * @param [in] timeout Maximum time, in seconds, to spend on each antenna
+ * @return Auto-deploy command
+ */
+constexpr frame<2> auto_deploy(uint8_t timeout) noexcept
+{
+    return { { AUTO_DEPLOY, timeout } };
+}
+
+/** @return Cancel-deployment command */
+constexpr frame<1> cancel_deploy() noexcept { return { { CANCEL_DEPLOY } }; }
+
+} // namespace encode
+
+/** Running watchdog thread. Stopped when the object is destroyed. */
+using watchdog = unique_handle<&k_ants_watchdog_stop>;
+
+/**
+ * Open antenna system session
+ *
+ * The C API keeps a single global session, so only one device should be open
+ * at a time. Closing happens automatically when the device is destroyed.
+ */
+class device
+{
+public:
+    /**
+     * Open the antenna system
+     * @param [in] bus I2C bus device name
+     * @param [in] primary I2C address of the primary microcontroller
+     * @param [in] secondary I2C address of the secondary microcontroller
+     * @param [in] ant_count Number of antennas
+     * @param [in] timeout Watchdog timeout (in seconds)
+     * @return Open device, or the `k_ants_init` failure status
+     */
+    static result<device> open(const char * bus, uint8_t primary,
+                               uint8_t secondary, uint8_t ant_count,
+                               uint32_t timeout)
+    {
+        KANTSStatus status = k_ants_init(const_cast<char *>(bus), primary,
+                                         secondary, ant_count, timeout);
+        if (status != ANTS_OK)
+        {
+            return unexpected<KANTSStatus>(status);
+        }
+
+        return device();
+    }
+
+    /** @return `true` if this object owns the session */
+    bool is_open() const noexcept { return session_.active(); }
+
+    /** Close the session early */
+    void close() noexcept { session_.reset(); }
+
+    /**
+     * Read a telemetry item
+     * @tparam Tag Selector from ::kubos::ants::telemetry
+     * @return Telemetry value
+     */
+    template <typename Tag>
+    result<typename Tag::type> get() const
+    {
+        return fetch<typename Tag::type>(&Tag::read);
+    }
+
+    /**
+     * @param [in] antenna Antenna to query
+     * @return Number of deployment attempts
+     */
+    result<uint8_t> activation_count(KANTSAnt antenna) const
+    {
+        return fetch<uint8_t>(&k_ants_get_activation_count, antenna);
+    }
+
+    /**
+     * @param [in] antenna Antenna to query
+     * @return Cumulative deployment time (in 50ms steps)
+     */
+    result<uint16_t> activation_time(KANTSAnt antenna) const
+    {
+        return fetch<uint16_t>(&k_ants_get_activation_time, antenna);
+    }
+
+    /**
+     * Select the microcontroller which receives commands
+     * @param [in] config Controller to use
+     * @return Result of the command
+     */
+    result<void> configure(KANTSController config) const
+    {
+        return check(k_ants_configure(config));
+    }
+
+    /** @return Result of arming the system */
+    result<void> arm() const { return check(k_ants_arm()); }
+
+    /** @return Result of disarming the system */
+    result<void> disarm() const { return check(k_ants_disarm()); }
+
+    /**
+     * Deploy a single antenna
+     * @param [in] antenna Antenna to deploy
+     * @param [in] override Ignore the deployment switches
+     * @param [in] timeout Maximum deployment time, in seconds
+     * @return Result of the command
+     */
+    result<void> deploy(KANTSAnt antenna, bool override, uint8_t timeout) const
+    {
+        return check(k_ants_deploy(antenna, override, timeout));
+    }
+
+    /**
+     * Send a prebuilt command frame
+     * @param [in] cmd Frame from ::kubos::ants::encode
+     * @return Result of the command
+     */
+    template <std::size_t N>
+    result<void> send(const frame<N> & cmd) const
+    {
+        return check(k_ants_passthrough(cmd.data(), N, nullptr, 0));
+    }
+
+    /**
+     * Pass a raw command through to the antenna system without copying
+     * either buffer
+     * @param [in] tx Command to send
+     * @param [in] rx Buffer for the response (may be empty)
+     * @return Result of the transfer
+     */
+    result<void> passthrough(const_bytes tx, mutable_bytes rx) const
+    {
+        return check(k_ants_passthrough(tx.data(), static_cast<int>(tx.size()),
+                                        rx.empty() ? nullptr : rx.data(),
+                                        static_cast<int>(rx.size())));
+    }
+
+    /**
+     * Start the watchdog kicking thread
+     * @return Watchdog handle which stops the thread when destroyed
+     */
+    result<watchdog> start_watchdog() const
+    {
+        KANTSStatus status = k_ants_watchdog_start();
+        if (status != ANTS_OK)
+        {
+            return unexpected<KANTSStatus>(status);
+        }
+
+        return watchdog(true);
+    }
+
+private:
+    device() noexcept : session_(true) {}
+
+    unique_handle<&k_ants_terminate> session_;
+};
+
+} // namespace ants
+} // namespace kubos
+
+/* @} */
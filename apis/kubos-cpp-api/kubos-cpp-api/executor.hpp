@@ -0,0 +1,621 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @addtogroup KUBOS_CPP_API
+ * @{
+ */
+
+#pragma once
+
+#if __cplusplus < 202002L
+#error "executor.hpp requires C++20 coroutines"
+#endif
+
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <unordered_set>
+#include <utility>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "result.hpp"
+#include "task.hpp"
+
+namespace kubos {
+
+/**
+ * Hashed timer wheel
+ *
+ * Timers are intrusive nodes which live in the suspended coroutine's frame, so
+ * arming one never allocates. Each slot covers one tick; timers further out
+ * than one revolution stay in their slot and are skipped until their tick
+ * comes round.
+ */
+class timer_wheel
+{
+public:
+    /** Wheel resolution */
+    static constexpr std::chrono::nanoseconds tick{ std::chrono::milliseconds(1) };
+    /** Number of slots (one revolution = `slots` ticks) */
+    static constexpr std::size_t slots = 256;
+
+    /** Timer entry, embedded in the awaiting coroutine's frame */
+    struct node
+    {
+        uint64_t                deadline = 0; /**< Expiry tick */
+        std::coroutine_handle<> handle;       /**< Coroutine to resume */
+        node *                  prev = nullptr;
+        node *                  next = nullptr;
+    };
+
+    /**
+     * @param [in] now Current monotonic time
+     * @return Tick containing `now`
+     */
+    static uint64_t tick_of(std::chrono::nanoseconds now) noexcept
+    {
+        return static_cast<uint64_t>(now / tick);
+    }
+
+    /**
+     * @param [in] when Expiry time
+     * @return First tick which starts at or after `when`
+     */
+    static uint64_t ceil_tick(std::chrono::nanoseconds when) noexcept
+    {
+        return static_cast<uint64_t>((when + tick - std::chrono::nanoseconds(1))
+                                     / tick);
+    }
+
+    /** @return `true` if no timers are armed */
+    bool empty() const noexcept { return count_ == 0; }
+
+    /**
+     * Arm a timer
+     * @param [in] entry Timer to arm, with `deadline` and `handle` set
+     */
+    void insert(node * entry) noexcept
+    {
+        /* A slot the wheel has already passed would not be visited again */
+        if (entry->deadline < current_)
+        {
+            entry->deadline = current_;
+        }
+
+        node *& head = wheel_[entry->deadline % slots];
+        entry->prev  = nullptr;
+        entry->next  = head;
+        if (head != nullptr)
+        {
+            head->prev = entry;
+        }
+        head = entry;
+        ++count_;
+    }
+
+    /**
+     * Fire every timer which expires at or before `now`
+     * @param [in] now Current tick
+     * @param [in] fire Called with the handle of each expired timer
+     */
+    template <typename Fn>
+    void advance(uint64_t now, Fn && fire)
+    {
+        if (now < current_)
+        {
+            return;
+        }
+
+        /* Past one revolution every slot has to be checked anyway */
+        uint64_t steps = now - current_ + 1;
+        if (steps > slots)
+        {
+            steps = slots;
+        }
+
+        for (uint64_t i = 0; i < steps && count_ != 0; i++)
+        {
+            node * entry = wheel_[(current_ + i) % slots];
+            while (entry != nullptr)
+            {
+                node * next = entry->next;
+                if (entry->deadline <= now)
+                {
+                    unlink(entry);
+                    fire(entry->handle);
+                }
+                entry = next;
+            }
+        }
+
+        current_ = now + 1;
+    }
+
+    /** @return Earliest armed deadline (only valid if not empty) */
+    uint64_t next_deadline() const noexcept
+    {
+        /* The nearest slots are the likely ones, so look there first */
+        for (uint64_t i = 0; i < slots; i++)
+        {
+            uint64_t tick = current_ + i;
+            for (node * entry = wheel_[tick % slots]; entry != nullptr;
+                 entry        = entry->next)
+            {
+                if (entry->deadline <= tick)
+                {
+                    return entry->deadline;
+                }
+            }
+        }
+
+        /* Everything is at least one revolution away */
+        uint64_t best = UINT64_MAX;
+        for (node * head : wheel_)
+        {
+            for (node * entry = head; entry != nullptr; entry = entry->next)
+            {
+                if (entry->deadline < best)
+                {
+                    best = entry->deadline;
+                }
+            }
+        }
+
+        return best;
+    }
+
+    /**
+     * Set the tick the wheel starts turning from
+     * @param [in] now Current tick
+     */
+    void reset(uint64_t now) noexcept
+    {
+        if (count_ == 0)
+        {
+            current_ = now;
+        }
+    }
+
+private:
+    void unlink(node * entry) noexcept
+    {
+        if (entry->prev != nullptr)
+        {
+            entry->prev->next = entry->next;
+        }
+        else
+        {
+            wheel_[entry->deadline % slots] = entry->next;
+        }
+
+        if (entry->next != nullptr)
+        {
+            entry->next->prev = entry->prev;
+        }
+
+        entry->prev = entry->next = nullptr;
+        --count_;
+    }
+
+    node *      wheel_[slots] = {};
+    uint64_t    current_      = 0;
+    std::size_t count_        = 0;
+};
+
+/**
+ * Single-threaded coroutine executor
+ *
+ * Drives any number of device coroutines from one thread. Timers come from a
+ * ::kubos::timer_wheel backed by a single timerfd, and file descriptors can be
+ * awaited through epoll. The thread sleeps in `epoll_wait` whenever nothing is
+ * runnable, and the timerfd is only armed while a timer is pending.
+ *
+ * Everything except ::kubos::executor::stop must be called from the thread
+ * running the executor.
+ */
+class executor
+{
+public:
+    /**
+     * Create an executor
+     * @return Executor, or the `errno` of the failed setup call
+     */
+    static result<std::unique_ptr<executor>, int> create()
+    {
+        std::unique_ptr<executor> ex(new executor());
+        if (ex->epoll_ < 0 || ex->timer_ < 0 || ex->wake_ < 0)
+        {
+            return unexpected<int>(ex->error_);
+        }
+
+        return ex;
+    }
+
+    executor(const executor &) = delete;
+    executor & operator=(const executor &) = delete;
+
+    /** Coroutines still suspended at this point are destroyed unfinished */
+    ~executor()
+    {
+        for (void * frame : spawned_)
+        {
+            std::coroutine_handle<>::from_address(frame).destroy();
+        }
+
+        for (int fd : { epoll_, timer_, wake_ })
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+    }
+
+    /**
+     * Start a coroutine which runs independently of its creator
+     * @param [in] work Coroutine to run. Its frame is freed when it finishes,
+     *                  or when the executor is destroyed.
+     */
+    void spawn(task<void> work)
+    {
+        detached d            = run_detached(std::move(work));
+        d.handle.promise().ex = this;
+        spawned_.insert(d.handle.address());
+        schedule(d.handle);
+    }
+
+    /**
+     * Queue a suspended coroutine to be resumed on the next pass
+     * @param [in] handle Coroutine to resume
+     */
+    void schedule(std::coroutine_handle<> handle) { ready_.push_back(handle); }
+
+    /**
+     * Run until every spawned coroutine has finished or ::stop is called
+     * @return 0 on success, otherwise the `errno` of the failed call
+     */
+    int run()
+    {
+        stopped_ = false;
+
+        while (!stopped_ && !spawned_.empty())
+        {
+            while (!ready_.empty())
+            {
+                std::coroutine_handle<> handle = ready_.front();
+                ready_.pop_front();
+                handle.resume();
+            }
+
+            if (stopped_ || spawned_.empty())
+            {
+                break;
+            }
+
+            if (arm_timer() != 0)
+            {
+                return errno;
+            }
+
+            struct epoll_event events[16];
+            int count = epoll_wait(epoll_, events, 16, -1);
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return errno;
+            }
+
+            for (int i = 0; i < count; i++)
+            {
+                uint64_t drain;
+
+                if (events[i].data.ptr == &timer_)
+                {
+                    (void) read(timer_, &drain, sizeof(drain));
+                }
+                else if (events[i].data.ptr == &wake_)
+                {
+                    (void) read(wake_, &drain, sizeof(drain));
+                }
+                else
+                {
+                    schedule(std::coroutine_handle<>::from_address(
+                        events[i].data.ptr));
+                }
+            }
+
+            wheel_.advance(timer_wheel::tick_of(now()),
+                           [this](std::coroutine_handle<> h) { schedule(h); });
+        }
+
+        return 0;
+    }
+
+    /** Stop ::run. Safe to call from any thread. */
+    void stop() noexcept
+    {
+        uint64_t one = 1;
+
+        stopped_ = true;
+        (void) write(wake_, &one, sizeof(one));
+    }
+
+    /** Awaitable returned by ::sleep_for */
+    struct sleep_awaiter
+    {
+        executor &               ex;
+        std::chrono::nanoseconds delay;
+        timer_wheel::node        entry;
+
+        bool await_ready() const noexcept { return delay.count() <= 0; }
+
+        void await_suspend(std::coroutine_handle<> handle) noexcept
+        {
+            std::chrono::nanoseconds current = executor::now();
+
+            ex.wheel_.reset(timer_wheel::tick_of(current));
+            entry.deadline = timer_wheel::ceil_tick(current + delay);
+            entry.handle   = handle;
+            ex.wheel_.insert(&entry);
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    /**
+     * Suspend the calling coroutine for at least `delay`
+     * @param [in] delay Time to wait. Rounded up to the wheel's tick.
+     * @return Awaitable
+     */
+    sleep_awaiter sleep_for(std::chrono::nanoseconds delay) noexcept
+    {
+        return sleep_awaiter{ *this, delay, {} };
+    }
+
+    /** Awaitable returned by ::readable */
+    struct fd_awaiter
+    {
+        executor & ex;
+        int        fd;
+        int        error;
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle) noexcept
+        {
+            struct epoll_event event = {};
+            event.events             = EPOLLIN | EPOLLONESHOT;
+            event.data.ptr           = handle.address();
+
+            if (epoll_ctl(ex.epoll_, EPOLL_CTL_ADD, fd, &event) != 0
+                && (errno != EEXIST
+                    || epoll_ctl(ex.epoll_, EPOLL_CTL_MOD, fd, &event) != 0))
+            {
+                error = errno;
+                return false;
+            }
+
+            return true;
+        }
+
+        /** @return 0 once readable, otherwise the `errno` of the failed setup */
+        int await_resume() const noexcept { return error; }
+    };
+
+    /**
+     * Suspend the calling coroutine until `fd` is readable
+     * @param [in] fd File descriptor to watch
+     * @return Awaitable
+     */
+    fd_awaiter readable(int fd) noexcept { return fd_awaiter{ *this, fd, 0 }; }
+
+    /** @return Current `CLOCK_MONOTONIC` time */
+    static std::chrono::nanoseconds now() noexcept
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return std::chrono::seconds(ts.tv_sec)
+               + std::chrono::nanoseconds(ts.tv_nsec);
+    }
+
+private:
+    /* Fire-and-forget coroutine used by spawn; frees itself on completion */
+    struct detached
+    {
+        struct promise_type;
+
+        /* Drops the finished frame from the executor's list and frees it */
+        struct retire
+        {
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<promise_type> self) noexcept
+            {
+                self.promise().ex->spawned_.erase(self.address());
+                self.destroy();
+            }
+            void await_resume() const noexcept {}
+        };
+
+        struct promise_type
+        {
+            executor * ex = nullptr;
+
+            detached get_return_object() noexcept
+            {
+                return { std::coroutine_handle<promise_type>::from_promise(
+                    *this) };
+            }
+            std::suspend_always initial_suspend() const noexcept { return {}; }
+            retire              final_suspend() const noexcept { return {}; }
+            void                return_void() const noexcept {}
+            void unhandled_exception() const noexcept { std::terminate(); }
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    static detached run_detached(task<void> work) { co_await std::move(work); }
+
+    executor()
+    {
+        epoll_ = epoll_create1(EPOLL_CLOEXEC);
+        timer_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        wake_  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_ < 0 || timer_ < 0 || wake_ < 0)
+        {
+            error_ = errno;
+            return;
+        }
+
+        struct epoll_event event = {};
+        event.events             = EPOLLIN;
+        event.data.ptr           = &timer_;
+        epoll_ctl(epoll_, EPOLL_CTL_ADD, timer_, &event);
+
+        event.data.ptr = &wake_;
+        epoll_ctl(epoll_, EPOLL_CTL_ADD, wake_, &event);
+    }
+
+    /* Point the timerfd at the next deadline, or disarm it */
+    int arm_timer() noexcept
+    {
+        struct itimerspec spec = {};
+
+        if (!wheel_.empty())
+        {
+            std::chrono::nanoseconds when
+                = wheel_.next_deadline() * timer_wheel::tick;
+
+            spec.it_value.tv_sec  = when.count() / 1000000000;
+            spec.it_value.tv_nsec = when.count() % 1000000000;
+        }
+
+        return timerfd_settime(timer_, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    int                                 epoll_ = -1;
+    int                                 timer_ = -1;
+    int                                 wake_  = -1;
+    int                                 error_ = 0;
+    bool                                stopped_ = false;
+    std::unordered_set<void *>          spawned_;
+    timer_wheel                         wheel_;
+    std::deque<std::coroutine_handle<>> ready_;
+};
+
+/**
+ * Coroutine mutex for serializing transactions on one device
+ *
+ * Waiters queue in FIFO order and are handed the lock through the executor,
+ * so a coroutine never blocks the executor thread while waiting for the bus.
+ */
+class async_mutex
+{
+public:
+    /**
+     * @param [in] ex Executor which resumes waiting coroutines
+     */
+    explicit async_mutex(executor & ex) noexcept : ex_(ex) {}
+
+    /** Releases the lock when destroyed */
+    class guard
+    {
+    public:
+        explicit guard(async_mutex & mtx) noexcept : mtx_(&mtx) {}
+        guard(guard && other) noexcept : mtx_(std::exchange(other.mtx_, nullptr)) {}
+        guard(const guard &) = delete;
+        guard & operator=(const guard &) = delete;
+        guard & operator=(guard &&) = delete;
+
+        ~guard()
+        {
+            if (mtx_ != nullptr)
+            {
+                mtx_->unlock();
+            }
+        }
+
+    private:
+        async_mutex * mtx_;
+    };
+
+    /** Awaitable returned by ::lock */
+    struct lock_awaiter
+    {
+        async_mutex &           mtx;
+        std::coroutine_handle<> handle;
+
+        bool await_ready() noexcept
+        {
+            if (!mtx.locked_)
+            {
+                mtx.locked_ = true;
+                return true;
+            }
+
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            handle = h;
+            mtx.waiters_.push_back(h);
+        }
+
+        guard await_resume() noexcept { return guard(mtx); }
+    };
+
+    /**
+     * Take the lock
+     * @return Awaitable producing a guard which holds the lock
+     */
+    lock_awaiter lock() noexcept { return lock_awaiter{ *this, {} }; }
+
+private:
+    void unlock()
+    {
+        if (waiters_.empty())
+        {
+            locked_ = false;
+            return;
+        }
+
+        /* Ownership passes straight to the next waiter */
+        std::coroutine_handle<> next = waiters_.front();
+        waiters_.pop_front();
+        ex_.schedule(next);
+    }
+
+    executor &                          ex_;
+    bool                                locked_ = false;
+    std::deque<std::coroutine_handle<>> waiters_;
+};
+
+} // namespace kubos
+
+/* @} */
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @addtogroup KUBOS_CPP_API
+ * @{
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "span.hpp"
+
+namespace kubos {
+
+/**
+ * Fixed-size command frame
+ *
+ * Built by the per-device `encode` functions. All of them are `constexpr`, so
+ * a frame made from constant arguments is laid out at compile time and sent
+ * straight from read-only storage.
+ */
+template <std::size_t N>
+struct frame
+{
+    /** Raw frame bytes, command byte first */
+    uint8_t bytes[N];
+
+    /** @return Pointer to the first byte */
+    constexpr const uint8_t * data() const noexcept { return bytes; }
+    /** @return Frame length */
+    static constexpr std::size_t size() noexcept { return N; }
+
+    constexpr uint8_t operator[](std::size_t idx) const noexcept
+    {
+        return bytes[idx];
+    }
+
+    /** @return Read-only view of the frame */
+    const_bytes view() const noexcept { return const_bytes(bytes, N); }
+};
+
+namespace detail {
+
+/** @return Low byte of a 16-bit value */
+constexpr uint8_t lo(uint16_t value) noexcept
+{
+    return static_cast<uint8_t>(value & 0xFF);
+}
+
+/** @return High byte of a 16-bit value */
+constexpr uint8_t hi(uint16_t value) noexcept
+{
+    return static_cast<uint8_t>(value >> 8);
+}
+
+} // namespace detail
+
+} // namespace kubos
+
+/* @} */
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @addtogroup KUBOS_CPP_API
+ * @{
+ */
+
+#pragma once
+
+#include <utility>
+
+namespace kubos {
+
+/**
+ * Move-only owner of a C API session
+ *
+ * The C device APIs keep their state in file-scope globals and are torn down
+ * by a parameterless call (`k_adcs_terminate`, `k_radio_watchdog_stop`, ...).
+ * This handle makes that call exactly once, when the owning object goes out
+ * of scope. It is a single `bool`, so wrapping a session costs nothing.
+ *
+ * @tparam Release C function called to release the session. Its return value,
+ *                 if any, is discarded.
+ */
+template <auto Release>
+class unique_handle
+{
+public:
+    /** Construct an empty handle */
+    constexpr unique_handle() noexcept = default;
+
+    /**
+     * Take ownership of an open session
+     * @param [in] active `true` if the session was successfully opened
+     */
+    constexpr explicit unique_handle(bool active) noexcept : active_(active) {}
+
+    unique_handle(const unique_handle &) = delete;
+    unique_handle & operator=(const unique_handle &) = delete;
+
+    unique_handle(unique_handle && other) noexcept
+        : active_(std::exchange(other.active_, false))
+    {
+    }
+
+    unique_handle & operator=(unique_handle && other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            active_ = std::exchange(other.active_, false);
+        }
+
+        return *this;
+    }
+
+    ~unique_handle() { reset(); }
+
+    /** Release the session now, if it is still held */
+    void reset() noexcept
+    {
+        if (active_)
+        {
+            active_ = false;
+            (void) Release();
+        }
+    }
+
+    /** @return `true` if this handle still owns the session */
+    constexpr bool active() const noexcept { return active_; }
+
+private:
+    bool active_ = false;
+};
+
+} // namespace kubos
+
+/* @} */
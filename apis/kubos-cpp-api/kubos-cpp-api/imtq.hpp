@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @addtogroup KUBOS_CPP_API
+ * @{
+ */
+
+#pragma once
+
+#include <imtq.h>
+
+#include "frame.hpp"
+#include "handle.hpp"
+#include "result.hpp"
+#include "span.hpp"
+
+namespace kubos {
+namespace imtq {
+
+/** Result type returned by every iMTQ call */
+template <typename T>
+using result = kubos::result<T, KADCSStatus>;
+
+/**
+ * Typed telemetry selectors for ::kubos::imtq::device::get
+ *
+ * Each selector names the C structure it produces and the C getter which
+ * fills it, so `dev.get<telemetry::calib_mtm>()` compiles down to a single
+ * call to `k_imtq_get_calib_mtm`. The command byte and response length let
+ * the asynchronous wrappers in imtq_async.hpp issue the same exchange without
+ * blocking.
+ */
+namespace telemetry {
+
+/** Current system state */
+struct system_state
+{
+    using type = imtq_state;
+    static constexpr uint8_t     command = GET_STATE;
+    static constexpr std::size_t length  = sizeof(imtq_state);
+    static KADCSStatus read(type * data) { return k_imtq_get_system_state(data); }
+};
+
+/** Raw magnetometer measurement */
+struct raw_mtm
+{
+    using type = imtq_mtm_msg;
+    static constexpr uint8_t     command = GET_MTM_RAW;
+    static constexpr std::size_t length  = sizeof(imtq_mtm_data);
+    static KADCSStatus read(type * data) { return k_imtq_get_raw_mtm(data); }
+};
+
+/** Calibrated magnetometer measurement */
+struct calib_mtm
+{
+    using type = imtq_mtm_msg;
+    static constexpr uint8_t     command = GET_MTM_CALIB;
+    static constexpr std::size_t length  = sizeof(imtq_mtm_data);
+    static KADCSStatus read(type * data) { return k_imtq_get_calib_mtm(data); }
+};
+
+/** Coil currents */
+struct coil_current
+{
+    using type = imtq_coil_current;
+    static constexpr uint8_t     command = GET_CURRENT;
+    static constexpr std::size_t length  = sizeof(imtq_coil_current);
+    static KADCSStatus read(type * data) { return k_imtq_get_coil_current(data); }
+};
+
+/** Coil temperatures */
+struct coil_temps
+{
+    using type = imtq_coil_temp;
+    static constexpr uint8_t     command = GET_TEMPS;
+    static constexpr std::size_t length  = sizeof(imtq_coil_temp);
+    static KADCSStatus read(type * data) { return k_imtq_get_coil_temps(data); }
+};
+
+/** Commanded actuation dipole */
+struct dipole
+{
+    using type = imtq_dipole;
+    static constexpr uint8_t     command = GET_DIPOLE;
+    static constexpr std::size_t length  = sizeof(imtq_dipole);
+    static KADCSStatus read(type * data) { return k_imtq_get_dipole(data); }
+};
+
+/** Detumble data */
+struct detumble
+{
+    using type = imtq_detumble;
+    static constexpr uint8_t     command = GET_DETUMBLE;
+    static constexpr std::size_t length  = sizeof(imtq_detumble);
+    static KADCSStatus read(type * data) { return k_imtq_get_detumble(data); }
+};
+
+/** Raw housekeeping */
+struct raw_housekeeping
+{
+    using type = imtq_housekeeping_raw;
+    static constexpr uint8_t     command = GET_HOUSE_RAW;
+    static constexpr std::size_t length  = sizeof(imtq_housekeeping_raw);
+    static KADCSStatus read(type * data)
+    {
+        return k_imtq_get_raw_housekeeping(data);
+    }
+};
+
+/** Engineering housekeeping */
+struct eng_housekeeping
+{
+    using type = imtq_housekeeping_eng;
+    static constexpr uint8_t     command = GET_HOUSE_ENG;
+    static constexpr std::size_t length  = sizeof(imtq_housekeeping_eng);
+    static KADCSStatus read(type * data)
+    {
+        return k_imtq_get_eng_housekeeping(data);
+    }
+};
+
+/** Current operating mode */
+struct mode
+{
+    using type = ADCSMode;
+    static KADCSStatus read(type * data) { return k_adcs_get_mode(data); }
+};
+
+} // namespace telemetry
+
+/**
+ * Compile-time command frame builders
+ *
+ * Byte layouts match the packets built by the corresponding `k_imtq_*`
+ * functions.
+ */
+namespace encode {
+
+/** @return No-op command */
+constexpr frame<1> noop() noexcept { return { { NOOP } }; }
+
+/** @return Cancel-operation command */
+constexpr frame<1> cancel_op() noexcept { return { { CANCEL_OP } }; }
+
+/** @return Start-MTM-measurement command */
+constexpr frame<1> start_measurement() noexcept
+{
+    return { { START_MEASURE } };
+}
+
+/**
+ * @param [in] cmd Actuation command value
+ * @param [in] x X-axis value
+ * @param [in] y Y-axis value
+ * @param [in] z Z-axis value
+ * @param [in] time Actuation duration in milliseconds
+ * @return Actuation command frame
+ */
+constexpr frame<9> actuation(uint8_t cmd, int16_t x, int16_t y, int16_t z,
+                             uint16_t time) noexcept
+{
+    return { { cmd, detail::lo(x), detail::hi(x), detail::lo(y), detail::hi(y),
+               detail::lo(z), detail::hi(z), detail::lo(time),
+               detail::hi(time) } };
+}
+
+/**
+ * @param [in] x X-axis current in 10<sup>-4</sup> A
+ * @param [in] y Y-axis current in 10<sup>-4</sup> A
+ * @param [in] z Z-axis current in 10<sup>-4</sup> A
+ * @param [in] time Actuation duration in milliseconds
+ * @return Start-actuation (current) command
+ */
+constexpr frame<9> start_actuation_current(int16_t x, int16_t y, int16_t z,
+                                           uint16_t time) noexcept
+{
+    return actuation(START_CURRENT, x, y, z, time);
+}
+
+/**
+ * @param [in] x X-axis dipole in 10<sup>-4</sup> Am<sup>2</sup>
+ * @param [in] y Y-axis dipole in 10<sup>-4</sup> Am<sup>2</sup>
+ * @param [in] z Z-axis dipole in 10<sup>-4</sup> Am<sup>2</sup>
+ * @param [in] time Actuation duration in milliseconds
+ * @return Start-actuation (dipole) command
+ */
+constexpr frame<9> start_actuation_dipole(int16_t x, int16_t y, int16_t z,
+                                          uint16_t time) noexcept
+{
+    return actuation(START_DIPOLE, x, y, z, time);
+}
+
+/**
+ * @param [in] axis Axis to test
+ * @return Start-self-test command
+ */
+constexpr frame<2> start_test(ADCSTestType axis) noexcept
+{
+    return { { START_TEST, static_cast<uint8_t>(axis) } };
+}
+
+/**
+ * @param [in] time Detumble duration in seconds
+ * @return Start-detumble command
+ */
+constexpr frame<3> start_detumble(uint16_t time) noexcept
+{
+    return { { START_BDOT, detail::lo(time), detail::hi(time) } };
+}
+
+} // namespace encode
+
+/** Running watchdog thread. Stopped when the object is destroyed. */
+using watchdog = unique_handle<&k_imtq_watchdog_stop>;
+
+/**
+ * Open iMTQ session
+ *
+ * The C API keeps a single global session, so only one device should be open
+ * at a time. Closing happens automatically when the device is destroyed.
+ */
+class device
+{
+public:
+    /**
+     * Open the iMTQ
+     * @param [in] bus I2C bus device name
+     * @param [in] addr I2C address of the iMTQ
+     * @param [in] timeout Watchdog timeout (in seconds)
+     * @return Open device, or the `k_adcs_init` failure status
+     */
+    static result<device> open(const char * bus, uint16_t addr, int timeout)
+    {
+        KADCSStatus status
+            = k_adcs_init(const_cast<char *>(bus), addr, timeout);
+        if (status != ADCS_OK)
+        {
+            return unexpected<KADCSStatus>(status);
+        }
+
+        return device();
+    }
+
+    /** @return `true` if this object owns the session */
+    bool is_open() const noexcept { return session_.active(); }
+
+    /** Close the session early */
+    void close() noexcept { session_.reset(); }
+
+    /**
+     * Read a telemetry item
+     * @tparam Tag Selector from ::kubos::imtq::telemetry
+     * @return Telemetry structure
+     */
+    template <typename Tag>
+    result<typename Tag::type> get() const
+    {
+        return fetch<typename Tag::type>(&Tag::read);
+    }
+
+    /** @return Result of a no-op command */
+    result<void> noop() const { return check(k_adcs_noop()); }
+
+    /** @return Result of a software reset */
+    result<void> reset() const { return check(k_adcs_reset(SOFT_RESET)); }
+
+    /**
+     * Change the operating mode
+     * @param [in] mode New mode
+     * @param [in] duration Detumble duration (only used for ::DETUMBLE)
+     * @return Result of the mode change
+     */
+    result<void> set_mode(ADCSMode mode, adcs_mode_param duration = 0) const
+    {
+        return check(k_adcs_set_mode(mode, &duration));
+    }
+
+    /**
+     * Send a prebuilt command frame
+     * @param [in] cmd Frame from ::kubos::imtq::encode
+     * @return Response header
+     */
+    template <std::size_t N>
+    result<imtq_resp_header> send(const frame<N> & cmd) const
+    {
+        imtq_resp_header response{};
+        KADCSStatus      status
+            = k_adcs_passthrough(cmd.data(), N, reinterpret_cast<uint8_t *>(&response),
+                                 sizeof(response), nullptr);
+        if (status != ADCS_OK)
+        {
+            return unexpected<KADCSStatus>(status);
+        }
+
+        return response;
+    }
+
+    /**
+     * Pass a raw command through to the iMTQ without copying either buffer
+     * @param [in] tx Command to send
+     * @param [in] rx Buffer for the response
+     * @param [in] delay Delay between write and read (`nullptr` for default)
+     * @return Result of the transfer
+     */
+    result<void> passthrough(const_bytes tx, mutable_bytes rx,
+                             const struct timespec * delay = nullptr) const
+    {
+        return check(k_adcs_passthrough(tx.data(), static_cast<int>(tx.size()),
+                                        rx.data(), static_cast<int>(rx.size()),
+                                        delay));
+    }
+
+    /**
+     * Start the watchdog kicking thread
+     * @return Watchdog handle which stops the thread when destroyed
+     */
+    result<watchdog> start_watchdog() const
+    {
+        KADCSStatus status = k_imtq_watchdog_start();
+        if (status != ADCS_OK)
+        {
+            return unexpected<KADCSStatus>(status);
+        }
+
+        return watchdog(true);
+    }
+
+private:
+    device() noexcept : session_(true) {}
+
+    unique_handle<&k_adcs_terminate> session_;
+};
+
+} // namespace imtq
+} // namespace kubos
+
+/* @} */
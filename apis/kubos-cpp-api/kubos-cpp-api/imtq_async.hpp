@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @addtogroup KUBOS_CPP_API
+ * @{
+ */
+
+#pragma once
+
+#include <chrono>
+#include <pthread.h>
+
+#include "executor.hpp"
+#include "imtq.hpp"
+
+namespace kubos {
+namespace imtq {
+
+/**
+ * Non-blocking view of an open iMTQ session
+ *
+ * Each exchange is split around the iMTQ's processing gap: the command is
+ * written, the coroutine sleeps on the executor's timer wheel, and the reply
+ * is read afterwards. Nothing here calls `nanosleep`, so one executor thread
+ * can keep many device operations in flight.
+ *
+ * Exchanges issued through the same object are serialized in call order.
+ * The C `imtq_mutex` is still taken around each exchange, so blocking callers
+ * (such as the watchdog thread) cannot interleave with it.
+ */
+class async_device
+{
+public:
+    /** Default gap between command and reply (matches `kprv_imtq_transfer`) */
+    static constexpr std::chrono::nanoseconds transfer_delay{ 1000001 };
+    /** Gap needed for the iMTQ to come back up after a reset */
+    static constexpr std::chrono::milliseconds reset_delay{ 100 };
+    /** Time needed for a self-test to complete */
+    static constexpr std::chrono::milliseconds test_delay{ 1300 };
+
+    /**
+     * @param [in] dev Open device. Must outlive this object.
+     * @param [in] ex Executor which drives the operations
+     */
+    async_device(device & dev, executor & ex) noexcept
+        : dev_(dev), ex_(ex), lock_(ex)
+    {
+    }
+
+    /** @return `true` if the underlying session is still open */
+    bool is_open() const noexcept { return dev_.is_open(); }
+
+    /**
+     * Read a telemetry item
+     * @tparam Tag Selector from ::kubos::imtq::telemetry
+     * @return Telemetry structure
+     */
+    template <typename Tag>
+    task<result<typename Tag::type>> get()
+    {
+        typename Tag::type data{};
+        const uint8_t      cmd = Tag::command;
+
+        KADCSStatus status
+            = co_await transfer(const_bytes(&cmd, 1),
+                                mutable_bytes(reinterpret_cast<uint8_t *>(&data),
+                                              Tag::length));
+        if (status != ADCS_OK)
+        {
+            co_return unexpected<KADCSStatus>(status);
+        }
+
+        co_return data;
+    }
+
+    /**
+     * Send a prebuilt command frame
+     * @param [in] cmd Frame from ::kubos::imtq::encode. Copied into the
+     *                 coroutine frame, so temporaries are fine.
+     * @return Response header
+     */
+    template <std::size_t N>
+    task<result<imtq_resp_header>> send(frame<N> cmd)
+    {
+        imtq_resp_header response{};
+
+        KADCSStatus status = co_await transfer(
+            const_bytes(cmd.data(), N),
+            mutable_bytes(reinterpret_cast<uint8_t *>(&response),
+                          sizeof(response)));
+        if (status != ADCS_OK)
+        {
+            co_return unexpected<KADCSStatus>(status);
+        }
+
+        co_return response;
+    }
+
+    /** @return Result of a software reset */
+    task<result<void>> reset()
+    {
+        const uint8_t    packet[2] = { RESET_MTQ >> 8, RESET_MTQ & 0xFF };
+        imtq_resp_header response{};
+
+        KADCSStatus status = co_await transfer(
+            const_bytes(packet, sizeof(packet)),
+            mutable_bytes(reinterpret_cast<uint8_t *>(&response),
+                          sizeof(response)),
+            reset_delay);
+
+        /* The iMTQ has just rebooted, so silence is the expected answer */
+        if (status != ADCS_ERROR_NO_RESPONSE)
+        {
+            co_return unexpected<KADCSStatus>(ADCS_ERROR);
+        }
+
+        co_return result<void>();
+    }
+
+    /**
+     * Run a self-test and collect its results
+     * @param [in] axis Axis to test
+     * @param [in] buffer JSON object which receives the test results
+     * @return Result of the test
+     */
+    task<result<void>> run_test(ADCSTestType axis, adcs_test_results buffer)
+    {
+        if (buffer == nullptr)
+        {
+            co_return unexpected<KADCSStatus>(ADCS_ERROR_CONFIG);
+        }
+
+        result<imtq_resp_header> started = co_await send(encode::start_test(axis));
+        if (!started)
+        {
+            co_return unexpected<KADCSStatus>(started.status());
+        }
+
+        co_await ex_.sleep_for(test_delay);
+
+        const uint8_t cmd = GET_TEST;
+        if (axis == TEST_ALL)
+        {
+            imtq_test_result_all data{};
+
+            KADCSStatus status = co_await transfer(
+                const_bytes(&cmd, 1),
+                mutable_bytes(reinterpret_cast<uint8_t *>(&data), sizeof(data)));
+            if (status != ADCS_OK)
+            {
+                co_return unexpected<KADCSStatus>(status);
+            }
+
+            for (const imtq_test_result & step :
+                 { data.init, data.x_pos, data.x_neg, data.y_pos, data.y_neg,
+                   data.z_pos, data.z_neg, data.final })
+            {
+                kprv_adcs_process_test(buffer, step);
+            }
+        }
+        else
+        {
+            imtq_test_result_single data{};
+
+            KADCSStatus status = co_await transfer(
+                const_bytes(&cmd, 1),
+                mutable_bytes(reinterpret_cast<uint8_t *>(&data), sizeof(data)));
+            if (status != ADCS_OK)
+            {
+                co_return unexpected<KADCSStatus>(status);
+            }
+
+            kprv_adcs_process_test(buffer, data.init);
+            kprv_adcs_process_test(buffer, data.step);
+            kprv_adcs_process_test(buffer, data.final);
+        }
+
+        co_return result<void>();
+    }
+
+    /**
+     * Raw command/response exchange
+     * @param [in] tx Command to send. Must stay valid until the task finishes.
+     * @param [in] rx Buffer for the response
+     * @param [in] delay Gap between command and reply
+     * @return `ADCS_OK` if OK, error otherwise
+     */
+    task<KADCSStatus> transfer(const_bytes tx, mutable_bytes rx,
+                               std::chrono::nanoseconds delay = transfer_delay)
+    {
+        if (tx.empty() || rx.empty())
+        {
+            co_return ADCS_ERROR_CONFIG;
+        }
+
+        async_mutex::guard serial = co_await lock_.lock();
+
+        /*
+         * Blocking callers may be holding the C lock; poll for it on the
+         * wheel instead of parking the executor thread in timedlock
+         */
+        std::chrono::nanoseconds waited{ 0 };
+        while (pthread_mutex_trylock(&imtq_mutex) != 0)
+        {
+            if (waited >= lock_timeout)
+            {
+                co_return ADCS_ERROR_MUTEX;
+            }
+
+            co_await ex_.sleep_for(lock_poll);
+            waited += lock_poll;
+        }
+
+        KADCSStatus status
+            = kprv_imtq_send(tx.data(), static_cast<int>(tx.size()));
+        if (status == ADCS_OK)
+        {
+            co_await ex_.sleep_for(delay);
+            status = kprv_imtq_receive(tx[0], rx.data(),
+                                       static_cast<int>(rx.size()));
+        }
+
+        if (pthread_mutex_unlock(&imtq_mutex) != 0 && status == ADCS_OK)
+        {
+            status = ADCS_ERROR_MUTEX;
+        }
+
+        co_return status;
+    }
+
+private:
+    /* Same one-second bound as the blocking path's timedlock */
+    static constexpr std::chrono::milliseconds lock_timeout{ 1000 };
+    static constexpr std::chrono::milliseconds lock_poll{ 1 };
+
+    device &    dev_;
+    executor &  ex_;
+    async_mutex lock_;
+};
+
+} // namespace imtq
+} // namespace kubos
+
+/* @} */
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @addtogroup KUBOS_CPP_API
+ * @{
+ */
+
+#pragma once
+
+#include <gomspace-p31u-api.h>
+
+#include "frame.hpp"
+#include "handle.hpp"
+#include "result.hpp"
+#include "span.hpp"
+
+namespace kubos {
+namespace p31u {
+
+/** Result type returned by every EPS call */
+template <typename T>
+using result = kubos::result<T, KEPSStatus>;
+
+/**
+ * Typed telemetry selectors for ::kubos::p31u::device::get
+ */
+namespace telemetry {
+
+/** System housekeeping data */
+struct housekeeping
+{
+    using type = eps_hk_t;
+    static KEPSStatus read(type * data) { return k_eps_get_housekeeping(data); }
+};
+
+/** System configuration */
+struct system_config
+{
+    using type = eps_system_config_t;
+    static KEPSStatus read(type * data) { return k_eps_get_system_config(data); }
+};
+
+/** Battery configuration */
+struct battery_config
+{
+    using type = eps_battery_config_t;
+    static KEPSStatus read(type * data)
+    {
+        return k_eps_get_battery_config(data);
+    }
+};
+
+} // namespace telemetry
+
+/**
+ * Compile-time command frame builders
+ *
+ * Byte layouts match the packets built by the corresponding `k_eps_*`
+ * functions. Arguments are not range checked; use the ::kubos::p31u::device
+ * methods when the values are not known to be valid.
+ */
+namespace encode {
+
+/**
+ * @param [in] channel_mask Bitmask of output channels to turn on
+ * @return Set-output command
+ */
+constexpr frame<2> set_output(uint8_t channel_mask) noexcept
+{
+    return { { SET_OUTPUT, channel_mask } };
+}
+
+/**
+ * @param [in] channel Output to control (0-7)
+ * @param [in] value 0 = Off, 1 = On
+ * @param [in] delay Seconds to wait before changing the output
+ * @return Set-single-output command
+ */
+constexpr frame<5> set_single_output(uint8_t channel, uint8_t value,
+                                     int16_t delay) noexcept
+{
+    /* The EPS numbers its outputs in reverse; see k_eps_set_single_output */
+    return { { SET_SINGLE_OUTPUT, static_cast<uint8_t>(7 - channel), value,
+               detail::hi(static_cast<uint16_t>(delay)),
+               detail::lo(static_cast<uint16_t>(delay)) } };
+}
+
+/**
+ * @param [in] cmd Heater control command (always `0` for now)
+ * @param [in] heater Heater to control
+ * @param [in] mode 0 = Off, 1 = On
+ * @return Set-heater command
+ */
+constexpr frame<4> set_heater(uint8_t cmd, uint8_t heater, uint8_t mode) noexcept
+{
+    return { { SET_HEATER, cmd, heater, mode } };
+}
+
+} // namespace encode
+
+/** Running watchdog thread. Stopped when the object is destroyed. */
+using watchdog = unique_handle<&k_eps_watchdog_stop>;
+
+/**
+ * Open NanoPower session
+ *
+ * The C API keeps a single global session, so only one device should be open
+ * at a time. Closing happens automatically when the device is destroyed.
+ */
+class device
+{
+public:
+    /**
+     * Open the EPS
+     * @param [in] bus I2C bus device name
+     * @param [in] addr I2C address of the EPS
+     * @return Open device, or the `k_eps_init` failure status
+     */
+    static result<device> open(const char * bus, uint8_t addr)
+    {
+        KEPSConf   config = { const_cast<char *>(bus), addr };
+        KEPSStatus status = k_eps_init(config);
+        if (status != EPS_OK)
+        {
+            return unexpected<KEPSStatus>(status);
+        }
+
+        return device();
+    }
+
+    /** @return `true` if this object owns the session */
+    bool is_open() const noexcept { return session_.active(); }
+
+    /** Close the session early */
+    void close() noexcept { session_.reset(); }
+
+    /**
+     * Read a telemetry item
+     * @tparam Tag Selector from ::kubos::p31u::telemetry
+     * @return Telemetry structure
+     */
+    template <typename Tag>
+    result<typename Tag::type> get() const
+    {
+        return fetch<typename Tag::type>(&Tag::read);
+    }
+
+    /** @return Result of a ping */
+    result<void> ping() const { return check(k_eps_ping()); }
+
+    /** @return Result of a soft reboot */
+    result<void> reboot() const { return check(k_eps_reboot()); }
+
+    /**
+     * Turn on/off the NanoPower outputs
+     * @param [in] channel_mask Bitmask of output channels to turn on
+     * @return Result of the command
+     */
+    result<void> set_output(uint8_t channel_mask) const
+    {
+        return check(k_eps_set_output(channel_mask));
+    }
+
+    /**
+     * Turn on/off a single output
+     * @param [in] channel Output to control (0-7)
+     * @param [in] value 0 = Off, 1 = On
+     * @param [in] delay Seconds to wait before changing the output
+     * @return Result of the command
+     */
+    result<void> set_single_output(uint8_t channel, uint8_t value,
+                                   int16_t delay = 0) const
+    {
+        return check(k_eps_set_single_output(channel, value, delay));
+    }
+
+    /**
+     * Send a prebuilt command frame
+     * @param [in] cmd Frame from ::kubos::p31u::encode
+     * @return Response header
+     */
+    template <std::size_t N>
+    result<eps_resp_header> send(const frame<N> & cmd) const
+    {
+        eps_resp_header response{};
+        KEPSStatus      status
+            = k_eps_passthrough(cmd.data(), N,
+                                reinterpret_cast<uint8_t *>(&response),
+                                sizeof(response));
+        if (status != EPS_OK)
+        {
+            return unexpected<KEPSStatus>(status);
+        }
+
+        return response;
+    }
+
+    /**
+     * Pass a raw command through to the EPS without copying either buffer
+     * @param [in] tx Command to send
+     * @param [in] rx Buffer for the response
+     * @return Result of the transfer
+     */
+    result<void> passthrough(const_bytes tx, mutable_bytes rx) const
+    {
+        return check(k_eps_passthrough(tx.data(), static_cast<int>(tx.size()),
+                                       rx.data(), static_cast<int>(rx.size())));
+    }
+
+    /**
+     * Start the watchdog kicking thread
+     * @param [in] interval Seconds between kicks
+     * @return Watchdog handle which stops the thread when destroyed
+     */
+    result<watchdog> start_watchdog(uint32_t interval) const
+    {
+        KEPSStatus status = k_eps_watchdog_start(interval);
+        if (status != EPS_OK)
+        {
+            return unexpected<KEPSStatus>(status);
+        }
+
+        return watchdog(true);
+    }
+
+private:
+    device() noexcept : session_(true) {}
+
+    unique_handle<&k_eps_terminate> session_;
+};
+
+} // namespace p31u
+} // namespace kubos
+
+/* @} */
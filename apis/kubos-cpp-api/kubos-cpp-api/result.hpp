@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @defgroup KUBOS_CPP_API Kubos C++ Bindings
+ * @addtogroup KUBOS_CPP_API
+ * @{
+ */
+
+#pragma once
+
+#include <cassert>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace kubos {
+
+/**
+ * Maps a C status enum onto its success value
+ *
+ * Every C API in this tree returns a status enum whose success value is the
+ * first enumerator, so the default covers all of them. Specialize this if a
+ * status type ever breaks that rule.
+ */
+template <typename E>
+struct status_traits
+{
+    /** Value of `E` which indicates success */
+    static constexpr E ok = static_cast<E>(0);
+};
+
+/**
+ * Error wrapper used to construct a failed ::result
+ */
+template <typename E>
+class unexpected
+{
+public:
+    /**
+     * Wrap a failure status
+     * @param [in] status Status returned by the C API
+     */
+    constexpr explicit unexpected(E status) noexcept : status_(status) {}
+
+    /** @return Wrapped failure status */
+    constexpr E status() const noexcept { return status_; }
+
+private:
+    E status_;
+};
+
+/**
+ * Expected-style return value holding either a `T` or a failure status `E`
+ *
+ * No exceptions are thrown. Accessing the value of a failed result is a
+ * programming error and is caught by `assert` in debug builds.
+ */
+template <typename T, typename E>
+class result
+{
+public:
+    /** Type of the contained value */
+    using value_type = T;
+    /** Type of the failure status */
+    using status_type = E;
+
+    /**
+     * Construct a successful result
+     * @param [in] value Value to store
+     */
+    result(const T & value) : status_(status_traits<E>::ok)
+    {
+        new (&value_) T(value);
+    }
+
+    /**
+     * Construct a successful result
+     * @param [in] value Value to move into the result
+     */
+    result(T && value) : status_(status_traits<E>::ok)
+    {
+        new (&value_) T(std::move(value));
+    }
+
+    /**
+     * Construct a failed result
+     * @param [in] err Failure status
+     */
+    result(unexpected<E> err) noexcept : status_(err.status())
+    {
+        assert(status_ != status_traits<E>::ok);
+    }
+
+    result(const result & other) : status_(other.status_)
+    {
+        if (other.has_value())
+        {
+            new (&value_) T(other.value_);
+        }
+    }
+
+    result(result && other) noexcept(std::is_nothrow_move_constructible<T>::value)
+        : status_(other.status_)
+    {
+        if (other.has_value())
+        {
+            new (&value_) T(std::move(other.value_));
+        }
+    }
+
+    result & operator=(result other) noexcept(
+        std::is_nothrow_move_constructible<T>::value)
+    {
+        this->~result();
+        new (this) result(std::move(other));
+        return *this;
+    }
+
+    ~result()
+    {
+        if (has_value())
+        {
+            value_.~T();
+        }
+    }
+
+    /** @return `true` if the result holds a value */
+    constexpr bool has_value() const noexcept
+    {
+        return status_ == status_traits<E>::ok;
+    }
+
+    /** @return `true` if the result holds a value */
+    constexpr explicit operator bool() const noexcept { return has_value(); }
+
+    /** @return Status of the underlying call (the success value if OK) */
+    constexpr E status() const noexcept { return status_; }
+
+    /** @return Contained value */
+    T & value() & noexcept
+    {
+        assert(has_value());
+        return value_;
+    }
+
+    /** @return Contained value */
+    const T & value() const & noexcept
+    {
+        assert(has_value());
+        return value_;
+    }
+
+    /** @return Contained value */
+    T && value() && noexcept
+    {
+        assert(has_value());
+        return std::move(value_);
+    }
+
+    /**
+     * Get the contained value, or a fallback if the call failed
+     * @param [in] fallback Value to return on failure
+     * @return Contained value or `fallback`
+     */
+    template <typename U>
+    T value_or(U && fallback) const &
+    {
+        return has_value() ? value_ : static_cast<T>(std::forward<U>(fallback));
+    }
+
+    T &       operator*() & noexcept { return value(); }
+    const T & operator*() const & noexcept { return value(); }
+    T *       operator->() noexcept { return &value(); }
+    const T * operator->() const noexcept { return &value(); }
+
+private:
+    union {
+        T value_;
+    };
+    E status_;
+};
+
+/**
+ * Result of a call which produces no value
+ */
+template <typename E>
+class result<void, E>
+{
+public:
+    /** Type of the failure status */
+    using status_type = E;
+
+    /** Construct a successful result */
+    constexpr result() noexcept : status_(status_traits<E>::ok) {}
+
+    /**
+     * Construct a failed result
+     * @param [in] err Failure status
+     */
+    constexpr result(unexpected<E> err) noexcept : status_(err.status()) {}
+
+    /** @return `true` if the call succeeded */
+    constexpr bool has_value() const noexcept
+    {
+        return status_ == status_traits<E>::ok;
+    }
+
+    /** @return `true` if the call succeeded */
+    constexpr explicit operator bool() const noexcept { return has_value(); }
+
+    /** @return Status of the underlying call */
+    constexpr E status() const noexcept { return status_; }
+
+private:
+    E status_;
+};
+
+/**
+ * Convert a C status value into a ::result
+ * @param [in] status Status returned by the C API
+ * @return Successful result if `status` is the success value
+ */
+template <typename E>
+constexpr result<void, E> check(E status) noexcept
+{
+    if (status != status_traits<E>::ok)
+    {
+        return unexpected<E>(status);
+    }
+
+    return {};
+}
+
+/**
+ * Call a C getter which fills a `T` through an out-pointer
+ * @param [in] fn Getter to call
+ * @param [in] args Arguments passed ahead of the out-pointer
+ * @return Filled value, or the status returned by `fn`
+ */
+template <typename T, typename Fn, typename... Args>
+inline auto fetch(Fn fn, Args... args)
+    -> result<T, decltype(fn(args..., static_cast<T *>(nullptr)))>
+{
+    using E = decltype(fn(args..., static_cast<T *>(nullptr)));
+
+    T    data{};
+    E    status = fn(args..., &data);
+    if (status != status_traits<E>::ok)
+    {
+        return unexpected<E>(status);
+    }
+
+    return data;
+}
+
+} // namespace kubos
+
+/* @} */
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @addtogroup KUBOS_CPP_API
+ * @{
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#if __cplusplus > 201703L && __has_include(<span>)
+#include <span>
+#endif
+
+namespace kubos {
+
+#if defined(__cpp_lib_span)
+
+/** Non-owning view of a contiguous buffer */
+template <typename T>
+using span = std::span<T>;
+
+#else
+
+/**
+ * Non-owning view of a contiguous buffer
+ *
+ * Subset of C++20's `std::span` (dynamic extent only) so that frames can be
+ * handed to the C APIs without being copied. When building as C++20 this is
+ * an alias of `std::span` instead.
+ */
+template <typename T>
+class span
+{
+public:
+    /** Element type */
+    using element_type = T;
+    /** Iterator type */
+    using iterator = T *;
+
+    /** Construct an empty view */
+    constexpr span() noexcept : data_(nullptr), size_(0) {}
+
+    /**
+     * Construct a view from a pointer and a length
+     * @param [in] data First element
+     * @param [in] size Number of elements
+     */
+    constexpr span(T * data, std::size_t size) noexcept
+        : data_(data), size_(size)
+    {
+    }
+
+    /**
+     * Construct a view of a C array
+     * @param [in] arr Array to view
+     */
+    template <std::size_t N>
+    constexpr span(T (&arr)[N]) noexcept : data_(arr), size_(N)
+    {
+    }
+
+    /**
+     * Construct a view of a container with `data()` and `size()`
+     * (`std::array`, `std::vector`, `std::string`, another span...)
+     * @param [in] c Container to view
+     */
+    template <typename C,
+              typename = decltype(static_cast<T *>(std::declval<C &>().data())),
+              typename = decltype(std::declval<C &>().size())>
+    constexpr span(C & c) noexcept : data_(c.data()), size_(c.size())
+    {
+    }
+
+    /** @return Pointer to the first element */
+    constexpr T * data() const noexcept { return data_; }
+    /** @return Number of elements */
+    constexpr std::size_t size() const noexcept { return size_; }
+    /** @return Size of the view in bytes */
+    constexpr std::size_t size_bytes() const noexcept
+    {
+        return size_ * sizeof(T);
+    }
+    /** @return `true` if the view is empty */
+    constexpr bool empty() const noexcept { return size_ == 0; }
+
+    constexpr T & operator[](std::size_t idx) const noexcept
+    {
+        return data_[idx];
+    }
+
+    constexpr iterator begin() const noexcept { return data_; }
+    constexpr iterator end() const noexcept { return data_ + size_; }
+
+    /**
+     * @param [in] count Number of leading elements to keep
+     * @return View of the first `count` elements
+     */
+    constexpr span first(std::size_t count) const noexcept
+    {
+        return span(data_, count);
+    }
+
+    /**
+     * @param [in] offset Index of the first element to keep
+     * @param [in] count Number of elements to keep
+     * @return View of `count` elements starting at `offset`
+     */
+    constexpr span subspan(std::size_t offset,
+                           std::size_t count = static_cast<std::size_t>(-1)) const
+        noexcept
+    {
+        return span(data_ + offset,
+                    count == static_cast<std::size_t>(-1) ? size_ - offset
+                                                          : count);
+    }
+
+private:
+    T *         data_;
+    std::size_t size_;
+};
+
+#endif
+
+/** Read-only byte buffer */
+using const_bytes = span<const uint8_t>;
+/** Writable byte buffer */
+using mutable_bytes = span<uint8_t>;
+
+} // namespace kubos
+
+/* @} */
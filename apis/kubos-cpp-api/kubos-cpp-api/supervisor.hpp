@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @addtogroup KUBOS_CPP_API
+ * @{
+ */
+
+#pragma once
+
+#include <supervisor.h>
+
+#include "result.hpp"
+
+namespace kubos {
+namespace supervisor {
+
+/**
+ * Supervisor call status
+ *
+ * The C API only reports pass/fail, so this is the whole error space.
+ */
+enum class status
+{
+    ok,   /**< Command sent and response CRC valid */
+    error /**< Command failed or response CRC invalid */
+};
+
+/** Result type returned by every supervisor call */
+template <typename T>
+using result = kubos::result<T, status>;
+
+namespace detail {
+
+inline result<void> check(bool ok) noexcept
+{
+    if (!ok)
+    {
+        return unexpected<status>(status::error);
+    }
+
+    return {};
+}
+
+} // namespace detail
+
+/** @return Supervisor version and configuration */
+inline result<supervisor_version_t> version()
+{
+    supervisor_version_t data{};
+    if (!supervisor_get_version(&data))
+    {
+        return unexpected<status>(status::error);
+    }
+
+    return data;
+}
+
+/** @return Supervisor housekeeping data */
+inline result<supervisor_housekeeping_t> housekeeping()
+{
+    supervisor_housekeeping_t data{};
+    if (!supervisor_get_housekeeping(&data))
+    {
+        return unexpected<status>(status::error);
+    }
+
+    return data;
+}
+
+/** @return Result of power cycling the iOBC */
+inline result<void> powercycle() { return detail::check(supervisor_powercycle()); }
+
+/** @return Result of resetting the supervisor */
+inline result<void> reset() { return detail::check(supervisor_reset()); }
+
+/** @return Result of an emergency reset of the supervisor */
+inline result<void> emergency_reset()
+{
+    return detail::check(supervisor_emergency_reset());
+}
+
+} // namespace supervisor
+} // namespace kubos
+
+/* @} */
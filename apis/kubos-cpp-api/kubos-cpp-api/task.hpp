@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @addtogroup KUBOS_CPP_API
+ * @{
+ */
+
+#pragma once
+
+#if __cplusplus < 202002L
+#error "task.hpp requires C++20 coroutines"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace kubos {
+
+template <typename T>
+class task;
+
+namespace detail {
+
+/* Resumes whoever co_awaited the task once it finishes */
+struct final_awaiter
+{
+    bool await_ready() const noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<Promise> self) const noexcept
+    {
+        if (self.promise().continuation)
+        {
+            return self.promise().continuation;
+        }
+
+        return std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {}
+};
+
+struct promise_base
+{
+    std::coroutine_handle<> continuation;
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    final_awaiter       final_suspend() const noexcept { return {}; }
+
+    /* Nothing in this layer throws; an escaping exception is a bug */
+    void unhandled_exception() const noexcept { std::terminate(); }
+};
+
+} // namespace detail
+
+/**
+ * Lazily started coroutine producing a `T`
+ *
+ * A task does nothing until it is `co_await`ed (or handed to
+ * ::kubos::executor::spawn). The awaiting coroutine is resumed directly when
+ * the task finishes, without going back through the executor.
+ */
+template <typename T = void>
+class task
+{
+public:
+    struct promise_type : detail::promise_base
+    {
+        std::optional<T> value;
+
+        task get_return_object() noexcept
+        {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        template <typename U>
+        void return_value(U && val)
+        {
+            value.emplace(std::forward<U>(val));
+        }
+    };
+
+    task(task && other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    task(const task &) = delete;
+    task & operator=(const task &) = delete;
+
+    task & operator=(task && other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+
+        return *this;
+    }
+
+    ~task() { destroy(); }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+
+    T await_resume() { return std::move(*handle_.promise().value); }
+
+private:
+    explicit task(std::coroutine_handle<promise_type> handle) noexcept
+        : handle_(handle)
+    {
+    }
+
+    void destroy() noexcept
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+            handle_ = {};
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+/**
+ * Lazily started coroutine with no result
+ */
+template <>
+class task<void>
+{
+public:
+    struct promise_type : detail::promise_base
+    {
+        task get_return_object() noexcept
+        {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        void return_void() const noexcept {}
+    };
+
+    task(task && other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    task(const task &) = delete;
+    task & operator=(const task &) = delete;
+
+    task & operator=(task && other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            handle_ = std::exchange(other.handle_, {});
+        }
+
+        return *this;
+    }
+
+    ~task() { destroy(); }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    explicit task(std::coroutine_handle<promise_type> handle) noexcept
+        : handle_(handle)
+    {
+    }
+
+    void destroy() noexcept
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+            handle_ = {};
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+} // namespace kubos
+
+/* @} */
@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @addtogroup KUBOS_CPP_API
+ * @{
+ */
+
+#pragma once
+
+/*
+ * trxvu.h defines reset command macros which collide with the iMTQ
+ * (`SOFT_RESET`) and NanoPower (`HARD_RESET`) headers. Keep them from leaking
+ * out of this header so all of the device bindings can share a translation
+ * unit, whatever order they are included in.
+ */
+#pragma push_macro("SOFT_RESET")
+#pragma push_macro("HARD_RESET")
+#pragma push_macro("WATCHDOG_RESET")
+#undef SOFT_RESET
+#undef HARD_RESET
+#undef WATCHDOG_RESET
+#include <trxvu.h>
+#undef SOFT_RESET
+#undef HARD_RESET
+#undef WATCHDOG_RESET
+#pragma pop_macro("WATCHDOG_RESET")
+#pragma pop_macro("HARD_RESET")
+#pragma pop_macro("SOFT_RESET")
+
+#include "frame.hpp"
+#include "handle.hpp"
+#include "result.hpp"
+#include "span.hpp"
+
+namespace kubos {
+namespace trxvu {
+
+/** Result type returned by every radio call */
+template <typename T>
+using result = kubos::result<T, KRadioStatus>;
+
+/**
+ * Typed telemetry selectors for ::kubos::trxvu::device::get
+ *
+ * Each selector picks the right member out of the ::radio_telem union, so
+ * callers never touch the union directly.
+ */
+namespace telemetry {
+
+/** Current transmitter telemetry */
+struct tx_all
+{
+    using type = trxvu_tx_telem_raw;
+    static KRadioStatus read(type * data)
+    {
+        radio_telem  telem;
+        KRadioStatus status = k_radio_get_telemetry(&telem, RADIO_TX_TELEM_ALL);
+        *data               = telem.tx_telem;
+        return status;
+    }
+};
+
+/** Transmitter telemetry sampled during the last transmission */
+struct tx_last
+{
+    using type = trxvu_tx_telem_raw;
+    static KRadioStatus read(type * data)
+    {
+        radio_telem  telem;
+        KRadioStatus status = k_radio_get_telemetry(&telem, RADIO_TX_TELEM_LAST);
+        *data               = telem.tx_telem;
+        return status;
+    }
+};
+
+/** Transmitter uptime */
+struct tx_uptime
+{
+    using type = trxvu_uptime;
+    static KRadioStatus read(type * data)
+    {
+        radio_telem  telem;
+        KRadioStatus status = k_radio_get_telemetry(&telem, RADIO_TX_UPTIME);
+        *data               = telem.uptime;
+        return status;
+    }
+};
+
+/** Transmitter state flags */
+struct tx_state
+{
+    using type = uint8_t;
+    static KRadioStatus read(type * data)
+    {
+        radio_telem  telem;
+        KRadioStatus status = k_radio_get_telemetry(&telem, RADIO_TX_STATE);
+        *data               = telem.tx_state;
+        return status;
+    }
+};
+
+/** Current receiver telemetry */
+struct rx_all
+{
+    using type = trxvu_rx_telem_raw;
+    static KRadioStatus read(type * data)
+    {
+        radio_telem  telem;
+        KRadioStatus status = k_radio_get_telemetry(&telem, RADIO_RX_TELEM_ALL);
+        *data               = telem.rx_telem;
+        return status;
+    }
+};
+
+/** Receiver uptime */
+struct rx_uptime
+{
+    using type = trxvu_uptime;
+    static KRadioStatus read(type * data)
+    {
+        radio_telem  telem;
+        KRadioStatus status = k_radio_get_telemetry(&telem, RADIO_RX_UPTIME);
+        *data               = telem.uptime;
+        return status;
+    }
+};
+
+} // namespace telemetry
+
+/**
+ * Compile-time frame builders
+ */
+namespace encode {
+
+/**
+ * Build an AX.25 call-sign from a six character string literal
+ * @param [in] ascii Call-sign, space padded to six characters
+ * @param [in] ssid Station SSID
+ * @return Call-sign structure
+ */
+constexpr ax25_callsign callsign(const char (&ascii)[7], uint8_t ssid) noexcept
+{
+    return { { static_cast<uint8_t>(ascii[0]), static_cast<uint8_t>(ascii[1]),
+               static_cast<uint8_t>(ascii[2]), static_cast<uint8_t>(ascii[3]),
+               static_cast<uint8_t>(ascii[4]), static_cast<uint8_t>(ascii[5]) },
+             ssid };
+}
+
+/**
+ * Header which precedes the payload of a ::SEND_AX25_OVERRIDE frame
+ * @param [in] to Destination call-sign
+ * @param [in] from Source call-sign
+ * @return Frame header, as built by `k_radio_send_override`
+ */
+constexpr frame<15> override_header(const ax25_callsign & to,
+                                    const ax25_callsign & from) noexcept
+{
+    return { { SEND_AX25_OVERRIDE, to.ascii[0], to.ascii[1], to.ascii[2],
+               to.ascii[3], to.ascii[4], to.ascii[5], to.ssid, from.ascii[0],
+               from.ascii[1], from.ascii[2], from.ascii[3], from.ascii[4],
+               from.ascii[5], from.ssid } };
+}
+
+} // namespace encode
+
+/**
+ * Frame returned by ::kubos::trxvu::device::recv
+ */
+struct rx_frame
+{
+    radio_rx_header header;  /**< Receive metadata */
+    mutable_bytes   payload; /**< Payload, pointing into the caller's buffer */
+};
+
+/** Running watchdog thread. Stopped when the object is destroyed. */
+using watchdog = unique_handle<&k_radio_watchdog_stop>;
+
+/**
+ * Open TRXVU session
+ *
+ * The C API keeps a single global session, so only one device should be open
+ * at a time. Closing happens automatically when the device is destroyed.
+ */
+class device
+{
+public:
+    /**
+     * Open the radio
+     * @param [in] bus I2C bus device name
+     * @param [in] tx Transmitter properties
+     * @param [in] rx Receiver properties
+     * @param [in] timeout Watchdog timeout (in seconds)
+     * @return Open device, or the `k_radio_init` failure status
+     */
+    static result<device> open(const char * bus, trx_prop tx, trx_prop rx,
+                               uint16_t timeout)
+    {
+        KRadioStatus status
+            = k_radio_init(const_cast<char *>(bus), tx, rx, timeout);
+        if (status != RADIO_OK)
+        {
+            return unexpected<KRadioStatus>(status);
+        }
+
+        return device();
+    }
+
+    /** @return `true` if this object owns the session */
+    bool is_open() const noexcept { return session_.active(); }
+
+    /** Close the session early */
+    void close() noexcept { session_.reset(); }
+
+    /**
+     * Read a telemetry item
+     * @tparam Tag Selector from ::kubos::trxvu::telemetry
+     * @return Telemetry value
+     */
+    template <typename Tag>
+    result<typename Tag::type> get() const
+    {
+        return fetch<typename Tag::type>(&Tag::read);
+    }
+
+    /**
+     * Apply a transmitter configuration
+     * @param [in] config New configuration
+     * @return Result of the configuration
+     */
+    result<void> configure(radio_config & config) const
+    {
+        return check(k_radio_configure(&config));
+    }
+
+    /**
+     * Reset the radio
+     * @param [in] type Type of reset
+     * @return Result of the reset
+     */
+    result<void> reset(KRadioReset type) const
+    {
+        return check(k_radio_reset(type));
+    }
+
+    /**
+     * Queue a frame for transmission
+     * @param [in] payload Frame payload
+     * @return Number of transmit buffer slots left
+     */
+    result<uint8_t> send(const_bytes payload) const
+    {
+        return fetch<uint8_t>(&k_radio_send, as_chars(payload),
+                              static_cast<int>(payload.size()));
+    }
+
+    /**
+     * Queue a frame for transmission with non-default call-signs
+     * @param [in] payload Frame payload
+     * @param [in] to Destination call-sign
+     * @param [in] from Source call-sign
+     * @return Number of transmit buffer slots left
+     */
+    result<uint8_t> send(const_bytes payload, ax25_callsign to,
+                         ax25_callsign from) const
+    {
+        return fetch<uint8_t>(&k_radio_send_override, to, from,
+                              as_chars(payload),
+                              static_cast<int>(payload.size()));
+    }
+
+    /**
+     * Receive a frame into a caller-owned buffer
+     * @param [in] buffer Storage for the payload. Must hold at least the
+     *                    receiver's `max_size` bytes.
+     * @return Received frame, or `RADIO_RX_EMPTY` if nothing was waiting
+     */
+    result<rx_frame> recv(mutable_bytes buffer) const
+    {
+        if (buffer.size() < radio_rx.max_size)
+        {
+            return unexpected<KRadioStatus>(RADIO_ERROR_CONFIG);
+        }
+
+        rx_frame     frame{};
+        uint8_t      len = 0;
+        KRadioStatus status
+            = k_radio_recv(&frame.header, buffer.data(), &len);
+        if (status != RADIO_OK)
+        {
+            return unexpected<KRadioStatus>(status);
+        }
+
+        frame.payload = buffer.first(frame.header.msg_size);
+        return frame;
+    }
+
+    /**
+     * Start the watchdog kicking thread
+     * @return Watchdog handle which stops the thread when destroyed
+     */
+    result<watchdog> start_watchdog() const
+    {
+        KRadioStatus status = k_radio_watchdog_start();
+        if (status != RADIO_OK)
+        {
+            return unexpected<KRadioStatus>(status);
+        }
+
+        return watchdog(true);
+    }
+
+private:
+    device() noexcept : session_(true) {}
+
+    /* The C API takes `char *` but only ever reads the payload */
+    static char * as_chars(const_bytes payload) noexcept
+    {
+        return reinterpret_cast<char *>(const_cast<uint8_t *>(payload.data()));
+    }
+
+    unique_handle<&k_radio_terminate> session_;
+};
+
+} // namespace trxvu
+} // namespace kubos
+
+/* @} */
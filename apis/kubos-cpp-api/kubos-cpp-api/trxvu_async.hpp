@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @addtogroup KUBOS_CPP_API
+ * @{
+ */
+
+#pragma once
+
+#include <chrono>
+
+#include "executor.hpp"
+#include "trxvu.hpp"
+
+namespace kubos {
+namespace trxvu {
+
+/**
+ * Non-blocking receive loop for an open TRXVU session
+ *
+ * The TRXVU has no interrupt line, so frames still have to be polled for.
+ * Between polls the coroutine sleeps on the executor's timer wheel rather
+ * than holding a thread.
+ */
+class async_device
+{
+public:
+    /**
+     * @param [in] dev Open device. Must outlive this object.
+     * @param [in] ex Executor which drives the polling
+     */
+    async_device(device & dev, executor & ex) noexcept : dev_(dev), ex_(ex) {}
+
+    /** @return `true` if the underlying session is still open */
+    bool is_open() const noexcept { return dev_.is_open(); }
+
+    /**
+     * Wait for a frame
+     * @param [in] buffer Storage for the payload. Must hold at least the
+     *                    receiver's `max_size` bytes and stay valid until
+     *                    the task finishes.
+     * @param [in] interval Time between polls of the receive buffer
+     * @param [in] timeout Give up after this long (zero polls once)
+     * @return Received frame, or `RADIO_RX_EMPTY` if none arrived in time
+     */
+    task<result<rx_frame>> recv(mutable_bytes buffer,
+                                std::chrono::nanoseconds interval,
+                                std::chrono::nanoseconds timeout)
+    {
+        std::chrono::nanoseconds deadline = executor::now() + timeout;
+
+        for (;;)
+        {
+            result<rx_frame> frame = dev_.recv(buffer);
+            if (frame || frame.status() != RADIO_RX_EMPTY)
+            {
+                co_return frame;
+            }
+
+            if (executor::now() + interval > deadline)
+            {
+                co_return unexpected<KRadioStatus>(RADIO_RX_EMPTY);
+            }
+
+            co_await ex_.sleep_for(interval);
+        }
+    }
+
+private:
+    device &   dev_;
+    executor & ex_;
+};
+
+} // namespace trxvu
+} // namespace kubos
+
+/* @} */
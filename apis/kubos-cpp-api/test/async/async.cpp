@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <imtq_async.hpp>
+#include <trxvu_async.hpp>
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+extern "C" {
+#include <cmocka.h>
+}
+
+#include <chrono>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+static const char * bus  = "/dev/i2c-1";
+static uint16_t     addr = 0x40;
+
+static imtq_resp_header response = {};
+
+static std::unique_ptr<kubos::executor> make_executor()
+{
+    auto ex = kubos::executor::create();
+    assert_true(ex.has_value());
+
+    return std::move(ex.value());
+}
+
+static kubos::imtq::device open_imtq()
+{
+    will_return(__wrap_open, 1);
+    expect_value(__wrap_write, cmd, NOOP);
+    expect_value(__wrap_read, len, sizeof(imtq_resp_header));
+    will_return(__wrap_read, &response);
+
+    auto dev = kubos::imtq::device::open(bus, addr, 60);
+    assert_true(dev.has_value());
+
+    return std::move(dev.value());
+}
+
+static kubos::task<void> sleeper(kubos::executor & ex,
+                                 std::chrono::milliseconds delay,
+                                 std::vector<int> & order)
+{
+    co_await ex.sleep_for(delay);
+    order.push_back(static_cast<int>(delay.count()));
+}
+
+static void test_sleep_order(void ** arg)
+{
+    auto             ex = make_executor();
+    std::vector<int> order;
+
+    auto start = kubos::executor::now();
+
+    ex->spawn(sleeper(*ex, 30ms, order));
+    ex->spawn(sleeper(*ex, 10ms, order));
+    ex->spawn(sleeper(*ex, 20ms, order));
+
+    assert_int_equal(ex->run(), 0);
+
+    /* All three run on one thread, so the total is the longest, not the sum */
+    auto elapsed = kubos::executor::now() - start;
+    assert_true(elapsed >= 30ms);
+    assert_true(elapsed < 60ms);
+
+    assert_int_equal(order.size(), 3);
+    assert_int_equal(order[0], 10);
+    assert_int_equal(order[1], 20);
+    assert_int_equal(order[2], 30);
+}
+
+static void test_async_get(void ** arg)
+{
+    auto ex  = make_executor();
+    auto dev = open_imtq();
+
+    kubos::imtq::async_device adev(dev, *ex);
+
+    imtq_state state = {};
+    state.uptime     = 35;
+
+    expect_value(__wrap_write, cmd, GET_STATE);
+    expect_value(__wrap_read, len, sizeof(imtq_state));
+    will_return(__wrap_read, &state);
+
+    kubos::imtq::result<imtq_state> result
+        = kubos::unexpected<KADCSStatus>(ADCS_ERROR);
+
+    ex->spawn([](kubos::imtq::async_device &              adev,
+                 kubos::imtq::result<imtq_state> & out) -> kubos::task<void> {
+        out = co_await adev.get<kubos::imtq::telemetry::system_state>();
+    }(adev, result));
+
+    assert_int_equal(ex->run(), 0);
+
+    assert_true(result.has_value());
+    assert_int_equal(result->uptime, 35);
+
+    will_return(__wrap_close, 0);
+}
+
+static void test_async_serialized(void ** arg)
+{
+    auto ex  = make_executor();
+    auto dev = open_imtq();
+
+    kubos::imtq::async_device adev(dev, *ex);
+
+    imtq_state  state  = {};
+    imtq_dipole dipole = {};
+    dipole.data.x      = 42;
+
+    /*
+     * If the second exchange were written before the first reply was read,
+     * the first reply would carry the wrong echo and fail
+     */
+    expect_value(__wrap_write, cmd, GET_STATE);
+    expect_value(__wrap_read, len, sizeof(imtq_state));
+    will_return(__wrap_read, &state);
+    expect_value(__wrap_write, cmd, GET_DIPOLE);
+    expect_value(__wrap_read, len, sizeof(imtq_dipole));
+    will_return(__wrap_read, &dipole);
+
+    KADCSStatus first  = ADCS_ERROR;
+    KADCSStatus second = ADCS_ERROR;
+    int16_t     x      = 0;
+
+    ex->spawn([](kubos::imtq::async_device & adev,
+                 KADCSStatus &               out) -> kubos::task<void> {
+        auto res = co_await adev.get<kubos::imtq::telemetry::system_state>();
+        out      = res.status();
+    }(adev, first));
+
+    ex->spawn([](kubos::imtq::async_device & adev, KADCSStatus & out,
+                 int16_t & x) -> kubos::task<void> {
+        auto res = co_await adev.get<kubos::imtq::telemetry::dipole>();
+        out      = res.status();
+        if (res)
+        {
+            x = res->data.x;
+        }
+    }(adev, second, x));
+
+    assert_int_equal(ex->run(), 0);
+
+    assert_int_equal(first, ADCS_OK);
+    assert_int_equal(second, ADCS_OK);
+    assert_int_equal(x, 42);
+
+    will_return(__wrap_close, 0);
+}
+
+static void test_stop(void ** arg)
+{
+    auto             ex = make_executor();
+    std::vector<int> order;
+
+    /* Never finishes on its own within the test */
+    ex->spawn(sleeper(*ex, 10000ms, order));
+    ex->spawn([](kubos::executor & ex) -> kubos::task<void> {
+        co_await ex.sleep_for(1ms);
+        ex.stop();
+    }(*ex));
+
+    assert_int_equal(ex->run(), 0);
+    assert_true(order.empty());
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_sleep_order),
+        cmocka_unit_test(test_async_get),
+        cmocka_unit_test(test_async_serialized),
+        cmocka_unit_test(test_stop),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmocka.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * File descriptor handed out by the mocked open(). Anything else belongs to
+ * the executor (epoll, timerfd, eventfd) and goes to the real call.
+ */
+#define I2C_FD 1
+
+static uint8_t last_cmd;
+
+int     __real_close(int fd);
+ssize_t __real_write(int fd, const void * buf, size_t count);
+ssize_t __real_read(int fd, void * buf, size_t count);
+
+/* Returns a file descriptor or -1 on failure */
+int __wrap_open(const char * filename, int flags)
+{
+    return mock_type(int);
+}
+
+/* Returns 0 on success and -1 on failure */
+int __wrap_close(int fd)
+{
+    if (fd != I2C_FD)
+    {
+        return __real_close(fd);
+    }
+
+    return mock_type(int);
+}
+
+int __wrap_ioctl(int fd, unsigned long request, ...)
+{
+    return 0;
+}
+
+/*
+ * Returns number of bytes "written" or -1 on failure
+ */
+ssize_t __wrap_write(int fd, const char * buf, size_t count)
+{
+    if (fd != I2C_FD)
+    {
+        return __real_write(fd, buf, count);
+    }
+
+    uint8_t cmd = buf[0];
+    check_expected(cmd);
+
+    last_cmd = cmd;
+
+    return (ssize_t) count;
+}
+
+/*
+ * Returns number of bytes "read" or -1 on failure
+ *
+ * The iMTQ echoes the most recent command byte, so a reply read after a
+ * second command has been written comes back with the wrong echo
+ */
+ssize_t __wrap_read(int fd, char * buf, size_t count)
+{
+    if (fd != I2C_FD)
+    {
+        return __real_read(fd, buf, count);
+    }
+
+    ssize_t len = (ssize_t) count;
+
+    check_expected(len);
+
+    uint8_t * resp = (uint8_t *) mock();
+
+    memcpy(buf, resp, count);
+    buf[0] = last_cmd;
+
+    return len;
+}
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* All of the bindings must be usable from a single translation unit */
+#include <imtq.hpp>
+#include <trxvu.hpp>
+#include <p31u.hpp>
+#include <ants.hpp>
+#include <supervisor.hpp>
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+extern "C" {
+#include <cmocka.h>
+}
+
+#include <utility>
+
+static const char * bus  = "/dev/i2c-1";
+static uint16_t     addr = 0x40;
+
+static imtq_resp_header response = {};
+static imtq_resp_header error_resp = { 0, IMTQ_ERROR_BAD_PARAM };
+
+/* Frame layouts are checked at compile time against the C packet layouts */
+static_assert(kubos::imtq::encode::start_detumble(0x1234)[0] == START_BDOT, "");
+static_assert(kubos::imtq::encode::start_detumble(0x1234)[1] == 0x34, "");
+static_assert(kubos::imtq::encode::start_detumble(0x1234)[2] == 0x12, "");
+static_assert(kubos::imtq::encode::start_actuation_dipole(-1, 2, 3, 500)[2]
+                  == 0xFF,
+              "");
+static_assert(kubos::p31u::encode::set_single_output(0, 1, 0x0102)[1] == 7, "");
+static_assert(kubos::p31u::encode::set_single_output(0, 1, 0x0102)[3] == 0x01,
+              "");
+static_assert(kubos::ants::encode::auto_deploy(10).size() == 2, "");
+static_assert(kubos::trxvu::encode::override_header(
+                  kubos::trxvu::encode::callsign("KUBOS ", 1),
+                  kubos::trxvu::encode::callsign("GROUND", 2))[14]
+                  == 2,
+              "");
+
+/* Handles are one flag wide */
+static_assert(sizeof(kubos::imtq::device) == sizeof(bool), "");
+
+static kubos::imtq::device open_imtq()
+{
+    will_return(__wrap_open, 1);
+    expect_value(__wrap_write, cmd, NOOP);
+    expect_value(__wrap_read, len, sizeof(imtq_resp_header));
+    will_return(__wrap_read, &response);
+
+    auto dev = kubos::imtq::device::open(bus, addr, 60);
+    assert_true(dev.has_value());
+
+    return std::move(dev.value());
+}
+
+static void test_open_close(void ** arg)
+{
+    {
+        auto dev = open_imtq();
+        assert_true(dev.is_open());
+
+        /* Moving the handle must not close the session twice */
+        auto moved = std::move(dev);
+        assert_false(dev.is_open());
+        assert_true(moved.is_open());
+
+        will_return(__wrap_close, 0);
+    }
+}
+
+static void test_get(void ** arg)
+{
+    auto dev = open_imtq();
+
+    imtq_state state = {};
+    state.uptime     = 35;
+
+    expect_value(__wrap_write, cmd, GET_STATE);
+    expect_value(__wrap_read, len, sizeof(imtq_state));
+    will_return(__wrap_read, &state);
+
+    auto result = dev.get<kubos::imtq::telemetry::system_state>();
+
+    assert_true(result.has_value());
+    assert_int_equal(result->uptime, 35);
+
+    will_return(__wrap_close, 0);
+}
+
+static void test_send_error(void ** arg)
+{
+    auto dev = open_imtq();
+
+    expect_value(__wrap_write, cmd, START_BDOT);
+    expect_value(__wrap_read, len, sizeof(imtq_resp_header));
+    will_return(__wrap_read, &error_resp);
+
+    auto result = dev.send(kubos::imtq::encode::start_detumble(30));
+
+    assert_false(result.has_value());
+    assert_int_equal(result.status(), ADCS_ERROR_INTERNAL);
+
+    will_return(__wrap_close, 0);
+}
+
+static void test_passthrough_span(void ** arg)
+{
+    auto dev = open_imtq();
+
+    const uint8_t    tx[] = { NOOP };
+    imtq_resp_header rx   = {};
+
+    expect_value(__wrap_write, cmd, NOOP);
+    expect_value(__wrap_read, len, sizeof(imtq_resp_header));
+    will_return(__wrap_read, &response);
+
+    auto result = dev.passthrough(
+        tx, kubos::mutable_bytes(reinterpret_cast<uint8_t *>(&rx), sizeof(rx)));
+
+    assert_true(result.has_value());
+    assert_int_equal(rx.cmd, NOOP);
+
+    will_return(__wrap_close, 0);
+}
+
+static void test_open_fail(void ** arg)
+{
+    /* Rejected before touching the bus, so nothing needs to be closed */
+    auto dev = kubos::p31u::device::open(bus, 0);
+
+    assert_false(dev.has_value());
+    assert_int_equal(dev.status(), EPS_ERROR_CONFIG);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_open_close),
+        cmocka_unit_test(test_get),
+        cmocka_unit_test(test_send_error),
+        cmocka_unit_test(test_passthrough_span),
+        cmocka_unit_test(test_open_fail),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmocka.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+static uint8_t last_cmd;
+
+/* Returns a file descriptor or -1 on failure */
+int __wrap_open(const char * filename, int flags)
+{
+    return mock_type(int);
+}
+
+/* Returns 0 on success and -1 on failure */
+int __wrap_close(int fd)
+{
+    return mock_type(int);
+}
+
+int __wrap_ioctl(int fd, unsigned long request, ...)
+{
+    return 0;
+}
+
+/* Returns number of bytes "written" or -1 on failure */
+ssize_t __wrap_write(int fd, const char * buf, size_t count)
+{
+    uint8_t cmd = buf[0];
+    check_expected(cmd);
+
+    last_cmd = cmd;
+
+    return (ssize_t) count;
+}
+
+/*
+ * Returns number of bytes "read" or -1 on failure
+ *
+ * Both the iMTQ and the NanoPower echo the command byte at the start of each
+ * response, so do the same here
+ */
+ssize_t __wrap_read(int fd, char * buf, size_t count)
+{
+    ssize_t len = (ssize_t) count;
+
+    check_expected(len);
+
+    uint8_t * resp = (uint8_t *) mock();
+
+    memcpy(buf, resp, count);
+    buf[0] = last_cmd;
+
+    return len;
+}
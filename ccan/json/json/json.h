@@ -26,6 +26,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum {
 	JSON_NULL,
@@ -34,6 +35,7 @@ typedef enum {
 	JSON_NUMBER,
 	JSON_ARRAY,
 	JSON_OBJECT,
+	JSON_INTEGER, /* last, so the other tags keep their values */
 } JsonTag;
 
 typedef struct JsonNode JsonNode;
@@ -48,6 +50,10 @@ struct JsonNode
 	char *key; /* Must be valid UTF-8. */
 	
 	JsonTag tag;
+	
+	/* 0 while the node can be changed; see json_freeze */
+	uint32_t refs;
+	
 	union {
 		/* JSON_BOOL */
 		bool bool_;
@@ -58,6 +64,9 @@ struct JsonNode
 		/* JSON_NUMBER */
 		double number_;
 		
+		/* JSON_INTEGER */
+		int64_t int_;
+		
 		/* JSON_ARRAY */
 		/* JSON_OBJECT */
 		struct {
@@ -94,6 +103,7 @@ JsonNode *json_mknull(void);
 JsonNode *json_mkbool(bool b);
 JsonNode *json_mkstring(const char *s);
 JsonNode *json_mknumber(double n);
+JsonNode *json_mkint(int64_t n);
 JsonNode *json_mkarray(void);
 JsonNode *json_mkobject(void);
 
@@ -104,6 +114,129 @@ void json_prepend_member(JsonNode *object, const char *key, JsonNode *value);
 
 void json_remove_from_parent(JsonNode *node);
 
+/*** Numbers ***/
+
+/*
+ * Integers without a fraction or exponent are decoded as JSON_INTEGER when
+ * they fit in an int64_t, and as JSON_NUMBER (double) otherwise.  These
+ * accept either tag.
+ *
+ * json_get_int fails for a JSON_NUMBER with a fractional part or outside the
+ * int64_t range.  Both fail for non-numeric nodes.
+ */
+bool json_get_int(const JsonNode *node, int64_t *out);
+bool json_get_number(const JsonNode *node, double *out);
+
+/*** Merge patches (RFC 7386) ***/
+
+/*
+ * Build a merge patch which turns a into b: changed members and whole new
+ * values, with null for each member of a that b lacks.  Members whose
+ * subtrees are identical are left out, so the patch is as small as the
+ * delta.  Returns {} if a and b are equal objects, and a copy of b if
+ * either is not an object.
+ *
+ * As RFC 7386 itself cannot, the patch cannot set a member to null or add
+ * an object value containing null members; those nulls are read as removals.
+ */
+JsonNode *json_diff(const JsonNode *a, const JsonNode *b);
+
+/*
+ * Apply a merge patch to target (which may be NULL), changing only the
+ * members the patch names.  Returns the patched document: target itself
+ * when it and the patch are both objects, otherwise a new node which has
+ * taken target's place (and key) in its parent, if any, with target freed.
+ * The patch is not modified.
+ */
+JsonNode *json_merge_patch(JsonNode *target, const JsonNode *patch);
+
+/*** Immutable documents ***/
+
+/*
+ * A frozen document can be read by any number of threads at once, without
+ * locks, through the usual lookup, traversal and encoding functions; a
+ * const JsonNode * from these functions can be passed wherever a document
+ * is only read.  It must not be changed: edits instead make a new version
+ * which shares every unchanged subtree with the old one.
+ *
+ * Frozen nodes are reference counted (atomically), and any frozen node may
+ * be retained and released on its own.  To hand a document to another
+ * thread, retain it first and have that thread release it.  Frozen nodes
+ * have no parent or prev links, since a shared node can sit in several
+ * documents at once.
+ *
+ * Nodes frozen or created while an arena is in use are never freed by
+ * json_release: their memory comes back with json_arena_reset, once
+ * nothing uses them.
+ */
+
+/*
+ * Freeze a finished document (which must not be inside another node).
+ * Returns it, with one reference owned by the caller.
+ */
+const JsonNode *json_freeze(JsonNode *node);
+
+bool            json_is_frozen(const JsonNode *node);
+const JsonNode *json_retain(const JsonNode *node);
+void            json_release(const JsonNode *node);
+
+/*
+ * Make a new version of a frozen object with member key set to value, or
+ * removed if value is NULL.  NULL object means {}.  A frozen value is
+ * shared; any other value is copied, and stays the caller's.  Members
+ * after the changed one are shared, those before it are copied shallowly
+ * (their values are shared).  Returns a new reference, or NULL if object
+ * is not a frozen object.
+ */
+const JsonNode *json_frozen_set(const JsonNode *object, const char *key, const JsonNode *value);
+
+/*
+ * Make a new version of a frozen document (or NULL) with a merge patch
+ * applied, as json_merge_patch would.  Only the objects on the way to a
+ * change are copied.  Returns a new reference.
+ */
+const JsonNode *json_frozen_patch(const JsonNode *target, const JsonNode *patch);
+
+/* Make a changeable deep copy of a (frozen) document. */
+JsonNode *json_thaw(const JsonNode *node);
+
+/*** Memory ***/
+
+/*
+ * Nodes, keys, strings and encoder output normally come from the heap.
+ * While a thread has an arena in use they are carved out of the arena's
+ * buffer instead, so building and encoding a document does not touch the
+ * heap.  Freeing arena memory (json_delete, json_free) only gives back the
+ * most recent allocation; everything else is reclaimed at once by
+ * json_arena_reset.  Running out of arena space is fatal, like running out
+ * of heap, so size the buffer from the high-water mark in 'peak'.
+ *
+ * Anything allocated from an arena must be freed while that arena is in
+ * use, or not at all.
+ *
+ * When built with KUBOS_NO_HEAP, the library never calls malloc.  Memory
+ * wanted with no arena in use comes from a fixed pool of
+ * KUBOS_JSON_POOL_SIZE bytes (64 KiB by default) shared by all threads,
+ * which json_delete and json_free give back to in full.  Running the pool
+ * dry is fatal too.
+ */
+typedef struct {
+	char   *base;
+	size_t  size;
+	size_t  used;
+	size_t  last; /* offset of the most recent allocation */
+	size_t  peak; /* most ever in use */
+} JsonArena;
+
+void       json_arena_init      (JsonArena *arena, void *buffer, size_t size);
+void       json_arena_reset     (JsonArena *arena);
+
+/* Make arena the calling thread's arena (NULL for the heap); returns the previous one. */
+JsonArena *json_arena_use       (JsonArena *arena);
+
+/* Free a string returned by json_encode, json_encode_string or json_stringify. */
+void       json_free            (void *ptr);
+
 /*** Debugging ***/
 
 /*
@@ -0,0 +1,135 @@
+/* Build, decode, encode and diff documents inside an arena, checking that none of it reaches the heap and that the arena's space is accounted for. */
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+static bool heap_trap;
+static int heap_calls;
+
+static void *counted_malloc(size_t size)
+{
+	if (heap_trap)
+		heap_calls++;
+	return malloc(size);
+}
+
+static void *counted_realloc(void *ptr, size_t size)
+{
+	if (heap_trap)
+		heap_calls++;
+	return realloc(ptr, size);
+}
+
+#define malloc(size) counted_malloc(size)
+#define realloc(ptr, size) counted_realloc(ptr, size)
+
+#include "common.h"
+
+static char buffer[8192];
+
+static void test_build(JsonArena *arena)
+{
+	JsonNode *doc, *list;
+	char *encoded;
+	size_t used, alloc;
+	int i;
+
+	heap_trap = true;
+	heap_calls = 0;
+
+	doc = json_mkobject();
+	json_append_member(doc, "name", json_mkstring("imtq"));
+	json_append_member(doc, "uptime", json_mkint(35));
+	json_append_member(doc, "field", json_mknumber(0.5));
+	list = json_mkarray();
+	for (i = 0; i < 40; i++)
+		json_append_element(list, json_mkint(i * 1000));
+	json_append_member(doc, "samples", list);
+
+	ok1(((uintptr_t) doc & (ARENA_ALIGN - 1)) == 0);
+	ok1(arena_owns(arena, doc) && arena_owns(arena, doc->children.head->key));
+
+	/* The encoder's buffer outgrows its first block several times */
+	used = arena->used;
+	encoded = json_encode(doc);
+	ok1(encoded != NULL && strncmp(encoded, "{\"name\":\"imtq\",\"uptime\":35,\"field\":0.5,\"samples\":[0,1000,", 55) == 0);
+	for (alloc = 16; alloc < strlen(encoded); alloc *= 2)
+		;
+	ok1(arena->used - used == ARENA_HEADER + arena_round(alloc + 1));
+
+	/* It was the newest block, so freeing it gives the space back */
+	json_free(encoded);
+	ok1(arena->used == used);
+
+	json_delete(doc);
+
+	heap_trap = false;
+	ok1(heap_calls == 0);
+}
+
+static void test_decode_diff(JsonArena *arena)
+{
+	const char *a = "{\"0x2003\":3,\"0x4004\":100,\"s\":\"a\\tb\",\"x\":{\"y\":[1,2,3]}}";
+	const char *b = "{\"0x2003\":3,\"0x4004\":250,\"s\":\"a\\tb\",\"x\":{\"y\":[1,2,3]}}";
+	JsonNode *doc_a, *doc_b, *patch;
+	char *encoded;
+
+	heap_trap = true;
+	heap_calls = 0;
+
+	doc_a = json_decode(a);
+	doc_b = json_decode(b);
+	ok1(doc_a != NULL && doc_b != NULL && arena_owns(arena, doc_b));
+
+	encoded = json_encode(doc_a);
+	ok1(encoded != NULL && strcmp(encoded, a) == 0);
+	json_free(encoded);
+
+	patch = json_diff(doc_a, doc_b);
+	encoded = json_encode(patch);
+	ok1(encoded != NULL && strcmp(encoded, "{\"0x4004\":250}") == 0);
+	json_free(encoded);
+
+	json_merge_patch(doc_a, patch);
+	json_delete(patch);
+	patch = json_diff(doc_a, doc_b);
+	ok1(patch != NULL && patch->children.head == NULL);
+
+	heap_trap = false;
+	ok1(heap_calls == 0);
+}
+
+int main(void)
+{
+	JsonArena arena, other;
+	JsonNode *node;
+	size_t peak;
+
+	plan_tests(17);
+
+	json_arena_init(&arena, buffer + 1, sizeof(buffer) - 1);
+	ok1(((uintptr_t) arena.base & (ARENA_ALIGN - 1)) == 0 && arena.used == 0);
+
+	ok1(json_arena_use(&arena) == NULL);
+	test_build(&arena);
+	test_decode_diff(&arena);
+
+	/* A reset empties the arena but keeps the high-water mark */
+	peak = arena.peak;
+	json_arena_reset(&arena);
+	ok1(arena.used == 0 && arena.peak == peak && peak > 0);
+
+	/* Arenas nest, and with none in use allocations go back to the heap */
+	json_arena_init(&other, buffer, 0);
+	ok1(json_arena_use(&other) == &arena);
+	ok1(json_arena_use(NULL) == &other);
+
+	heap_trap = true;
+	heap_calls = 0;
+	node = json_mkstring("heap");
+	heap_trap = false;
+	ok1(heap_calls == 2 && !arena_owns(&arena, node));
+	json_delete(node);
+
+	return exit_status();
+}
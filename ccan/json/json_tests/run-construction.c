@@ -54,6 +54,36 @@ static void test_number(void)
 	json_delete(num);
 }
 
+static void test_integer(void)
+{
+	JsonNode *num;
+	int64_t i;
+	double d;
+	
+	num = json_mkint(INT64_MAX);
+	should_be(num, "9223372036854775807");
+	json_delete(num);
+	
+	num = json_mkint(INT64_MIN);
+	should_be(num, "-9223372036854775808");
+	json_delete(num);
+	
+	num = json_decode("9007199254740993");
+	ok1(num != NULL && num->tag == JSON_INTEGER);
+	ok1(json_get_int(num, &i) && i == 9007199254740993LL);
+	json_delete(num);
+	
+	num = json_decode("12.5");
+	ok1(num != NULL && num->tag == JSON_NUMBER);
+	ok1(!json_get_int(num, &i));
+	ok1(json_get_number(num, &d) && d == 12.5);
+	json_delete(num);
+	
+	num = json_decode("1e3");
+	ok1(json_get_int(num, &i) && i == 1000);
+	json_delete(num);
+}
+
 static void test_array(void)
 {
 	JsonNode *array;
@@ -164,7 +194,7 @@ int main(void)
 	
 	(void) chomp;
 	
-	plan_tests(49);
+	plan_tests(57);
 	
 	ok1(json_find_element(NULL, 0) == NULL);
 	ok1(json_find_member(NULL, "") == NULL);
@@ -184,6 +214,7 @@ int main(void)
 	
 	test_string();
 	test_number();
+	test_integer();
 	test_array();
 	test_object();
 	
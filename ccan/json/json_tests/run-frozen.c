@@ -0,0 +1,251 @@
+/* Freeze documents, edit them into new versions which share unchanged subtrees, read them from several threads at once, and check that releasing every version frees every node. */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+static int live_blocks;
+
+static void *counted_malloc(size_t size)
+{
+	__atomic_add_fetch(&live_blocks, 1, __ATOMIC_RELAXED);
+	return malloc(size);
+}
+
+static void counted_free(void *ptr)
+{
+	if (ptr != NULL)
+		__atomic_sub_fetch(&live_blocks, 1, __ATOMIC_RELAXED);
+	free(ptr);
+}
+
+#define malloc(size) counted_malloc(size)
+#define free(ptr) counted_free(ptr)
+
+#include "common.h"
+
+#define READERS 4
+#define VERSIONS 200
+
+static const char *config = "{\"0x2003\":3,\"gains\":{\"x\":[1,2,3],\"y\":0.5},\"name\":\"imtq\"}";
+
+static bool encodes_as(const JsonNode *node, const char *expected)
+{
+	char *encoded = json_encode(node);
+	bool ret = encoded != NULL && strcmp(encoded, expected) == 0;
+
+	if (!ret)
+		diag("expected %s, got %s", expected, encoded);
+	json_free(encoded);
+	return ret;
+}
+
+static void test_versions(void)
+{
+	const JsonNode *v1, *v2, *v3, *gains, *value;
+	JsonNode *name, *thawed;
+	int before = live_blocks;
+
+	v1 = json_freeze(json_decode(config));
+	ok1(json_is_frozen(v1) && json_check(v1, NULL));
+
+	/* Members after the change are shared as they are */
+	value = json_freeze(json_mkint(4));
+	v2 = json_frozen_set(v1, "0x2003", value);
+	json_release(value);
+	ok1(encodes_as(v2, "{\"0x2003\":4,\"gains\":{\"x\":[1,2,3],\"y\":0.5},\"name\":\"imtq\"}"));
+	ok1(json_find_member((JsonNode*) v2, "gains") == json_find_member((JsonNode*) v1, "gains"));
+	ok1(json_check(v2, NULL));
+
+	/* Those before it are copied, but their subtrees are still shared */
+	name = json_mkstring("mtq");
+	v3 = json_frozen_set(v2, "name", name);
+	json_delete(name);
+	gains = json_find_member((JsonNode*) v3, "gains");
+	ok1(gains != json_find_member((JsonNode*) v2, "gains"));
+	ok1(gains->children.head == json_find_member((JsonNode*) v1, "gains")->children.head);
+	ok1(encodes_as(v3, "{\"0x2003\":4,\"gains\":{\"x\":[1,2,3],\"y\":0.5},\"name\":\"mtq\"}"));
+
+	/* Removing, adding */
+	json_release(v2);
+	v2 = json_frozen_set(v3, "gains", NULL);
+	ok1(encodes_as(v2, "{\"0x2003\":4,\"name\":\"mtq\"}"));
+	json_release(v2);
+	name = json_mkbool(true);
+	v2 = json_frozen_set(v3, "mode", name);
+	json_delete(name);
+	ok1(encodes_as(v2, "{\"0x2003\":4,\"gains\":{\"x\":[1,2,3],\"y\":0.5},\"name\":\"mtq\",\"mode\":true}"));
+	ok1(json_check(v2, NULL));
+
+	/* A member kept after its document is gone keeps what follows it */
+	gains = json_retain(json_find_member((JsonNode*) v1, "gains"));
+	json_release(v1);
+	json_release(v2);
+	json_release(v3);
+	ok1(encodes_as(gains, "{\"x\":[1,2,3],\"y\":0.5}"));
+	ok1(strcmp(gains->next->key, "name") == 0);
+
+	thawed = json_thaw(gains);
+	json_release(gains);
+	json_append_member(thawed, "z", json_mknull());
+	ok1(!json_is_frozen(thawed) && json_check(thawed, NULL));
+	json_delete(thawed);
+
+	ok1(live_blocks == before);
+}
+
+static void test_patch(void)
+{
+	const JsonNode *v1, *v2;
+	JsonNode *patch, *mutable;
+	char *expected;
+	int before = live_blocks;
+
+	v1 = json_freeze(json_decode(config));
+	patch = json_decode("{\"gains\":{\"y\":null,\"z\":{\"w\":null}},\"0x2003\":null,\"mode\":7}");
+
+	v2 = json_frozen_patch(v1, patch);
+	ok1(encodes_as(v2, "{\"gains\":{\"x\":[1,2,3],\"z\":{}},\"name\":\"imtq\",\"mode\":7}"));
+	ok1(json_check(v2, NULL));
+
+	/* Untouched subtrees are the old version's, which is unchanged */
+	ok1(json_find_member(json_find_member((JsonNode*) v2, "gains"), "x")->children.head
+	    == json_find_member(json_find_member((JsonNode*) v1, "gains"), "x")->children.head);
+	ok1(encodes_as(v1, config));
+
+	/* Same answer as patching a changeable copy */
+	mutable = json_merge_patch(json_decode(config), patch);
+	expected = json_encode(mutable);
+	ok1(encodes_as(v2, expected));
+	json_free(expected);
+
+	json_delete(mutable);
+	json_delete(patch);
+	json_release(v1);
+	json_release(v2);
+
+	/* Not an object: the patch replaces the document */
+	v1 = json_freeze(json_decode("[1]"));
+	patch = json_decode("{\"a\":\"b\",\"c\":null}");
+	v2 = json_frozen_patch(v1, patch);
+	ok1(encodes_as(v2, "{\"a\":\"b\"}"));
+	json_release(v2);
+	v2 = json_frozen_patch(NULL, json_find_member(patch, "a"));
+	ok1(encodes_as(v2, "\"b\""));
+	json_release(v2);
+	json_release(v1);
+	json_delete(patch);
+
+	ok1(live_blocks == before);
+}
+
+static const JsonNode *shared;
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *reader(void *arg)
+{
+	int *mismatches = (int*) arg;
+	int i;
+
+	for (i = 0; i < VERSIONS * 10; i++) {
+		const JsonNode *doc;
+		int64_t version = -1, copy = -2;
+
+		/* Only taking the reference needs the lock; reading doesn't */
+		pthread_mutex_lock(&shared_lock);
+		doc = json_retain(shared);
+		pthread_mutex_unlock(&shared_lock);
+
+		json_get_int(json_find_member((JsonNode*) doc, "version"), &version);
+		json_get_int(json_find_member(json_find_member((JsonNode*) doc, "nested"), "version"), &copy);
+		if (version != copy || json_find_member((JsonNode*) doc, "name") == NULL)
+			(*mismatches)++;
+
+		json_release(doc);
+	}
+
+	return NULL;
+}
+
+static void test_threads(void)
+{
+	pthread_t threads[READERS];
+	int mismatches[READERS] = {0};
+	JsonNode *patch;
+	int before = live_blocks;
+	int i;
+	bool ok = true;
+
+	shared = json_freeze(json_decode("{\"version\":0,\"nested\":{\"version\":0},\"name\":\"imtq\"}"));
+
+	for (i = 0; i < READERS; i++)
+		pthread_create(&threads[i], NULL, reader, &mismatches[i]);
+
+	for (i = 1; i <= VERSIONS; i++) {
+		const JsonNode *old, *next;
+		char text[64];
+
+		snprintf(text, sizeof(text), "{\"version\":%d,\"nested\":{\"version\":%d}}", i, i);
+		patch = json_decode(text);
+
+		next = json_frozen_patch(shared, patch);
+		pthread_mutex_lock(&shared_lock);
+		old = shared;
+		shared = next;
+		pthread_mutex_unlock(&shared_lock);
+		json_release(old);
+
+		json_delete(patch);
+	}
+
+	for (i = 0; i < READERS; i++) {
+		pthread_join(threads[i], NULL);
+		ok &= (mismatches[i] == 0);
+	}
+
+	ok1(ok);
+	ok1(encodes_as(shared, "{\"version\":200,\"nested\":{\"version\":200},\"name\":\"imtq\"}"));
+	json_release(shared);
+	ok1(live_blocks == before);
+}
+
+static void test_arena(void)
+{
+	static char buffer[4096];
+	JsonArena arena;
+	const JsonNode *v1, *v2;
+	size_t used;
+
+	json_arena_init(&arena, buffer, sizeof(buffer));
+	json_arena_use(&arena);
+
+	/* Arena nodes are pinned: releasing them leaves the arena alone */
+	v1 = json_freeze(json_decode(config));
+	v2 = json_frozen_set(v1, "name", json_find_member((JsonNode*) v1, "name"));
+	used = arena.used;
+	json_release(v1);
+	json_release(v2);
+	ok1(arena.used == used);
+	ok1(encodes_as(v1, config));
+
+	json_arena_use(NULL);
+}
+
+int main(void)
+{
+	plan_tests(14 + 8 + 3 + 2 + 2);
+
+	test_versions();
+	test_patch();
+	test_threads();
+	test_arena();
+
+	ok1(json_frozen_set(NULL, NULL, NULL) == NULL);
+	{
+		JsonNode *array = json_mkarray();
+		const JsonNode *frozen = json_freeze(array);
+		ok1(json_frozen_set(frozen, "a", NULL) == NULL);
+		json_release(frozen);
+	}
+
+	return exit_status();
+}
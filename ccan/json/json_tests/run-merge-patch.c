@@ -0,0 +1,164 @@
+/* Apply the RFC 7386 appendix A examples, then check that json_diff produces minimal patches which json_merge_patch turns back into the original. */
+
+#include "common.h"
+
+static const char *merge_cases[][3] = {
+	/* target, patch, result */
+	{"{\"a\":\"b\"}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"},
+	{"{\"a\":\"b\"}", "{\"b\":\"c\"}", "{\"a\":\"b\",\"b\":\"c\"}"},
+	{"{\"a\":\"b\"}", "{\"a\":null}", "{}"},
+	{"{\"a\":\"b\",\"b\":\"c\"}", "{\"a\":null}", "{\"b\":\"c\"}"},
+	{"{\"a\":[\"b\"]}", "{\"a\":\"c\"}", "{\"a\":\"c\"}"},
+	{"{\"a\":\"c\"}", "{\"a\":[\"b\"]}", "{\"a\":[\"b\"]}"},
+	{"{\"a\":{\"b\":\"c\"}}", "{\"a\":{\"b\":\"d\",\"c\":null}}", "{\"a\":{\"b\":\"d\"}}"},
+	{"{\"a\":[{\"b\":\"c\"}]}", "{\"a\":[1]}", "{\"a\":[1]}"},
+	{"[\"a\",\"b\"]", "[\"c\",\"d\"]", "[\"c\",\"d\"]"},
+	{"{\"a\":\"b\"}", "[\"c\"]", "[\"c\"]"},
+	{"{\"a\":\"foo\"}", "null", "null"},
+	{"{\"a\":\"foo\"}", "\"bar\"", "\"bar\""},
+	{"{\"e\":null}", "{\"a\":1}", "{\"e\":null,\"a\":1}"},
+	{"[1,2]", "{\"a\":\"b\",\"c\":null}", "{\"a\":\"b\"}"},
+	{"{}", "{\"a\":{\"bb\":{\"ccc\":null}}}", "{\"a\":{\"bb\":{}}}"},
+};
+
+static const char *diff_cases[][3] = {
+	/* a, b, expected patch */
+	{"{\"0x2003\":3,\"0x4004\":100,\"0xa001\":0.5}",
+	 "{\"0x2003\":3,\"0x4004\":250,\"0xa001\":0.5}",
+	 "{\"0x4004\":250}"},
+	{"{\"x\":{\"y\":[1,2,3],\"z\":true}}", "{\"x\":{\"z\":true,\"y\":[1,2,3]}}", "{}"},
+	{"{\"x\":{\"y\":1,\"z\":2},\"w\":\"s\"}", "{\"x\":{\"y\":1},\"w\":\"s\",\"v\":[]}",
+	 "{\"x\":{\"z\":null},\"v\":[]}"},
+	{"{\"n\":1}", "{\"n\":1.0}", "{}"},
+	{"{\"n\":1}", "{\"n\":\"1\"}", "{\"n\":\"1\"}"},
+	{"[1,2]", "[1,2,3]", "[1,2,3]"},
+	{"{\"a\":1}", "7", "7"},
+};
+
+static void check_json(JsonNode *node, const char *expected, const char *what)
+{
+	char errmsg[256];
+	char *encoded;
+	
+	if (!json_check(node, errmsg)) {
+		fail("%s: invariants check failed: %s", what, errmsg);
+		return;
+	}
+	
+	encoded = json_encode(node);
+	if (encoded != NULL && strcmp(encoded, expected) == 0)
+		pass("%s is %s", what, expected);
+	else
+		fail("%s should be %s, but is actually %s", what, expected, encoded);
+	free(encoded);
+}
+
+static void test_merge(void)
+{
+	size_t i;
+	
+	for (i = 0; i < sizeof(merge_cases) / sizeof(*merge_cases); i++) {
+		JsonNode *target = json_decode(merge_cases[i][0]);
+		JsonNode *patch = json_decode(merge_cases[i][1]);
+		
+		target = json_merge_patch(target, patch);
+		check_json(target, merge_cases[i][2], merge_cases[i][1]);
+		
+		json_delete(target);
+		json_delete(patch);
+	}
+}
+
+static void test_diff(void)
+{
+	size_t i;
+	
+	for (i = 0; i < sizeof(diff_cases) / sizeof(*diff_cases); i++) {
+		JsonNode *a = json_decode(diff_cases[i][0]);
+		JsonNode *b = json_decode(diff_cases[i][1]);
+		JsonNode *patch = json_diff(a, b);
+		JsonNode *remaining;
+		
+		check_json(patch, diff_cases[i][2], diff_cases[i][1]);
+		
+		/* Member order may differ, so compare by diffing again */
+		a = json_merge_patch(a, patch);
+		remaining = json_diff(a, b);
+		if (b->tag == JSON_OBJECT)
+			check_json(remaining, "{}", "patched document's diff");
+		else
+			check_json(remaining, diff_cases[i][1], "patched document");
+		
+		json_delete(remaining);
+		json_delete(patch);
+		json_delete(a);
+		json_delete(b);
+	}
+}
+
+static void test_nested_replace(void)
+{
+	JsonNode *doc = json_decode("{\"a\":1,\"b\":{\"c\":2},\"d\":3}");
+	JsonNode *patch = json_decode("{\"b\":5}");
+	JsonNode *ret = json_merge_patch(doc, patch);
+	
+	/* The replaced member keeps its place */
+	ok1(ret == doc);
+	check_json(doc, "{\"a\":1,\"b\":5,\"d\":3}", "member replaced in place");
+	
+	json_delete(patch);
+	json_delete(doc);
+}
+
+/* Documents whose hashes collide are still told apart */
+static void test_hash_collision(void)
+{
+	JsonNode *a = json_decode("{\"x\":{\"y\":1},\"z\":[1,2]}");
+	JsonNode *b = json_decode("{\"x\":{\"y\":2},\"z\":[1,2]}");
+	JsonNode *c = json_decode("{\"z\":[1,2.0],\"x\":{\"y\":1}}");
+	HashSlot slots[64] = {{0}};
+	HashMemo memo = { slots, 63 };
+	JsonNode *patch;
+	
+	hash_tree(&memo, a);
+	hash_tree(&memo, b);
+	hash_tree(&memo, c);
+	memo_slot(&memo, b)->hash = memo_hash(&memo, a);
+	memo_slot(&memo, json_find_member(b, "x"))->hash = memo_hash(&memo, json_find_member(a, "x"));
+	
+	ok1(!same_value(&memo, a, b));
+	ok1(same_value(&memo, a, c));
+	
+	patch = diff_value(&memo, a, b);
+	check_json(patch, "{\"x\":{\"y\":2}}", "patch despite colliding hashes");
+	
+	json_delete(patch);
+	json_delete(c);
+	json_delete(b);
+	json_delete(a);
+}
+
+int main(void)
+{
+	(void) chomp;
+	
+	plan_tests(15 + 7 * 2 + 2 + 3 + 4);
+	
+	test_merge();
+	test_diff();
+	test_nested_replace();
+	test_hash_collision();
+	
+	ok1(json_diff(NULL, NULL) == NULL);
+	ok1(json_merge_patch(NULL, NULL) == NULL);
+	{
+		JsonNode *patch = json_decode("{\"a\":{\"b\":null}}");
+		JsonNode *doc = json_merge_patch(NULL, patch);
+		ok1(doc != NULL && doc->tag == JSON_OBJECT);
+		ok1(json_find_member(json_find_member(doc, "a"), "b") == NULL);
+		json_delete(doc);
+		json_delete(patch);
+	}
+	
+	return exit_status();
+}
@@ -0,0 +1,113 @@
+/* Without a heap, documents built outside an arena come from the fixed pool, and everything freed goes back to it in one piece. */
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define KUBOS_NO_HEAP
+#define KUBOS_JSON_POOL_SIZE 4096
+
+static int heap_calls;
+
+static void *counted_malloc(size_t size)
+{
+	heap_calls++;
+	return malloc(size);
+}
+
+static void *counted_realloc(void *ptr, size_t size)
+{
+	heap_calls++;
+	return realloc(ptr, size);
+}
+
+#define malloc(size) counted_malloc(size)
+#define realloc(ptr, size) counted_realloc(ptr, size)
+
+#include "common.h"
+
+static char buffer[2048];
+
+/* Free bytes in the pool, counting headers; sets *blocks to the number of free blocks */
+static size_t pool_free_bytes(int *blocks)
+{
+	size_t bytes = 0;
+	PoolBlock *block;
+
+	*blocks = 0;
+	for (block = pool_free; block != NULL; block = block->next) {
+		bytes += POOL_HEADER + block->size;
+		(*blocks)++;
+	}
+	return bytes;
+}
+
+static bool pool_whole(void)
+{
+	int blocks;
+	return pool_free_bytes(&blocks) == sizeof(pool_storage.bytes) && blocks == 1;
+}
+
+int main(void)
+{
+	const char *text = "{\"0x2003\":3,\"0x4004\":100,\"s\":\"a\\tb\",\"x\":{\"y\":[1,2,3]}}";
+	JsonArena arena;
+	JsonNode *doc, *list, *a, *b, *c;
+	char *encoded;
+	size_t before;
+	int blocks, i;
+	bool same = true;
+
+	plan_tests(9);
+
+	/* Decoding and encoding many times over fits in a small pool */
+	for (i = 0; i < 200 && same; i++) {
+		doc = json_decode(text);
+		encoded = json_encode(doc);
+		same = encoded != NULL && strcmp(encoded, text) == 0;
+		json_free(encoded);
+		json_delete(doc);
+		same = same && pool_whole();
+	}
+	ok1(same);
+	ok1(pool_owns(pool_free) && heap_calls == 0);
+
+	/* The encoder's buffer is grown by moving it within the pool */
+	list = json_mkarray();
+	for (i = 0; i < 40; i++)
+		json_append_element(list, json_mkint(i * 1000));
+	encoded = json_encode(list);
+	ok1(encoded != NULL && pool_owns(encoded)
+	    && strncmp(encoded, "[0,1000,2000,", 13) == 0);
+	json_free(encoded);
+	json_delete(list);
+	ok1(pool_whole());
+
+	/* Blocks freed out of order are merged with both neighbours */
+	a = json_mkstring("first");
+	b = json_mkstring("second");
+	c = json_mkstring("third");
+	json_delete(a);
+	json_delete(c);
+	pool_free_bytes(&blocks);
+	ok1(blocks == 2);
+	json_delete(b);
+	ok1(pool_whole());
+
+	/* An arena in use keeps the pool out of it... */
+	json_arena_init(&arena, buffer, sizeof(buffer));
+	a = json_mkstring("pool");
+	before = pool_free_bytes(&blocks);
+	json_arena_use(&arena);
+	doc = json_decode(text);
+	ok1(arena_owns(&arena, doc) && pool_free_bytes(&blocks) == before);
+
+	/* ...but pool memory freed meanwhile still goes back to the pool */
+	json_delete(a);
+	ok1(pool_free_bytes(&blocks) > before);
+	json_delete(doc);
+	json_arena_use(NULL);
+
+	ok1(pool_whole() && heap_calls == 0);
+
+	return exit_status();
+}
@@ -24,6 +24,9 @@
 #include "json.h"
 
 #include <assert.h>
+#ifdef KUBOS_NO_HEAP
+#include <pthread.h>
+#endif
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,13 +37,330 @@
 		exit(EXIT_FAILURE);                     \
 	} while (0)
 
-/* Sadly, strdup is not portable. */
-static char *json_strdup(const char *str)
+/*
+ * Memory: the heap (a fixed pool under KUBOS_NO_HEAP), or the calling
+ * thread's arena.
+ *
+ * Each arena block is preceded by its size, so the most recent block can be
+ * grown in place (the encoder's string buffer) or handed back.
+ */
+
+#define ARENA_ALIGN 8
+#define ARENA_HEADER ((sizeof(size_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define ARENA_NONE ((size_t) -1)
+
+static __thread JsonArena *arena_current;
+
+static size_t arena_round(size_t size)
 {
-	char *ret = (char*) malloc(strlen(str) + 1);
+	return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static bool arena_owns(const JsonArena *arena, const void *ptr)
+{
+	const char *p = (const char*) ptr;
+	return arena != NULL && p >= arena->base && p < arena->base + arena->size;
+}
+
+static size_t *arena_header(const JsonArena *arena, size_t offset)
+{
+	return (size_t*) (arena->base + offset);
+}
+
+static void *arena_alloc(JsonArena *arena, size_t size)
+{
+	size_t need = ARENA_HEADER + arena_round(size);
+	
+	if (need < size || arena->size - arena->used < need)
+		return NULL;
+	
+	arena->last = arena->used;
+	*arena_header(arena, arena->last) = size;
+	arena->used += need;
+	if (arena->used > arena->peak)
+		arena->peak = arena->used;
+	
+	return arena->base + arena->last + ARENA_HEADER;
+}
+
+static void *arena_realloc(JsonArena *arena, void *ptr, size_t size)
+{
+	size_t offset = (size_t) ((char*) ptr - arena->base) - ARENA_HEADER;
+	size_t old = *arena_header(arena, offset);
+	void *ret;
+	
+	/* The newest block just moves the end of the arena */
+	if (offset == arena->last) {
+		size_t need = ARENA_HEADER + arena_round(size);
+		if (need < size || arena->size - offset < need)
+			return NULL;
+		*arena_header(arena, offset) = size;
+		arena->used = offset + need;
+		if (arena->used > arena->peak)
+			arena->peak = arena->used;
+		return ptr;
+	}
+	
+	ret = arena_alloc(arena, size);
+	if (ret != NULL)
+		memcpy(ret, ptr, old < size ? old : size);
+	return ret;
+}
+
+static void arena_release(JsonArena *arena, void *ptr)
+{
+	size_t offset = (size_t) ((char*) ptr - arena->base) - ARENA_HEADER;
+	
+	/* Only the newest block can be given back before a reset */
+	if (offset == arena->last) {
+		arena->used = offset;
+		arena->last = ARENA_NONE;
+	}
+}
+
+#ifdef KUBOS_NO_HEAP
+
+/*
+ * Without a heap, memory wanted outside an arena comes from a fixed pool
+ * shared by every thread: first fit over a free list kept in address order,
+ * so neighbouring free blocks can be merged when one is given back.
+ */
+
+#ifndef KUBOS_JSON_POOL_SIZE
+#define KUBOS_JSON_POOL_SIZE 65536
+#endif
+
+typedef struct PoolBlock PoolBlock;
+struct PoolBlock {
+	size_t size; /* bytes after the header */
+	PoolBlock *next; /* next free block, while free */
+};
+
+#define POOL_HEADER ((sizeof(PoolBlock) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static union {
+	char bytes[KUBOS_JSON_POOL_SIZE];
+	uint64_t align;
+} pool_storage;
+
+static PoolBlock *pool_free;
+static bool pool_ready;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static bool pool_owns(const void *ptr)
+{
+	const char *p = (const char*) ptr;
+	return p >= pool_storage.bytes && p < pool_storage.bytes + sizeof(pool_storage.bytes);
+}
+
+static PoolBlock *pool_block(void *ptr)
+{
+	return (PoolBlock*) ((char*) ptr - POOL_HEADER);
+}
+
+/* Called with pool_mutex held */
+static void *pool_alloc_locked(size_t size)
+{
+	size_t need = arena_round(size);
+	PoolBlock **link;
+	
+	if (!pool_ready) {
+		pool_free = (PoolBlock*) pool_storage.bytes;
+		pool_free->size = sizeof(pool_storage.bytes) - POOL_HEADER;
+		pool_free->next = NULL;
+		pool_ready = true;
+	}
+	
+	if (need < size)
+		return NULL;
+	
+	for (link = &pool_free; *link != NULL; link = &(*link)->next) {
+		PoolBlock *block = *link;
+		
+		if (block->size < need)
+			continue;
+		
+		/* Split off the rest if it can hold a block of its own */
+		if (block->size - need > POOL_HEADER) {
+			PoolBlock *rest = (PoolBlock*) ((char*) block + POOL_HEADER + need);
+			rest->size = block->size - need - POOL_HEADER;
+			rest->next = block->next;
+			block->size = need;
+			*link = rest;
+		} else {
+			*link = block->next;
+		}
+		
+		return (char*) block + POOL_HEADER;
+	}
+	
+	return NULL;
+}
+
+/* Called with pool_mutex held */
+static void pool_release_locked(void *ptr)
+{
+	PoolBlock *block = pool_block(ptr);
+	PoolBlock *prev = NULL;
+	PoolBlock *next = pool_free;
+	
+	while (next != NULL && next < block) {
+		prev = next;
+		next = next->next;
+	}
+	
+	block->next = next;
+	if (next != NULL && (char*) block + POOL_HEADER + block->size == (char*) next) {
+		block->size += POOL_HEADER + next->size;
+		block->next = next->next;
+	}
+	
+	if (prev == NULL) {
+		pool_free = block;
+	} else if ((char*) prev + POOL_HEADER + prev->size == (char*) block) {
+		prev->size += POOL_HEADER + block->size;
+		prev->next = block->next;
+	} else {
+		prev->next = block;
+	}
+}
+
+static void *pool_alloc(size_t size)
+{
+	void *ret;
+	
+	pthread_mutex_lock(&pool_mutex);
+	ret = pool_alloc_locked(size);
+	pthread_mutex_unlock(&pool_mutex);
+	
+	return ret;
+}
+
+static void *pool_realloc(void *ptr, size_t size)
+{
+	size_t old = pool_block(ptr)->size;
+	void *ret;
+	
+	if (size <= old)
+		return ptr;
+	
+	pthread_mutex_lock(&pool_mutex);
+	ret = pool_alloc_locked(size);
+	if (ret != NULL) {
+		memcpy(ret, ptr, old);
+		pool_release_locked(ptr);
+	}
+	pthread_mutex_unlock(&pool_mutex);
+	
+	return ret;
+}
+
+static void pool_release(void *ptr)
+{
+	pthread_mutex_lock(&pool_mutex);
+	pool_release_locked(ptr);
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+#endif
+
+static void *json_alloc(size_t size)
+{
+	void *ret;
+	
+	if (arena_current != NULL)
+		ret = arena_alloc(arena_current, size);
+	else
+#ifdef KUBOS_NO_HEAP
+		ret = pool_alloc(size);
+#else
+		ret = malloc(size);
+#endif
+	
+	if (ret == NULL)
+		out_of_memory();
+	return ret;
+}
+
+static void *json_calloc(size_t size)
+{
+	void *ret = json_alloc(size);
+	memset(ret, 0, size);
+	return ret;
+}
+
+static void *json_realloc(void *ptr, size_t size)
+{
+	void *ret;
+	
+	if (ptr == NULL)
+		return json_alloc(size);
+	
+	if (arena_owns(arena_current, ptr))
+		ret = arena_realloc(arena_current, ptr, size);
+	else
+#ifdef KUBOS_NO_HEAP
+		ret = pool_owns(ptr) ? pool_realloc(ptr, size) : NULL;
+#else
+		ret = realloc(ptr, size);
+#endif
+	
 	if (ret == NULL)
 		out_of_memory();
-	strcpy(ret, str);
+	return ret;
+}
+
+void json_free(void *ptr)
+{
+	if (ptr == NULL)
+		return;
+	
+	if (arena_owns(arena_current, ptr))
+		arena_release(arena_current, ptr);
+#ifdef KUBOS_NO_HEAP
+	else if (pool_owns(ptr))
+		pool_release(ptr);
+#else
+	else
+		free(ptr);
+#endif
+}
+
+void json_arena_init(JsonArena *arena, void *buffer, size_t size)
+{
+	uintptr_t start = (uintptr_t) buffer;
+	size_t skip = (size_t) ((ARENA_ALIGN - start % ARENA_ALIGN) % ARENA_ALIGN);
+	
+	if (buffer == NULL || size < skip) {
+		arena->base = NULL;
+		arena->size = 0;
+	} else {
+		arena->base = (char*) buffer + skip;
+		arena->size = size - skip;
+	}
+	arena->peak = 0;
+	json_arena_reset(arena);
+}
+
+void json_arena_reset(JsonArena *arena)
+{
+	arena->used = 0;
+	arena->last = ARENA_NONE;
+}
+
+JsonArena *json_arena_use(JsonArena *arena)
+{
+	JsonArena *previous = arena_current;
+	arena_current = arena;
+	return previous;
+}
+
+/* Sadly, strdup is not portable. */
+static char *json_strdup(const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *ret = (char*) json_alloc(len);
+	memcpy(ret, str, len);
 	return ret;
 }
 
@@ -55,9 +375,7 @@ typedef struct
 
 static void sb_init(SB *sb)
 {
-	sb->start = (char*) malloc(17);
-	if (sb->start == NULL)
-		out_of_memory();
+	sb->start = (char*) json_alloc(17);
 	sb->cur = sb->start;
 	sb->end = sb->start + 16;
 }
@@ -77,9 +395,7 @@ static void sb_grow(SB *sb, int need)
 		alloc *= 2;
 	} while (alloc < length + need);
 	
-	sb->start = (char*) realloc(sb->start, alloc + 1);
-	if (sb->start == NULL)
-		out_of_memory();
+	sb->start = (char*) json_realloc(sb->start, alloc + 1);
 	sb->cur = sb->start + length;
 	sb->end = sb->start + alloc;
 }
@@ -111,7 +427,7 @@ static char *sb_finish(SB *sb)
 
 static void sb_free(SB *sb)
 {
-	free(sb->start);
+	json_free(sb->start);
 }
 
 /*
@@ -330,7 +646,7 @@ static void to_surrogate_pair(uchar_t unicode, uint16_t *uc, uint16_t *lc)
 
 static bool parse_value     (const char **sp, JsonNode        **out);
 static bool parse_string    (const char **sp, char            **out);
-static bool parse_number    (const char **sp, double           *out);
+static bool parse_number    (const char **sp, JsonNode        **out);
 static bool parse_array     (const char **sp, JsonNode        **out);
 static bool parse_object    (const char **sp, JsonNode        **out);
 static bool parse_hex16     (const char **sp, uint16_t         *out);
@@ -342,6 +658,7 @@ static void emit_value              (SB *out, const JsonNode *node);
 static void emit_value_indented     (SB *out, const JsonNode *node, const char *space, int indent_level);
 static void emit_string             (SB *out, const char *str);
 static void emit_number             (SB *out, double num);
+static void emit_integer            (SB *out, int64_t num);
 static void emit_array              (SB *out, const JsonNode *array);
 static void emit_array_indented     (SB *out, const JsonNode *array, const char *space, int indent_level);
 static void emit_object             (SB *out, const JsonNode *object);
@@ -355,6 +672,62 @@ static void prepend_node(JsonNode *parent, JsonNode *child);
 static void append_member(JsonNode *object, char *key, JsonNode *value);
 
 /* Assertion-friendly validity checks */
+static const char digit_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/* Number of decimal digits in v, without a loop: log10 from the bit length */
+static int count_digits(uint64_t v)
+{
+	static const uint64_t thresholds[20] = {
+		0, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+		10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+		100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+		100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+		100000000000000000ULL, 1000000000000000000ULL,
+		10000000000000000000ULL,
+	};
+	int t = ((64 - __builtin_clzll(v | 1)) * 1233) >> 12;
+	
+	return t + (v >= thresholds[t]);
+}
+
+static void emit_integer(SB *out, int64_t num)
+{
+	uint64_t v = (num < 0) ? 0 - (uint64_t) num : (uint64_t) num;
+	int neg = num < 0;
+	int len = count_digits(v) + neg;
+	char *b;
+	
+	sb_need(out, len);
+	b = out->cur + len;
+	out->cur[0] = '-';
+	
+	/* Two digits per step, from the end */
+	while (v >= 100) {
+		unsigned int pair = (unsigned int) (v % 100) * 2;
+		v /= 100;
+		*--b = digit_pairs[pair + 1];
+		*--b = digit_pairs[pair];
+	}
+	if (v >= 10) {
+		*--b = digit_pairs[v * 2 + 1];
+		*--b = digit_pairs[v * 2];
+	} else {
+		*--b = (char) ('0' + v);
+	}
+	
+	out->cur += len;
+}
+
 static bool tag_is_valid(unsigned int tag);
 static bool number_is_valid(const char *num);
 
@@ -407,7 +780,7 @@ char *json_encode_string(const char *str)
 
 char *json_stringify(const JsonNode *node, const char *space)
 {
-    if (node == NULL || space == NULL) {
+    if (node == NULL) {
         return NULL;
     }
 
@@ -425,11 +798,13 @@ char *json_stringify(const JsonNode *node, const char *space)
 void json_delete(JsonNode *node)
 {
 	if (node != NULL) {
+		assert(!json_is_frozen(node));
+		
 		json_remove_from_parent(node);
 		
 		switch (node->tag) {
 			case JSON_STRING:
-				free(node->string_);
+				json_free(node->string_);
 				break;
 			case JSON_ARRAY:
 			case JSON_OBJECT:
@@ -444,7 +819,7 @@ void json_delete(JsonNode *node)
 			default:;
 		}
 		
-		free(node);
+		json_free(node);
 	}
 }
 
@@ -515,9 +890,7 @@ JsonNode *json_first_child(const JsonNode *node)
 
 static JsonNode *mknode(JsonTag tag)
 {
-	JsonNode *ret = (JsonNode*) calloc(1, sizeof(JsonNode));
-	if (ret == NULL)
-		out_of_memory();
+	JsonNode *ret = (JsonNode*) json_calloc(sizeof(JsonNode));
 	ret->tag = tag;
 	return ret;
 }
@@ -553,6 +926,57 @@ JsonNode *json_mknumber(double n)
 	return node;
 }
 
+JsonNode *json_mkint(int64_t n)
+{
+	JsonNode *node = mknode(JSON_INTEGER);
+	node->int_ = n;
+	return node;
+}
+
+bool json_get_int(const JsonNode *node, int64_t *out)
+{
+	if (node == NULL)
+		return false;
+	
+	if (node->tag == JSON_INTEGER) {
+		if (out)
+			*out = node->int_;
+		return true;
+	}
+	
+	/* 2^63 is exactly representable; anything below it converts exactly */
+	if (node->tag == JSON_NUMBER
+	    && node->number_ >= -9223372036854775808.0
+	    && node->number_ < 9223372036854775808.0
+	    && node->number_ == (double) (int64_t) node->number_) {
+		if (out)
+			*out = (int64_t) node->number_;
+		return true;
+	}
+	
+	return false;
+}
+
+bool json_get_number(const JsonNode *node, double *out)
+{
+	if (node == NULL)
+		return false;
+	
+	if (node->tag == JSON_INTEGER) {
+		if (out)
+			*out = (double) node->int_;
+		return true;
+	}
+	
+	if (node->tag == JSON_NUMBER) {
+		if (out)
+			*out = node->number_;
+		return true;
+	}
+	
+	return false;
+}
+
 JsonNode *json_mkarray(void)
 {
 	return mknode(JSON_ARRAY);
@@ -603,6 +1027,7 @@ void json_append_element(JsonNode *array, JsonNode *element)
 
 	assert(array->tag == JSON_ARRAY);
 	assert(element->parent == NULL);
+	assert(!json_is_frozen(array) && !json_is_frozen(element));
 	
 	append_node(array, element);
 }
@@ -615,6 +1040,7 @@ void json_prepend_element(JsonNode *array, JsonNode *element)
 
 	assert(array->tag == JSON_ARRAY);
 	assert(element->parent == NULL);
+	assert(!json_is_frozen(array) && !json_is_frozen(element));
 	
 	prepend_node(array, element);
 }
@@ -627,6 +1053,7 @@ void json_append_member(JsonNode *object, const char *key, JsonNode *value)
 
 	assert(object->tag == JSON_OBJECT);
 	assert(value->parent == NULL);
+	assert(!json_is_frozen(object) && !json_is_frozen(value));
 	
 	append_member(object, json_strdup(key), value);
 }
@@ -639,6 +1066,7 @@ void json_prepend_member(JsonNode *object, const char *key, JsonNode *value)
 
 	assert(object->tag == JSON_OBJECT);
 	assert(value->parent == NULL);
+	assert(!json_is_frozen(object) && !json_is_frozen(value));
 	
 	value->key = json_strdup(key);
 	prepend_node(object, value);
@@ -662,7 +1090,7 @@ void json_remove_from_parent(JsonNode *node)
 		else
 			parent->children.tail = node->prev;
 		
-		free(node->key);
+		json_free(node->key);
 		
 		node->parent = NULL;
 		node->prev = node->next = NULL;
@@ -727,16 +1155,12 @@ static bool parse_value(const char **sp, JsonNode **out)
 			}
 			return false;
 		
-		default: {
-			double num;
-			if (parse_number(&s, out ? &num : NULL)) {
-				if (out)
-					*out = json_mknumber(num);
+		default:
+			if (parse_number(&s, out)) {
 				*sp = s;
 				return true;
 			}
 			return false;
-		}
 	}
 }
 
@@ -834,7 +1258,7 @@ success:
 
 failure_free_key:
 	if (out)
-		free(key);
+		json_free(key);
 failure:
 	json_delete(ret);
 	return false;
@@ -965,27 +1389,38 @@ failed:
  *
  * This function takes the strict approach.
  */
-bool parse_number(const char **sp, double *out)
+bool parse_number(const char **sp, JsonNode **out)
 {
 	const char *s = *sp;
+	const char *digits;
+	bool negative = false;
+	bool integer = true;
+	uint64_t magnitude = 0;
 
 	/* '-'? */
-	if (*s == '-')
+	if (*s == '-') {
+		negative = true;
 		s++;
+	}
 
 	/* (0 | [1-9][0-9]*) */
+	digits = s;
 	if (*s == '0') {
 		s++;
 	} else {
 		if (!is_digit(*s))
 			return false;
 		do {
+			/* Can't overflow: only the first 19 digits are accumulated */
+			if (s - digits < 19)
+				magnitude = magnitude * 10 + (uint64_t) (*s - '0');
 			s++;
 		} while (is_digit(*s));
 	}
 
 	/* ('.' [0-9]+)? */
 	if (*s == '.') {
+		integer = false;
 		s++;
 		if (!is_digit(*s))
 			return false;
@@ -996,6 +1431,7 @@ bool parse_number(const char **sp, double *out)
 
 	/* ([Ee] [+-]? [0-9]+)? */
 	if (*s == 'E' || *s == 'e') {
+		integer = false;
 		s++;
 		if (*s == '+' || *s == '-')
 			s++;
@@ -1006,8 +1442,19 @@ bool parse_number(const char **sp, double *out)
 		} while (is_digit(*s));
 	}
 
-	if (out)
-		*out = strtod(*sp, NULL);
+	if (out) {
+		/*
+		 * Exact fast path for integers which fit in an int64_t.  -0 stays a
+		 * double so that it survives a round trip.
+		 */
+		if (integer && s - digits <= 19 && magnitude != 0
+		    && magnitude <= (negative ? (uint64_t) INT64_MAX + 1 : (uint64_t) INT64_MAX))
+			*out = json_mkint(negative ? (int64_t) (0 - magnitude) : (int64_t) magnitude);
+		else if (integer && magnitude == 0 && !negative)
+			*out = json_mkint(0);
+		else
+			*out = json_mknumber(strtod(*sp, NULL));
+	}
 
 	*sp = s;
 	return true;
@@ -1037,6 +1484,9 @@ static void emit_value(SB *out, const JsonNode *node)
 		case JSON_NUMBER:
 			emit_number(out, node->number_);
 			break;
+		case JSON_INTEGER:
+			emit_integer(out, node->int_);
+			break;
 		case JSON_ARRAY:
 			emit_array(out, node);
 			break;
@@ -1064,6 +1514,9 @@ void emit_value_indented(SB *out, const JsonNode *node, const char *space, int i
 		case JSON_NUMBER:
 			emit_number(out, node->number_);
 			break;
+		case JSON_INTEGER:
+			emit_integer(out, node->int_);
+			break;
 		case JSON_ARRAY:
 			emit_array_indented(out, node, space, indent_level);
 			break;
@@ -1291,7 +1744,7 @@ static void emit_number(SB *out, double num)
 
 static bool tag_is_valid(unsigned int tag)
 {
-	return (/* tag >= JSON_NULL && */ tag <= JSON_OBJECT);
+	return (/* tag >= JSON_NULL && */ tag <= JSON_INTEGER);
 }
 
 static bool number_is_valid(const char *num)
@@ -1360,6 +1813,581 @@ static int write_hex16(char *out, uint16_t val)
 	return 4;
 }
 
+/*
+ * Structural hashing.  Equal documents hash alike: object members are
+ * combined order-independently, and 1, 1.0 and 1e0 hash as the same number.
+ * Hashes are memoized per node for the duration of one json_diff, so
+ * telling two different subtrees apart usually costs O(1) after a single
+ * pass over each document.  Matching hashes are only a hint: same_value
+ * confirms them by comparing the subtrees.
+ */
+
+typedef struct {
+	const JsonNode *node;
+	uint64_t hash;
+} HashSlot;
+
+typedef struct {
+	HashSlot *slots;
+	size_t mask;
+} HashMemo;
+
+static uint64_t hash_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static uint64_t hash_string(const char *s)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	
+	for (; *s != 0; s++) {
+		h ^= (unsigned char) *s;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static size_t count_nodes(const JsonNode *node)
+{
+	const JsonNode *child;
+	size_t count = 1;
+	
+	json_foreach(child, node)
+		count += count_nodes(child);
+	return count;
+}
+
+static HashSlot *memo_slot(const HashMemo *memo, const JsonNode *node)
+{
+	size_t i = (size_t) hash_mix((uint64_t) (uintptr_t) node) & memo->mask;
+	
+	while (memo->slots[i].node != NULL && memo->slots[i].node != node)
+		i = (i + 1) & memo->mask;
+	return &memo->slots[i];
+}
+
+static uint64_t hash_tree(HashMemo *memo, const JsonNode *node)
+{
+	const JsonNode *child;
+	uint64_t h = hash_mix(node->tag + 1);
+	int64_t integer;
+	double number;
+	HashSlot *slot;
+	
+	switch (node->tag) {
+		case JSON_BOOL:
+			h = hash_mix(h ^ (uint64_t) node->bool_);
+			break;
+		case JSON_STRING:
+			h = hash_mix(h ^ hash_string(node->string_));
+			break;
+		case JSON_NUMBER:
+		case JSON_INTEGER:
+			/* Both numeric tags hash as JSON_NUMBER */
+			h = hash_mix(JSON_NUMBER + 1);
+			if (json_get_int(node, &integer)) {
+				h = hash_mix(h ^ (uint64_t) integer);
+			} else {
+				uint64_t bits;
+				json_get_number(node, &number);
+				memcpy(&bits, &number, sizeof(bits));
+				h = hash_mix(~h ^ bits);
+			}
+			break;
+		case JSON_ARRAY:
+			json_foreach(child, node)
+				h = hash_mix(h * 31 + hash_tree(memo, child));
+			break;
+		case JSON_OBJECT: {
+			uint64_t sum = 0;
+			json_foreach(child, node)
+				sum += hash_mix(hash_string(child->key) ^ hash_mix(hash_tree(memo, child)));
+			h = hash_mix(h ^ sum);
+			break;
+		}
+		default:
+			break;
+	}
+	
+	slot = memo_slot(memo, node);
+	slot->node = node;
+	slot->hash = h;
+	return h;
+}
+
+static uint64_t memo_hash(const HashMemo *memo, const JsonNode *node)
+{
+	return memo_slot(memo, node)->hash;
+}
+
+/* Whether a and b are equal documents, in the sense hash_tree hashes them alike. */
+static bool same_value(const HashMemo *memo, const JsonNode *a, const JsonNode *b)
+{
+	const JsonNode *child, *other;
+	int64_t int_a, int_b;
+	double num_a, num_b;
+	size_t count_a = 0, count_b = 0;
+	
+	if (memo_hash(memo, a) != memo_hash(memo, b))
+		return false;
+	
+	if (json_get_number(a, &num_a) && json_get_number(b, &num_b)) {
+		bool is_int_a = json_get_int(a, &int_a);
+		bool is_int_b = json_get_int(b, &int_b);
+		if (is_int_a || is_int_b)
+			return is_int_a && is_int_b && int_a == int_b;
+		return num_a == num_b;
+	}
+	
+	if (a->tag != b->tag)
+		return false;
+	
+	switch (a->tag) {
+		case JSON_BOOL:
+			return a->bool_ == b->bool_;
+		case JSON_STRING:
+			return strcmp(a->string_, b->string_) == 0;
+		case JSON_ARRAY:
+			for (child = a->children.head, other = b->children.head;
+			     child != NULL && other != NULL;
+			     child = child->next, other = other->next) {
+				if (!same_value(memo, child, other))
+					return false;
+			}
+			return child == NULL && other == NULL;
+		case JSON_OBJECT:
+			json_foreach(child, a)
+				count_a++;
+			json_foreach(child, b)
+				count_b++;
+			if (count_a != count_b)
+				return false;
+			json_foreach(child, a) {
+				other = json_find_member((JsonNode*) b, child->key);
+				if (other == NULL || !same_value(memo, child, other))
+					return false;
+			}
+			return true;
+		default:
+			return true;
+	}
+}
+
+static JsonNode *copy_value(const JsonNode *node)
+{
+	const JsonNode *child;
+	JsonNode *ret;
+	
+	switch (node->tag) {
+		case JSON_BOOL:
+			return json_mkbool(node->bool_);
+		case JSON_STRING:
+			return json_mkstring(node->string_);
+		case JSON_NUMBER:
+			return json_mknumber(node->number_);
+		case JSON_INTEGER:
+			return json_mkint(node->int_);
+		case JSON_ARRAY:
+		case JSON_OBJECT:
+			ret = mknode(node->tag);
+			json_foreach(child, node) {
+				JsonNode *copy = copy_value(child);
+				if (child->key != NULL)
+					copy->key = json_strdup(child->key);
+				append_node(ret, copy);
+			}
+			return ret;
+		default:
+			return json_mknull();
+	}
+}
+
+/* Look up a member, trying the one after the previous match first. */
+static JsonNode *find_member_from(JsonNode *object, JsonNode **cursor, const char *key)
+{
+	JsonNode *member = *cursor;
+	
+	if (member == NULL || strcmp(member->key, key) != 0)
+		member = json_find_member(object, key);
+	*cursor = (member != NULL) ? member->next : NULL;
+	return member;
+}
+
+static JsonNode *diff_value(const HashMemo *memo, JsonNode *a, JsonNode *b)
+{
+	JsonNode *patch;
+	JsonNode *member;
+	JsonNode *cursor;
+	
+	/* Anything but an object is replaced outright */
+	if (a->tag != JSON_OBJECT || b->tag != JSON_OBJECT)
+		return copy_value(b);
+	
+	patch = json_mkobject();
+	if (same_value(memo, a, b))
+		return patch;
+	
+	cursor = b->children.head;
+	json_foreach(member, a) {
+		if (find_member_from(b, &cursor, member->key) == NULL)
+			append_member(patch, json_strdup(member->key), json_mknull());
+	}
+	
+	cursor = a->children.head;
+	json_foreach(member, b) {
+		JsonNode *old = find_member_from(a, &cursor, member->key);
+		JsonNode *change;
+		
+		if (old == NULL) {
+			change = copy_value(member);
+		} else if (same_value(memo, old, member)) {
+			continue;
+		} else if (old->tag == JSON_OBJECT && member->tag == JSON_OBJECT) {
+			change = diff_value(memo, old, member);
+		} else {
+			change = copy_value(member);
+		}
+		
+		append_member(patch, json_strdup(member->key), change);
+	}
+	
+	return patch;
+}
+
+JsonNode *json_diff(const JsonNode *a, const JsonNode *b)
+{
+	HashMemo memo;
+	JsonNode *patch;
+	size_t size = 16;
+	size_t nodes;
+	
+	if (a == NULL || b == NULL)
+		return NULL;
+	
+	nodes = count_nodes(a) + count_nodes(b);
+	while (size < nodes * 2)
+		size <<= 1;
+	
+	memo.slots = (HashSlot*) json_calloc(size * sizeof(HashSlot));
+	memo.mask = size - 1;
+	
+	hash_tree(&memo, a);
+	hash_tree(&memo, b);
+	
+	/* Nothing is modified; the casts just let the lookup helpers be shared */
+	patch = diff_value(&memo, (JsonNode*) a, (JsonNode*) b);
+	
+	json_free(memo.slots);
+	return patch;
+}
+
+/* Put replacement where node was (keeping its key), then free node. */
+static void replace_node(JsonNode *node, JsonNode *replacement)
+{
+	JsonNode *parent;
+	
+	if (node == NULL)
+		return;
+	
+	parent = node->parent;
+	if (parent != NULL) {
+		replacement->parent = parent;
+		replacement->prev = node->prev;
+		replacement->next = node->next;
+		replacement->key = node->key;
+		
+		if (node->prev != NULL)
+			node->prev->next = replacement;
+		else
+			parent->children.head = replacement;
+		if (node->next != NULL)
+			node->next->prev = replacement;
+		else
+			parent->children.tail = replacement;
+		
+		node->parent = NULL;
+		node->prev = node->next = NULL;
+		node->key = NULL;
+	}
+	
+	json_delete(node);
+}
+
+static JsonNode *merge_value(JsonNode *target, const JsonNode *patch)
+{
+	const JsonNode *member;
+	
+	if (patch->tag != JSON_OBJECT) {
+		JsonNode *value = copy_value(patch);
+		replace_node(target, value);
+		return value;
+	}
+	
+	if (target == NULL || target->tag != JSON_OBJECT) {
+		JsonNode *object = json_mkobject();
+		replace_node(target, object);
+		target = object;
+	}
+	
+	json_foreach(member, patch) {
+		JsonNode *old = json_find_member(target, member->key);
+		
+		if (member->tag == JSON_NULL)
+			json_delete(old);
+		else if (old != NULL)
+			merge_value(old, member);
+		else
+			append_member(target, json_strdup(member->key), merge_value(NULL, member));
+	}
+	
+	return target;
+}
+
+JsonNode *json_merge_patch(JsonNode *target, const JsonNode *patch)
+{
+	assert(!json_is_frozen(target));
+	
+	if (patch == NULL)
+		return target;
+	
+	return merge_value(target, patch);
+}
+
+/*
+ * Immutable documents.
+ *
+ * A frozen node's refs counts the pointers to it: from its parent's
+ * children.head or its previous sibling's next, and from callers holding a
+ * reference.  Nodes never change once frozen, so an edit copies the nodes
+ * leading up to the change and points the copies at the old ones after it.
+ * Nodes allocated from an arena are pinned instead of counted.
+ */
+
+#define REFS_PINNED UINT32_MAX
+
+static uint32_t frozen_refs(const JsonNode *node)
+{
+	return arena_owns(arena_current, node) ? REFS_PINNED : 1;
+}
+
+static JsonNode *frozen_retain(const JsonNode *node)
+{
+	JsonNode *ret = (JsonNode*) node;
+	
+	if (ret != NULL && __atomic_load_n(&ret->refs, __ATOMIC_RELAXED) != REFS_PINNED)
+		__atomic_add_fetch(&ret->refs, 1, __ATOMIC_RELAXED);
+	return ret;
+}
+
+/* Drop a reference to node; free it, and so on down its sibling chain, at zero. */
+static void frozen_release(JsonNode *node)
+{
+	while (node != NULL
+	       && __atomic_load_n(&node->refs, __ATOMIC_RELAXED) != REFS_PINNED
+	       && __atomic_sub_fetch(&node->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+		JsonNode *next = node->next;
+		
+		if (node->tag == JSON_STRING)
+			json_free(node->string_);
+		else if (node->tag == JSON_ARRAY || node->tag == JSON_OBJECT)
+			frozen_release(node->children.head);
+		json_free(node->key);
+		json_free(node);
+		
+		node = next;
+	}
+}
+
+static void freeze_tree(JsonNode *node)
+{
+	JsonNode *child;
+	
+	json_foreach(child, node)
+		freeze_tree(child);
+	
+	node->parent = NULL;
+	node->prev = NULL;
+	node->refs = frozen_refs(node);
+}
+
+/* A new frozen node with node's value (sharing its children) under key. */
+static JsonNode *frozen_copy(const JsonNode *node, const char *key)
+{
+	JsonNode *ret = mknode(node->tag);
+	
+	switch (node->tag) {
+		case JSON_BOOL:
+			ret->bool_ = node->bool_;
+			break;
+		case JSON_STRING:
+			ret->string_ = json_strdup(node->string_);
+			break;
+		case JSON_NUMBER:
+			ret->number_ = node->number_;
+			break;
+		case JSON_INTEGER:
+			ret->int_ = node->int_;
+			break;
+		case JSON_ARRAY:
+		case JSON_OBJECT:
+			ret->children.head = frozen_retain(node->children.head);
+			ret->children.tail = node->children.tail;
+			break;
+		default:;
+	}
+	
+	if (key != NULL)
+		ret->key = json_strdup(key);
+	ret->refs = frozen_refs(ret);
+	return ret;
+}
+
+/* value, ready to link into a frozen document under key */
+static JsonNode *frozen_value(const JsonNode *value, const char *key)
+{
+	JsonNode *ret;
+	
+	if (json_is_frozen(value))
+		return frozen_copy(value, key);
+	
+	ret = copy_value(value);
+	if (key != NULL)
+		ret->key = json_strdup(key);
+	freeze_tree(ret);
+	return ret;
+}
+
+const JsonNode *json_freeze(JsonNode *node)
+{
+	if (node == NULL)
+		return NULL;
+	
+	assert(node->parent == NULL);
+	assert(!json_is_frozen(node));
+	
+	freeze_tree(node);
+	return node;
+}
+
+bool json_is_frozen(const JsonNode *node)
+{
+	return node != NULL && __atomic_load_n(&node->refs, __ATOMIC_RELAXED) != 0;
+}
+
+const JsonNode *json_retain(const JsonNode *node)
+{
+	assert(node == NULL || json_is_frozen(node));
+	
+	return frozen_retain(node);
+}
+
+void json_release(const JsonNode *node)
+{
+	assert(node == NULL || json_is_frozen(node));
+	
+	frozen_release((JsonNode*) node);
+}
+
+const JsonNode *json_frozen_set(const JsonNode *object, const char *key, const JsonNode *value)
+{
+	const JsonNode *old;
+	const JsonNode *match = NULL;
+	JsonNode *ret;
+	JsonNode *last = NULL;
+	JsonNode **link;
+	
+	if (key == NULL)
+		return NULL;
+	
+	if (object != NULL) {
+		if (object->tag != JSON_OBJECT || !json_is_frozen(object))
+			return NULL;
+		
+		json_foreach(old, object) {
+			if (strcmp(old->key, key) == 0) {
+				match = old;
+				break;
+			}
+		}
+	}
+	
+	if (match == NULL && value == NULL)
+		return object != NULL ? json_retain(object) : json_freeze(json_mkobject());
+	
+	ret = mknode(JSON_OBJECT);
+	ret->refs = frozen_refs(ret);
+	link = &ret->children.head;
+	
+	if (object != NULL) {
+		for (old = object->children.head; old != match; old = old->next) {
+			*link = last = frozen_copy(old, old->key);
+			link = &last->next;
+		}
+	}
+	
+	if (value != NULL) {
+		*link = last = frozen_value(value, key);
+		link = &last->next;
+	}
+	
+	if (match != NULL && match->next != NULL) {
+		*link = frozen_retain(match->next);
+		ret->children.tail = object->children.tail;
+	} else {
+		ret->children.tail = last;
+	}
+	
+	return ret;
+}
+
+const JsonNode *json_frozen_patch(const JsonNode *target, const JsonNode *patch)
+{
+	const JsonNode *member;
+	const JsonNode *ret;
+	
+	assert(target == NULL || json_is_frozen(target));
+	
+	if (patch == NULL)
+		return json_retain(target);
+	
+	if (patch->tag != JSON_OBJECT)
+		return frozen_value(patch, NULL);
+	
+	if (target == NULL || target->tag != JSON_OBJECT)
+		ret = json_freeze(json_mkobject());
+	else
+		ret = json_retain(target);
+	
+	json_foreach(member, patch) {
+		const JsonNode *next;
+		
+		if (member->tag == JSON_NULL) {
+			next = json_frozen_set(ret, member->key, NULL);
+		} else {
+			const JsonNode *value = json_frozen_patch(
+				json_find_member((JsonNode*) ret, member->key), member);
+			next = json_frozen_set(ret, member->key, value);
+			json_release(value);
+		}
+		
+		json_release(ret);
+		ret = next;
+	}
+	
+	return ret;
+}
+
+JsonNode *json_thaw(const JsonNode *node)
+{
+	return node != NULL ? copy_value(node) : NULL;
+}
+
 bool json_check(const JsonNode *node, char errmsg[256])
 {
 	#define problem(...) do { \
@@ -1397,6 +2425,7 @@ bool json_check(const JsonNode *node, char errmsg[256])
 		} else {
 			JsonNode *child;
 			JsonNode *last = NULL;
+			bool frozen = json_is_frozen(node);
 			
 			if (head->prev != NULL)
 				problem("First child's prev pointer is not NULL");
@@ -1409,10 +2438,18 @@ bool json_check(const JsonNode *node, char errmsg[256])
 				if (child->next == head)
 					problem("child->next == head (cycle)");
 				
-				if (child->parent != node)
-					problem("child does not point back to parent");
-				if (child->next != NULL && child->next->prev != child)
-					problem("child->next does not point back to child");
+				/* Frozen nodes may be shared, so they only link forwards */
+				if (frozen) {
+					if (!json_is_frozen(child))
+						problem("child of a frozen node is not frozen");
+					if (child->parent != NULL || child->prev != NULL)
+						problem("frozen child has parent or prev links");
+				} else {
+					if (child->parent != node)
+						problem("child does not point back to parent");
+					if (child->next != NULL && child->next->prev != child)
+						problem("child->next does not point back to child");
+				}
 				
 				if (node->tag == JSON_ARRAY && child->key != NULL)
 					problem("Array element's key is not NULL");
@@ -0,0 +1,771 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <telemetry-decoder.h>
+#include <checksum.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <gomspace-p31u-api.h>
+/* The P31u and TRXVU headers both name a reset delay/command HARD_RESET */
+#undef HARD_RESET
+#include <imtq.h>
+#include <json.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <supervisor.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <trxvu.h>
+#include <unistd.h>
+
+/* Rows decoded at a time before being scattered into the columns */
+#define DECODE_BLOCK 256
+
+/*
+ * Record formats
+ *
+ * Each record is decoded into a row struct by the owning API's own
+ * conversion where it has one, and the columns are picked out of the row.
+ */
+
+#define EPS_COL(type, field) \
+    { #field, type, offsetof(eps_hk_t, field) }
+#define EPS_COL_AT(type, field, i) \
+    { #field "_" #i, type, offsetof(eps_hk_t, field[i]) }
+
+static void decode_eps_hk(const uint8_t * record, void * row)
+{
+    kprv_eps_decode_housekeeping((const eps_hk_t *) record, row);
+}
+
+static const k_decode_column eps_hk_columns[] = {
+    EPS_COL_AT(DECODE_UINT16, vboost, 0),
+    EPS_COL_AT(DECODE_UINT16, vboost, 1),
+    EPS_COL_AT(DECODE_UINT16, vboost, 2),
+    EPS_COL(DECODE_UINT16, vbatt),
+    EPS_COL_AT(DECODE_UINT16, curin, 0),
+    EPS_COL_AT(DECODE_UINT16, curin, 1),
+    EPS_COL_AT(DECODE_UINT16, curin, 2),
+    EPS_COL(DECODE_UINT16, cursun),
+    EPS_COL(DECODE_UINT16, cursys),
+    EPS_COL_AT(DECODE_UINT16, curout, 0),
+    EPS_COL_AT(DECODE_UINT16, curout, 1),
+    EPS_COL_AT(DECODE_UINT16, curout, 2),
+    EPS_COL_AT(DECODE_UINT16, curout, 3),
+    EPS_COL_AT(DECODE_UINT16, curout, 4),
+    EPS_COL_AT(DECODE_UINT16, curout, 5),
+    EPS_COL_AT(DECODE_UINT8, output, 0),
+    EPS_COL_AT(DECODE_UINT8, output, 1),
+    EPS_COL_AT(DECODE_UINT8, output, 2),
+    EPS_COL_AT(DECODE_UINT8, output, 3),
+    EPS_COL_AT(DECODE_UINT8, output, 4),
+    EPS_COL_AT(DECODE_UINT8, output, 5),
+    EPS_COL_AT(DECODE_UINT8, output, 6),
+    EPS_COL_AT(DECODE_UINT8, output, 7),
+    EPS_COL_AT(DECODE_UINT16, output_on_delta, 0),
+    EPS_COL_AT(DECODE_UINT16, output_on_delta, 1),
+    EPS_COL_AT(DECODE_UINT16, output_on_delta, 2),
+    EPS_COL_AT(DECODE_UINT16, output_on_delta, 3),
+    EPS_COL_AT(DECODE_UINT16, output_on_delta, 4),
+    EPS_COL_AT(DECODE_UINT16, output_on_delta, 5),
+    EPS_COL_AT(DECODE_UINT16, output_on_delta, 6),
+    EPS_COL_AT(DECODE_UINT16, output_on_delta, 7),
+    EPS_COL_AT(DECODE_UINT16, output_off_delta, 0),
+    EPS_COL_AT(DECODE_UINT16, output_off_delta, 1),
+    EPS_COL_AT(DECODE_UINT16, output_off_delta, 2),
+    EPS_COL_AT(DECODE_UINT16, output_off_delta, 3),
+    EPS_COL_AT(DECODE_UINT16, output_off_delta, 4),
+    EPS_COL_AT(DECODE_UINT16, output_off_delta, 5),
+    EPS_COL_AT(DECODE_UINT16, output_off_delta, 6),
+    EPS_COL_AT(DECODE_UINT16, output_off_delta, 7),
+    EPS_COL_AT(DECODE_UINT16, latchup, 0),
+    EPS_COL_AT(DECODE_UINT16, latchup, 1),
+    EPS_COL_AT(DECODE_UINT16, latchup, 2),
+    EPS_COL_AT(DECODE_UINT16, latchup, 3),
+    EPS_COL_AT(DECODE_UINT16, latchup, 4),
+    EPS_COL_AT(DECODE_UINT16, latchup, 5),
+    EPS_COL(DECODE_UINT32, wdt_i2c_time_left),
+    EPS_COL(DECODE_UINT32, wdt_gnd_time_left),
+    EPS_COL_AT(DECODE_UINT8, wdt_csp_pings_left, 0),
+    EPS_COL_AT(DECODE_UINT8, wdt_csp_pings_left, 1),
+    EPS_COL(DECODE_UINT32, counter_wdt_i2c),
+    EPS_COL(DECODE_UINT32, counter_wdt_gnd),
+    EPS_COL_AT(DECODE_UINT32, counter_wdt_csp, 0),
+    EPS_COL_AT(DECODE_UINT32, counter_wdt_csp, 1),
+    EPS_COL(DECODE_UINT32, counter_boot),
+    EPS_COL_AT(DECODE_INT16, temp, 0),
+    EPS_COL_AT(DECODE_INT16, temp, 1),
+    EPS_COL_AT(DECODE_INT16, temp, 2),
+    EPS_COL_AT(DECODE_INT16, temp, 3),
+    EPS_COL_AT(DECODE_INT16, temp, 4),
+    EPS_COL_AT(DECODE_INT16, temp, 5),
+    EPS_COL(DECODE_UINT8, boot_cause),
+    EPS_COL(DECODE_UINT8, batt_mode),
+    EPS_COL(DECODE_UINT8, ppt_mode),
+};
+
+#define IMTQ_COL(type, name, field) \
+    { name, type, offsetof(imtq_housekeeping_raw, field) }
+
+/* The iMTQ's responses are little endian, so they're used as read */
+static void decode_imtq_hk_raw(const uint8_t * record, void * row)
+{
+    memcpy(row, record, sizeof(imtq_housekeeping_raw));
+}
+
+static const k_decode_column imtq_hk_raw_columns[] = {
+    IMTQ_COL(DECODE_UINT8, "cmd", hdr.cmd),
+    IMTQ_COL(DECODE_UINT8, "status", hdr.status),
+    IMTQ_COL(DECODE_UINT16, "voltage_d", voltage_d),
+    IMTQ_COL(DECODE_UINT16, "voltage_a", voltage_a),
+    IMTQ_COL(DECODE_UINT16, "current_d", current_d),
+    IMTQ_COL(DECODE_UINT16, "current_a", current_a),
+    IMTQ_COL(DECODE_INT16, "coil_current_x", coil_current.x),
+    IMTQ_COL(DECODE_INT16, "coil_current_y", coil_current.y),
+    IMTQ_COL(DECODE_INT16, "coil_current_z", coil_current.z),
+    IMTQ_COL(DECODE_INT16, "coil_temp_x", coil_temp.x),
+    IMTQ_COL(DECODE_INT16, "coil_temp_y", coil_temp.y),
+    IMTQ_COL(DECODE_INT16, "coil_temp_z", coil_temp.z),
+    IMTQ_COL(DECODE_UINT16, "mcu_temp", mcu_temp),
+};
+
+#define TX_COL(type, field) \
+    { #field, type, offsetof(trxvu_tx_telem_eng, field) }
+#define RX_COL(type, field) \
+    { #field, type, offsetof(trxvu_rx_telem_eng, field) }
+
+static void decode_trxvu_tx(const uint8_t * record, void * row)
+{
+    trxvu_tx_telem_raw raw;
+
+    memcpy(&raw, record, sizeof(raw));
+    k_radio_tx_telem_eng(&raw, row);
+}
+
+static const k_decode_column trxvu_tx_columns[] = {
+    TX_COL(DECODE_INT32, reflected_mdbm),
+    TX_COL(DECODE_INT32, forward_mdbm),
+    TX_COL(DECODE_UINT32, reflected_nw),
+    TX_COL(DECODE_UINT32, forward_nw),
+    TX_COL(DECODE_INT32, supply_voltage_mv),
+    TX_COL(DECODE_INT32, supply_current_ua),
+    TX_COL(DECODE_INT32, temp_power_amp_mdegc),
+    TX_COL(DECODE_INT32, temp_oscillator_mdegc),
+};
+
+static void decode_trxvu_rx(const uint8_t * record, void * row)
+{
+    trxvu_rx_telem_raw raw;
+
+    memcpy(&raw, record, sizeof(raw));
+    k_radio_rx_telem_eng(&raw, row);
+}
+
+static const k_decode_column trxvu_rx_columns[] = {
+    RX_COL(DECODE_INT32, doppler_offset_hz),
+    RX_COL(DECODE_INT32, supply_current_ua),
+    RX_COL(DECODE_INT32, supply_voltage_mv),
+    RX_COL(DECODE_INT32, temp_oscillator_mdegc),
+    RX_COL(DECODE_INT32, temp_power_amp_mdegc),
+    RX_COL(DECODE_INT32, signal_strength_mdbm),
+};
+
+/* Supervisor housekeeping, as read, plus the outcome of its CRC check */
+typedef struct {
+    supervisor_housekeeping_t hk;
+    uint8_t                   crc_ok;
+} __attribute__((packed)) supervisor_row;
+
+#define SUP_COL(type, field) \
+    { #field, type, offsetof(supervisor_row, hk.fields.field) }
+#define SUP_COL_AT(type, field, i) \
+    { #field "_" #i, type, offsetof(supervisor_row, hk.fields.field[i]) }
+
+static void decode_supervisor_hk(const uint8_t * record, void * row)
+{
+    supervisor_row * sup = row;
+
+    memcpy(&sup->hk, record, LENGTH_TELEMETRY_HOUSEKEEPING);
+    sup->crc_ok = supervisor_calculate_CRC(record + 1,
+                                           LENGTH_TELEMETRY_HOUSEKEEPING - 2)
+                  == record[LENGTH_TELEMETRY_HOUSEKEEPING - 1];
+}
+
+static const k_decode_column supervisor_hk_columns[] = {
+    SUP_COL(DECODE_UINT8, spi_command_status),
+    { "enable_status", DECODE_UINT8,
+      offsetof(supervisor_row, hk.fields.enable_status.raw_value) },
+    SUP_COL(DECODE_UINT32, supervisor_uptime),
+    SUP_COL(DECODE_UINT32, iobc_uptime),
+    SUP_COL(DECODE_UINT32, iobc_reset_count),
+    SUP_COL_AT(DECODE_UINT16, adc_data, 0),
+    SUP_COL_AT(DECODE_UINT16, adc_data, 1),
+    SUP_COL_AT(DECODE_UINT16, adc_data, 2),
+    SUP_COL_AT(DECODE_UINT16, adc_data, 3),
+    SUP_COL_AT(DECODE_UINT16, adc_data, 4),
+    SUP_COL_AT(DECODE_UINT16, adc_data, 5),
+    SUP_COL_AT(DECODE_UINT16, adc_data, 6),
+    SUP_COL_AT(DECODE_UINT16, adc_data, 7),
+    SUP_COL_AT(DECODE_UINT16, adc_data, 8),
+    SUP_COL_AT(DECODE_UINT16, adc_data, 9),
+    SUP_COL(DECODE_UINT8, adc_update_flag),
+    { "crc_ok", DECODE_UINT8, offsetof(supervisor_row, crc_ok) },
+};
+
+#define NUM_COLUMNS(columns) ((int) (sizeof(columns) / sizeof(columns[0])))
+
+static const k_decode_format formats[] = {
+    {
+        .name        = "p31u-hk",
+        .description = "GomSpace P31u housekeeping response bodies (eps_hk_t)",
+        .record_size = sizeof(eps_hk_t),
+        .row_size    = sizeof(eps_hk_t),
+        .decode      = decode_eps_hk,
+        .columns     = eps_hk_columns,
+        .num_columns = NUM_COLUMNS(eps_hk_columns),
+    },
+    {
+        .name        = "imtq-hk-raw",
+        .description = "ISIS iMTQ raw housekeeping responses (imtq_housekeeping_raw)",
+        .record_size = sizeof(imtq_housekeeping_raw),
+        .row_size    = sizeof(imtq_housekeeping_raw),
+        .decode      = decode_imtq_hk_raw,
+        .columns     = imtq_hk_raw_columns,
+        .num_columns = NUM_COLUMNS(imtq_hk_raw_columns),
+    },
+    {
+        .name        = "trxvu-tx",
+        .description = "ISIS TRXVU transmitter telemetry (trxvu_tx_telem_raw), in engineering units",
+        .record_size = sizeof(trxvu_tx_telem_raw),
+        .row_size    = sizeof(trxvu_tx_telem_eng),
+        .decode      = decode_trxvu_tx,
+        .columns     = trxvu_tx_columns,
+        .num_columns = NUM_COLUMNS(trxvu_tx_columns),
+    },
+    {
+        .name        = "trxvu-rx",
+        .description = "ISIS TRXVU receiver telemetry (trxvu_rx_telem_raw), in engineering units",
+        .record_size = sizeof(trxvu_rx_telem_raw),
+        .row_size    = sizeof(trxvu_rx_telem_eng),
+        .decode      = decode_trxvu_rx,
+        .columns     = trxvu_rx_columns,
+        .num_columns = NUM_COLUMNS(trxvu_rx_columns),
+    },
+    {
+        .name        = "supervisor-hk",
+        .description = "iOBC supervisor housekeeping (supervisor_housekeeping_t), with a CRC check column",
+        .record_size = LENGTH_TELEMETRY_HOUSEKEEPING,
+        .row_size    = sizeof(supervisor_row),
+        .decode      = decode_supervisor_hk,
+        .columns     = supervisor_hk_columns,
+        .num_columns = NUM_COLUMNS(supervisor_hk_columns),
+    },
+};
+
+const k_decode_format * k_decode_format_find(const char * name)
+{
+    if (name == NULL)
+    {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+    {
+        if (strcmp(formats[i].name, name) == 0)
+        {
+            return &formats[i];
+        }
+    }
+
+    return NULL;
+}
+
+const k_decode_format * k_decode_format_get(int index)
+{
+    if (index < 0 || index >= (int) (sizeof(formats) / sizeof(formats[0])))
+    {
+        return NULL;
+    }
+
+    return &formats[index];
+}
+
+size_t k_decode_type_size(KDecodeType type)
+{
+    switch (type)
+    {
+        case DECODE_UINT8:
+        case DECODE_INT8:
+            return 1;
+        case DECODE_UINT16:
+        case DECODE_INT16:
+            return 2;
+        case DECODE_UINT32:
+        case DECODE_INT32:
+        default:
+            return 4;
+    }
+}
+
+const char * k_decode_type_name(KDecodeType type)
+{
+    switch (type)
+    {
+        case DECODE_UINT8:
+            return "uint8";
+        case DECODE_INT8:
+            return "int8";
+        case DECODE_UINT16:
+            return "uint16";
+        case DECODE_INT16:
+            return "int16";
+        case DECODE_UINT32:
+            return "uint32";
+        case DECODE_INT32:
+            return "int32";
+        default:
+            return "unknown";
+    }
+}
+
+/*
+ * Parallel decoding
+ */
+
+typedef struct {
+    const k_decode_format * format;
+    const uint8_t *         data;
+    size_t                  first;
+    size_t                  count;
+    void * const *          columns;
+    KDecodeStatus           status;
+} decode_chunk;
+
+/*
+ * Copy one column out of a block of rows. The sizes are constant in each
+ * loop, so the copies compile down to plain (unaligned) loads and stores.
+ */
+static void scatter(const uint8_t * rows, size_t row_size, size_t count,
+                    size_t value_size, uint8_t * dest)
+{
+    switch (value_size)
+    {
+        case 1:
+            for (size_t i = 0; i < count; i++)
+            {
+                dest[i] = rows[i * row_size];
+            }
+            break;
+        case 2:
+            for (size_t i = 0; i < count; i++)
+            {
+                memcpy(dest + i * 2, rows + i * row_size, 2);
+            }
+            break;
+        default:
+            for (size_t i = 0; i < count; i++)
+            {
+                memcpy(dest + i * 4, rows + i * row_size, 4);
+            }
+            break;
+    }
+}
+
+static void * decode_worker(void * arg)
+{
+    decode_chunk *          chunk = arg;
+    const k_decode_format * format = chunk->format;
+    uint8_t *               rows;
+
+    rows = malloc(format->row_size * DECODE_BLOCK);
+    if (rows == NULL)
+    {
+        chunk->status = DECODE_ERROR;
+        return NULL;
+    }
+
+    for (size_t done = 0; done < chunk->count; done += DECODE_BLOCK)
+    {
+        size_t          block = chunk->count - done;
+        size_t          first = chunk->first + done;
+        const uint8_t * record = chunk->data + first * format->record_size;
+
+        if (block > DECODE_BLOCK)
+        {
+            block = DECODE_BLOCK;
+        }
+
+        for (size_t i = 0; i < block; i++)
+        {
+            format->decode(record + i * format->record_size,
+                           rows + i * format->row_size);
+        }
+
+        for (int c = 0; c < format->num_columns; c++)
+        {
+            const k_decode_column * column = &format->columns[c];
+            size_t value_size = k_decode_type_size(column->type);
+
+            scatter(rows + column->offset, format->row_size, block,
+                    value_size,
+                    (uint8_t *) chunk->columns[c] + first * value_size);
+        }
+    }
+
+    free(rows);
+    chunk->status = DECODE_OK;
+
+    return NULL;
+}
+
+KDecodeStatus k_decode_records(const k_decode_format * format,
+                               const uint8_t * data, size_t count,
+                               void * const * columns, int threads)
+{
+    pthread_t     workers[K_DECODE_MAX_THREADS];
+    decode_chunk  chunks[K_DECODE_MAX_THREADS];
+    size_t        first = 0;
+    int           started = 0;
+    KDecodeStatus status = DECODE_OK;
+
+    if (format == NULL || columns == NULL || (data == NULL && count != 0)
+        || threads < 1 || threads > K_DECODE_MAX_THREADS)
+    {
+        return DECODE_ERROR_CONFIG;
+    }
+
+    if (count == 0)
+    {
+        return DECODE_OK;
+    }
+
+    /* Don't bother splitting up work smaller than a block per thread */
+    if ((size_t) threads > (count + DECODE_BLOCK - 1) / DECODE_BLOCK)
+    {
+        threads = (count + DECODE_BLOCK - 1) / DECODE_BLOCK;
+    }
+
+    for (int i = 0; i < threads; i++)
+    {
+        size_t share = count / threads + ((size_t) i < count % threads);
+
+        chunks[i] = (decode_chunk) {
+            .format  = format,
+            .data    = data,
+            .first   = first,
+            .count   = share,
+            .columns = columns,
+            .status  = DECODE_ERROR,
+        };
+        first += share;
+    }
+
+    /* The first chunk is decoded on the calling thread */
+    for (int i = 1; i < threads; i++)
+    {
+        if (pthread_create(&workers[i], NULL, decode_worker, &chunks[i]) != 0)
+        {
+            break;
+        }
+        started = i;
+    }
+
+    decode_worker(&chunks[0]);
+
+    for (int i = 1; i <= started; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    for (int i = 0; i < threads; i++)
+    {
+        if (chunks[i].status != DECODE_OK)
+        {
+            status = DECODE_ERROR;
+        }
+    }
+
+    return status;
+}
+
+/*
+ * File decoding
+ */
+
+static size_t align_up(size_t value)
+{
+    return (value + K_DECODE_ARROW_ALIGN - 1) / K_DECODE_ARROW_ALIGN
+           * K_DECODE_ARROW_ALIGN;
+}
+
+/* Create `name` in `dir` at `size` bytes, mapped for writing */
+static KDecodeStatus map_output(const char * dir, const char * name,
+                                size_t size, uint8_t ** map)
+{
+    char path[PATH_MAX];
+    int  fd;
+
+    *map = NULL;
+
+    if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int) sizeof(path))
+    {
+        return DECODE_ERROR_CONFIG;
+    }
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror("Failed to create output file");
+        return DECODE_ERROR_IO;
+    }
+
+    if (ftruncate(fd, size) != 0)
+    {
+        perror("Failed to size output file");
+        close(fd);
+        return DECODE_ERROR_IO;
+    }
+
+    if (size != 0)
+    {
+        *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (*map == MAP_FAILED)
+        {
+            perror("Failed to map output file");
+            *map = NULL;
+            close(fd);
+            return DECODE_ERROR_IO;
+        }
+    }
+
+    close(fd);
+
+    return DECODE_OK;
+}
+
+static KDecodeStatus write_schema(const k_decode_format * format,
+                                  const char * dir, size_t count, bool arrow,
+                                  const size_t * offsets)
+{
+    char         path[PATH_MAX];
+    char         file[PATH_MAX];
+    FILE *       out;
+    char *       text;
+    JsonNode *   schema = json_mkobject();
+    JsonNode *   columns = json_mkarray();
+    KDecodeStatus status = DECODE_OK;
+
+    json_append_member(schema, "format", json_mkstring(format->name));
+    json_append_member(schema, "records", json_mkint(count));
+    json_append_member(schema, "layout",
+                       json_mkstring(arrow ? "arrow" : "columns"));
+    if (arrow)
+    {
+        json_append_member(schema, "file", json_mkstring("columns.bin"));
+        json_append_member(schema, "alignment",
+                           json_mkint(K_DECODE_ARROW_ALIGN));
+    }
+
+    for (int c = 0; c < format->num_columns; c++)
+    {
+        const k_decode_column * column = &format->columns[c];
+        JsonNode *              entry = json_mkobject();
+
+        json_append_member(entry, "name", json_mkstring(column->name));
+        json_append_member(entry, "type",
+                           json_mkstring(k_decode_type_name(column->type)));
+        if (arrow)
+        {
+            json_append_member(entry, "offset", json_mkint(offsets[c]));
+            json_append_member(entry, "length",
+                               json_mkint(count
+                                          * k_decode_type_size(column->type)));
+        }
+        else
+        {
+            snprintf(file, sizeof(file), "%s.bin", column->name);
+            json_append_member(entry, "file", json_mkstring(file));
+        }
+        json_append_element(columns, entry);
+    }
+
+    json_append_member(schema, "columns", columns);
+
+    text = json_stringify(schema, "  ");
+    json_delete(schema);
+
+    snprintf(path, sizeof(path), "%s/schema.json", dir);
+    out = fopen(path, "w");
+    if (out == NULL || fprintf(out, "%s\n", text) < 0)
+    {
+        perror("Failed to write schema");
+        status = DECODE_ERROR_IO;
+    }
+
+    if (out != NULL && fclose(out) != 0)
+    {
+        status = DECODE_ERROR_IO;
+    }
+
+    json_free(text);
+
+    return status;
+}
+
+KDecodeStatus k_decode_file(const k_decode_format * format,
+                            const char * input, const char * output_dir,
+                            const k_decode_options * options,
+                            size_t * records)
+{
+    void *          columns[format == NULL ? 1 : format->num_columns];
+    size_t          offsets[format == NULL ? 1 : format->num_columns];
+    size_t          sizes[format == NULL ? 1 : format->num_columns];
+    const uint8_t * data = NULL;
+    uint8_t *       arrow_map = NULL;
+    size_t          arrow_size = 0;
+    size_t          count;
+    struct stat     info;
+    bool            arrow = (options != NULL && options->arrow);
+    int             threads = (options != NULL) ? options->threads : 0;
+    int             fd;
+    KDecodeStatus   status = DECODE_OK;
+
+    if (format == NULL || input == NULL || output_dir == NULL || threads < 0)
+    {
+        return DECODE_ERROR_CONFIG;
+    }
+
+    if (threads == 0)
+    {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    if (threads > K_DECODE_MAX_THREADS)
+    {
+        threads = K_DECODE_MAX_THREADS;
+    }
+
+    fd = open(input, O_RDONLY);
+    if (fd < 0)
+    {
+        perror("Failed to open input");
+        return DECODE_ERROR_IO;
+    }
+
+    if (fstat(fd, &info) != 0)
+    {
+        perror("Failed to read input size");
+        close(fd);
+        return DECODE_ERROR_IO;
+    }
+
+    count = info.st_size / format->record_size;
+    if (info.st_size % format->record_size != 0)
+    {
+        fprintf(stderr, "Warning: ignoring %zu trailing bytes of %s\n",
+                (size_t) (info.st_size % format->record_size), input);
+    }
+
+    if (count != 0)
+    {
+        data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            perror("Failed to map input");
+            close(fd);
+            return DECODE_ERROR_IO;
+        }
+        madvise((void *) data, info.st_size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    if (mkdir(output_dir, 0755) != 0 && errno != EEXIST)
+    {
+        perror("Failed to create output directory");
+        status = DECODE_ERROR_IO;
+    }
+
+    for (int c = 0; c < format->num_columns; c++)
+    {
+        sizes[c] = count * k_decode_type_size(format->columns[c].type);
+        offsets[c] = arrow_size;
+        arrow_size += align_up(sizes[c]);
+        columns[c] = NULL;
+    }
+
+    if (status == DECODE_OK && arrow)
+    {
+        status = map_output(output_dir, "columns.bin", arrow_size, &arrow_map);
+        for (int c = 0; arrow_map != NULL && c < format->num_columns; c++)
+        {
+            columns[c] = arrow_map + offsets[c];
+        }
+    }
+    else if (status == DECODE_OK)
+    {
+        for (int c = 0; status == DECODE_OK && c < format->num_columns; c++)
+        {
+            char name[PATH_MAX];
+
+            snprintf(name, sizeof(name), "%s.bin", format->columns[c].name);
+            status = map_output(output_dir, name, sizes[c],
+                                (uint8_t **) &columns[c]);
+        }
+    }
+
+    if (status == DECODE_OK)
+    {
+        status = k_decode_records(format, data, count, columns, threads);
+    }
+
+    if (status == DECODE_OK)
+    {
+        status = write_schema(format, output_dir, count, arrow, offsets);
+    }
+
+    if (arrow_map != NULL)
+    {
+        munmap(arrow_map, arrow_size);
+    }
+    else
+    {
+        for (int c = 0; c < format->num_columns; c++)
+        {
+            if (columns[c] != NULL)
+            {
+                munmap(columns[c], sizes[c]);
+            }
+        }
+    }
+
+    if (data != NULL)
+    {
+        munmap((void *) data, info.st_size);
+    }
+
+    if (status == DECODE_OK && records != NULL)
+    {
+        *records = count;
+    }
+
+    return status;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <telemetry-decoder.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static void usage(const char * name)
+{
+    fprintf(stderr,
+            "Usage: %s [-t threads] [--arrow] <format> <input> <output-dir>\n"
+            "       %s --list\n"
+            "\n"
+            "  -t, --threads N  Decoding threads (default: one per CPU)\n"
+            "  -a, --arrow      Write one Arrow-compatible columns.bin\n"
+            "  -l, --list       List the record formats\n",
+            name, name);
+}
+
+static void list_formats(void)
+{
+    const k_decode_format * format;
+
+    for (int i = 0; (format = k_decode_format_get(i)) != NULL; i++)
+    {
+        printf("%-16s %4zu bytes  %s\n", format->name, format->record_size,
+               format->description);
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    static const struct option long_options[] = {
+        { "threads", required_argument, NULL, 't' },
+        { "arrow", no_argument, NULL, 'a' },
+        { "list", no_argument, NULL, 'l' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    k_decode_options        options = { 0 };
+    const k_decode_format * format;
+    struct timespec         start;
+    struct timespec         end;
+    size_t                  records = 0;
+    int                     opt;
+
+    while ((opt = getopt_long(argc, argv, "t:alh", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 't':
+                options.threads = atoi(optarg);
+                if (options.threads < 1)
+                {
+                    fprintf(stderr, "Bad thread count: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'a':
+                options.arrow = true;
+                break;
+            case 'l':
+                list_formats();
+                return EXIT_SUCCESS;
+            case 'h':
+                usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind != 3)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    format = k_decode_format_find(argv[optind]);
+    if (format == NULL)
+    {
+        fprintf(stderr, "Unknown format: %s (see --list)\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (k_decode_file(format, argv[optind + 1], argv[optind + 2], &options,
+                      &records)
+        != DECODE_OK)
+    {
+        fprintf(stderr, "Failed to decode %s\n", argv[optind + 1]);
+        return EXIT_FAILURE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec)
+                     + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("Decoded %zu %s records in %.3f s", records, format->name,
+           seconds);
+    if (seconds > 0)
+    {
+        printf(" (%.1f M records/s)", records / seconds / 1e6);
+    }
+    printf("\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @defgroup DECODER Ground Telemetry Decoder
+ * @addtogroup DECODER
+ * @{
+ */
+
+#ifndef K_TELEMETRY_DECODER_H
+#define K_TELEMETRY_DECODER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Most decoding threads used at once
+ */
+#define K_DECODE_MAX_THREADS 64
+/**
+ * Alignment and padding of each column in the Arrow-compatible layout
+ */
+#define K_DECODE_ARROW_ALIGN 64
+
+/**
+ * Decoder function status
+ */
+typedef enum {
+    DECODE_OK = 0,
+    DECODE_ERROR,           /**< Generic error */
+    DECODE_ERROR_CONFIG,    /**< Bad argument */
+    DECODE_ERROR_IO         /**< Input or output file error */
+} KDecodeStatus;
+
+/**
+ * Column value types. Values are written in host byte order.
+ */
+typedef enum {
+    DECODE_UINT8,
+    DECODE_INT8,
+    DECODE_UINT16,
+    DECODE_INT16,
+    DECODE_UINT32,
+    DECODE_INT32
+} KDecodeType;
+
+/**
+ * One output column
+ */
+typedef struct {
+    const char * name;      /**< Column name */
+    KDecodeType  type;      /**< Value type */
+    size_t       offset;    /**< Offset of the value in the format's decoded row */
+} k_decode_column;
+
+/**
+ * Decode one raw record into a row
+ * @param [in] record Raw record, `record_size` bytes
+ * @param [out] row Decoded row, `row_size` bytes
+ */
+typedef void (*k_decode_row)(const uint8_t * record, void * row);
+
+/**
+ * A raw record format, with its columns
+ */
+typedef struct {
+    const char *            name;           /**< Format name, as given to the CLI */
+    const char *            description;    /**< One-line description */
+    size_t                  record_size;    /**< Raw record size, in bytes */
+    size_t                  row_size;       /**< Decoded row size, in bytes */
+    k_decode_row            decode;         /**< Record decoder */
+    const k_decode_column * columns;        /**< Output columns */
+    int                     num_columns;    /**< Number of columns */
+} k_decode_format;
+
+/**
+ * File decoding settings
+ */
+typedef struct {
+    int  threads;   /**< Decoding threads; 0 for one per online CPU */
+    bool arrow;     /**< Write the Arrow-compatible single-file layout */
+} k_decode_options;
+
+/**
+ * @brief Look up a record format by name
+ * @param [in] name Format name
+ * @return const k_decode_format* Format, or NULL if unknown
+ */
+const k_decode_format * k_decode_format_find(const char * name);
+
+/**
+ * @brief Walk the known record formats
+ * @param [in] index Format number, from 0
+ * @return const k_decode_format* Format, or NULL past the last one
+ */
+const k_decode_format * k_decode_format_get(int index);
+
+/**
+ * @brief Size of a column value
+ * @param [in] type Value type
+ * @return size_t Size in bytes
+ */
+size_t k_decode_type_size(KDecodeType type);
+
+/**
+ * @brief Name of a column value type, as Arrow names it
+ * @param [in] type Value type
+ * @return const char* Type name, e.g. "uint16"
+ */
+const char * k_decode_type_name(KDecodeType type);
+
+/**
+ * @brief Decode records into columns
+ *
+ * The records are split into contiguous chunks which are decoded in
+ * parallel, each straight into its own slice of every column.
+ *
+ * @param [in] format Record format
+ * @param [in] data `count` back-to-back raw records
+ * @param [in] count Number of records
+ * @param [out] columns One array of `count` values per column of `format`
+ * @param [in] threads Decoding threads, 1 to ::K_DECODE_MAX_THREADS
+ * @return KDecodeStatus `DECODE_OK` if OK, error otherwise
+ */
+KDecodeStatus k_decode_records(const k_decode_format * format,
+                               const uint8_t * data, size_t count,
+                               void * const * columns, int threads);
+
+/**
+ * @brief Decode a capture file of raw records into column files
+ *
+ * The input is memory-mapped, and so is every output file, so the
+ * records are decoded straight into the page cache. A trailing partial
+ * record is ignored, with a warning.
+ *
+ * `output_dir` (created if needed) receives `schema.json`, which lists
+ * the format, record count and columns, and then either:
+ *  - one `<column>.bin` file per column, a plain array of values, or
+ *  - with `options->arrow`, a single `columns.bin` in which every column
+ *    starts on a ::K_DECODE_ARROW_ALIGN byte boundary and is zero-padded
+ *    to a multiple of it, as Arrow lays out primitive array buffers. The
+ *    schema gives each column's offset and length, so a reader can map
+ *    the buffers into Arrow arrays (no nulls) without copying.
+ *
+ * @param [in] format Record format
+ * @param [in] input Capture file
+ * @param [in] output_dir Output directory
+ * @param [in] options Settings, or NULL for the defaults
+ * @param [out] records Number of records decoded (may be NULL)
+ * @return KDecodeStatus `DECODE_OK` if OK, error otherwise
+ */
+KDecodeStatus k_decode_file(const k_decode_format * format,
+                            const char * input, const char * output_dir,
+                            const k_decode_options * options,
+                            size_t * records);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
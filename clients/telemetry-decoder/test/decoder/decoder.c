@@ -0,0 +1,428 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmocka.h>
+#include <checksum.h>
+#include <gomspace-p31u-api.h>
+/* The P31u and TRXVU headers both name a reset delay/command HARD_RESET */
+#undef HARD_RESET
+#include <json.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <supervisor.h>
+#include <telemetry-decoder.h>
+#include <trxvu.h>
+#include <unistd.h>
+
+/* Enough records for several blocks on each thread, and a short last one */
+#define RECORDS 5003
+
+static int find_column(const k_decode_format * format, const char * name)
+{
+    for (int c = 0; c < format->num_columns; c++)
+    {
+        if (strcmp(format->columns[c].name, name) == 0)
+        {
+            return c;
+        }
+    }
+
+    fail_msg("No column %s in %s", name, format->name);
+
+    return -1;
+}
+
+/* Housekeeping for record `i`, in host byte order */
+static eps_hk_t eps_record(size_t i)
+{
+    eps_hk_t hk = { 0 };
+
+    hk.vbatt = 7000 + i % 1000;
+    hk.curin[2] = i;
+    hk.output[7] = i & 1;
+    hk.wdt_gnd_time_left = 172800 - i;
+    hk.counter_boot = 4000000000u + i;
+    hk.temp[5] = -(int16_t) (i % 40);
+    hk.ppt_mode = 1 + i % 2;
+
+    return hk;
+}
+
+static uint8_t * eps_capture(size_t count)
+{
+    uint8_t * data = malloc(count * sizeof(eps_hk_t));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        eps_hk_t hk = eps_record(i);
+        eps_hk_t wire;
+
+        /* The byte swap is its own inverse */
+        kprv_eps_decode_housekeeping(&hk, &wire);
+        memcpy(data + i * sizeof(wire), &wire, sizeof(wire));
+    }
+
+    return data;
+}
+
+static void check_eps_columns(const k_decode_format * format,
+                              void * const * columns, size_t count)
+{
+    const uint16_t * vbatt = columns[find_column(format, "vbatt")];
+    const uint16_t * curin = columns[find_column(format, "curin_2")];
+    const uint8_t *  output = columns[find_column(format, "output_7")];
+    const uint32_t * gnd = columns[find_column(format, "wdt_gnd_time_left")];
+    const uint32_t * boot = columns[find_column(format, "counter_boot")];
+    const int16_t *  temp = columns[find_column(format, "temp_5")];
+    const uint8_t *  ppt = columns[find_column(format, "ppt_mode")];
+
+    for (size_t i = 0; i < count; i++)
+    {
+        eps_hk_t hk = eps_record(i);
+
+        assert_int_equal(vbatt[i], hk.vbatt);
+        assert_int_equal(curin[i], hk.curin[2]);
+        assert_int_equal(output[i], hk.output[7]);
+        assert_int_equal(gnd[i], hk.wdt_gnd_time_left);
+        assert_int_equal(boot[i], hk.counter_boot);
+        assert_int_equal(temp[i], hk.temp[5]);
+        assert_int_equal(ppt[i], hk.ppt_mode);
+    }
+}
+
+static void ** alloc_columns(const k_decode_format * format, size_t count)
+{
+    void ** columns = calloc(format->num_columns, sizeof(void *));
+
+    for (int c = 0; c < format->num_columns; c++)
+    {
+        columns[c] = calloc(count, k_decode_type_size(format->columns[c].type));
+    }
+
+    return columns;
+}
+
+static void free_columns(const k_decode_format * format, void ** columns)
+{
+    for (int c = 0; c < format->num_columns; c++)
+    {
+        free(columns[c]);
+    }
+    free(columns);
+}
+
+static void * read_file(const char * dir, const char * name, size_t * size)
+{
+    char   path[512];
+    FILE * file;
+    void * data;
+    long   length;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    file = fopen(path, "rb");
+    assert_non_null(file);
+
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    data = calloc(1, length + 1);
+    assert_int_equal(fread(data, 1, length, file), length);
+    fclose(file);
+
+    *size = length;
+
+    return data;
+}
+
+static int64_t member_int(JsonNode * object, const char * key)
+{
+    int64_t value = -1;
+
+    assert_true(json_get_int(json_find_member(object, key), &value));
+
+    return value;
+}
+
+static void test_formats(void ** arg)
+{
+    const k_decode_format * format;
+    int                     count = 0;
+
+    while ((format = k_decode_format_get(count)) != NULL)
+    {
+        assert_ptr_equal(k_decode_format_find(format->name), format);
+
+        /* Every column lies inside the decoded row */
+        for (int c = 0; c < format->num_columns; c++)
+        {
+            assert_true(format->columns[c].offset
+                            + k_decode_type_size(format->columns[c].type)
+                        <= format->row_size);
+        }
+        count++;
+    }
+
+    assert_int_equal(count, 5);
+    assert_null(k_decode_format_get(-1));
+    assert_null(k_decode_format_find("nope"));
+    assert_null(k_decode_format_find(NULL));
+    assert_string_equal(k_decode_type_name(DECODE_INT16), "int16");
+    assert_int_equal(k_decode_type_size(DECODE_UINT32), 4);
+}
+
+static void test_records_bad_args(void ** arg)
+{
+    const k_decode_format * format = k_decode_format_find("p31u-hk");
+    uint8_t                 data[sizeof(eps_hk_t)] = { 0 };
+    void *                  columns[1] = { NULL };
+
+    assert_int_equal(k_decode_records(NULL, data, 1, columns, 1),
+                     DECODE_ERROR_CONFIG);
+    assert_int_equal(k_decode_records(format, NULL, 1, columns, 1),
+                     DECODE_ERROR_CONFIG);
+    assert_int_equal(k_decode_records(format, data, 1, NULL, 1),
+                     DECODE_ERROR_CONFIG);
+    assert_int_equal(k_decode_records(format, data, 1, columns, 0),
+                     DECODE_ERROR_CONFIG);
+    assert_int_equal(k_decode_records(format, data, 1, columns,
+                                      K_DECODE_MAX_THREADS + 1),
+                     DECODE_ERROR_CONFIG);
+
+    /* Nothing to do */
+    assert_int_equal(k_decode_records(format, NULL, 0, columns, 1), DECODE_OK);
+}
+
+static void test_records_eps(void ** arg)
+{
+    const k_decode_format * format = k_decode_format_find("p31u-hk");
+    uint8_t *               data = eps_capture(RECORDS);
+
+    for (int threads = 1; threads <= 8; threads *= 2)
+    {
+        void ** columns = alloc_columns(format, RECORDS);
+
+        assert_int_equal(k_decode_records(format, data, RECORDS, columns,
+                                          threads),
+                         DECODE_OK);
+        check_eps_columns(format, columns, RECORDS);
+
+        free_columns(format, columns);
+    }
+
+    free(data);
+}
+
+static void test_records_trxvu(void ** arg)
+{
+    const k_decode_format * format = k_decode_format_find("trxvu-tx");
+    trxvu_tx_telem_raw      raw[RECORDS];
+    void **                 columns = alloc_columns(format, RECORDS);
+
+    for (size_t i = 0; i < RECORDS; i++)
+    {
+        raw[i] = (trxvu_tx_telem_raw) {
+            .inst_RF_reflected = i % 4096,
+            .inst_RF_forward   = (i * 7) % 4096,
+            .supply_voltage    = 3000,
+            .supply_current    = 1000 + i % 100,
+            .temp_power_amp    = 2000 + i % 500,
+            .temp_oscillator   = 2100,
+        };
+    }
+
+    assert_int_equal(k_decode_records(format, (const uint8_t *) raw, RECORDS,
+                                      columns, 4),
+                     DECODE_OK);
+
+    const int32_t *  forward = columns[find_column(format, "forward_mdbm")];
+    const uint32_t * nw = columns[find_column(format, "reflected_nw")];
+    const int32_t *  amp = columns[find_column(format, "temp_power_amp_mdegc")];
+
+    /* Same values as the API's own conversion */
+    for (size_t i = 0; i < RECORDS; i++)
+    {
+        trxvu_tx_telem_eng eng;
+
+        k_radio_tx_telem_eng(&raw[i], &eng);
+        assert_int_equal(forward[i], eng.forward_mdbm);
+        assert_int_equal(nw[i], eng.reflected_nw);
+        assert_int_equal(amp[i], eng.temp_power_amp_mdegc);
+    }
+
+    free_columns(format, columns);
+}
+
+static void test_records_supervisor(void ** arg)
+{
+    const k_decode_format *   format = k_decode_format_find("supervisor-hk");
+    supervisor_housekeeping_t hk[2] = { 0 };
+    void **                   columns = alloc_columns(format, 2);
+    uint32_t                  uptime = 86400;
+
+    for (int i = 0; i < 2; i++)
+    {
+        hk[i].fields.spi_command_status = 0xAA;
+        hk[i].fields.enable_status.raw_value = 0x05;
+        memcpy(&hk[i].fields.supervisor_uptime, &uptime, sizeof(uptime));
+        hk[i].raw_value[LENGTH_TELEMETRY_HOUSEKEEPING - 1]
+            = supervisor_calculate_CRC(hk[i].raw_value + 1,
+                                       LENGTH_TELEMETRY_HOUSEKEEPING - 2);
+    }
+
+    /* Corrupted in transit */
+    hk[1].raw_value[20] ^= 0x10;
+
+    assert_int_equal(k_decode_records(format, (const uint8_t *) hk, 2,
+                                      columns, 1),
+                     DECODE_OK);
+
+    const uint8_t *  status = columns[find_column(format, "spi_command_status")];
+    const uint8_t *  enable = columns[find_column(format, "enable_status")];
+    const uint32_t * up = columns[find_column(format, "supervisor_uptime")];
+    const uint8_t *  crc_ok = columns[find_column(format, "crc_ok")];
+
+    assert_int_equal(status[0], 0xAA);
+    assert_int_equal(enable[0], 0x05);
+    assert_int_equal(up[0], 86400);
+    assert_int_equal(crc_ok[0], 1);
+    assert_int_equal(crc_ok[1], 0);
+
+    free_columns(format, columns);
+}
+
+static void test_file(void ** arg)
+{
+    const k_decode_format * format = k_decode_format_find("p31u-hk");
+    char                    dir[] = "/tmp/telemetry-decoder-XXXXXX";
+    char                    input[sizeof(dir) + 16];
+    char                    plain[sizeof(dir) + 16];
+    char                    arrow[sizeof(dir) + 16];
+    uint8_t *               data = eps_capture(RECORDS);
+    k_decode_options        options = {.threads = 3 };
+    size_t                  records = 0;
+    size_t                  size;
+    FILE *                  file;
+
+    assert_non_null(mkdtemp(dir));
+    snprintf(input, sizeof(input), "%s/hk.raw", dir);
+    snprintf(plain, sizeof(plain), "%s/plain", dir);
+    snprintf(arrow, sizeof(arrow), "%s/arrow", dir);
+
+    /* A capture cut off part way through its last record */
+    file = fopen(input, "wb");
+    assert_non_null(file);
+    const uint8_t partial[11] = { 0 };
+    fwrite(data, 1, RECORDS * sizeof(eps_hk_t), file);
+    fwrite(partial, 1, sizeof(partial), file);
+    fclose(file);
+
+    /* One file per column */
+    assert_int_equal(k_decode_file(format, input, plain, &options, &records),
+                     DECODE_OK);
+    assert_int_equal(records, RECORDS);
+
+    void ** columns = calloc(format->num_columns, sizeof(void *));
+    for (int c = 0; c < format->num_columns; c++)
+    {
+        char name[64];
+
+        snprintf(name, sizeof(name), "%s.bin", format->columns[c].name);
+        columns[c] = read_file(plain, name, &size);
+        assert_int_equal(size,
+                         RECORDS * k_decode_type_size(format->columns[c].type));
+    }
+    check_eps_columns(format, columns, RECORDS);
+    free_columns(format, columns);
+
+    char *     text = read_file(plain, "schema.json", &size);
+    JsonNode * schema = json_decode(text);
+    assert_non_null(schema);
+    assert_string_equal(json_find_member(schema, "format")->string_,
+                        "p31u-hk");
+    assert_int_equal(member_int(schema, "records"), RECORDS);
+    assert_string_equal(json_find_member(schema, "layout")->string_,
+                        "columns");
+    JsonNode * column
+        = json_find_element(json_find_member(schema, "columns"), 3);
+    assert_string_equal(json_find_member(column, "name")->string_, "vbatt");
+    assert_string_equal(json_find_member(column, "type")->string_, "uint16");
+    assert_string_equal(json_find_member(column, "file")->string_,
+                        "vbatt.bin");
+    json_delete(schema);
+    free(text);
+
+    /* One aligned file, laid out by the schema */
+    options.arrow = true;
+    assert_int_equal(k_decode_file(format, input, arrow, &options, &records),
+                     DECODE_OK);
+
+    uint8_t * buffers = read_file(arrow, "columns.bin", &size);
+    assert_int_equal(size % K_DECODE_ARROW_ALIGN, 0);
+
+    text = read_file(arrow, "schema.json", &size);
+    schema = json_decode(text);
+    assert_non_null(schema);
+    assert_string_equal(json_find_member(schema, "layout")->string_, "arrow");
+
+    columns = calloc(format->num_columns, sizeof(void *));
+    JsonNode * entry;
+    int        c = 0;
+    json_foreach(entry, json_find_member(schema, "columns"))
+    {
+        size_t offset = member_int(entry, "offset");
+        size_t length = member_int(entry, "length");
+
+        assert_int_equal(offset % K_DECODE_ARROW_ALIGN, 0);
+        assert_int_equal(length,
+                         RECORDS * k_decode_type_size(format->columns[c].type));
+        columns[c++] = buffers + offset;
+    }
+    assert_int_equal(c, format->num_columns);
+    check_eps_columns(format, columns, RECORDS);
+    free(columns);
+    free(buffers);
+    json_delete(schema);
+    free(text);
+
+    /* Missing input */
+    assert_int_equal(k_decode_file(format, "/nonexistent/hk.raw", plain,
+                                   NULL, NULL),
+                     DECODE_ERROR_IO);
+    assert_int_equal(k_decode_file(NULL, input, plain, NULL, NULL),
+                     DECODE_ERROR_CONFIG);
+
+    free(data);
+
+    char command[128];
+    snprintf(command, sizeof(command), "rm -rf %s", dir);
+    assert_int_equal(system(command), 0);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_formats),
+        cmocka_unit_test(test_records_bad_args),
+        cmocka_unit_test(test_records_eps),
+        cmocka_unit_test(test_records_trxvu),
+        cmocka_unit_test(test_records_supervisor),
+        cmocka_unit_test(test_file),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
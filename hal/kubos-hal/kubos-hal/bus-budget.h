@@ -0,0 +1,157 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @defgroup BUS_BUDGET HAL Bus Time Budgets
+ * @addtogroup BUS_BUDGET
+ * @{
+ */
+
+#ifndef K_BUS_BUDGET_H
+#define K_BUS_BUDGET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "i2c.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum number of budgets which can be registered
+ */
+#define K_BUDGET_MAX      16
+/**
+ * Maximum budget name length (including the terminating NULL)
+ */
+#define K_BUDGET_NAME_LEN 16
+/**
+ * Bus time charged up front per byte, in [us]: 9 bit times at 100kHz
+ */
+#define K_BUDGET_BYTE_US  90
+
+/**
+ * Bus budget function status
+ */
+typedef enum {
+    BUDGET_OK = 0,
+    BUDGET_ERROR,           /**< Generic error */
+    BUDGET_ERROR_CONFIG,    /**< Bad argument */
+    BUDGET_ERROR_FULL       /**< No free registry slots */
+} KBudgetStatus;
+
+/**
+ * Budget settings. Zero fields take their default.
+ */
+typedef struct {
+    uint32_t rate_us;       /**< Bus time allowed per second in [us] (default 100000) */
+    uint32_t burst_us;      /**< Bus time which can be used at once after idling in [us] (default `rate_us`) */
+    uint32_t max_wait_ms;   /**< Longest a transfer waits for admission; 0 waits as long as needed */
+    bool     critical;      /**< Safety-critical: always admitted at once, but still charged */
+} k_budget_config;
+
+/**
+ * Counters for one budget
+ */
+typedef struct {
+    char     name[K_BUDGET_NAME_LEN]; /**< Name given when registered */
+    bool     critical;      /**< Budget is safety-critical */
+    uint32_t rate_us;       /**< Configured rate */
+    uint32_t burst_us;      /**< Configured burst */
+    int64_t  tokens_us;     /**< Current balance; negative while paying off an overrun */
+    uint32_t transfers;     /**< Transfers admitted */
+    uint64_t bus_us;        /**< Bus time used */
+    uint32_t waits;         /**< Transfers which had to wait for admission */
+    uint64_t wait_us;       /**< Total time spent waiting */
+    uint32_t refused;       /**< Transfers refused after `max_wait_ms` */
+} k_budget_stats;
+
+/**
+ * @brief Register a client's share of bus time
+ *
+ * Each budget is a token bucket holding up to `burst_us` of bus time and
+ * refilled at `rate_us` per second. A thread charges its transfers to a
+ * budget between ::k_budget_enter and ::k_budget_leave: before each
+ * ::k_i2c_write or ::k_i2c_read it must hold enough tokens for the
+ * transfer's length (capped at `burst_us`) or wait for them, and afterwards
+ * the bus time actually measured is taken off. Threads outside any budget
+ * are not limited.
+ *
+ * Transfers under a critical budget never wait, so watchdog kicks and
+ * similar traffic keep their deadlines while bulk clients are held back.
+ *
+ * Registering an existing name changes its settings and gives back the
+ * same id.
+ *
+ * @param [in] name Client name (truncated to ::K_BUDGET_NAME_LEN - 1)
+ * @param [in] config Budget settings, or NULL for the defaults
+ * @param [out] id Budget id for ::k_budget_enter
+ * @return KBudgetStatus `BUDGET_OK` if OK, error otherwise
+ */
+KBudgetStatus k_budget_register(const char * name,
+                                const k_budget_config * config, int * id);
+
+/**
+ * @brief Charge the calling thread's transfers to a budget
+ * @param [in] id Budget id from ::k_budget_register, or -1 for none
+ * @return int The budget previously in effect, to give to ::k_budget_leave
+ */
+int k_budget_enter(int id);
+
+/**
+ * @brief Go back to the budget in effect before ::k_budget_enter
+ * @param [in] previous Value returned by the matching ::k_budget_enter
+ */
+void k_budget_leave(int previous);
+
+/**
+ * @brief Read the counters for every registered budget
+ * @param [out] buffer Storage for up to `max` records
+ * @param [in] max Number of records `buffer` can hold
+ * @param [out] count Number of records written
+ * @return KBudgetStatus `BUDGET_OK` if OK, error otherwise
+ */
+KBudgetStatus k_budget_snapshot(k_budget_stats * buffer, int max, int * count);
+
+/**
+ * @brief Wait until the calling thread's budget can cover a transfer
+ *
+ * Used by the I2C functions.
+ *
+ * @param [in] len Transfer length in bytes
+ * @return KI2CStatus `I2C_OK` to go ahead, `I2C_ERROR_BUDGET` if refused
+ */
+KI2CStatus kprv_budget_admit(int len);
+
+/**
+ * @brief Whether the calling thread is charging a budget
+ * @return bool `true` if transfers should be timed for ::kprv_budget_charge
+ */
+bool kprv_budget_active(void);
+
+/**
+ * @brief Take measured bus time off the calling thread's budget
+ * @param [in] bus_ns Bus time used in [ns]
+ */
+void kprv_budget_charge(uint64_t bus_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
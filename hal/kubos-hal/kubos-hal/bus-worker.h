@@ -0,0 +1,165 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @defgroup BUS_WORKER HAL Per-Bus Workers
+ * @addtogroup BUS_WORKER
+ * @{
+ */
+
+#ifndef K_BUS_WORKER_H
+#define K_BUS_WORKER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum number of physical buses (one worker each)
+ */
+#define K_BUS_MAX         4
+/**
+ * Maximum number of routed devices
+ */
+#define K_BUS_DEVICES     16
+/**
+ * Maximum device name length (including the terminating NULL)
+ */
+#define K_BUS_NAME_LEN    16
+/**
+ * Maximum bus device path length (including the terminating NULL)
+ */
+#define K_BUS_PATH_LEN    32
+/**
+ * Maximum number of requests in one ::k_bus_run
+ */
+#define K_BUS_RUN_MAX     64
+/**
+ * Runs each worker can have waiting at once
+ */
+#define K_BUS_QUEUE_DEPTH 8
+
+/**
+ * Bus worker function status
+ */
+typedef enum {
+    BUS_OK = 0,
+    BUS_ERROR,              /**< Generic error */
+    BUS_ERROR_CONFIG,       /**< Bad argument, or a device with no bus */
+    BUS_ERROR_FULL          /**< No free bus or device slots, or too many requests */
+} KBusStatus;
+
+/**
+ * One transaction, such as a device API telemetry call
+ * @param [in] arg Caller's argument
+ * @return int Result, reported in the completion
+ */
+typedef int (*k_bus_fn)(void * arg);
+
+/**
+ * A transaction to run on a device's bus
+ */
+typedef struct {
+    const char * device;    /**< Device name given to ::k_bus_attach */
+    k_bus_fn     fn;        /**< Transaction */
+    void *       arg;       /**< Passed to `fn` */
+    uint64_t     user_data; /**< Returned in the completion */
+} k_bus_request;
+
+/**
+ * Result of one request
+ */
+typedef struct {
+    uint64_t user_data;     /**< Value given in the request */
+    int      result;        /**< Value `fn` returned */
+    int      bus;           /**< Bus it ran on (index into ::k_bus_snapshot) */
+    uint64_t start_ns;      /**< When it started (::k_clock_now) */
+    uint64_t end_ns;        /**< When it finished */
+} k_bus_completion;
+
+/**
+ * Accounting data for one bus worker
+ */
+typedef struct {
+    char     path[K_BUS_PATH_LEN];  /**< Bus device path */
+    bool     running;       /**< `true` while the worker thread is up */
+    uint32_t runs;          /**< Runs it took part in */
+    uint32_t requests;      /**< Requests it ran */
+    uint64_t busy_ns;       /**< Time spent running requests */
+} k_bus_stats;
+
+/**
+ * @brief Route a device's requests to the worker for its bus
+ *
+ * Devices on the same bus path share a worker. Attaching a known device
+ * again moves it to the new bus.
+ *
+ * @param [in] device Device name (truncated to ::K_BUS_NAME_LEN - 1)
+ * @param [in] path Bus device path, e.g. "/dev/i2c-1" or "/dev/spidev0.2"
+ * @return KBusStatus `BUS_OK` if OK, error otherwise
+ */
+KBusStatus k_bus_attach(const char * device, const char * path);
+
+/**
+ * @brief Run a set of requests, each bus in parallel
+ *
+ * Requests for devices on the same bus run one after another in the order
+ * given, on that bus's worker thread; different buses run at the same time.
+ * The call returns once every request has finished, so a sweep takes as
+ * long as its busiest bus rather than the sum of them all. Workers start on
+ * first use, named "bus-" plus the last part of the bus path (e.g.
+ * "bus-i2c-1") for ::k_thread_create and ::k_thread_stats_register, and
+ * charge their transfers to the caller's bus budget. A bus whose worker
+ * can't be started, or is being stopped, is swept by the calling thread.
+ *
+ * If any device has no bus, nothing is run. Requests must not call
+ * ::k_bus_run themselves.
+ *
+ * @param [in] requests Requests
+ * @param [in] count Number of requests (at most ::K_BUS_RUN_MAX)
+ * @param [out] completions One per request, in the same order
+ * @return KBusStatus `BUS_OK` if every request ran, error otherwise
+ */
+KBusStatus k_bus_run(const k_bus_request * requests, int count,
+                     k_bus_completion * completions);
+
+/**
+ * @brief Stop every worker
+ *
+ * Waits for queued runs to finish; callers still waiting for room in a
+ * queue run their requests themselves. Routes are kept, and workers start
+ * again on the next ::k_bus_run.
+ */
+void k_bus_terminate(void);
+
+/**
+ * @brief Read the accounting data for every bus
+ * @param [out] buffer Storage for up to `max` records
+ * @param [in] max Number of records `buffer` can hold
+ * @param [out] count Number of records written
+ * @return KBusStatus `BUS_OK` if OK, error otherwise
+ */
+KBusStatus k_bus_snapshot(k_bus_stats * buffer, int max, int * count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
@@ -0,0 +1,139 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @defgroup CLOCK HAL Clock
+ * @addtogroup CLOCK
+ * @{
+ */
+
+#ifndef K_CLOCK_H
+#define K_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Nanoseconds per second
+ */
+#define K_CLOCK_NS_PER_SEC 1000000000ULL
+
+/**
+ * A time source. Every delay and timestamp taken by the HAL and the device
+ * APIs goes through the installed one.
+ */
+typedef struct {
+    /** Current monotonic time, in ns */
+    uint64_t (*now)(void * context);
+    /** Return once `now` has reached `deadline_ns` */
+    void (*sleep_until)(void * context, uint64_t deadline_ns);
+    /** Passed to both functions */
+    void * context;
+} k_clock_ops;
+
+/**
+ * @brief Install a time source
+ *
+ * Should be called before any device is opened; threads already sleeping
+ * finish their sleep on the old one.
+ *
+ * @param [in] ops Time source, which must outlive its use, or NULL for the
+ *             system's `CLOCK_MONOTONIC`
+ */
+void k_clock_set(const k_clock_ops * ops);
+
+/**
+ * @brief Install a virtual time source
+ *
+ * Virtual time only moves when it is told to, so runs are deterministic
+ * and no real time is spent sleeping:
+ *  - A sleep by the calling thread (the one driving the test or
+ *    simulation) moves time straight to its deadline
+ *  - A sleep by any other thread (watchdogs, refresh threads) waits until
+ *    the driving thread has moved time past its deadline
+ *  - ::k_clock_advance moves time explicitly
+ *
+ * @param [in] start_ns Initial time
+ */
+void k_clock_use_virtual(uint64_t start_ns);
+
+/**
+ * @brief Move virtual time forward, waking the threads whose deadlines
+ *        have passed
+ *
+ * Does nothing unless the virtual time source is installed.
+ *
+ * @param [in] ns Time to add
+ */
+void k_clock_advance(uint64_t ns);
+
+/**
+ * @brief Current monotonic time
+ * @return uint64_t Time in ns
+ */
+uint64_t k_clock_now(void);
+
+/**
+ * @brief Sleep until a point in time
+ * @param [in] deadline_ns Time, as returned by ::k_clock_now, to wake at
+ */
+void k_clock_sleep_until(uint64_t deadline_ns);
+
+/**
+ * @brief Sleep for a duration
+ * @param [in] ns Time to sleep
+ */
+void k_clock_sleep(uint64_t ns);
+
+/**
+ * @brief Sleep for a duration given as a `timespec`, like `nanosleep`
+ * @param [in] delay Time to sleep
+ */
+void k_clock_nanosleep(const struct timespec * delay);
+
+/**
+ * @brief Sleep until a point in time, or until a word changes
+ *
+ * Returns once `deadline_ns` is reached, or early once `*word` no longer
+ * holds `seen` and ::k_clock_notify has been called, so a thread sleeping
+ * on a schedule can be told the schedule changed. Like the other sleeps it
+ * is a cancellation point. Under a time source installed with
+ * ::k_clock_set the wait can't be cut short, and lasts until the deadline.
+ *
+ * @param [in] deadline_ns Time, as returned by ::k_clock_now, to wake at
+ * @param [in] word Word to watch
+ * @param [in] seen Value of `*word` the caller last saw
+ */
+void k_clock_wait_until(uint64_t deadline_ns, const uint32_t * word,
+                        uint32_t seen);
+
+/**
+ * @brief Wake every ::k_clock_wait_until caller to recheck its word
+ *
+ * Change the word (atomically) first.
+ */
+void k_clock_notify(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
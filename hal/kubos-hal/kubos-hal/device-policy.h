@@ -0,0 +1,186 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @defgroup DEVICE_POLICY HAL Device Retry and Circuit Breaker Policy
+ * @addtogroup DEVICE_POLICY
+ * @{
+ */
+
+#ifndef K_DEVICE_POLICY_H
+#define K_DEVICE_POLICY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "i2c.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum number of devices which can have a policy at once
+ */
+#define K_POLICY_MAX      16
+/**
+ * Maximum device name length (including the terminating NULL)
+ */
+#define K_POLICY_NAME_LEN 16
+
+/**
+ * Device policy function status
+ */
+typedef enum {
+    POLICY_OK = 0,
+    POLICY_ERROR,           /**< Generic error */
+    POLICY_ERROR_CONFIG,    /**< Bad argument, or device attached under another name */
+    POLICY_ERROR_FULL       /**< No free registry slots */
+} KPolicyStatus;
+
+/**
+ * Circuit breaker state
+ */
+typedef enum {
+    POLICY_CLOSED = 0,      /**< Device healthy, transfers go through */
+    POLICY_OPEN,            /**< Device presumed dead, transfers fail fast */
+    POLICY_HALF_OPEN        /**< A single trial transfer is checking the device */
+} KPolicyState;
+
+/**
+ * Retry and circuit breaker settings. Zero fields take their default.
+ */
+typedef struct {
+    uint32_t max_attempts;      /**< Tries per bus operation, including the first (default 3) */
+    uint32_t base_delay_us;     /**< Backoff ceiling before the first retry (default 1000) */
+    uint32_t max_delay_us;      /**< Largest backoff ceiling (default 20000) */
+    uint32_t failure_threshold; /**< Consecutive failed operations which open the breaker (default 3) */
+    uint32_t open_ms;           /**< Time the breaker stays open before a trial (default 5000) */
+    bool     retry_writes;      /**< Retry any failed write, for devices whose commands are all idempotent (default false) */
+} k_policy_config;
+
+/**
+ * Device health probe. Should issue the device's cheapest harmless command.
+ */
+typedef void (*k_policy_probe)(void);
+
+/**
+ * Counters for one device
+ */
+typedef struct {
+    char         name[K_POLICY_NAME_LEN]; /**< Name given when attached */
+    bool         active;    /**< `true` while the device is attached */
+    KPolicyState state;     /**< Current breaker state */
+    uint32_t     operations; /**< Bus operations requested */
+    uint32_t     retries;   /**< Extra attempts made after a failure */
+    uint32_t     failures;  /**< Operations which failed every attempt */
+    uint32_t     rejected;  /**< Operations refused because the breaker was open */
+    uint32_t     trips;     /**< Number of times the breaker has opened */
+    uint32_t     probes;    /**< Background probes run */
+} k_policy_stats;
+
+/**
+ * @brief Put a device under a retry and circuit breaker policy
+ *
+ * From then on every ::k_i2c_write and ::k_i2c_read against `addr` on `bus`
+ * is retried on failure, up to `max_attempts` times with a random delay of
+ * up to `base_delay_us` doubling per retry (capped at `max_delay_us`).
+ * A failed write is only retried if the device never acknowledged its
+ * address, so no part of the command can have reached it; set
+ * `retry_writes` to retry any failed write.
+ *
+ * After `failure_threshold` operations in a row have failed every attempt,
+ * the breaker opens and further operations return `I2C_ERROR_UNAVAILABLE`
+ * immediately, without touching the bus. After `open_ms` a single trial is
+ * let through: if `probe` is given it is run from a background thread,
+ * otherwise the next caller's operation is the trial. A successful trial
+ * closes the breaker; a failed one opens it for another `open_ms`.
+ *
+ * Attaching a name which is already in use moves it to the new bus and
+ * address (so re-initializing a device API is harmless). Either way the
+ * name's counters carry on from where they were.
+ *
+ * @param [in] name Device name (truncated to ::K_POLICY_NAME_LEN - 1)
+ * @param [in] bus I2C bus from ::k_i2c_init
+ * @param [in] addr Device address
+ * @param [in] config Policy settings, or NULL for the defaults
+ * @param [in] probe Health probe, or NULL
+ * @return KPolicyStatus `POLICY_OK` if OK, error otherwise
+ */
+KPolicyStatus k_policy_attach(const char * name, int bus, uint16_t addr,
+                              const k_policy_config * config,
+                              k_policy_probe probe);
+
+/**
+ * @brief Take a device out from under its policy
+ *
+ * Any background probe is stopped, waiting for one already talking to the
+ * device to finish, so the bus may be closed once this returns. Must not be
+ * called from a probe. Does nothing if the device is not attached.
+ *
+ * @param [in] bus I2C bus the device was attached with
+ * @param [in] addr Device address
+ */
+void k_policy_detach(int bus, uint16_t addr);
+
+/**
+ * @brief Change an attached device's settings
+ *
+ * The breaker is closed and its failure count cleared.
+ *
+ * @param [in] name Device name
+ * @param [in] config New settings, or NULL for the defaults
+ * @return KPolicyStatus `POLICY_OK` if OK, `POLICY_ERROR_CONFIG` if no such device
+ */
+KPolicyStatus k_policy_configure(const char * name,
+                                 const k_policy_config * config);
+
+/**
+ * @brief Read the counters for every device which has had a policy
+ * @param [out] buffer Storage for up to `max` records
+ * @param [in] max Number of records `buffer` can hold
+ * @param [out] count Number of records written
+ * @return KPolicyStatus `POLICY_OK` if OK, error otherwise
+ */
+KPolicyStatus k_policy_snapshot(k_policy_stats * buffer, int max, int * count);
+
+/**
+ * Single bus operation, as run by ::kprv_policy_run
+ */
+typedef KI2CStatus (*kprv_policy_op)(int bus, uint16_t addr, uint8_t * ptr,
+                                     int len);
+
+/**
+ * @brief Run a bus operation under the device's policy
+ *
+ * Used by the I2C functions. Runs `op` once if the device has no policy.
+ *
+ * @param [in] op Operation
+ * @param [in] write `true` if `op` sends data to the device
+ * @param [in] bus I2C bus
+ * @param [in] addr Device address
+ * @param [in] ptr Data buffer
+ * @param [in] len Data length
+ * @return KI2CStatus Result of the last attempt, or `I2C_ERROR_UNAVAILABLE`
+ */
+KI2CStatus kprv_policy_run(kprv_policy_op op, bool write, int bus,
+                           uint16_t addr, uint8_t * ptr, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
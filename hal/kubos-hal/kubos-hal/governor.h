@@ -0,0 +1,256 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @defgroup GOVERNOR HAL Power-Aware Polling Governor
+ * @addtogroup GOVERNOR
+ * @{
+ */
+
+#ifndef K_GOVERNOR_H
+#define K_GOVERNOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum number of governed activities
+ */
+#define K_GOV_MAX            16
+/**
+ * Maximum number of custom conditions
+ */
+#define K_GOV_MAX_CONDITIONS 8
+/**
+ * Maximum activity or condition name length (including the terminating NULL)
+ */
+#define K_GOV_NAME_LEN       16
+/**
+ * Largest message on a topic ::k_gov_follow can follow
+ */
+#define K_GOV_FOLLOW_SIZE    256
+/**
+ * Default slowdown of activities in `GOV_MODE_SAFE`
+ */
+#define K_GOV_SCALE_SAFE     4
+/**
+ * Default slowdown of activities in `GOV_MODE_CRITICAL`
+ */
+#define K_GOV_SCALE_CRITICAL 8
+
+/**
+ * Governor function status
+ */
+typedef enum {
+    GOV_OK = 0,
+    GOV_ERROR,              /**< Generic error */
+    GOV_ERROR_CONFIG,       /**< Bad argument */
+    GOV_ERROR_FULL          /**< No free activity or condition slots */
+} KGovStatus;
+
+/**
+ * Power modes, numbered as the P31u reports its battery mode
+ */
+typedef enum {
+    GOV_MODE_INITIAL = 0,
+    GOV_MODE_CRITICAL,
+    GOV_MODE_SAFE,
+    GOV_MODE_NORMAL,
+    GOV_MODE_FULL,
+    GOV_MODES               /**< Number of modes */
+} KGovMode;
+
+/**
+ * How often an activity runs in each power mode. Zero fields take their
+ * default.
+ */
+typedef struct {
+    /**
+     * Period in each mode, in ms (0 = the base period, times
+     * ::K_GOV_SCALE_SAFE in `SAFE` and ::K_GOV_SCALE_CRITICAL in `CRITICAL`)
+     */
+    uint32_t period_ms[GOV_MODES];
+} k_gov_profile;
+
+/**
+ * Map a message on a followed topic to a power mode
+ * @param [in] data Message
+ * @param [in] len Message length
+ * @return int Power mode, or -1 to leave the mode as it is
+ */
+typedef int (*k_gov_mode_fn)(const void * data, uint32_t len);
+
+/**
+ * Accounting data for one governed activity
+ */
+typedef struct {
+    char     name[K_GOV_NAME_LEN];  /**< Activity name */
+    bool     active;            /**< `true` once registered */
+    uint32_t base_period_ms;    /**< Period it was registered with */
+    uint32_t period_ms;         /**< Period in effect now */
+    uint32_t wakeups;           /**< Wakeups so far */
+    uint32_t base_wakeups;      /**< Wakeups it would have had at its base period */
+    uint64_t cpu_ns;            /**< CPU time spent between wakeups and the next sleep */
+    uint64_t bus_ns;            /**< Bus time spent likewise (tracked threads only) */
+    uint64_t cpu_saved_ns;      /**< CPU time the skipped wakeups would have cost */
+    uint64_t bus_saved_ns;      /**< Bus time the skipped wakeups would have cost */
+} k_gov_stats;
+
+/**
+ * @brief Register a periodic activity
+ *
+ * If the name is already known (its profile was set first, or the activity
+ * is being restarted), that slot is reused and its accounting carries on.
+ *
+ * @param [in] name Activity name (truncated to ::K_GOV_NAME_LEN - 1)
+ * @param [in] base_period_ms Period in normal operation
+ * @param [in] max_period_ms Longest period any mode or condition may give
+ *             it, e.g. to keep a watchdog fed (0 = no limit)
+ * @param [out] activity Activity id
+ * @return KGovStatus `GOV_OK` if OK, error otherwise
+ */
+KGovStatus k_gov_register(const char * name, uint32_t base_period_ms,
+                          uint32_t max_period_ms, int * activity);
+
+/**
+ * @brief Look up an activity by name
+ * @param [in] name Activity name
+ * @param [out] activity Activity id
+ * @return KGovStatus `GOV_OK` if found, `GOV_ERROR` otherwise
+ */
+KGovStatus k_gov_find(const char * name, int * activity);
+
+/**
+ * @brief Set the per-mode periods of an activity
+ *
+ * May be called before the activity registers, so a service can tune the
+ * device APIs' activities by name.
+ *
+ * @param [in] name Activity name
+ * @param [in] profile Periods, or NULL for the defaults
+ * @return KGovStatus `GOV_OK` if OK, error otherwise
+ */
+KGovStatus k_gov_set_profile(const char * name, const k_gov_profile * profile);
+
+/**
+ * @brief Create a custom condition, or look one up by name
+ *
+ * Conditions start inactive.
+ *
+ * @param [in] name Condition name (e.g. "eclipse", "ground-pass")
+ * @param [out] condition Condition id
+ * @return KGovStatus `GOV_OK` if OK, error otherwise
+ */
+KGovStatus k_gov_condition(const char * name, int * condition);
+
+/**
+ * @brief Set the period of an activity while a condition holds
+ *
+ * While any condition with a period for the activity is active, the
+ * shortest of those periods replaces its mode's period.
+ *
+ * @param [in] name Activity name
+ * @param [in] condition Condition id
+ * @param [in] period_ms Period (0 = none for this condition)
+ * @return KGovStatus `GOV_OK` if OK, error otherwise
+ */
+KGovStatus k_gov_set_condition_period(const char * name, int condition,
+                                      uint32_t period_ms);
+
+/**
+ * @brief Turn a condition on or off
+ * @param [in] condition Condition id
+ * @param [in] active Whether it holds
+ * @return KGovStatus `GOV_OK` if OK, error otherwise
+ */
+KGovStatus k_gov_set_condition(int condition, bool active);
+
+/**
+ * @brief Change the power mode
+ *
+ * Every activity's period is recomputed together, and activities asleep in
+ * ::k_gov_sleep are woken to reschedule against their new periods.
+ *
+ * @param [in] mode Power mode
+ * @return KGovStatus `GOV_OK` if OK, error otherwise
+ */
+KGovStatus k_gov_set_mode(KGovMode mode);
+
+/**
+ * @brief Current power mode
+ * @return KGovMode Power mode (`GOV_MODE_NORMAL` until first set)
+ */
+KGovMode k_gov_mode(void);
+
+/**
+ * @brief Follow the power mode published on a topic
+ *
+ * A background thread ("governor") reads every message published on the
+ * topic and sets the mode `fn` maps it to. The P31u API follows its
+ * housekeeping topic this way when initialized, so the mode tracks the
+ * battery mode whenever housekeeping is read.
+ *
+ * @param [in] topic Topic id (see ::k_pubsub_topic)
+ * @param [in] size Largest message on the topic (at most ::K_GOV_FOLLOW_SIZE)
+ * @param [in] fn Message to mode mapping
+ * @return KGovStatus `GOV_OK` if OK, error otherwise
+ */
+KGovStatus k_gov_follow(int topic, uint32_t size, k_gov_mode_fn fn);
+
+/**
+ * @brief Stop following a topic
+ */
+void k_gov_unfollow(void);
+
+/**
+ * @brief Current period of an activity
+ * @param [in] activity Activity id
+ * @return uint32_t Period in ms (0 if unknown)
+ */
+uint32_t k_gov_period(int activity);
+
+/**
+ * @brief Sleep until an activity's next run
+ *
+ * Call at the end of each pass through the activity's loop. The first call
+ * sleeps one period; later ones sleep until one period after the previous
+ * wakeup, following the period as it changes during the sleep. The time
+ * since the last wakeup is charged to the activity. Keeps the thread's
+ * ::k_thread_stats_period in step. A cancellation point.
+ *
+ * @param [in] activity Activity id, used by one thread only
+ */
+void k_gov_sleep(int activity);
+
+/**
+ * @brief Read the accounting data for every activity
+ * @param [out] buffer Storage for up to `max` records
+ * @param [in] max Number of records `buffer` can hold
+ * @param [out] count Number of records written
+ * @return KGovStatus `GOV_OK` if OK, error otherwise
+ */
+KGovStatus k_gov_snapshot(k_gov_stats * buffer, int max, int * count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
@@ -28,6 +28,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
  * IOCTL master role value
  */
@@ -50,7 +54,9 @@ typedef enum {
     I2C_ERROR_TXE_TIMEOUT,
     I2C_ERROR_BTF_TIMEOUT,
     I2C_ERROR_NULL_HANDLE,
-    I2C_ERROR_CONFIG
+    I2C_ERROR_CONFIG,
+    I2C_ERROR_UNAVAILABLE,  /**< Device's circuit breaker is open (see ::k_policy_attach) */
+    I2C_ERROR_BUDGET        /**< Caller's bus budget ran dry (see ::k_budget_register) */
 } KI2CStatus;
 
 /**
@@ -117,11 +123,18 @@ write_status = k_i2c_write(bus, slave_addr, &cmd, 1);
  * There is one semaphore per bus. This function will block indefinitely
  * while waiting for the semaphore.
  *
+ * If the device has been given a policy with ::k_policy_attach, writes the
+ * device never saw are retried and a dead device is failed fast.
+ *
+ * If the calling thread has entered a bus budget with ::k_budget_enter, the
+ * transfer waits until the budget can cover it and is charged afterwards.
+ *
  * @param i2c I2C bus to transmit over
  * @param addr address of target I2C device
  * @param ptr pointer to data buffer
  * @param len length of data in buffer
- * @return KI2CStatus I2C_OK on success, I2C_ERROR on error
+ * @return KI2CStatus I2C_OK on success, I2C_ERROR_NACK if the device didn't
+ *         acknowledge its address, I2C_ERROR on other errors
  */
 KI2CStatus k_i2c_write(int i2c, uint16_t addr, uint8_t *ptr, int len);
 
@@ -147,6 +160,12 @@ read_status = k_i2c_read(bus, slave_addr, buffer, read_len);
  * There is one semaphore per bus. This function will block indefinitely
  * while waiting for the semaphore.
  *
+ * If the device has been given a policy with ::k_policy_attach, failed
+ * reads are retried and a dead device is failed fast.
+ *
+ * If the calling thread has entered a bus budget with ::k_budget_enter, the
+ * transfer waits until the budget can cover it and is charged afterwards.
+ *
  * @param i2c I2C bus to read from
  * @param addr address of target I2C device
  * @param ptr pointer to data buffer
@@ -155,5 +174,9 @@ read_status = k_i2c_read(bus, slave_addr, buffer, read_len);
  */
 KI2CStatus k_i2c_read(int i2c, uint16_t addr, uint8_t *ptr, int len);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
 /* @} */
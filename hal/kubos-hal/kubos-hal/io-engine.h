@@ -0,0 +1,251 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @defgroup IO_ENGINE HAL Batched I/O Engine
+ * @addtogroup IO_ENGINE
+ * @{
+ */
+
+#ifndef K_IO_ENGINE_H
+#define K_IO_ENGINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Offset value meaning "the file's current position". Required for pipes,
+ * sockets and serial ports.
+ */
+#define K_IO_OFFSET_CURRENT -1
+
+/**
+ * I/O engine function status
+ */
+typedef enum {
+    IO_OK = 0,
+    IO_ERROR,               /**< Generic error */
+    IO_ERROR_CONFIG,        /**< Bad argument or configuration */
+    IO_ERROR_FULL,          /**< No free request, file or buffer slots */
+    IO_ERROR_NOT_SUPPORTED  /**< Operation not available on this backend */
+} KIOStatus;
+
+/**
+ * Mechanism the engine is running on
+ */
+typedef enum {
+    IO_BACKEND_URING = 0,   /**< io_uring: one syscall per batch */
+    IO_BACKEND_EPOLL        /**< epoll plus plain read/write calls */
+} KIOBackend;
+
+/**
+ * Engine configuration. Zero fields take their default.
+ */
+typedef struct {
+    uint32_t queue_depth;   /**< Maximum requests in flight (default 32) */
+    uint32_t max_files;     /**< Registered file slots (default 8) */
+    uint32_t buffer_count;  /**< Registered buffers in total (default 16) */
+    uint32_t buffer_size;   /**< Size of each buffer in bytes (default 256) */
+    uint32_t recv_buffers;  /**< Buffers set aside for ::k_io_queue_recv.
+                                 Must be a power of two and less than
+                                 `buffer_count` (default 8) */
+    bool     force_epoll;   /**< Skip io_uring even if the kernel has it */
+    bool     kernel_poll;   /**< Let a kernel thread pick up submissions
+                                 (`IORING_SETUP_SQPOLL`) where permitted */
+} k_io_config;
+
+/**
+ * Result of one request
+ */
+typedef struct {
+    uint64_t user_data;     /**< Value given when the request was queued */
+    int32_t  result;        /**< Bytes transferred, or -errno */
+    int32_t  buffer;        /**< Buffer holding the data, or -1 */
+    bool     more;          /**< `true` if the request is still armed */
+} k_io_completion;
+
+/**
+ * Opaque engine handle
+ */
+typedef struct k_io_engine k_io_engine;
+
+/**
+ * @brief Create an I/O engine
+ *
+ * io_uring is used when the kernel supports everything the engine needs
+ * (registered files and buffers, provided buffer rings and timed waits);
+ * otherwise the engine quietly falls back to epoll. Use ::k_io_backend to
+ * see which was picked.
+ *
+ * An engine is not thread-safe. Each thread doing I/O should own its own.
+ *
+ * @param [in] config Configuration, or NULL for the defaults
+ * @param [out] engine New engine
+ * @return KIOStatus `IO_OK` if OK, error otherwise
+ */
+KIOStatus k_io_init(const k_io_config * config, k_io_engine ** engine);
+
+/**
+ * @brief Destroy an engine
+ *
+ * Outstanding requests are dropped. Registered descriptors are not closed.
+ *
+ * @param [in,out] engine Engine to destroy. Set to NULL afterwards.
+ */
+void k_io_terminate(k_io_engine ** engine);
+
+/**
+ * @param [in] engine Engine to query
+ * @return Backend in use
+ */
+KIOBackend k_io_backend(const k_io_engine * engine);
+
+/**
+ * @brief Register a file descriptor with the engine
+ *
+ * Requests refer to files by slot, which saves the kernel a descriptor
+ * lookup per request. The epoll backend switches the descriptor to
+ * non-blocking mode.
+ *
+ * @param [in] engine Engine
+ * @param [in] fd Open descriptor (serial port, socket, pipe or file)
+ * @param [out] slot Slot to use in requests
+ * @return KIOStatus `IO_OK` if OK, error otherwise
+ */
+KIOStatus k_io_register_file(k_io_engine * engine, int fd, int * slot);
+
+/**
+ * @brief Release a file slot
+ *
+ * Fails with `IO_ERROR_CONFIG` while requests on the slot are outstanding.
+ *
+ * @param [in] engine Engine
+ * @param [in] slot Slot from ::k_io_register_file
+ * @return KIOStatus `IO_OK` if OK, error otherwise
+ */
+KIOStatus k_io_unregister_file(k_io_engine * engine, int slot);
+
+/**
+ * @brief Borrow a registered buffer for a read or write
+ * @param [in] engine Engine
+ * @param [out] index Buffer index to use in requests
+ * @param [out] data Buffer memory (`buffer_size` bytes)
+ * @return KIOStatus `IO_OK` if OK, `IO_ERROR_FULL` if none are free
+ */
+KIOStatus k_io_buffer_acquire(k_io_engine * engine, int * index, uint8_t ** data);
+
+/**
+ * @brief Hand a buffer back
+ *
+ * Works for both borrowed buffers and buffers delivered by a receive
+ * completion. Receive buffers go straight back to the receive pool.
+ *
+ * @param [in] engine Engine
+ * @param [in] index Buffer index
+ */
+void k_io_buffer_release(k_io_engine * engine, int index);
+
+/**
+ * @param [in] engine Engine
+ * @param [in] index Buffer index (e.g. from a completion)
+ * @return Buffer memory, or NULL if the index is invalid
+ */
+uint8_t * k_io_buffer_data(k_io_engine * engine, int index);
+
+/**
+ * @brief Queue a read into a registered buffer
+ * @param [in] engine Engine
+ * @param [in] slot File slot
+ * @param [in] buffer Buffer index from ::k_io_buffer_acquire
+ * @param [in] len Bytes to read (at most `buffer_size`)
+ * @param [in] offset File offset, or ::K_IO_OFFSET_CURRENT
+ * @param [in] user_data Returned in the completion
+ * @return KIOStatus `IO_OK` if OK, error otherwise
+ */
+KIOStatus k_io_queue_read(k_io_engine * engine, int slot, int buffer,
+                          uint32_t len, int64_t offset, uint64_t user_data);
+
+/**
+ * @brief Queue a write from a registered buffer
+ * @param [in] engine Engine
+ * @param [in] slot File slot
+ * @param [in] buffer Buffer index from ::k_io_buffer_acquire
+ * @param [in] len Bytes to write (at most `buffer_size`)
+ * @param [in] offset File offset, or ::K_IO_OFFSET_CURRENT
+ * @param [in] user_data Returned in the completion
+ * @return KIOStatus `IO_OK` if OK, error otherwise
+ */
+KIOStatus k_io_queue_write(k_io_engine * engine, int slot, int buffer,
+                           uint32_t len, int64_t offset, uint64_t user_data);
+
+/**
+ * @brief Arm a continuous receive
+ *
+ * Every chunk of data which arrives produces a completion with `more` set
+ * and the data in a receive buffer, which must be handed back with
+ * ::k_io_buffer_release. The request stays armed until end-of-file, an
+ * error, or ::k_io_queue_cancel, which produce a final completion with
+ * `more` clear and no buffer. Sockets use a single multishot receive on
+ * io_uring; serial ports and pipes are re-armed by the engine.
+ *
+ * If every receive buffer is in use, reception pauses until one is
+ * released.
+ *
+ * @param [in] engine Engine
+ * @param [in] slot File slot
+ * @param [in] user_data Returned in every completion
+ * @return KIOStatus `IO_OK` if OK, error otherwise
+ */
+KIOStatus k_io_queue_recv(k_io_engine * engine, int slot, uint64_t user_data);
+
+/**
+ * @brief Cancel a queued or armed request
+ *
+ * The request finishes with `-ECANCELED` (unless it completed first).
+ *
+ * @param [in] engine Engine
+ * @param [in] user_data Value the request was queued with
+ * @return KIOStatus `IO_OK` if OK, `IO_ERROR_CONFIG` if no such request
+ */
+KIOStatus k_io_queue_cancel(k_io_engine * engine, uint64_t user_data);
+
+/**
+ * @brief Submit everything queued and collect completions
+ *
+ * On io_uring this is a single `io_uring_enter` call for the whole batch,
+ * and none at all if completions are already waiting and nothing is queued.
+ *
+ * @param [in] engine Engine
+ * @param [out] events Storage for completions
+ * @param [in] max Number of completions `events` can hold (at least 2)
+ * @param [in] timeout_ms Maximum wait if nothing has completed yet
+ *                        (0 = don't wait, -1 = wait forever)
+ * @param [out] count Number of completions written
+ * @return KIOStatus `IO_OK` if OK (including timeouts), error otherwise
+ */
+KIOStatus k_io_wait(k_io_engine * engine, k_io_completion * events, int max,
+                    int timeout_ms, int * count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
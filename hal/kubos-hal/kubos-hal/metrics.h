@@ -0,0 +1,218 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @defgroup METRICS HAL Device Health Metrics
+ * @addtogroup METRICS
+ * @{
+ */
+
+#ifndef K_METRICS_H
+#define K_METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum number of devices with metrics
+ */
+#define K_METRICS_DEVICES  8
+/**
+ * Maximum device name length (including the terminating NULL)
+ */
+#define K_METRICS_NAME_LEN 16
+/**
+ * Commands per device: one per command byte
+ */
+#define K_METRICS_COMMANDS 256
+/**
+ * Version of the encoded form written by ::k_metrics_encode
+ */
+#define K_METRICS_VERSION  1
+/**
+ * Largest encoding of a full table
+ */
+#define K_METRICS_ENCODED_MAX                                   \
+    (21 + K_METRICS_DEVICES * (1 + K_METRICS_NAME_LEN + 3       \
+                               + K_METRICS_COMMANDS * (2 + K_METRIC_EVENTS * 5)))
+
+/**
+ * Metrics function status
+ */
+typedef enum {
+    METRICS_OK = 0,
+    METRICS_ERROR,          /**< Generic error, or malformed encoding */
+    METRICS_ERROR_CONFIG,   /**< Bad argument */
+    METRICS_ERROR_FULL      /**< No free device slots, or output buffer too small */
+} KMetricsStatus;
+
+/**
+ * Counted events. Bus events are counted per I2C transfer by the HAL, under
+ * the command byte the transfer's thread last sent the device; protocol
+ * events are counted per command by the device APIs.
+ */
+typedef enum {
+    METRIC_SUCCESS = 0,     /**< Bus transfer completed */
+    METRIC_NACK,            /**< Bus transfer not acknowledged */
+    METRIC_TIMEOUT,         /**< Bus transfer timed out, or the device had no response ready */
+    METRIC_BUS_ERROR,       /**< Bus transfer failed otherwise */
+    METRIC_RETRY,           /**< Bus transfer retried by the device policy */
+    METRIC_ECHO_MISMATCH,   /**< Response echoed a different command */
+    METRIC_CHECKSUM,        /**< Response failed its checksum */
+    METRIC_DEVICE_ERROR,    /**< Device reported an error status */
+    K_METRIC_EVENTS         /**< Number of event types */
+} KMetricsEvent;
+
+/**
+ * A copy of every counter. Large (about 64 KB); keep it static.
+ */
+typedef struct {
+    uint64_t time_ns;                           /**< When it was taken (::k_clock_now) */
+    int      devices;                           /**< Devices registered */
+    char     names[K_METRICS_DEVICES][K_METRICS_NAME_LEN]; /**< Device names */
+    uint32_t counts[K_METRICS_DEVICES][K_METRICS_COMMANDS][K_METRIC_EVENTS]; /**< Counters */
+} k_metrics_table;
+
+/**
+ * Header of an encoded table
+ */
+typedef struct {
+    uint8_t  version;       /**< Encoding version */
+    bool     delta;         /**< Counts are increases since `since_ns` */
+    uint64_t time_ns;       /**< When the counts were taken */
+    uint64_t since_ns;      /**< Start of the delta (0 if not a delta) */
+} k_metrics_header;
+
+/**
+ * Called by ::k_metrics_decode for each command with a nonzero count
+ * @param [in] arg Caller's argument
+ * @param [in] device Device name
+ * @param [in] command Command byte
+ * @param [in] counts Count of each ::KMetricsEvent
+ */
+typedef void (*k_metrics_row_fn)(void * arg, const char * device,
+                                 uint8_t command,
+                                 const uint32_t counts[K_METRIC_EVENTS]);
+
+/**
+ * @brief Create a device's counters, or look them up by name
+ * @param [in] name Device name (truncated to ::K_METRICS_NAME_LEN - 1)
+ * @param [out] device Device id
+ * @return KMetricsStatus `METRICS_OK` if OK, error otherwise
+ */
+KMetricsStatus k_metrics_device(const char * name, int * device);
+
+/**
+ * @brief Count bus events for a device on an I2C bus
+ *
+ * From then on every read and write to the address is counted by the I2C
+ * functions, as are the device policy's retries.
+ *
+ * @param [in] device Device id
+ * @param [in] bus I2C bus, as returned by ::k_i2c_init
+ * @param [in] addr Device address
+ * @return KMetricsStatus `METRICS_OK` if OK, error otherwise
+ */
+KMetricsStatus k_metrics_attach(int device, int bus, uint16_t addr);
+
+/**
+ * @brief Count one event
+ *
+ * A relaxed atomic increment, cheap enough to leave on in flight builds.
+ * Does nothing if `device` or `event` is out of range.
+ *
+ * @param [in] device Device id
+ * @param [in] command Command byte
+ * @param [in] event Event
+ */
+void k_metrics_record(int device, uint8_t command, KMetricsEvent event);
+
+/**
+ * @brief Copy every counter
+ *
+ * Counters are read one at a time without stopping recorders, so the copy
+ * is not an instant across counters, but no count is ever torn.
+ *
+ * @param [out] table Copy
+ * @return KMetricsStatus `METRICS_OK` if OK, error otherwise
+ */
+KMetricsStatus k_metrics_snapshot(k_metrics_table * table);
+
+/**
+ * @brief Encode a table, or the change between two, compactly
+ *
+ * Little-endian, with variable-length counts, and only the commands with a
+ * nonzero count:
+ *  - `"KM"`, version (u8), flags (u8, bit 0 = delta), time (u64), start of
+ *    the delta (u64), number of devices (u8)
+ *  - per device: name length (u8), name, number of commands (varint)
+ *  - per command: command byte (u8), mask of events present (u8), then a
+ *    varint count for each event present, in ::KMetricsEvent order
+ *
+ * Varints are LEB128: 7 bits per byte, low bits first, top bit set on all
+ * but the last byte. Counters wrap at 2^32, and deltas are taken modulo
+ * 2^32, so they stay right across a wrap.
+ *
+ * @param [in] now Table to encode
+ * @param [in] since Earlier table to subtract, or NULL for absolute counts
+ * @param [out] buffer Output
+ * @param [in] size Size of `buffer` (::K_METRICS_ENCODED_MAX always fits)
+ * @param [out] len Bytes written
+ * @return KMetricsStatus `METRICS_OK` if OK, `METRICS_ERROR_FULL` if
+ *         `buffer` is too small, error otherwise
+ */
+KMetricsStatus k_metrics_encode(const k_metrics_table * now,
+                                const k_metrics_table * since,
+                                uint8_t * buffer, size_t size, size_t * len);
+
+/**
+ * @brief Decode the output of ::k_metrics_encode
+ * @param [in] buffer Encoded table
+ * @param [in] len Length of `buffer`
+ * @param [out] header Header (may be NULL)
+ * @param [in] fn Called for each command, in order (may be NULL)
+ * @param [in] arg Passed to `fn`
+ * @return KMetricsStatus `METRICS_OK` if OK, `METRICS_ERROR` if malformed
+ */
+KMetricsStatus k_metrics_decode(const uint8_t * buffer, size_t len,
+                                k_metrics_header * header,
+                                k_metrics_row_fn fn, void * arg);
+
+/**
+ * @brief Count one attempt at a bus transfer
+ *
+ * Used by the I2C functions and the device policy. A write's first byte
+ * becomes the calling thread's current command for the device.
+ *
+ * @param [in] bus I2C bus
+ * @param [in] addr Device address
+ * @param [in] tx Data written, or NULL for a read or a retry
+ * @param [in] event `METRIC_SUCCESS`, the kind of failure, or `METRIC_RETRY`
+ */
+void kprv_metrics_transfer(int bus, uint16_t addr, const uint8_t * tx,
+                           KMetricsEvent event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
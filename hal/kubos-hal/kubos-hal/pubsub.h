@@ -0,0 +1,176 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @defgroup PUBSUB HAL Device Data Publish/Subscribe
+ * @addtogroup PUBSUB
+ * @{
+ */
+
+#ifndef K_PUBSUB_H
+#define K_PUBSUB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum number of topics which can be created
+ */
+#define K_PUBSUB_MAX_TOPICS      16
+/**
+ * Maximum number of subscribers per topic
+ */
+#define K_PUBSUB_MAX_SUBSCRIBERS 8
+/**
+ * Maximum topic name length (including the terminating NULL)
+ */
+#define K_PUBSUB_NAME_LEN        16
+
+/**
+ * Number of `uint64_t` words of storage a topic needs
+ * @param size Largest message, in bytes
+ * @param capacity Messages kept (a power of two)
+ */
+#define K_PUBSUB_STORAGE(size, capacity) \
+    ((size_t) (capacity) * (2 + ((size_t) (size) + 7) / 8))
+
+/**
+ * Publish/subscribe function status
+ */
+typedef enum {
+    PUBSUB_OK = 0,
+    PUBSUB_EMPTY,           /**< No new message */
+    PUBSUB_ERROR,           /**< Generic error */
+    PUBSUB_ERROR_CONFIG,    /**< Bad argument */
+    PUBSUB_ERROR_FULL       /**< No free topic or subscriber slots */
+} KPubSubStatus;
+
+/**
+ * A subscription. Owned by one consumer thread; the topic keeps no pointer
+ * to it.
+ */
+typedef struct {
+    int      topic;         /**< Topic subscribed to */
+    int      index;         /**< Subscriber slot in the topic */
+    int      fd;            /**< Readiness eventfd */
+    uint64_t cursor;        /**< Next message to read */
+} k_pubsub_sub;
+
+/**
+ * @brief Create a topic, or look up an existing one by name
+ *
+ * Each topic is a ring of the last `capacity` messages of up to `size`
+ * bytes, kept in caller-provided storage so that publishing never
+ * allocates. Any number of threads may publish; every subscriber reads
+ * every message at its own pace. A subscriber which falls more than
+ * `capacity` messages behind loses the oldest ones, and is told how many.
+ *
+ * Creating a name which already exists gives back the same topic, as long
+ * as `size` matches; `storage` is then not used.
+ *
+ * @param [in] name Topic name (truncated to ::K_PUBSUB_NAME_LEN - 1)
+ * @param [in] size Largest message, in bytes
+ * @param [in] capacity Messages kept; a power of two
+ * @param [in] storage ::K_PUBSUB_STORAGE(size, capacity) words, which must
+ *             outlive the process' use of the topic
+ * @param [in] words Number of words in `storage`
+ * @param [out] topic Topic id
+ * @return KPubSubStatus `PUBSUB_OK` if OK, error otherwise
+ */
+KPubSubStatus k_pubsub_topic(const char * name, uint32_t size,
+                             uint32_t capacity, uint64_t * storage,
+                             size_t words, int * topic);
+
+/**
+ * @brief Look up a topic by name
+ * @param [in] name Topic name
+ * @param [out] topic Topic id
+ * @return KPubSubStatus `PUBSUB_OK` if found, `PUBSUB_ERROR` otherwise
+ */
+KPubSubStatus k_pubsub_find(const char * name, int * topic);
+
+/**
+ * @brief Publish a message to every subscriber of a topic
+ *
+ * Lock-free and allocation-free. Subscribers waiting on their descriptor
+ * are woken.
+ *
+ * @param [in] topic Topic id
+ * @param [in] data Message
+ * @param [in] len Message length, up to the topic's size
+ * @return KPubSubStatus `PUBSUB_OK` if OK, error otherwise
+ */
+KPubSubStatus k_pubsub_publish(int topic, const void * data, uint32_t len);
+
+/**
+ * @brief Subscribe to a topic
+ *
+ * The subscription sees messages published from now on.
+ *
+ * @param [in] topic Topic id
+ * @param [out] sub Subscription to set up
+ * @return KPubSubStatus `PUBSUB_OK` if OK, error otherwise
+ */
+KPubSubStatus k_pubsub_subscribe(int topic, k_pubsub_sub * sub);
+
+/**
+ * @brief Cancel a subscription
+ *
+ * The descriptor is left open for the topic's next subscriber.
+ *
+ * @param [in] sub Subscription
+ */
+void k_pubsub_unsubscribe(k_pubsub_sub * sub);
+
+/**
+ * @brief Take the next message for a subscription, without blocking
+ *
+ * When nothing is waiting, the subscription's descriptor is armed so that
+ * the next publish makes it readable.
+ *
+ * @param [in] sub Subscription
+ * @param [out] data Storage for the topic's largest message
+ * @param [out] len Length of the message read (may be NULL)
+ * @param [out] lost Messages skipped because the subscriber fell behind
+ *              (may be NULL)
+ * @return KPubSubStatus `PUBSUB_OK` if a message was read, `PUBSUB_EMPTY`
+ *         if there was none, error otherwise
+ */
+KPubSubStatus k_pubsub_read(k_pubsub_sub * sub, void * data, uint32_t * len,
+                            uint32_t * lost);
+
+/**
+ * @brief Descriptor which polls readable when a subscription may have
+ *        messages
+ *
+ * Wait on it with `poll` or `epoll` after ::k_pubsub_read returns
+ * `PUBSUB_EMPTY`. ::k_pubsub_read drains it.
+ *
+ * @param [in] sub Subscription
+ * @return int eventfd descriptor
+ */
+int k_pubsub_fd(const k_pubsub_sub * sub);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
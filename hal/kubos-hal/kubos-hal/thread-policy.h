@@ -0,0 +1,159 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @defgroup THREAD_POLICY HAL Background Thread Policy
+ * @addtogroup THREAD_POLICY
+ * @{
+ */
+
+#ifndef K_THREAD_POLICY_H
+#define K_THREAD_POLICY_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum number of named thread policies
+ */
+#define K_THREAD_POLICY_MAX        16
+/**
+ * Maximum thread name length (including the terminating NULL), as the
+ * kernel allows
+ */
+#define K_THREAD_POLICY_NAME_LEN   16
+/**
+ * Stack size, in KiB, of threads whose policy doesn't give one
+ */
+#define K_THREAD_POLICY_STACK_KB   128
+/**
+ * Environment variable read for a policy spec the first time a thread is
+ * created
+ */
+#define K_THREAD_POLICY_ENV        "KUBOS_THREAD_POLICY"
+
+/**
+ * Thread policy function status
+ */
+typedef enum {
+    THREAD_POLICY_OK = 0,
+    THREAD_POLICY_ERROR,        /**< Generic error, or the thread couldn't be started */
+    THREAD_POLICY_ERROR_CONFIG, /**< Bad argument or policy spec */
+    THREAD_POLICY_ERROR_FULL    /**< No free policy slots */
+} KThreadPolicyStatus;
+
+/**
+ * Scheduling class
+ */
+typedef enum {
+    THREAD_SCHED_INHERIT = 0,   /**< Same class and priority as the creating thread */
+    THREAD_SCHED_OTHER,         /**< `SCHED_OTHER` */
+    THREAD_SCHED_FIFO,          /**< `SCHED_FIFO` (real-time) */
+    THREAD_SCHED_RR             /**< `SCHED_RR` (real-time) */
+} KThreadSched;
+
+/**
+ * Attributes for a background thread. Zero fields take their default.
+ */
+typedef struct {
+    uint32_t     stack_kb;  /**< Stack size in KiB (0 = ::K_THREAD_POLICY_STACK_KB) */
+    KThreadSched sched;     /**< Scheduling class (0 = inherited) */
+    int          priority;  /**< Real-time priority, for `FIFO` and `RR` */
+    uint64_t     cpu_mask;  /**< CPUs the thread may run on, bit 0 = CPU 0 (0 = any) */
+    bool         mlock;     /**< Lock the process's memory before starting the thread */
+} k_thread_policy;
+
+/**
+ * @brief Set the policy for threads of a given name
+ *
+ * Only affects threads created afterwards.
+ *
+ * @param [in] name Thread name, or NULL for the default policy, used by
+ *                  threads without one of their own
+ * @param [in] policy Policy to use, or NULL to remove the named policy
+ *                    (or reset the default one)
+ * @return KThreadPolicyStatus `THREAD_POLICY_OK` if OK, error otherwise
+ */
+KThreadPolicyStatus k_thread_policy_set(const char * name,
+                                        const k_thread_policy * policy);
+
+/**
+ * @brief Get the policy threads of a given name would be created with
+ * @param [in] name Thread name, or NULL for the default policy
+ * @param [out] policy Policy in effect
+ * @return KThreadPolicyStatus `THREAD_POLICY_OK` if OK, error otherwise
+ */
+KThreadPolicyStatus k_thread_policy_get(const char * name,
+                                        k_thread_policy * policy);
+
+/**
+ * @brief Set thread policies from a text spec
+ *
+ * This is how a service applies the `thread-policy` value of its
+ * configuration. The spec is a `;`-separated list of
+ * `<thread name>:<setting>,<setting>...` entries, where the name `default`
+ * sets the default policy and the settings are:
+ *  - `stack=<KiB>`
+ *  - `sched=other|fifo|rr|inherit`
+ *  - `priority=<n>`
+ *  - `cpus=<mask>`, e.g. `0x1` for CPU 0 alone
+ *  - `mlock` (or `mlock=0|1`)
+ *
+ * For example
+ * `default:stack=64;imtq-watchdog:sched=fifo,priority=40,cpus=0x1,mlock`.
+ * Each entry replaces any earlier policy for its thread. Nothing is
+ * changed if the spec doesn't parse.
+ *
+ * @param [in] spec Policy spec
+ * @return KThreadPolicyStatus `THREAD_POLICY_OK` if OK, error otherwise
+ */
+KThreadPolicyStatus k_thread_policy_parse(const char * spec);
+
+/**
+ * @brief Start a named background thread under its policy
+ *
+ * The thread gets the stack size, scheduling and CPU affinity of its
+ * policy and is given `name`, so it shows up under it in `ps` and `top`.
+ * If a real-time class or affinity can't be applied (e.g. the process lacks
+ * `CAP_SYS_NICE`), a warning is printed and the thread is started with
+ * inherited scheduling and no affinity instead, so a watchdog is never left
+ * unstarted over its policy. A failure to lock memory is likewise only a
+ * warning.
+ *
+ * All device API background threads are started this way, under the names
+ * they report to ::k_thread_stats_register.
+ *
+ * @param [in] name Thread name (truncated to ::K_THREAD_POLICY_NAME_LEN - 1)
+ * @param [out] thread Thread handle, or NULL to start the thread detached
+ * @param [in] start Thread function
+ * @param [in] arg Argument passed to `start`
+ * @return KThreadPolicyStatus `THREAD_POLICY_OK` if OK, error otherwise
+ *         (with `errno` set)
+ */
+KThreadPolicyStatus k_thread_create(const char * name, pthread_t * thread,
+                                    void * (*start)(void *), void * arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
@@ -0,0 +1,158 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @defgroup THREAD_STATS HAL Background Thread Accounting
+ * @addtogroup THREAD_STATS
+ * @{
+ */
+
+#ifndef K_THREAD_STATS_H
+#define K_THREAD_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum number of threads which can be tracked at once
+ */
+#define K_THREAD_STATS_MAX      16
+/**
+ * Maximum thread name length (including the terminating NULL)
+ */
+#define K_THREAD_STATS_NAME_LEN 16
+/**
+ * A wakeup more than this many milliseconds after it was due counts as a
+ * missed deadline
+ */
+#define K_THREAD_STATS_SLACK_MS 100
+
+/**
+ * Thread accounting function status
+ */
+typedef enum {
+    THREAD_STATS_OK = 0,
+    THREAD_STATS_ERROR,         /**< Generic error */
+    THREAD_STATS_ERROR_CONFIG,  /**< Bad argument, or thread already registered */
+    THREAD_STATS_ERROR_FULL     /**< No free registry slots */
+} KThreadStatsStatus;
+
+/**
+ * Accounting data for one background thread
+ */
+typedef struct {
+    char     name[K_THREAD_STATS_NAME_LEN]; /**< Name given at registration */
+    bool     active;            /**< `true` while the thread is registered */
+    uint32_t period_ms;         /**< Expected time between wakeups (0 = untimed) */
+    uint32_t wakeups;           /**< Number of times the thread has woken up */
+    uint32_t missed_deadlines;  /**< Wakeups more than ::K_THREAD_STATS_SLACK_MS late */
+    uint64_t max_lateness_ns;   /**< Latest wakeup seen, relative to when it was due */
+    uint64_t cpu_ns;            /**< CPU time used (`CLOCK_THREAD_CPUTIME_ID`) */
+    uint32_t bus_transfers;     /**< Number of I2C reads and writes */
+    uint64_t bus_ns;            /**< Wall-clock time spent in I2C reads and writes */
+} k_thread_stats;
+
+/**
+ * @brief Start accounting for the calling thread
+ *
+ * Must be called from the thread being tracked. If a thread with the same
+ * name was registered before and has since exited, its record is reused and
+ * the counters carry on from where they stopped, so restarting a watchdog
+ * does not reset its history.
+ *
+ * @param [in] name Thread name (truncated to ::K_THREAD_STATS_NAME_LEN - 1)
+ * @param [in] period_ms Expected time between wakeups, or 0 if the thread
+ *                       has no schedule to keep
+ * @return KThreadStatsStatus `THREAD_STATS_OK` if OK, error otherwise
+ */
+KThreadStatsStatus k_thread_stats_register(const char * name, uint32_t period_ms);
+
+/**
+ * @brief Stop accounting for the calling thread
+ *
+ * The final CPU time is recorded and the record stays readable through
+ * ::k_thread_stats_snapshot. The signature matches `pthread_cleanup_push`, so
+ * a thread which is stopped with `pthread_cancel` can still unregister.
+ *
+ * @param [in] arg Unused
+ */
+void k_thread_stats_unregister(void * arg);
+
+/**
+ * @brief Record a wakeup of the calling thread
+ *
+ * Call once at the top of each pass through the thread's loop. If the thread
+ * was registered with a period, a wakeup later than the previous wakeup plus
+ * the period plus ::K_THREAD_STATS_SLACK_MS is counted as a missed deadline.
+ * Does nothing if the calling thread is not registered.
+ */
+void k_thread_stats_wakeup(void);
+
+/**
+ * @brief Change the expected time between wakeups of the calling thread
+ *
+ * For threads whose schedule is retuned at run time, so that running slower
+ * on purpose isn't counted as missing deadlines. Does nothing if the calling
+ * thread is not registered.
+ *
+ * @param [in] period_ms New period (0 = untimed)
+ */
+void k_thread_stats_period(uint32_t period_ms);
+
+/**
+ * @brief Read the accounting data for every tracked thread
+ *
+ * CPU time for running threads is sampled at the time of the call.
+ *
+ * @param [out] buffer Storage for up to `max` records
+ * @param [in] max Number of records `buffer` can hold
+ * @param [out] count Number of records written
+ * @return KThreadStatsStatus `THREAD_STATS_OK` if OK, error otherwise
+ */
+KThreadStatsStatus k_thread_stats_snapshot(k_thread_stats * buffer, int max,
+                                           int * count);
+
+/**
+ * @brief Whether the calling thread is registered
+ *
+ * Used by the bus functions to skip timing for untracked threads.
+ *
+ * @return `true` if registered
+ */
+bool kprv_thread_stats_tracked(void);
+
+/**
+ * @brief Charge one bus transfer to the calling thread
+ * @param [in] elapsed_ns Time the transfer took
+ */
+void kprv_thread_stats_bus(uint64_t elapsed_ns);
+
+/**
+ * @brief Bus time charged to the calling thread so far
+ * @return uint64_t Time in ns (0 if the thread is not registered)
+ */
+uint64_t kprv_thread_stats_bus_ns(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
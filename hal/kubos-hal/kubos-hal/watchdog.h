@@ -0,0 +1,157 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/**
+ * @defgroup WATCHDOG HAL Device Watchdog Tracking
+ * @addtogroup WATCHDOG
+ * @{
+ */
+
+#ifndef K_WATCHDOG_H
+#define K_WATCHDOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum number of device watchdogs which can be tracked
+ */
+#define K_WDT_MAX      8
+/**
+ * Maximum watchdog name length (including the terminating NULL)
+ */
+#define K_WDT_NAME_LEN 16
+
+/**
+ * Watchdog tracking function status
+ */
+typedef enum {
+    WDT_OK = 0,
+    WDT_ERROR,              /**< Generic error */
+    WDT_ERROR_CONFIG,       /**< Bad argument */
+    WDT_ERROR_FULL          /**< No free registry slots */
+} KWDTStatus;
+
+/**
+ * How a device watchdog behaves
+ */
+typedef struct {
+    uint32_t timeout_ms;    /**< Time a kick buys */
+    uint32_t margin_ms;     /**< Kick explicitly once less than this is left */
+    bool     implicit;      /**< Any write to the device kicks it */
+} k_wdt_config;
+
+/**
+ * Counters for one watchdog
+ */
+typedef struct {
+    char     name[K_WDT_NAME_LEN]; /**< Name given when attached */
+    bool     active;        /**< `true` while the watchdog is attached */
+    bool     known;         /**< `true` once its time left has been learned */
+    uint32_t time_left_ms;  /**< Estimated time left when the snapshot was taken */
+    uint32_t kicks;         /**< Explicit kicks */
+    uint32_t implicit;      /**< Writes to the device counted as kicks */
+    uint32_t reports;       /**< Device reports of its time left */
+} k_wdt_stats;
+
+/**
+ * @brief Track a device's watchdog
+ *
+ * The tracker keeps an estimate of when the watchdog will expire, from
+ * three sources:
+ *  - ::k_wdt_kicked after each explicit kick
+ *  - Every successful ::k_i2c_write to `addr` on `bus`, if
+ *    `config->implicit` is set
+ *  - ::k_wdt_report, when the device tells us how much time is left
+ *
+ * A watchdog thread then only needs to kick once ::k_wdt_due has passed,
+ * so on a busy bus it rarely kicks at all. Until the time left is first
+ * learned, the watchdog is due immediately.
+ *
+ * Attaching a name which is already in use moves it to the new bus,
+ * address and settings, keeping its counters.
+ *
+ * @param [in] name Watchdog name (truncated to ::K_WDT_NAME_LEN - 1)
+ * @param [in] bus I2C bus from ::k_i2c_init
+ * @param [in] addr Device address
+ * @param [in] config Watchdog behavior; `timeout_ms` must be non-zero and
+ *             larger than `margin_ms`
+ * @param [out] wdt Watchdog id
+ * @return KWDTStatus `WDT_OK` if OK, error otherwise
+ */
+KWDTStatus k_wdt_attach(const char * name, int bus, uint16_t addr,
+                        const k_wdt_config * config, int * wdt);
+
+/**
+ * @brief Stop tracking a watchdog
+ * @param [in] wdt Watchdog id
+ */
+void k_wdt_detach(int wdt);
+
+/**
+ * @brief Record a successful explicit kick
+ * @param [in] wdt Watchdog id
+ */
+void k_wdt_kicked(int wdt);
+
+/**
+ * @brief Record the time left reported by the device
+ *
+ * Replaces the estimate, whichever way it moves it.
+ *
+ * @param [in] wdt Watchdog id
+ * @param [in] time_left_ms Time left before the watchdog expires
+ */
+void k_wdt_report(int wdt, uint32_t time_left_ms);
+
+/**
+ * @brief When the watchdog next needs an explicit kick
+ * @param [in] wdt Watchdog id
+ * @return uint64_t ::k_clock_now time at which less than `margin_ms` will
+ *         be left; 0 (due now) if the time left is unknown or the
+ *         watchdog is not attached
+ */
+uint64_t k_wdt_due(int wdt);
+
+/**
+ * @brief Read the counters for every watchdog which has been attached
+ * @param [out] buffer Storage for up to `max` records
+ * @param [in] max Number of records `buffer` can hold
+ * @param [out] count Number of records written
+ * @return KWDTStatus `WDT_OK` if OK, error otherwise
+ */
+KWDTStatus k_wdt_snapshot(k_wdt_stats * buffer, int max, int * count);
+
+/**
+ * @brief Count a successful write as a kick for implicitly kicked watchdogs
+ *
+ * Used by ::k_i2c_write. Lock-free.
+ *
+ * @param [in] bus I2C bus
+ * @param [in] addr Device address
+ */
+void kprv_wdt_traffic(int bus, uint16_t addr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @} */
@@ -0,0 +1,277 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bus-budget.h"
+#include "clock.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define BUDGET_DEFAULT_RATE_US 100000
+
+typedef struct {
+    k_budget_stats  stats;
+    k_budget_config config;
+    uint64_t        refilled_ns;    /* When tokens were last topped up */
+} budget_record;
+
+static budget_record   records[K_BUDGET_MAX];
+static int             record_count = 0;
+static pthread_mutex_t records_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Budget the calling thread is charging, or -1 */
+static __thread int current = -1;
+
+static uint64_t kprv_budget_now(void)
+{
+    return k_clock_now();
+}
+
+static void kprv_budget_set_config(budget_record * record,
+                                   const k_budget_config * config)
+{
+    if (config != NULL)
+    {
+        record->config = *config;
+    }
+    else
+    {
+        memset(&record->config, 0, sizeof(record->config));
+    }
+
+    if (record->config.rate_us == 0)
+    {
+        record->config.rate_us = BUDGET_DEFAULT_RATE_US;
+    }
+    if (record->config.burst_us == 0)
+    {
+        record->config.burst_us = record->config.rate_us;
+    }
+
+    record->stats.critical = record->config.critical;
+    record->stats.rate_us  = record->config.rate_us;
+    record->stats.burst_us = record->config.burst_us;
+}
+
+/* Add the tokens earned since the last refill. Caller holds the mutex. */
+static void kprv_budget_refill(budget_record * record, uint64_t now)
+{
+    uint64_t elapsed = now - record->refilled_ns;
+    int64_t  earned  = (int64_t) (elapsed / 1000) * record->config.rate_us
+                      / 1000000;
+
+    if (earned <= 0)
+    {
+        return;
+    }
+
+    /* Only move the clock on by what was paid out, so nothing is lost */
+    record->refilled_ns += (uint64_t) earned * 1000000000ULL
+                           / record->config.rate_us;
+    record->stats.tokens_us += earned;
+    if (record->stats.tokens_us >= (int64_t) record->config.burst_us)
+    {
+        record->stats.tokens_us = record->config.burst_us;
+        record->refilled_ns     = now;
+    }
+}
+
+KBudgetStatus k_budget_register(const char * name,
+                                const k_budget_config * config, int * id)
+{
+    budget_record * record = NULL;
+
+    if (name == NULL || name[0] == '\0' || id == NULL)
+    {
+        return BUDGET_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&records_mutex);
+
+    for (int i = 0; i < record_count; i++)
+    {
+        if (strncmp(records[i].stats.name, name, K_BUDGET_NAME_LEN - 1) == 0)
+        {
+            record = &records[i];
+            break;
+        }
+    }
+
+    if (record == NULL)
+    {
+        if (record_count == K_BUDGET_MAX)
+        {
+            pthread_mutex_unlock(&records_mutex);
+            fprintf(stderr, "No room for bus budget %s\n", name);
+            return BUDGET_ERROR_FULL;
+        }
+
+        record = &records[record_count++];
+        memset(record, 0, sizeof(*record));
+        snprintf(record->stats.name, sizeof(record->stats.name), "%s", name);
+        kprv_budget_set_config(record, config);
+
+        /* Start with a full bucket */
+        record->stats.tokens_us = record->config.burst_us;
+        record->refilled_ns     = kprv_budget_now();
+    }
+    else
+    {
+        kprv_budget_set_config(record, config);
+        if (record->stats.tokens_us > (int64_t) record->config.burst_us)
+        {
+            record->stats.tokens_us = record->config.burst_us;
+        }
+    }
+
+    *id = (int) (record - records);
+
+    pthread_mutex_unlock(&records_mutex);
+
+    return BUDGET_OK;
+}
+
+int k_budget_enter(int id)
+{
+    int previous = current;
+
+    current = (id >= 0 && id < K_BUDGET_MAX) ? id : -1;
+
+    return previous;
+}
+
+void k_budget_leave(int previous)
+{
+    current = previous;
+}
+
+KBudgetStatus k_budget_snapshot(k_budget_stats * buffer, int max, int * count)
+{
+    if (buffer == NULL || count == NULL || max < 0)
+    {
+        return BUDGET_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&records_mutex);
+
+    uint64_t now = kprv_budget_now();
+    int      i;
+
+    for (i = 0; i < record_count && i < max; i++)
+    {
+        kprv_budget_refill(&records[i], now);
+        buffer[i] = records[i].stats;
+    }
+    *count = i;
+
+    pthread_mutex_unlock(&records_mutex);
+
+    return BUDGET_OK;
+}
+
+KI2CStatus kprv_budget_admit(int len)
+{
+    budget_record * record;
+    uint64_t        start;
+    int64_t         needed;
+    bool            waited = false;
+
+    if (current < 0 || current >= record_count)
+    {
+        return I2C_OK;
+    }
+
+    record = &records[current];
+    start  = kprv_budget_now();
+
+    pthread_mutex_lock(&records_mutex);
+
+    /* A transfer bigger than the bucket goes once the bucket is full */
+    needed = (int64_t) (len > 0 ? len + 1 : 1) * K_BUDGET_BYTE_US;
+    if (needed > (int64_t) record->config.burst_us)
+    {
+        needed = record->config.burst_us;
+    }
+
+    while (!record->config.critical)
+    {
+        uint64_t now = kprv_budget_now();
+
+        kprv_budget_refill(record, now);
+        if (record->stats.tokens_us >= needed)
+        {
+            break;
+        }
+
+        /* Sleep until the shortfall has been earned back */
+        uint64_t wait_ns = (uint64_t) (needed - record->stats.tokens_us)
+                           * 1000000000ULL / record->config.rate_us;
+
+        if (record->config.max_wait_ms != 0
+            && now + wait_ns - start
+                   > (uint64_t) record->config.max_wait_ms * 1000000ULL)
+        {
+            record->stats.refused++;
+            pthread_mutex_unlock(&records_mutex);
+            return I2C_ERROR_BUDGET;
+        }
+
+        waited = true;
+        pthread_mutex_unlock(&records_mutex);
+
+        k_clock_sleep(wait_ns);
+
+        pthread_mutex_lock(&records_mutex);
+    }
+
+    record->stats.transfers++;
+    if (waited)
+    {
+        record->stats.waits++;
+        record->stats.wait_us += (kprv_budget_now() - start) / 1000;
+    }
+
+    pthread_mutex_unlock(&records_mutex);
+
+    return I2C_OK;
+}
+
+bool kprv_budget_active(void)
+{
+    return current >= 0;
+}
+
+void kprv_budget_charge(uint64_t bus_ns)
+{
+    budget_record * record;
+
+    if (current < 0 || current >= record_count)
+    {
+        return;
+    }
+
+    record = &records[current];
+
+    pthread_mutex_lock(&records_mutex);
+
+    kprv_budget_refill(record, kprv_budget_now());
+    record->stats.tokens_us -= (int64_t) (bus_ns / 1000);
+    record->stats.bus_us += bus_ns / 1000;
+
+    pthread_mutex_unlock(&records_mutex);
+}
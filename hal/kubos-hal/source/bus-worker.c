@@ -0,0 +1,402 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bus-worker.h"
+#include "bus-budget.h"
+#include "clock.h"
+#include "thread-policy.h"
+#include "thread-stats.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* One k_bus_run, shared by the workers taking part in it */
+typedef struct {
+    const k_bus_request * requests;
+    k_bus_completion *    completions;
+    int                   count;
+    int                   budget;   /* Caller's bus budget */
+    int                   pending;  /* Workers still running their share */
+    uint8_t               route[K_BUS_RUN_MAX];
+} bus_run;
+
+typedef struct {
+    k_bus_stats    stats;
+    char           thread_name[K_THREAD_POLICY_NAME_LEN];
+    bool           started;
+    bool           stopping;
+    pthread_t      thread;
+    pthread_cond_t wake;    /* Signalled when a run is queued */
+    pthread_cond_t space;   /* Signalled when a run is taken off the queue */
+    bus_run *      queue[K_BUS_QUEUE_DEPTH];
+    int            head;
+    int            queued;
+} bus_worker;
+
+typedef struct {
+    char name[K_BUS_NAME_LEN];
+    int  bus;
+} bus_device;
+
+static bus_worker workers[K_BUS_MAX];
+static int        worker_count = 0;
+static bus_device devices[K_BUS_DEVICES];
+static int        device_count = 0;
+
+static pthread_mutex_t bus_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  done_cond = PTHREAD_COND_INITIALIZER;
+
+KBusStatus k_bus_attach(const char * device, const char * path)
+{
+    int bus, index;
+
+    if (device == NULL || device[0] == '\0' || path == NULL
+        || path[0] == '\0' || strlen(path) >= K_BUS_PATH_LEN)
+    {
+        return BUS_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&bus_mutex);
+
+    for (bus = 0; bus < worker_count; bus++)
+    {
+        if (strcmp(workers[bus].stats.path, path) == 0)
+        {
+            break;
+        }
+    }
+
+    for (index = 0; index < device_count; index++)
+    {
+        if (strncmp(devices[index].name, device, K_BUS_NAME_LEN - 1) == 0)
+        {
+            break;
+        }
+    }
+
+    if ((bus == worker_count && worker_count == K_BUS_MAX)
+        || (index == device_count && device_count == K_BUS_DEVICES))
+    {
+        pthread_mutex_unlock(&bus_mutex);
+        return BUS_ERROR_FULL;
+    }
+
+    if (bus == worker_count)
+    {
+        bus_worker * worker = &workers[bus];
+        const char * last = strrchr(path, '/');
+
+        strcpy(worker->stats.path, path);
+        snprintf(worker->thread_name, sizeof(worker->thread_name), "bus-%s",
+                 (last != NULL) ? last + 1 : path);
+        pthread_cond_init(&worker->wake, NULL);
+        pthread_cond_init(&worker->space, NULL);
+        worker_count++;
+    }
+
+    if (index == device_count)
+    {
+        strncpy(devices[index].name, device, K_BUS_NAME_LEN - 1);
+        device_count++;
+    }
+
+    devices[index].bus = bus;
+
+    pthread_mutex_unlock(&bus_mutex);
+
+    return BUS_OK;
+}
+
+/* Run this bus's share of a run, returning the number of requests run */
+static int kprv_bus_batch(bus_run * run, int bus, uint64_t * busy_ns)
+{
+    int previous = k_budget_enter(run->budget);
+    int ran = 0;
+
+    *busy_ns = 0;
+
+    for (int i = 0; i < run->count; i++)
+    {
+        const k_bus_request * request = &run->requests[i];
+        k_bus_completion *    done    = &run->completions[i];
+
+        if (run->route[i] != bus)
+        {
+            continue;
+        }
+
+        done->user_data = request->user_data;
+        done->bus       = bus;
+        done->start_ns  = k_clock_now();
+        done->result    = request->fn(request->arg);
+        done->end_ns    = k_clock_now();
+
+        *busy_ns += done->end_ns - done->start_ns;
+        ran++;
+    }
+
+    k_budget_leave(previous);
+
+    return ran;
+}
+
+/* Called with bus_mutex held */
+static void kprv_bus_finish(bus_run * run, int bus, int ran, uint64_t busy_ns)
+{
+    workers[bus].stats.runs++;
+    workers[bus].stats.requests += ran;
+    workers[bus].stats.busy_ns += busy_ns;
+
+    if (--run->pending == 0)
+    {
+        pthread_cond_broadcast(&done_cond);
+    }
+}
+
+static void * kprv_bus_worker(void * arg)
+{
+    int          bus    = (int) (intptr_t) arg;
+    bus_worker * worker = &workers[bus];
+
+    k_thread_stats_register(worker->thread_name, 0);
+
+    pthread_mutex_lock(&bus_mutex);
+
+    while (1)
+    {
+        while (worker->queued == 0 && !worker->stopping)
+        {
+            pthread_cond_wait(&worker->wake, &bus_mutex);
+        }
+
+        /* Queued runs are finished before stopping */
+        if (worker->queued == 0)
+        {
+            break;
+        }
+
+        bus_run * run = worker->queue[worker->head];
+        worker->head = (worker->head + 1) % K_BUS_QUEUE_DEPTH;
+        worker->queued--;
+        pthread_cond_signal(&worker->space);
+
+        pthread_mutex_unlock(&bus_mutex);
+
+        uint64_t busy_ns;
+        k_thread_stats_wakeup();
+        int ran = kprv_bus_batch(run, bus, &busy_ns);
+
+        pthread_mutex_lock(&bus_mutex);
+        kprv_bus_finish(run, bus, ran, busy_ns);
+    }
+
+    pthread_mutex_unlock(&bus_mutex);
+
+    k_thread_stats_unregister(NULL);
+
+    return NULL;
+}
+
+/* Called with bus_mutex held */
+static bool kprv_bus_start(int bus)
+{
+    bus_worker * worker = &workers[bus];
+
+    if (worker->started)
+    {
+        return !worker->stopping;
+    }
+
+    worker->head   = 0;
+    worker->queued = 0;
+
+    if (k_thread_create(worker->thread_name, &worker->thread, kprv_bus_worker,
+                        (void *) (intptr_t) bus)
+        != THREAD_POLICY_OK)
+    {
+        perror("Failed to create bus worker");
+        return false;
+    }
+
+    worker->started = true;
+
+    return true;
+}
+
+KBusStatus k_bus_run(const k_bus_request * requests, int count,
+                     k_bus_completion * completions)
+{
+    bus_run run = {
+        .requests    = requests,
+        .completions = completions,
+        .count       = count,
+    };
+    bool used[K_BUS_MAX]       = { false };
+    bool inline_run[K_BUS_MAX] = { false };
+
+    if (requests == NULL || completions == NULL || count < 0)
+    {
+        return BUS_ERROR_CONFIG;
+    }
+    if (count > K_BUS_RUN_MAX)
+    {
+        return BUS_ERROR_FULL;
+    }
+
+    /* Workers charge the caller's budget */
+    run.budget = k_budget_enter(-1);
+    k_budget_leave(run.budget);
+
+    pthread_mutex_lock(&bus_mutex);
+
+    for (int i = 0; i < count; i++)
+    {
+        int index;
+
+        for (index = 0; index < device_count; index++)
+        {
+            if (requests[i].device != NULL && requests[i].fn != NULL
+                && strncmp(devices[index].name, requests[i].device,
+                           K_BUS_NAME_LEN - 1) == 0)
+            {
+                break;
+            }
+        }
+
+        if (index == device_count)
+        {
+            pthread_mutex_unlock(&bus_mutex);
+            return BUS_ERROR_CONFIG;
+        }
+
+        run.route[i] = (uint8_t) devices[index].bus;
+        used[devices[index].bus] = true;
+    }
+
+    for (int bus = 0; bus < worker_count; bus++)
+    {
+        bus_worker * worker = &workers[bus];
+
+        if (!used[bus])
+        {
+            continue;
+        }
+
+        bool runnable = kprv_bus_start(bus);
+
+        /* The worker may be stopped while we wait for room, so look again */
+        while (runnable && worker->queued == K_BUS_QUEUE_DEPTH)
+        {
+            pthread_cond_wait(&worker->space, &bus_mutex);
+            runnable = kprv_bus_start(bus);
+        }
+
+        /* A bus whose worker can't run is swept here instead */
+        if (!runnable)
+        {
+            inline_run[bus] = true;
+            run.pending++;
+            continue;
+        }
+
+        worker->queue[(worker->head + worker->queued) % K_BUS_QUEUE_DEPTH]
+            = &run;
+        worker->queued++;
+        run.pending++;
+        pthread_cond_signal(&worker->wake);
+    }
+
+    pthread_mutex_unlock(&bus_mutex);
+
+    for (int bus = 0; bus < K_BUS_MAX; bus++)
+    {
+        if (inline_run[bus])
+        {
+            uint64_t busy_ns;
+            int      ran = kprv_bus_batch(&run, bus, &busy_ns);
+
+            pthread_mutex_lock(&bus_mutex);
+            kprv_bus_finish(&run, bus, ran, busy_ns);
+            pthread_mutex_unlock(&bus_mutex);
+        }
+    }
+
+    pthread_mutex_lock(&bus_mutex);
+    while (run.pending > 0)
+    {
+        pthread_cond_wait(&done_cond, &bus_mutex);
+    }
+    pthread_mutex_unlock(&bus_mutex);
+
+    return BUS_OK;
+}
+
+void k_bus_terminate(void)
+{
+    bool stop[K_BUS_MAX] = { false };
+
+    pthread_mutex_lock(&bus_mutex);
+    for (int bus = 0; bus < worker_count; bus++)
+    {
+        if (workers[bus].started && !workers[bus].stopping)
+        {
+            workers[bus].stopping = true;
+            stop[bus]             = true;
+            pthread_cond_signal(&workers[bus].wake);
+            /* Callers waiting for room sweep the bus themselves instead */
+            pthread_cond_broadcast(&workers[bus].space);
+        }
+    }
+    pthread_mutex_unlock(&bus_mutex);
+
+    for (int bus = 0; bus < K_BUS_MAX; bus++)
+    {
+        if (stop[bus])
+        {
+            pthread_join(workers[bus].thread, NULL);
+
+            pthread_mutex_lock(&bus_mutex);
+            workers[bus].started  = false;
+            workers[bus].stopping = false;
+            pthread_mutex_unlock(&bus_mutex);
+        }
+    }
+}
+
+KBusStatus k_bus_snapshot(k_bus_stats * buffer, int max, int * count)
+{
+    if (buffer == NULL || count == NULL || max < 0)
+    {
+        return BUS_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&bus_mutex);
+
+    *count = 0;
+    for (int bus = 0; bus < worker_count && *count < max; bus++)
+    {
+        buffer[*count] = workers[bus].stats;
+        buffer[*count].running = workers[bus].started
+                                 && !workers[bus].stopping;
+        (*count)++;
+    }
+
+    pthread_mutex_unlock(&bus_mutex);
+
+    return BUS_OK;
+}
@@ -0,0 +1,269 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "clock.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+static uint64_t kprv_clock_system_now(void * context)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * K_CLOCK_NS_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+static void kprv_clock_system_sleep_until(void * context, uint64_t deadline_ns)
+{
+    struct timespec ts = {.tv_sec  = (time_t) (deadline_ns / K_CLOCK_NS_PER_SEC),
+                          .tv_nsec = (long) (deadline_ns % K_CLOCK_NS_PER_SEC) };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    {
+    }
+}
+
+/* Waiters on the system clock which can be woken early */
+static pthread_mutex_t wait_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wait_cond;
+static pthread_once_t  wait_once = PTHREAD_ONCE_INIT;
+
+static void kprv_clock_wait_init(void)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wait_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void kprv_clock_wait_unlock(void * arg)
+{
+    pthread_mutex_unlock(&wait_mutex);
+}
+
+static void kprv_clock_system_wait_until(uint64_t deadline_ns,
+                                         const uint32_t * word, uint32_t seen)
+{
+    struct timespec ts = {.tv_sec  = (time_t) (deadline_ns / K_CLOCK_NS_PER_SEC),
+                          .tv_nsec = (long) (deadline_ns % K_CLOCK_NS_PER_SEC) };
+
+    pthread_once(&wait_once, kprv_clock_wait_init);
+
+    pthread_mutex_lock(&wait_mutex);
+    pthread_cleanup_push(kprv_clock_wait_unlock, NULL);
+    while (__atomic_load_n(word, __ATOMIC_ACQUIRE) == seen
+           && pthread_cond_timedwait(&wait_cond, &wait_mutex, &ts) != ETIMEDOUT)
+    {
+    }
+    pthread_cleanup_pop(1);
+}
+
+static const k_clock_ops system_clock = {
+    .now         = kprv_clock_system_now,
+    .sleep_until = kprv_clock_system_sleep_until,
+    .context     = NULL,
+};
+
+/* Virtual time source state */
+static pthread_mutex_t virtual_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  virtual_cond = PTHREAD_COND_INITIALIZER;
+static uint64_t        virtual_now = 0;
+static pthread_t       virtual_driver;
+static bool            virtual_active = false;
+
+static uint64_t kprv_clock_virtual_now(void * context)
+{
+    return __atomic_load_n(&virtual_now, __ATOMIC_ACQUIRE);
+}
+
+static void kprv_clock_virtual_unlock(void * arg)
+{
+    pthread_mutex_unlock(&virtual_mutex);
+}
+
+static void kprv_clock_virtual_sleep_until(void * context, uint64_t deadline_ns)
+{
+    pthread_mutex_lock(&virtual_mutex);
+
+    if (pthread_equal(pthread_self(), virtual_driver))
+    {
+        if (deadline_ns > virtual_now)
+        {
+            __atomic_store_n(&virtual_now, deadline_ns, __ATOMIC_RELEASE);
+            pthread_cond_broadcast(&virtual_cond);
+        }
+        pthread_mutex_unlock(&virtual_mutex);
+        return;
+    }
+
+    /* Background threads wait for the driver; the wait is a cancellation point */
+    pthread_cleanup_push(kprv_clock_virtual_unlock, NULL);
+    while (virtual_active && virtual_now < deadline_ns)
+    {
+        pthread_cond_wait(&virtual_cond, &virtual_mutex);
+    }
+    pthread_cleanup_pop(1);
+}
+
+static void kprv_clock_virtual_wait_until(uint64_t deadline_ns,
+                                          const uint32_t * word, uint32_t seen)
+{
+    pthread_mutex_lock(&virtual_mutex);
+
+    if (pthread_equal(pthread_self(), virtual_driver))
+    {
+        if (__atomic_load_n(word, __ATOMIC_ACQUIRE) == seen
+            && deadline_ns > virtual_now)
+        {
+            __atomic_store_n(&virtual_now, deadline_ns, __ATOMIC_RELEASE);
+            pthread_cond_broadcast(&virtual_cond);
+        }
+        pthread_mutex_unlock(&virtual_mutex);
+        return;
+    }
+
+    pthread_cleanup_push(kprv_clock_virtual_unlock, NULL);
+    while (virtual_active && virtual_now < deadline_ns
+           && __atomic_load_n(word, __ATOMIC_ACQUIRE) == seen)
+    {
+        pthread_cond_wait(&virtual_cond, &virtual_mutex);
+    }
+    pthread_cleanup_pop(1);
+}
+
+static const k_clock_ops virtual_clock = {
+    .now         = kprv_clock_virtual_now,
+    .sleep_until = kprv_clock_virtual_sleep_until,
+    .context     = NULL,
+};
+
+static const k_clock_ops * current = &system_clock;
+
+static const k_clock_ops * kprv_clock_get(void)
+{
+    return __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+}
+
+void k_clock_set(const k_clock_ops * ops)
+{
+    if (ops == NULL)
+    {
+        ops = &system_clock;
+    }
+
+    if (ops != &virtual_clock)
+    {
+        /* Release anything still waiting on virtual time */
+        pthread_mutex_lock(&virtual_mutex);
+        virtual_active = false;
+        pthread_cond_broadcast(&virtual_cond);
+        pthread_mutex_unlock(&virtual_mutex);
+    }
+
+    __atomic_store_n(&current, ops, __ATOMIC_RELEASE);
+}
+
+void k_clock_use_virtual(uint64_t start_ns)
+{
+    pthread_mutex_lock(&virtual_mutex);
+    __atomic_store_n(&virtual_now, start_ns, __ATOMIC_RELEASE);
+    virtual_driver = pthread_self();
+    virtual_active = true;
+    pthread_cond_broadcast(&virtual_cond);
+    pthread_mutex_unlock(&virtual_mutex);
+
+    k_clock_set(&virtual_clock);
+}
+
+void k_clock_advance(uint64_t ns)
+{
+    pthread_mutex_lock(&virtual_mutex);
+    if (virtual_active)
+    {
+        __atomic_store_n(&virtual_now, virtual_now + ns, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&virtual_cond);
+    }
+    pthread_mutex_unlock(&virtual_mutex);
+}
+
+uint64_t k_clock_now(void)
+{
+    const k_clock_ops * ops = kprv_clock_get();
+
+    return ops->now(ops->context);
+}
+
+void k_clock_sleep_until(uint64_t deadline_ns)
+{
+    const k_clock_ops * ops = kprv_clock_get();
+
+    ops->sleep_until(ops->context, deadline_ns);
+}
+
+void k_clock_sleep(uint64_t ns)
+{
+    const k_clock_ops * ops = kprv_clock_get();
+
+    ops->sleep_until(ops->context, ops->now(ops->context) + ns);
+}
+
+void k_clock_nanosleep(const struct timespec * delay)
+{
+    if (delay == NULL || delay->tv_sec < 0 || delay->tv_nsec < 0)
+    {
+        return;
+    }
+
+    k_clock_sleep((uint64_t) delay->tv_sec * K_CLOCK_NS_PER_SEC
+                  + (uint64_t) delay->tv_nsec);
+}
+
+void k_clock_wait_until(uint64_t deadline_ns, const uint32_t * word,
+                        uint32_t seen)
+{
+    const k_clock_ops * ops = kprv_clock_get();
+
+    if (ops == &system_clock)
+    {
+        kprv_clock_system_wait_until(deadline_ns, word, seen);
+    }
+    else if (ops == &virtual_clock)
+    {
+        kprv_clock_virtual_wait_until(deadline_ns, word, seen);
+    }
+    else
+    {
+        ops->sleep_until(ops->context, deadline_ns);
+    }
+}
+
+void k_clock_notify(void)
+{
+    pthread_once(&wait_once, kprv_clock_wait_init);
+
+    pthread_mutex_lock(&wait_mutex);
+    pthread_cond_broadcast(&wait_cond);
+    pthread_mutex_unlock(&wait_mutex);
+
+    pthread_mutex_lock(&virtual_mutex);
+    pthread_cond_broadcast(&virtual_cond);
+    pthread_mutex_unlock(&virtual_mutex);
+}
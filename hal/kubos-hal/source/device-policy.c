@@ -0,0 +1,514 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "device-policy.h"
+#include "clock.h"
+#include "metrics.h"
+#include "thread-policy.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define POLICY_DEFAULT_ATTEMPTS  3
+#define POLICY_DEFAULT_BASE_US   1000
+#define POLICY_DEFAULT_MAX_US    20000
+#define POLICY_DEFAULT_THRESHOLD 3
+#define POLICY_DEFAULT_OPEN_MS   5000
+
+typedef struct {
+    k_policy_stats  stats;
+    k_policy_config config;
+    k_policy_probe  probe;
+    int             bus;
+    uint16_t        addr;
+    uint32_t        consecutive;    /* Failed operations in a row */
+    uint64_t        opened_ns;      /* When the breaker last opened */
+    pthread_t       trial;          /* Thread allowed through while half-open */
+    bool            prober_running;
+    bool            probing;        /* The prober is inside probe() */
+    uint32_t        generation;     /* Bumped whenever the record is reset */
+    unsigned int    seed;           /* Backoff jitter */
+} policy_record;
+
+static policy_record   records[K_POLICY_MAX];
+static int             record_count = 0;
+static pthread_mutex_t records_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  probe_done = PTHREAD_COND_INITIALIZER;
+
+static uint64_t kprv_policy_now(void)
+{
+    return k_clock_now();
+}
+
+static void kprv_policy_sleep_us(uint32_t us)
+{
+    k_clock_sleep((uint64_t) us * 1000);
+}
+
+static void kprv_policy_set_config(policy_record * record,
+                                   const k_policy_config * config)
+{
+    if (config != NULL)
+    {
+        record->config = *config;
+    }
+    else
+    {
+        memset(&record->config, 0, sizeof(record->config));
+    }
+
+    if (record->config.max_attempts == 0)
+    {
+        record->config.max_attempts = POLICY_DEFAULT_ATTEMPTS;
+    }
+    if (record->config.base_delay_us == 0)
+    {
+        record->config.base_delay_us = POLICY_DEFAULT_BASE_US;
+    }
+    if (record->config.max_delay_us == 0)
+    {
+        record->config.max_delay_us = POLICY_DEFAULT_MAX_US;
+    }
+    if (record->config.failure_threshold == 0)
+    {
+        record->config.failure_threshold = POLICY_DEFAULT_THRESHOLD;
+    }
+    if (record->config.open_ms == 0)
+    {
+        record->config.open_ms = POLICY_DEFAULT_OPEN_MS;
+    }
+}
+
+/* Close the breaker and orphan any running prober. Caller holds the mutex. */
+static void kprv_policy_reset(policy_record * record)
+{
+    record->stats.state    = POLICY_CLOSED;
+    record->consecutive    = 0;
+    record->prober_running = false;
+    record->generation++;
+}
+
+static policy_record * kprv_policy_find_device(int bus, uint16_t addr)
+{
+    for (int i = 0; i < record_count; i++)
+    {
+        if (records[i].stats.active && records[i].bus == bus
+            && records[i].addr == addr)
+        {
+            return &records[i];
+        }
+    }
+
+    return NULL;
+}
+
+static policy_record * kprv_policy_find_name(const char * name)
+{
+    for (int i = 0; i < record_count; i++)
+    {
+        if (strncmp(records[i].stats.name, name, K_POLICY_NAME_LEN - 1) == 0)
+        {
+            return &records[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * A prober's thread argument packs its record's index with the generation it
+ * was started for, so opening a breaker needs no allocation. The prober
+ * compares tokens to find out whether its record has since been reset.
+ */
+static void * kprv_policy_prober_token(const policy_record * record)
+{
+    uintptr_t index = (uintptr_t) (record - records);
+
+    return (void *) ((uintptr_t) record->generation * K_POLICY_MAX + index);
+}
+
+static void * kprv_policy_prober(void * arg)
+{
+    policy_record * record = &records[(uintptr_t) arg % K_POLICY_MAX];
+
+    while (1)
+    {
+        pthread_mutex_lock(&records_mutex);
+        uint32_t open_ms = record->config.open_ms;
+        pthread_mutex_unlock(&records_mutex);
+
+        kprv_policy_sleep_us(open_ms * 1000);
+
+        pthread_mutex_lock(&records_mutex);
+
+        if (kprv_policy_prober_token(record) != arg)
+        {
+            pthread_mutex_unlock(&records_mutex);
+            break;
+        }
+
+        if (record->stats.state != POLICY_OPEN)
+        {
+            record->prober_running = false;
+            pthread_mutex_unlock(&records_mutex);
+            break;
+        }
+
+        /* Let only this thread through while the probe runs */
+        record->stats.state = POLICY_HALF_OPEN;
+        record->trial       = pthread_self();
+        record->stats.probes++;
+        record->probing     = true;
+        k_policy_probe probe = record->probe;
+
+        pthread_mutex_unlock(&records_mutex);
+
+        probe();
+
+        pthread_mutex_lock(&records_mutex);
+
+        record->probing = false;
+        pthread_cond_broadcast(&probe_done);
+
+        if (kprv_policy_prober_token(record) != arg)
+        {
+            pthread_mutex_unlock(&records_mutex);
+            break;
+        }
+
+        if (record->stats.state == POLICY_HALF_OPEN)
+        {
+            /* The probe never reached the bus, so nothing was learnt */
+            record->stats.state = POLICY_OPEN;
+            record->opened_ns   = kprv_policy_now();
+        }
+        else if (record->stats.state == POLICY_CLOSED)
+        {
+            record->prober_running = false;
+            pthread_mutex_unlock(&records_mutex);
+            break;
+        }
+
+        pthread_mutex_unlock(&records_mutex);
+    }
+
+    return NULL;
+}
+
+/* Open the breaker. Caller holds the mutex. */
+static void kprv_policy_trip(policy_record * record)
+{
+    record->stats.state = POLICY_OPEN;
+    record->stats.trips++;
+    record->opened_ns   = kprv_policy_now();
+    record->consecutive = 0;
+
+    fprintf(stderr, "Device '%s' is not responding. Failing fast for %u ms\n",
+            record->stats.name, record->config.open_ms);
+
+    if (record->probe == NULL || record->prober_running)
+    {
+        return;
+    }
+
+    if (k_thread_create("device-probe", NULL, kprv_policy_prober,
+                        kprv_policy_prober_token(record))
+        != THREAD_POLICY_OK)
+    {
+        /* Callers will trial the device themselves instead */
+        perror("Failed to start device probe thread");
+    }
+    else
+    {
+        record->prober_running = true;
+    }
+}
+
+/* Whether an operation may go ahead. Caller holds the mutex. */
+static bool kprv_policy_admit(policy_record * record)
+{
+    switch (record->stats.state)
+    {
+        case POLICY_CLOSED:
+            return true;
+        case POLICY_OPEN:
+            if (!record->prober_running
+                && kprv_policy_now() - record->opened_ns
+                       >= (uint64_t) record->config.open_ms * 1000000ULL)
+            {
+                record->stats.state = POLICY_HALF_OPEN;
+                record->trial       = pthread_self();
+                return true;
+            }
+            return false;
+        case POLICY_HALF_OPEN:
+            return pthread_equal(record->trial, pthread_self());
+    }
+
+    return false;
+}
+
+/* Feed an operation's outcome to the breaker. Caller holds the mutex. */
+static void kprv_policy_result(policy_record * record, bool ok)
+{
+    switch (record->stats.state)
+    {
+        case POLICY_CLOSED:
+            if (ok)
+            {
+                record->consecutive = 0;
+            }
+            else if (++record->consecutive >= record->config.failure_threshold)
+            {
+                kprv_policy_trip(record);
+            }
+            break;
+        case POLICY_HALF_OPEN:
+            if (!pthread_equal(record->trial, pthread_self()))
+            {
+                break;
+            }
+            if (ok)
+            {
+                fprintf(stderr, "Device '%s' is responding again\n",
+                        record->stats.name);
+                record->stats.state = POLICY_CLOSED;
+                record->consecutive = 0;
+            }
+            else
+            {
+                record->stats.state = POLICY_OPEN;
+                record->opened_ns   = kprv_policy_now();
+            }
+            break;
+        case POLICY_OPEN:
+            /* Started before the breaker opened; too late to matter */
+            break;
+    }
+}
+
+/* Full-jitter exponential backoff. Caller holds the mutex. */
+static uint32_t kprv_policy_backoff(policy_record * record, uint32_t retry)
+{
+    uint64_t ceiling = record->config.base_delay_us;
+
+    ceiling <<= (retry < 31) ? retry : 31;
+    if (ceiling > record->config.max_delay_us)
+    {
+        ceiling = record->config.max_delay_us;
+    }
+
+    return (uint32_t) (rand_r(&record->seed) % (ceiling + 1));
+}
+
+KPolicyStatus k_policy_attach(const char * name, int bus, uint16_t addr,
+                              const k_policy_config * config,
+                              k_policy_probe probe)
+{
+    policy_record * record;
+
+    if (name == NULL || name[0] == '\0' || bus == 0)
+    {
+        return POLICY_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&records_mutex);
+
+    record = kprv_policy_find_name(name);
+
+    policy_record * owner = kprv_policy_find_device(bus, addr);
+    if (owner != NULL && owner != record)
+    {
+        pthread_mutex_unlock(&records_mutex);
+        fprintf(stderr, "Device '%s' already has a policy\n", name);
+        return POLICY_ERROR_CONFIG;
+    }
+
+    if (record == NULL)
+    {
+        if (record_count == K_POLICY_MAX)
+        {
+            pthread_mutex_unlock(&records_mutex);
+            fprintf(stderr, "No room for a policy for device '%s'\n", name);
+            return POLICY_ERROR_FULL;
+        }
+
+        record = &records[record_count++];
+        memset(record, 0, sizeof(*record));
+        strncpy(record->stats.name, name, K_POLICY_NAME_LEN - 1);
+    }
+
+    kprv_policy_set_config(record, config);
+    kprv_policy_reset(record);
+
+    record->bus          = bus;
+    record->addr         = addr;
+    record->probe        = probe;
+    record->seed         = (unsigned int) kprv_policy_now() ^ addr;
+    record->stats.active = true;
+
+    pthread_mutex_unlock(&records_mutex);
+
+    return POLICY_OK;
+}
+
+void k_policy_detach(int bus, uint16_t addr)
+{
+    pthread_mutex_lock(&records_mutex);
+
+    policy_record * record = kprv_policy_find_device(bus, addr);
+    if (record != NULL)
+    {
+        kprv_policy_reset(record);
+        record->stats.active = false;
+
+        /* The probe uses the device's bus, so let it finish first */
+        while (record->probing)
+        {
+            pthread_cond_wait(&probe_done, &records_mutex);
+        }
+    }
+
+    pthread_mutex_unlock(&records_mutex);
+}
+
+KPolicyStatus k_policy_configure(const char * name,
+                                 const k_policy_config * config)
+{
+    if (name == NULL)
+    {
+        return POLICY_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&records_mutex);
+
+    policy_record * record = kprv_policy_find_name(name);
+    if (record == NULL || !record->stats.active)
+    {
+        pthread_mutex_unlock(&records_mutex);
+        return POLICY_ERROR_CONFIG;
+    }
+
+    kprv_policy_set_config(record, config);
+    kprv_policy_reset(record);
+
+    pthread_mutex_unlock(&records_mutex);
+
+    return POLICY_OK;
+}
+
+KPolicyStatus k_policy_snapshot(k_policy_stats * buffer, int max, int * count)
+{
+    if (buffer == NULL || count == NULL || max < 0)
+    {
+        return POLICY_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&records_mutex);
+
+    int total = (record_count < max) ? record_count : max;
+
+    for (int i = 0; i < total; i++)
+    {
+        buffer[i] = records[i].stats;
+    }
+
+    pthread_mutex_unlock(&records_mutex);
+
+    *count = total;
+
+    return POLICY_OK;
+}
+
+KI2CStatus kprv_policy_run(kprv_policy_op op, bool write, int bus,
+                           uint16_t addr, uint8_t * ptr, int len)
+{
+    KI2CStatus status;
+
+    pthread_mutex_lock(&records_mutex);
+
+    policy_record * record = kprv_policy_find_device(bus, addr);
+    if (record == NULL)
+    {
+        pthread_mutex_unlock(&records_mutex);
+        return op(bus, addr, ptr, len);
+    }
+
+    record->stats.operations++;
+
+    if (!kprv_policy_admit(record))
+    {
+        record->stats.rejected++;
+        pthread_mutex_unlock(&records_mutex);
+        return I2C_ERROR_UNAVAILABLE;
+    }
+
+    /* A trial gets one shot; retrying would just hold the bus longer */
+    uint32_t attempts   = (record->stats.state == POLICY_HALF_OPEN)
+                              ? 1
+                              : record->config.max_attempts;
+    uint32_t generation = record->generation;
+    bool     retry_any  = !write || record->config.retry_writes;
+
+    pthread_mutex_unlock(&records_mutex);
+
+    for (uint32_t attempt = 1;; attempt++)
+    {
+        status = op(bus, addr, ptr, len);
+        if (status == I2C_OK || attempt >= attempts)
+        {
+            break;
+        }
+
+        /*
+         * A write which got past the address may have been acted on, and
+         * sending a command like a reset twice is not harmless
+         */
+        if (!retry_any && status != I2C_ERROR_ADDR_TIMEOUT
+            && status != I2C_ERROR_NACK)
+        {
+            break;
+        }
+
+        kprv_metrics_transfer(bus, addr, NULL, METRIC_RETRY);
+
+        pthread_mutex_lock(&records_mutex);
+        record->stats.retries++;
+        uint32_t delay = kprv_policy_backoff(record, attempt - 1);
+        pthread_mutex_unlock(&records_mutex);
+
+        kprv_policy_sleep_us(delay);
+    }
+
+    pthread_mutex_lock(&records_mutex);
+
+    if (record->generation == generation)
+    {
+        if (status != I2C_OK)
+        {
+            record->stats.failures++;
+        }
+
+        kprv_policy_result(record, status == I2C_OK);
+    }
+
+    pthread_mutex_unlock(&records_mutex);
+
+    return status;
+}
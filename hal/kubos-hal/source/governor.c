@@ -0,0 +1,594 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "governor.h"
+#include "clock.h"
+#include "pubsub.h"
+#include "thread-policy.h"
+#include "thread-stats.h"
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define NS_PER_MS 1000000ULL
+
+typedef struct {
+    k_gov_stats   stats;
+    uint32_t      max_period_ms;
+    k_gov_profile profile;
+    uint32_t      condition_ms[K_GOV_MAX_CONDITIONS];
+    uint32_t      period_ms;        /* Read without the mutex */
+    uint64_t      elapsed_ns;       /* Time covered by the wakeups so far */
+
+    /* Only touched by the activity's own thread */
+    bool          woken;
+    uint64_t      last_wakeup;
+    uint64_t      cpu_mark;
+    uint64_t      bus_mark;
+    uint32_t      reported_ms;      /* Period last given to thread-stats */
+} gov_record;
+
+static gov_record      records[K_GOV_MAX];
+static int             record_count = 0;
+static char            conditions[K_GOV_MAX_CONDITIONS][K_GOV_NAME_LEN];
+static int             condition_count = 0;
+static uint32_t        active_conditions = 0;
+static KGovMode        mode = GOV_MODE_NORMAL;
+static pthread_mutex_t gov_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Bumped whenever periods change, to wake sleeping activities */
+static uint32_t generation = 0;
+
+/*
+ * Followed topic. follow_mutex is held while starting and stopping, and
+ * not gov_mutex, since the thread being stopped may be waiting on that.
+ */
+static pthread_mutex_t follow_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t       follow_thread;
+static bool            following = false;
+static k_pubsub_sub    follow_sub;
+static uint64_t        follow_buffer[(K_GOV_FOLLOW_SIZE + 7) / 8];
+static k_gov_mode_fn   follow_fn = NULL;
+
+static const uint32_t default_scale[GOV_MODES] = {
+    [GOV_MODE_INITIAL]  = 1,
+    [GOV_MODE_CRITICAL] = K_GOV_SCALE_CRITICAL,
+    [GOV_MODE_SAFE]     = K_GOV_SCALE_SAFE,
+    [GOV_MODE_NORMAL]   = 1,
+    [GOV_MODE_FULL]     = 1,
+};
+
+static uint64_t kprv_gov_thread_cpu(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return (uint64_t) ts.tv_sec * K_CLOCK_NS_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+/* Period a record should run at now. Caller must hold gov_mutex. */
+static uint32_t kprv_gov_compute(const gov_record * record)
+{
+    uint64_t period = 0;
+
+    for (int i = 0; i < condition_count; i++)
+    {
+        uint32_t condition_ms = record->condition_ms[i];
+
+        if ((active_conditions & (1U << i)) && condition_ms != 0
+            && (period == 0 || condition_ms < period))
+        {
+            period = condition_ms;
+        }
+    }
+
+    if (period == 0)
+    {
+        period = record->profile.period_ms[mode];
+    }
+    if (period == 0)
+    {
+        period = (uint64_t) record->stats.base_period_ms * default_scale[mode];
+    }
+    if (record->max_period_ms != 0 && period > record->max_period_ms)
+    {
+        period = record->max_period_ms;
+    }
+
+    return (period > UINT32_MAX) ? UINT32_MAX : (uint32_t) period;
+}
+
+/* Recompute every period. Caller must hold gov_mutex, and then call
+ * k_clock_notify once it's released. */
+static void kprv_gov_retune(void)
+{
+    for (int i = 0; i < record_count; i++)
+    {
+        if (records[i].stats.active)
+        {
+            uint32_t period = kprv_gov_compute(&records[i]);
+
+            records[i].stats.period_ms = period;
+            __atomic_store_n(&records[i].period_ms, period, __ATOMIC_RELEASE);
+        }
+    }
+
+    __atomic_add_fetch(&generation, 1, __ATOMIC_ACQ_REL);
+}
+
+/* Named record, created if need be. Caller must hold gov_mutex. */
+static gov_record * kprv_gov_record(const char * name, bool create)
+{
+    gov_record * record;
+
+    for (int i = 0; i < record_count; i++)
+    {
+        if (strncmp(records[i].stats.name, name, K_GOV_NAME_LEN - 1) == 0)
+        {
+            return &records[i];
+        }
+    }
+
+    if (!create || record_count == K_GOV_MAX)
+    {
+        return NULL;
+    }
+
+    record = &records[record_count++];
+    memset(record, 0, sizeof(*record));
+    strncpy(record->stats.name, name, K_GOV_NAME_LEN - 1);
+
+    return record;
+}
+
+KGovStatus k_gov_register(const char * name, uint32_t base_period_ms,
+                          uint32_t max_period_ms, int * activity)
+{
+    gov_record * record;
+
+    if (name == NULL || name[0] == '\0' || base_period_ms == 0
+        || activity == NULL)
+    {
+        return GOV_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&gov_mutex);
+
+    record = kprv_gov_record(name, true);
+    if (record == NULL)
+    {
+        pthread_mutex_unlock(&gov_mutex);
+        fprintf(stderr, "No room to govern '%s'\n", name);
+        return GOV_ERROR_FULL;
+    }
+
+    record->stats.active         = true;
+    record->stats.base_period_ms = base_period_ms;
+    record->max_period_ms        = max_period_ms;
+    record->woken                = false;
+    record->reported_ms          = 0;
+    record->stats.period_ms      = kprv_gov_compute(record);
+    __atomic_store_n(&record->period_ms, record->stats.period_ms,
+                     __ATOMIC_RELEASE);
+
+    *activity = (int) (record - records);
+
+    pthread_mutex_unlock(&gov_mutex);
+
+    return GOV_OK;
+}
+
+KGovStatus k_gov_find(const char * name, int * activity)
+{
+    gov_record * record;
+
+    if (name == NULL || activity == NULL)
+    {
+        return GOV_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&gov_mutex);
+    record = kprv_gov_record(name, false);
+    if (record != NULL)
+    {
+        *activity = (int) (record - records);
+    }
+    pthread_mutex_unlock(&gov_mutex);
+
+    return (record != NULL) ? GOV_OK : GOV_ERROR;
+}
+
+KGovStatus k_gov_set_profile(const char * name, const k_gov_profile * profile)
+{
+    gov_record * record;
+
+    if (name == NULL || name[0] == '\0')
+    {
+        return GOV_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&gov_mutex);
+
+    record = kprv_gov_record(name, true);
+    if (record == NULL)
+    {
+        pthread_mutex_unlock(&gov_mutex);
+        return GOV_ERROR_FULL;
+    }
+
+    if (profile == NULL)
+    {
+        memset(&record->profile, 0, sizeof(record->profile));
+    }
+    else
+    {
+        record->profile = *profile;
+    }
+    kprv_gov_retune();
+
+    pthread_mutex_unlock(&gov_mutex);
+    k_clock_notify();
+
+    return GOV_OK;
+}
+
+KGovStatus k_gov_condition(const char * name, int * condition)
+{
+    KGovStatus status = GOV_OK;
+    int        index;
+
+    if (name == NULL || name[0] == '\0' || condition == NULL)
+    {
+        return GOV_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&gov_mutex);
+
+    for (index = 0; index < condition_count; index++)
+    {
+        if (strncmp(conditions[index], name, K_GOV_NAME_LEN - 1) == 0)
+        {
+            break;
+        }
+    }
+
+    if (index == condition_count)
+    {
+        if (condition_count == K_GOV_MAX_CONDITIONS)
+        {
+            status = GOV_ERROR_FULL;
+        }
+        else
+        {
+            memset(conditions[index], 0, K_GOV_NAME_LEN);
+            strncpy(conditions[index], name, K_GOV_NAME_LEN - 1);
+            condition_count++;
+        }
+    }
+
+    if (status == GOV_OK)
+    {
+        *condition = index;
+    }
+
+    pthread_mutex_unlock(&gov_mutex);
+
+    return status;
+}
+
+KGovStatus k_gov_set_condition_period(const char * name, int condition,
+                                      uint32_t period_ms)
+{
+    gov_record * record;
+
+    if (name == NULL || name[0] == '\0' || condition < 0)
+    {
+        return GOV_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&gov_mutex);
+
+    if (condition >= condition_count)
+    {
+        pthread_mutex_unlock(&gov_mutex);
+        return GOV_ERROR_CONFIG;
+    }
+
+    record = kprv_gov_record(name, true);
+    if (record == NULL)
+    {
+        pthread_mutex_unlock(&gov_mutex);
+        return GOV_ERROR_FULL;
+    }
+
+    record->condition_ms[condition] = period_ms;
+    kprv_gov_retune();
+
+    pthread_mutex_unlock(&gov_mutex);
+    k_clock_notify();
+
+    return GOV_OK;
+}
+
+KGovStatus k_gov_set_condition(int condition, bool active)
+{
+    uint32_t bits;
+
+    pthread_mutex_lock(&gov_mutex);
+
+    if (condition < 0 || condition >= condition_count)
+    {
+        pthread_mutex_unlock(&gov_mutex);
+        return GOV_ERROR_CONFIG;
+    }
+
+    bits = active ? (active_conditions | (1U << condition))
+                  : (active_conditions & ~(1U << condition));
+    if (bits == active_conditions)
+    {
+        pthread_mutex_unlock(&gov_mutex);
+        return GOV_OK;
+    }
+
+    active_conditions = bits;
+    kprv_gov_retune();
+
+    pthread_mutex_unlock(&gov_mutex);
+    k_clock_notify();
+
+    return GOV_OK;
+}
+
+KGovStatus k_gov_set_mode(KGovMode new_mode)
+{
+    if ((unsigned) new_mode >= GOV_MODES)
+    {
+        return GOV_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&gov_mutex);
+
+    if (new_mode == mode)
+    {
+        pthread_mutex_unlock(&gov_mutex);
+        return GOV_OK;
+    }
+
+    mode = new_mode;
+    kprv_gov_retune();
+
+    pthread_mutex_unlock(&gov_mutex);
+    k_clock_notify();
+
+    return GOV_OK;
+}
+
+KGovMode k_gov_mode(void)
+{
+    KGovMode current;
+
+    pthread_mutex_lock(&gov_mutex);
+    current = mode;
+    pthread_mutex_unlock(&gov_mutex);
+
+    return current;
+}
+
+static void * kprv_gov_follow_thread(void * args)
+{
+    struct pollfd fds = {.fd = k_pubsub_fd(&follow_sub), .events = POLLIN };
+    uint32_t      len;
+    int           new_mode;
+
+    while (1)
+    {
+        while (k_pubsub_read(&follow_sub, follow_buffer, &len, NULL) == PUBSUB_OK)
+        {
+            new_mode = follow_fn(follow_buffer, len);
+            if (new_mode >= 0 && new_mode < GOV_MODES)
+            {
+                k_gov_set_mode((KGovMode) new_mode);
+            }
+        }
+
+        poll(&fds, 1, -1);
+    }
+
+    return NULL;
+}
+
+KGovStatus k_gov_follow(int topic, uint32_t size, k_gov_mode_fn fn)
+{
+    KGovStatus status = GOV_OK;
+
+    if (size == 0 || size > K_GOV_FOLLOW_SIZE || fn == NULL)
+    {
+        return GOV_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&follow_mutex);
+
+    if (following)
+    {
+        status = (topic == follow_sub.topic) ? GOV_OK : GOV_ERROR_CONFIG;
+    }
+    else if (k_pubsub_subscribe(topic, &follow_sub) != PUBSUB_OK)
+    {
+        status = GOV_ERROR_CONFIG;
+    }
+    else
+    {
+        follow_fn = fn;
+
+        if (k_thread_create("governor", &follow_thread,
+                            kprv_gov_follow_thread, NULL)
+            != THREAD_POLICY_OK)
+        {
+            perror("Failed to create governor thread");
+            k_pubsub_unsubscribe(&follow_sub);
+            status = GOV_ERROR;
+        }
+        else
+        {
+            following = true;
+        }
+    }
+
+    pthread_mutex_unlock(&follow_mutex);
+
+    return status;
+}
+
+void k_gov_unfollow(void)
+{
+    pthread_mutex_lock(&follow_mutex);
+
+    if (following)
+    {
+        pthread_cancel(follow_thread);
+        pthread_join(follow_thread, NULL);
+
+        k_pubsub_unsubscribe(&follow_sub);
+        following = false;
+    }
+
+    pthread_mutex_unlock(&follow_mutex);
+}
+
+uint32_t k_gov_period(int activity)
+{
+    if (activity < 0 || activity >= K_GOV_MAX)
+    {
+        return 0;
+    }
+
+    return __atomic_load_n(&records[activity].period_ms, __ATOMIC_ACQUIRE);
+}
+
+void k_gov_sleep(int activity)
+{
+    gov_record * record;
+    uint64_t     now;
+    uint64_t     deadline;
+    uint64_t     period_ns;
+    uint32_t     period;
+    uint32_t     seen;
+
+    if (activity < 0 || activity >= K_GOV_MAX)
+    {
+        return;
+    }
+
+    record = &records[activity];
+    now = k_clock_now();
+
+    if (record->woken)
+    {
+        uint64_t cpu = kprv_gov_thread_cpu() - record->cpu_mark;
+        uint64_t bus = kprv_thread_stats_bus_ns() - record->bus_mark;
+
+        pthread_mutex_lock(&gov_mutex);
+        record->stats.cpu_ns += cpu;
+        record->stats.bus_ns += bus;
+        pthread_mutex_unlock(&gov_mutex);
+    }
+    else
+    {
+        record->last_wakeup = now;
+    }
+
+    while (1)
+    {
+        seen = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+        period = __atomic_load_n(&record->period_ms, __ATOMIC_ACQUIRE);
+
+        if (period != record->reported_ms)
+        {
+            k_thread_stats_period(period);
+            record->reported_ms = period;
+        }
+
+        period_ns = (uint64_t) period * NS_PER_MS;
+        deadline = record->last_wakeup + period_ns;
+        if (now >= deadline)
+        {
+            break;
+        }
+
+        /* Woken early if the periods are retuned meanwhile */
+        k_clock_wait_until(deadline, &generation, seen);
+        now = k_clock_now();
+    }
+
+    /* Keep to the schedule, unless we've fallen a whole period behind */
+    deadline = (now - deadline > period_ns) ? now : deadline;
+
+    pthread_mutex_lock(&gov_mutex);
+    record->stats.wakeups++;
+    record->elapsed_ns += deadline - record->last_wakeup;
+    pthread_mutex_unlock(&gov_mutex);
+
+    record->last_wakeup = deadline;
+    record->woken = true;
+    record->cpu_mark = kprv_gov_thread_cpu();
+    record->bus_mark = kprv_thread_stats_bus_ns();
+}
+
+KGovStatus k_gov_snapshot(k_gov_stats * buffer, int max, int * count)
+{
+    if (buffer == NULL || count == NULL || max < 0)
+    {
+        return GOV_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&gov_mutex);
+
+    int total = (record_count < max) ? record_count : max;
+
+    for (int i = 0; i < total; i++)
+    {
+        const gov_record * record = &records[i];
+        k_gov_stats *      stats = &buffer[i];
+        uint64_t           skipped = 0;
+
+        *stats = record->stats;
+
+        if (stats->base_period_ms != 0)
+        {
+            stats->base_wakeups = (uint32_t) (record->elapsed_ns
+                / ((uint64_t) stats->base_period_ms * NS_PER_MS));
+        }
+        if (stats->base_wakeups > stats->wakeups)
+        {
+            skipped = stats->base_wakeups - stats->wakeups;
+        }
+        if (stats->wakeups != 0)
+        {
+            stats->cpu_saved_ns = stats->cpu_ns / stats->wakeups * skipped;
+            stats->bus_saved_ns = stats->bus_ns / stats->wakeups * skipped;
+        }
+    }
+
+    pthread_mutex_unlock(&gov_mutex);
+
+    *count = total;
+
+    return GOV_OK;
+}
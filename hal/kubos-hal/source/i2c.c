@@ -16,6 +16,12 @@
  */
 
 #include "i2c.h"
+#include "bus-budget.h"
+#include "clock.h"
+#include "device-policy.h"
+#include "metrics.h"
+#include "thread-stats.h"
+#include "watchdog.h"
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/i2c-dev.h>
@@ -25,6 +31,7 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 KI2CStatus k_i2c_init(char * device, int * fp)
@@ -62,50 +69,146 @@ void k_i2c_terminate(int * fp)
     return;
 }
 
-KI2CStatus k_i2c_write(int i2c, uint16_t addr, uint8_t* ptr, int len)
+/* Metrics event for a transfer that failed with `err` */
+static KMetricsEvent kprv_i2c_event(int err)
 {
-    if (i2c == 0 || ptr == NULL)
+    switch (err)
     {
-        return I2C_ERROR;
+        case ENXIO:
+        case EREMOTEIO:
+            return METRIC_NACK;
+        case ETIMEDOUT:
+            return METRIC_TIMEOUT;
+        default:
+            return METRIC_BUS_ERROR;
     }
+}
+
+static KI2CStatus kprv_i2c_write(int i2c, uint16_t addr, uint8_t * ptr, int len)
+{
+    KI2CStatus    status   = I2C_OK;
+    KMetricsEvent event    = METRIC_SUCCESS;
+    bool          tracked  = kprv_thread_stats_tracked();
+    bool          budgeted = kprv_budget_active();
+    uint64_t      start    = (tracked || budgeted) ? k_clock_now() : 0;
+
+    /* A short transfer leaves errno alone; count it as a bus error */
+    errno = 0;
 
     /* Set the desired slave's address */
     if (ioctl(i2c, I2C_SLAVE, addr) < 0)
     {
+        event  = kprv_i2c_event(errno);
         perror("Couldn't reach requested address");
-        return I2C_ERROR_ADDR_TIMEOUT;
+        status = I2C_ERROR_ADDR_TIMEOUT;
     }
-
     /* Transmit buffer */
-    if (write(i2c, ptr, len) != len)
+    else if (write(i2c, ptr, len) != len)
     {
+        /* ENXIO means the address itself wasn't acknowledged */
+        status = (errno == ENXIO) ? I2C_ERROR_NACK : I2C_ERROR;
+        event  = kprv_i2c_event(errno);
         perror("I2C write failed");
-        return I2C_ERROR;
     }
 
-    return I2C_OK;
+    if (tracked || budgeted)
+    {
+        uint64_t elapsed = k_clock_now() - start;
+
+        if (tracked)
+        {
+            kprv_thread_stats_bus(elapsed);
+        }
+        if (budgeted)
+        {
+            kprv_budget_charge(elapsed);
+        }
+    }
+
+    kprv_metrics_transfer(i2c, addr, ptr, event);
+
+    return status;
 }
 
-KI2CStatus k_i2c_read(int i2c, uint16_t addr, uint8_t* ptr, int len)
+static KI2CStatus kprv_i2c_read(int i2c, uint16_t addr, uint8_t * ptr, int len)
 {
-    if (i2c == 0 || ptr == NULL)
-    {
-        return I2C_ERROR;
-    }
+    KI2CStatus    status   = I2C_OK;
+    KMetricsEvent event    = METRIC_SUCCESS;
+    bool          tracked  = kprv_thread_stats_tracked();
+    bool          budgeted = kprv_budget_active();
+    uint64_t      start    = (tracked || budgeted) ? k_clock_now() : 0;
+
+    /* A short transfer leaves errno alone; count it as a bus error */
+    errno = 0;
 
     /* Set the desired slave's address */
     if (ioctl(i2c, I2C_SLAVE, addr) < 0)
     {
+        event  = kprv_i2c_event(errno);
         perror("Couldn't reach requested address");
-        return I2C_ERROR_ADDR_TIMEOUT;
+        status = I2C_ERROR_ADDR_TIMEOUT;
     }
-
     /* Read in data */
-    if (read(i2c, ptr, len) != len)
+    else if (read(i2c, ptr, len) != len)
     {
+        event  = kprv_i2c_event(errno);
         perror("I2C read failed");
+        status = I2C_ERROR;
+    }
+
+    if (tracked || budgeted)
+    {
+        uint64_t elapsed = k_clock_now() - start;
+
+        if (tracked)
+        {
+            kprv_thread_stats_bus(elapsed);
+        }
+        if (budgeted)
+        {
+            kprv_budget_charge(elapsed);
+        }
+    }
+
+    kprv_metrics_transfer(i2c, addr, NULL, event);
+
+    return status;
+}
+
+KI2CStatus k_i2c_write(int i2c, uint16_t addr, uint8_t* ptr, int len)
+{
+    if (i2c == 0 || ptr == NULL)
+    {
         return I2C_ERROR;
     }
 
-    return I2C_OK;
+    KI2CStatus status = kprv_budget_admit(len);
+    if (status != I2C_OK)
+    {
+        return status;
+    }
+
+    status = kprv_policy_run(kprv_i2c_write, true, i2c, addr, ptr, len);
+    if (status == I2C_OK)
+    {
+        kprv_wdt_traffic(i2c, addr);
+    }
+
+    return status;
+}
+
+KI2CStatus k_i2c_read(int i2c, uint16_t addr, uint8_t* ptr, int len)
+{
+    if (i2c == 0 || ptr == NULL)
+    {
+        return I2C_ERROR;
+    }
+
+    KI2CStatus status = kprv_budget_admit(len);
+    if (status != I2C_OK)
+    {
+        return status;
+    }
+
+    return kprv_policy_run(kprv_i2c_read, false, i2c, addr, ptr, len);
 }
@@ -0,0 +1,1292 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "io-engine.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef KUBOS_HAL_IO_URING
+#include <linux/io_uring.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#endif
+
+#define IO_DEFAULT_QUEUE_DEPTH  32
+#define IO_DEFAULT_MAX_FILES    8
+#define IO_DEFAULT_BUFFER_COUNT 16
+#define IO_DEFAULT_BUFFER_SIZE  256
+#define IO_DEFAULT_RECV_BUFFERS 8
+
+/* Completions for internal requests (cancels) are swallowed */
+#define IO_TAG_INTERNAL UINT64_MAX
+
+/* Provided buffer group used by receives */
+#define IO_RECV_GROUP 0
+
+typedef enum {
+    IO_OP_READ,
+    IO_OP_WRITE,
+    IO_OP_RECV
+} io_op;
+
+typedef struct {
+    bool     used;
+    io_op    op;
+    int      slot;
+    int      buffer;     /* Read/write buffer, or -1 */
+    uint32_t len;
+    int64_t  offset;
+    uint64_t user_data;
+    bool     armed;      /* Submitted to the kernel or waiting in epoll */
+    bool     multishot;  /* io_uring multishot receive */
+    bool     cancelled;
+    bool     starved;    /* Receive waiting for a free receive buffer */
+} io_request;
+
+typedef struct {
+    int      fd;         /* -1 if the slot is free */
+    bool     socket;
+    bool     always_ready; /* epoll can't watch it (regular file) */
+    uint32_t events;     /* epoll interest currently registered */
+} io_file;
+
+struct k_io_engine {
+    KIOBackend   backend;
+    k_io_config  config;
+
+    uint8_t *    pool;
+    int *        free_buffers;  /* Stack of free general buffers */
+    int          free_count;
+    int *        free_recv;     /* epoll: stack of free receive buffers */
+    int          free_recv_count;
+
+    io_file *    files;
+    io_request * requests;
+
+    int          epoll_fd;
+
+#ifdef KUBOS_HAL_IO_URING
+    int                       ring_fd;
+    bool                      sq_poll;
+    void *                    sq_map;
+    size_t                    sq_map_len;
+    void *                    cq_map;
+    size_t                    cq_map_len;
+    struct io_uring_sqe *     sqes;
+    size_t                    sqes_len;
+    uint32_t *                sq_head;
+    uint32_t *                sq_tail;
+    uint32_t *                sq_flags;
+    uint32_t *                sq_array;
+    uint32_t                  sq_mask;
+    uint32_t                  sq_entries;
+    uint32_t                  sq_local_tail;
+    uint32_t *                cq_head;
+    uint32_t *                cq_tail;
+    uint32_t                  cq_mask;
+    struct io_uring_cqe *     cqes;
+    struct io_uring_buf_ring * buf_ring;
+    size_t                    buf_ring_len;
+    uint16_t                  buf_ring_tail;
+#endif
+};
+
+/* Helpers shared by both backends */
+
+static uint8_t * kprv_io_buffer(k_io_engine * engine, int index)
+{
+    return engine->pool + (size_t) index * engine->config.buffer_size;
+}
+
+static bool kprv_io_is_recv_buffer(const k_io_engine * engine, int index)
+{
+    return index >= 0 && (uint32_t) index < engine->config.recv_buffers;
+}
+
+static bool kprv_io_valid_slot(const k_io_engine * engine, int slot)
+{
+    return slot >= 0 && (uint32_t) slot < engine->config.max_files
+           && engine->files[slot].fd >= 0;
+}
+
+static io_request * kprv_io_new_request(k_io_engine * engine, io_op op,
+                                        int slot, uint64_t user_data)
+{
+    for (uint32_t i = 0; i < engine->config.queue_depth; i++)
+    {
+        io_request * req = &engine->requests[i];
+        if (!req->used)
+        {
+            memset(req, 0, sizeof(*req));
+            req->used      = true;
+            req->op        = op;
+            req->slot      = slot;
+            req->buffer    = -1;
+            req->user_data = user_data;
+            return req;
+        }
+    }
+
+    return NULL;
+}
+
+static void kprv_io_emit(k_io_completion * events, int * count,
+                         uint64_t user_data, int32_t result, int32_t buffer,
+                         bool more)
+{
+    k_io_completion * event = &events[(*count)++];
+
+    event->user_data = user_data;
+    event->result    = result;
+    event->buffer    = buffer;
+    event->more      = more;
+}
+
+/* Finish a request with a final completion */
+static void kprv_io_finish(io_request * req, k_io_completion * events,
+                           int * count, int32_t result)
+{
+    kprv_io_emit(events, count, req->user_data, result,
+                 (req->op == IO_OP_RECV) ? -1 : req->buffer, false);
+    req->used = false;
+}
+
+/* io_uring backend */
+
+#ifdef KUBOS_HAL_IO_URING
+
+static int kprv_io_uring_setup(uint32_t entries, struct io_uring_params * p)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int kprv_io_uring_enter(int fd, uint32_t to_submit,
+                               uint32_t min_complete, uint32_t flags,
+                               void * arg, size_t arg_len)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                         flags, arg, arg_len);
+}
+
+static int kprv_io_uring_register(int fd, uint32_t opcode, void * arg,
+                                  uint32_t nr_args)
+{
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void kprv_io_uring_teardown(k_io_engine * engine)
+{
+    if (engine->buf_ring != NULL)
+    {
+        munmap(engine->buf_ring, engine->buf_ring_len);
+        engine->buf_ring = NULL;
+    }
+    if (engine->sqes != NULL)
+    {
+        munmap(engine->sqes, engine->sqes_len);
+        engine->sqes = NULL;
+    }
+    if (engine->cq_map != NULL && engine->cq_map != engine->sq_map)
+    {
+        munmap(engine->cq_map, engine->cq_map_len);
+    }
+    engine->cq_map = NULL;
+    if (engine->sq_map != NULL)
+    {
+        munmap(engine->sq_map, engine->sq_map_len);
+        engine->sq_map = NULL;
+    }
+    if (engine->ring_fd >= 0)
+    {
+        close(engine->ring_fd);
+        engine->ring_fd = -1;
+    }
+}
+
+/* Hand a receive buffer to the kernel's provided buffer ring */
+static void kprv_io_uring_provide(k_io_engine * engine, int index)
+{
+    uint32_t               mask = engine->config.recv_buffers - 1;
+    struct io_uring_buf * buf
+        = &engine->buf_ring->bufs[engine->buf_ring_tail & mask];
+
+    buf->addr = (uint64_t) (uintptr_t) kprv_io_buffer(engine, index);
+    buf->len  = engine->config.buffer_size;
+    buf->bid  = (uint16_t) index;
+
+    engine->buf_ring_tail++;
+    __atomic_store_n(&engine->buf_ring->tail, engine->buf_ring_tail,
+                     __ATOMIC_RELEASE);
+}
+
+/*
+ * Try to bring up io_uring. Returns false (with everything undone) if the
+ * kernel is missing any feature the engine relies on.
+ */
+static bool kprv_io_uring_init(k_io_engine * engine)
+{
+    struct io_uring_params params;
+    /* Room for one request SQE plus one cancel SQE per request */
+    uint32_t               entries = engine->config.queue_depth * 2;
+
+    engine->ring_fd = -1;
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+    if (engine->config.kernel_poll)
+    {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = 100;
+    }
+
+    engine->ring_fd = kprv_io_uring_setup(entries, &params);
+    if (engine->ring_fd < 0 && engine->config.kernel_poll)
+    {
+        /* SQPOLL usually needs privileges; carry on without it */
+        memset(&params, 0, sizeof(params));
+        params.flags    = IORING_SETUP_CLAMP;
+        engine->ring_fd = kprv_io_uring_setup(entries, &params);
+    }
+    if (engine->ring_fd < 0)
+    {
+        return false;
+    }
+
+    engine->sq_poll = (params.flags & IORING_SETUP_SQPOLL) != 0;
+
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)
+        || !(params.features & IORING_FEAT_EXT_ARG))
+    {
+        kprv_io_uring_teardown(engine);
+        return false;
+    }
+
+    size_t sq_len = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    size_t cq_len = params.cq_off.cqes
+                    + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    engine->sq_map_len = (sq_len > cq_len) ? sq_len : cq_len;
+    engine->sq_map = mmap(NULL, engine->sq_map_len, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, engine->ring_fd,
+                          IORING_OFF_SQ_RING);
+    if (engine->sq_map == MAP_FAILED)
+    {
+        engine->sq_map = NULL;
+        kprv_io_uring_teardown(engine);
+        return false;
+    }
+    engine->cq_map     = engine->sq_map;
+    engine->cq_map_len = engine->sq_map_len;
+
+    engine->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    engine->sqes = mmap(NULL, engine->sqes_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, engine->ring_fd,
+                        IORING_OFF_SQES);
+    if (engine->sqes == MAP_FAILED)
+    {
+        engine->sqes = NULL;
+        kprv_io_uring_teardown(engine);
+        return false;
+    }
+
+    uint8_t * sq = engine->sq_map;
+    uint8_t * cq = engine->cq_map;
+
+    engine->sq_head       = (uint32_t *) (sq + params.sq_off.head);
+    engine->sq_tail       = (uint32_t *) (sq + params.sq_off.tail);
+    engine->sq_flags      = (uint32_t *) (sq + params.sq_off.flags);
+    engine->sq_array      = (uint32_t *) (sq + params.sq_off.array);
+    engine->sq_mask       = *(uint32_t *) (sq + params.sq_off.ring_mask);
+    engine->sq_entries    = params.sq_entries;
+    engine->sq_local_tail = *engine->sq_tail;
+    engine->cq_head       = (uint32_t *) (cq + params.cq_off.head);
+    engine->cq_tail       = (uint32_t *) (cq + params.cq_off.tail);
+    engine->cq_mask       = *(uint32_t *) (cq + params.cq_off.ring_mask);
+    engine->cqes          = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    /* Register every buffer so reads and writes skip the page pinning */
+    struct iovec * iov = calloc(engine->config.buffer_count, sizeof(*iov));
+    if (iov == NULL)
+    {
+        kprv_io_uring_teardown(engine);
+        return false;
+    }
+    for (uint32_t i = 0; i < engine->config.buffer_count; i++)
+    {
+        iov[i].iov_base = kprv_io_buffer(engine, (int) i);
+        iov[i].iov_len  = engine->config.buffer_size;
+    }
+    int ret = kprv_io_uring_register(engine->ring_fd, IORING_REGISTER_BUFFERS,
+                                     iov, engine->config.buffer_count);
+    free(iov);
+    if (ret < 0)
+    {
+        kprv_io_uring_teardown(engine);
+        return false;
+    }
+
+    /* Sparse file table, filled in by k_io_register_file */
+    int * fds = malloc(engine->config.max_files * sizeof(int));
+    if (fds == NULL)
+    {
+        kprv_io_uring_teardown(engine);
+        return false;
+    }
+    for (uint32_t i = 0; i < engine->config.max_files; i++)
+    {
+        fds[i] = -1;
+    }
+    ret = kprv_io_uring_register(engine->ring_fd, IORING_REGISTER_FILES, fds,
+                                 engine->config.max_files);
+    free(fds);
+    if (ret < 0)
+    {
+        kprv_io_uring_teardown(engine);
+        return false;
+    }
+
+    if (engine->config.recv_buffers != 0)
+    {
+        struct io_uring_buf_reg reg;
+
+        engine->buf_ring_len
+            = engine->config.recv_buffers * sizeof(struct io_uring_buf);
+        engine->buf_ring = mmap(NULL, engine->buf_ring_len,
+                                PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (engine->buf_ring == MAP_FAILED)
+        {
+            engine->buf_ring = NULL;
+            kprv_io_uring_teardown(engine);
+            return false;
+        }
+
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr    = (uint64_t) (uintptr_t) engine->buf_ring;
+        reg.ring_entries = engine->config.recv_buffers;
+        reg.bgid         = IO_RECV_GROUP;
+
+        if (kprv_io_uring_register(engine->ring_fd, IORING_REGISTER_PBUF_RING,
+                                   &reg, 1)
+            < 0)
+        {
+            kprv_io_uring_teardown(engine);
+            return false;
+        }
+
+        engine->buf_ring_tail = 0;
+        for (uint32_t i = 0; i < engine->config.recv_buffers; i++)
+        {
+            kprv_io_uring_provide(engine, (int) i);
+        }
+    }
+
+    return true;
+}
+
+static struct io_uring_sqe * kprv_io_uring_sqe(k_io_engine * engine)
+{
+    uint32_t head = __atomic_load_n(engine->sq_head, __ATOMIC_ACQUIRE);
+
+    if (engine->sq_local_tail - head >= engine->sq_entries)
+    {
+        return NULL;
+    }
+
+    uint32_t              index = engine->sq_local_tail & engine->sq_mask;
+    struct io_uring_sqe * sqe   = &engine->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    engine->sq_array[index] = index;
+    engine->sq_local_tail++;
+
+    return sqe;
+}
+
+static KIOStatus kprv_io_uring_arm(k_io_engine * engine, io_request * req)
+{
+    struct io_uring_sqe * sqe = kprv_io_uring_sqe(engine);
+    if (sqe == NULL)
+    {
+        return IO_ERROR_FULL;
+    }
+
+    sqe->flags     = IOSQE_FIXED_FILE;
+    sqe->fd        = req->slot;
+    sqe->user_data = (uint64_t) (req - engine->requests);
+
+    switch (req->op)
+    {
+        case IO_OP_READ:
+        case IO_OP_WRITE:
+            sqe->opcode    = (req->op == IO_OP_READ) ? IORING_OP_READ_FIXED
+                                                     : IORING_OP_WRITE_FIXED;
+            sqe->addr      = (uint64_t) (uintptr_t) kprv_io_buffer(engine,
+                                                                   req->buffer);
+            sqe->len       = req->len;
+            sqe->off       = (uint64_t) req->offset;
+            sqe->buf_index = (uint16_t) req->buffer;
+            break;
+        case IO_OP_RECV:
+            sqe->flags |= IOSQE_BUFFER_SELECT;
+            sqe->buf_group = IO_RECV_GROUP;
+            if (engine->files[req->slot].socket)
+            {
+                sqe->opcode = IORING_OP_RECV;
+                if (req->multishot)
+                {
+                    sqe->ioprio = IORING_RECV_MULTISHOT;
+                }
+            }
+            else
+            {
+                sqe->opcode = IORING_OP_READ;
+                sqe->len    = engine->config.buffer_size;
+                sqe->off    = (uint64_t) K_IO_OFFSET_CURRENT;
+            }
+            break;
+    }
+
+    req->armed = true;
+
+    return IO_OK;
+}
+
+static KIOStatus kprv_io_uring_cancel(k_io_engine * engine, io_request * req)
+{
+    struct io_uring_sqe * sqe = kprv_io_uring_sqe(engine);
+    if (sqe == NULL)
+    {
+        return IO_ERROR_FULL;
+    }
+
+    sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+    sqe->addr      = (uint64_t) (req - engine->requests);
+    sqe->user_data = IO_TAG_INTERNAL;
+
+    return IO_OK;
+}
+
+static void kprv_io_uring_complete(k_io_engine * engine,
+                                   const struct io_uring_cqe * cqe,
+                                   k_io_completion * events, int * count)
+{
+    if (cqe->user_data == IO_TAG_INTERNAL
+        || cqe->user_data >= engine->config.queue_depth)
+    {
+        return;
+    }
+
+    io_request * req = &engine->requests[cqe->user_data];
+    if (!req->used)
+    {
+        return;
+    }
+
+    if (req->op != IO_OP_RECV)
+    {
+        req->armed = false;
+        kprv_io_finish(req, events, count, cqe->res);
+        return;
+    }
+
+    if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER))
+    {
+        kprv_io_emit(events, count, req->user_data, cqe->res,
+                     (int32_t) (cqe->flags >> IORING_CQE_BUFFER_SHIFT), true);
+    }
+
+    if (cqe->flags & IORING_CQE_F_MORE)
+    {
+        return;
+    }
+
+    /* The kernel has let go of the request; decide whether to re-arm */
+    req->armed = false;
+
+    if (req->cancelled)
+    {
+        kprv_io_finish(req, events, count, -ECANCELED);
+    }
+    else if (cqe->res > 0)
+    {
+        kprv_io_uring_arm(engine, req);
+    }
+    else if (cqe->res == -ENOBUFS)
+    {
+        /* Re-armed from k_io_buffer_release */
+        req->starved = true;
+    }
+    else if (cqe->res == -EINVAL && req->multishot)
+    {
+        /* Kernel without multishot receive: re-arm after every chunk */
+        req->multishot = false;
+        kprv_io_uring_arm(engine, req);
+    }
+    else
+    {
+        kprv_io_finish(req, events, count, cqe->res);
+    }
+}
+
+static KIOStatus kprv_io_uring_wait(k_io_engine * engine,
+                                    k_io_completion * events, int max,
+                                    int timeout_ms, int * count)
+{
+    uint32_t pending = engine->sq_local_tail
+                       - __atomic_load_n(engine->sq_head, __ATOMIC_ACQUIRE);
+    bool     ready   = *count != 0
+                     || __atomic_load_n(engine->cq_tail, __ATOMIC_ACQUIRE)
+                            != *engine->cq_head;
+    uint32_t flags   = 0;
+
+    __atomic_store_n(engine->sq_tail, engine->sq_local_tail, __ATOMIC_RELEASE);
+
+    if (engine->sq_poll)
+    {
+        if (__atomic_load_n(engine->sq_flags, __ATOMIC_ACQUIRE)
+            & IORING_SQ_NEED_WAKEUP)
+        {
+            flags |= IORING_ENTER_SQ_WAKEUP;
+        }
+        pending = 0;
+    }
+
+    if (!ready && timeout_ms != 0)
+    {
+        struct __kernel_timespec     ts;
+        struct io_uring_getevents_arg arg;
+
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        if (timeout_ms > 0)
+        {
+            ts.tv_sec  = timeout_ms / 1000;
+            ts.tv_nsec = (long long) (timeout_ms % 1000) * 1000000;
+            arg.ts     = (uint64_t) (uintptr_t) &ts;
+        }
+
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (kprv_io_uring_enter(engine->ring_fd, pending, 1, flags, &arg,
+                                sizeof(arg))
+                < 0
+            && errno != ETIME && errno != EINTR)
+        {
+            perror("io_uring_enter failed");
+            return IO_ERROR;
+        }
+    }
+    else if (pending != 0 || flags != 0)
+    {
+        if (kprv_io_uring_enter(engine->ring_fd, pending, 0, flags, NULL, 0) < 0
+            && errno != EINTR)
+        {
+            perror("io_uring_enter failed");
+            return IO_ERROR;
+        }
+    }
+
+    uint32_t head = *engine->cq_head;
+    uint32_t tail = __atomic_load_n(engine->cq_tail, __ATOMIC_ACQUIRE);
+
+    /* A receive completion can produce two events, so keep room for both */
+    while (head != tail && *count + 2 <= max)
+    {
+        kprv_io_uring_complete(engine, &engine->cqes[head & engine->cq_mask],
+                               events, count);
+        head++;
+    }
+
+    __atomic_store_n(engine->cq_head, head, __ATOMIC_RELEASE);
+
+    return IO_OK;
+}
+
+#endif /* KUBOS_HAL_IO_URING */
+
+/* epoll backend */
+
+static KIOStatus kprv_io_epoll_init(k_io_engine * engine)
+{
+    engine->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (engine->epoll_fd < 0)
+    {
+        perror("Failed to create I/O epoll instance");
+        return IO_ERROR;
+    }
+
+    engine->free_recv = malloc(sizeof(int) * (engine->config.recv_buffers + 1));
+    if (engine->free_recv == NULL)
+    {
+        return IO_ERROR;
+    }
+
+    engine->free_recv_count = 0;
+    for (int i = (int) engine->config.recv_buffers - 1; i >= 0; i--)
+    {
+        engine->free_recv[engine->free_recv_count++] = i;
+    }
+
+    return IO_OK;
+}
+
+/* Bring the slot's epoll interest in line with its outstanding requests */
+static void kprv_io_epoll_update(k_io_engine * engine, int slot)
+{
+    io_file * file   = &engine->files[slot];
+    uint32_t  events = 0;
+
+    if (file->always_ready)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < engine->config.queue_depth; i++)
+    {
+        io_request * req = &engine->requests[i];
+        if (!req->used || req->slot != slot || req->cancelled || req->starved)
+        {
+            continue;
+        }
+
+        events |= (req->op == IO_OP_WRITE) ? EPOLLOUT : EPOLLIN;
+    }
+
+    if (events != file->events)
+    {
+        struct epoll_event ev;
+
+        ev.events   = events;
+        ev.data.u32 = (uint32_t) slot;
+        epoll_ctl(engine->epoll_fd, EPOLL_CTL_MOD, file->fd, &ev);
+        file->events = events;
+    }
+}
+
+/* Attempt a request whose descriptor is ready */
+static void kprv_io_epoll_perform(k_io_engine * engine, io_request * req,
+                                  k_io_completion * events, int * count)
+{
+    int     fd = engine->files[req->slot].fd;
+    ssize_t ret;
+
+    if (req->op == IO_OP_RECV)
+    {
+        if (engine->free_recv_count == 0)
+        {
+            req->starved = true;
+            return;
+        }
+
+        int index = engine->free_recv[--engine->free_recv_count];
+
+        ret = read(fd, kprv_io_buffer(engine, index), engine->config.buffer_size);
+        if (ret > 0)
+        {
+            kprv_io_emit(events, count, req->user_data, (int32_t) ret, index,
+                         true);
+            return;
+        }
+
+        engine->free_recv[engine->free_recv_count++] = index;
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return;
+        }
+
+        kprv_io_finish(req, events, count, (ret == 0) ? 0 : -errno);
+        return;
+    }
+
+    uint8_t * data = kprv_io_buffer(engine, req->buffer);
+
+    if (req->op == IO_OP_READ)
+    {
+        ret = (req->offset < 0) ? read(fd, data, req->len)
+                                : pread(fd, data, req->len, req->offset);
+    }
+    else
+    {
+        ret = (req->offset < 0) ? write(fd, data, req->len)
+                                : pwrite(fd, data, req->len, req->offset);
+    }
+
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return;
+    }
+
+    kprv_io_finish(req, events, count, (ret < 0) ? -errno : (int32_t) ret);
+}
+
+static KIOStatus kprv_io_epoll_wait(k_io_engine * engine,
+                                    k_io_completion * events, int max,
+                                    int timeout_ms, int * count)
+{
+    /* Regular files are always ready, so just do them */
+    for (uint32_t i = 0; i < engine->config.queue_depth && *count + 2 <= max;
+         i++)
+    {
+        io_request * req = &engine->requests[i];
+        if (req->used && !req->cancelled && !req->starved
+            && engine->files[req->slot].always_ready)
+        {
+            kprv_io_epoll_perform(engine, req, events, count);
+        }
+    }
+
+    for (uint32_t i = 0; i < engine->config.max_files; i++)
+    {
+        if (engine->files[i].fd >= 0)
+        {
+            kprv_io_epoll_update(engine, (int) i);
+        }
+    }
+
+    struct epoll_event ready[16];
+    int                nready = epoll_wait(engine->epoll_fd, ready, 16,
+                                           (*count != 0) ? 0 : timeout_ms);
+    if (nready < 0)
+    {
+        if (errno == EINTR)
+        {
+            return IO_OK;
+        }
+
+        perror("epoll_wait failed");
+        return IO_ERROR;
+    }
+
+    for (int n = 0; n < nready; n++)
+    {
+        int      slot = (int) ready[n].data.u32;
+        uint32_t ev   = ready[n].events;
+
+        for (uint32_t i = 0; i < engine->config.queue_depth && *count + 2 <= max;
+             i++)
+        {
+            io_request * req = &engine->requests[i];
+            if (!req->used || req->slot != slot || req->cancelled
+                || req->starved)
+            {
+                continue;
+            }
+
+            uint32_t wanted = (req->op == IO_OP_WRITE) ? EPOLLOUT : EPOLLIN;
+            if (ev & (wanted | EPOLLERR | EPOLLHUP))
+            {
+                kprv_io_epoll_perform(engine, req, events, count);
+            }
+        }
+    }
+
+    return IO_OK;
+}
+
+/* Public interface */
+
+KIOStatus k_io_init(const k_io_config * config, k_io_engine ** engine)
+{
+    k_io_engine * new_engine;
+
+    if (engine == NULL)
+    {
+        return IO_ERROR_CONFIG;
+    }
+
+    new_engine = calloc(1, sizeof(*new_engine));
+    if (new_engine == NULL)
+    {
+        return IO_ERROR;
+    }
+
+    if (config != NULL)
+    {
+        new_engine->config = *config;
+    }
+
+    k_io_config * cfg = &new_engine->config;
+    if (cfg->queue_depth == 0)
+    {
+        cfg->queue_depth = IO_DEFAULT_QUEUE_DEPTH;
+    }
+    if (cfg->max_files == 0)
+    {
+        cfg->max_files = IO_DEFAULT_MAX_FILES;
+    }
+    if (cfg->buffer_count == 0)
+    {
+        cfg->buffer_count = IO_DEFAULT_BUFFER_COUNT;
+    }
+    if (cfg->buffer_size == 0)
+    {
+        cfg->buffer_size = IO_DEFAULT_BUFFER_SIZE;
+    }
+    if (config == NULL || config->recv_buffers == 0)
+    {
+        cfg->recv_buffers = IO_DEFAULT_RECV_BUFFERS;
+    }
+
+    if ((cfg->recv_buffers & (cfg->recv_buffers - 1)) != 0
+        || cfg->recv_buffers >= cfg->buffer_count || cfg->buffer_count > 0xFFFF)
+    {
+        fprintf(stderr, "Invalid I/O engine buffer configuration\n");
+        free(new_engine);
+        return IO_ERROR_CONFIG;
+    }
+
+    new_engine->epoll_fd = -1;
+#ifdef KUBOS_HAL_IO_URING
+    new_engine->ring_fd = -1;
+#endif
+
+    size_t pool_len = (size_t) cfg->buffer_count * cfg->buffer_size;
+    if (posix_memalign((void **) &new_engine->pool, 4096, pool_len) != 0)
+    {
+        new_engine->pool = NULL;
+        k_io_terminate(&new_engine);
+        return IO_ERROR;
+    }
+
+    new_engine->files    = calloc(cfg->max_files, sizeof(io_file));
+    new_engine->requests = calloc(cfg->queue_depth, sizeof(io_request));
+    new_engine->free_buffers
+        = malloc(sizeof(int) * (cfg->buffer_count - cfg->recv_buffers));
+    if (new_engine->files == NULL || new_engine->requests == NULL
+        || new_engine->free_buffers == NULL)
+    {
+        k_io_terminate(&new_engine);
+        return IO_ERROR;
+    }
+
+    for (uint32_t i = 0; i < cfg->max_files; i++)
+    {
+        new_engine->files[i].fd = -1;
+    }
+
+    /* Receive buffers come first; the rest are handed out by acquire */
+    for (int i = (int) cfg->buffer_count - 1; i >= (int) cfg->recv_buffers; i--)
+    {
+        new_engine->free_buffers[new_engine->free_count++] = i;
+    }
+
+    new_engine->backend = IO_BACKEND_EPOLL;
+#ifdef KUBOS_HAL_IO_URING
+    if (!cfg->force_epoll && kprv_io_uring_init(new_engine))
+    {
+        new_engine->backend = IO_BACKEND_URING;
+    }
+#endif
+
+    if (new_engine->backend == IO_BACKEND_EPOLL
+        && kprv_io_epoll_init(new_engine) != IO_OK)
+    {
+        k_io_terminate(&new_engine);
+        return IO_ERROR;
+    }
+
+    *engine = new_engine;
+
+    return IO_OK;
+}
+
+void k_io_terminate(k_io_engine ** engine)
+{
+    if (engine == NULL || *engine == NULL)
+    {
+        return;
+    }
+
+    k_io_engine * old = *engine;
+
+#ifdef KUBOS_HAL_IO_URING
+    /* Closing the ring cancels whatever is still in flight */
+    kprv_io_uring_teardown(old);
+#endif
+
+    if (old->epoll_fd >= 0)
+    {
+        close(old->epoll_fd);
+    }
+
+    free(old->pool);
+    free(old->free_buffers);
+    free(old->free_recv);
+    free(old->files);
+    free(old->requests);
+    free(old);
+
+    *engine = NULL;
+}
+
+KIOBackend k_io_backend(const k_io_engine * engine)
+{
+    return engine->backend;
+}
+
+KIOStatus k_io_register_file(k_io_engine * engine, int fd, int * slot)
+{
+    struct stat info;
+    int         index = -1;
+
+    if (engine == NULL || fd < 0 || slot == NULL || fstat(fd, &info) != 0)
+    {
+        return IO_ERROR_CONFIG;
+    }
+
+    for (uint32_t i = 0; i < engine->config.max_files; i++)
+    {
+        if (engine->files[i].fd < 0)
+        {
+            index = (int) i;
+            break;
+        }
+    }
+
+    if (index < 0)
+    {
+        return IO_ERROR_FULL;
+    }
+
+    io_file * file = &engine->files[index];
+
+    file->socket       = S_ISSOCK(info.st_mode);
+    file->always_ready = false;
+    file->events       = 0;
+
+#ifdef KUBOS_HAL_IO_URING
+    if (engine->backend == IO_BACKEND_URING)
+    {
+        struct io_uring_files_update update;
+
+        memset(&update, 0, sizeof(update));
+        update.offset = (uint32_t) index;
+        update.fds    = (uint64_t) (uintptr_t) &fd;
+
+        if (kprv_io_uring_register(engine->ring_fd,
+                                   IORING_REGISTER_FILES_UPDATE, &update, 1)
+            < 0)
+        {
+            perror("Failed to register file with io_uring");
+            return IO_ERROR;
+        }
+    }
+#endif
+
+    if (engine->backend == IO_BACKEND_EPOLL)
+    {
+        struct epoll_event ev;
+        int                flags = fcntl(fd, F_GETFL);
+
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        {
+            perror("Failed to make descriptor non-blocking");
+            return IO_ERROR;
+        }
+
+        ev.events   = 0;
+        ev.data.u32 = (uint32_t) index;
+        if (epoll_ctl(engine->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        {
+            if (errno != EPERM)
+            {
+                perror("Failed to add descriptor to epoll");
+                return IO_ERROR;
+            }
+
+            file->always_ready = true;
+        }
+    }
+
+    file->fd = fd;
+    *slot    = index;
+
+    return IO_OK;
+}
+
+KIOStatus k_io_unregister_file(k_io_engine * engine, int slot)
+{
+    if (engine == NULL || !kprv_io_valid_slot(engine, slot))
+    {
+        return IO_ERROR_CONFIG;
+    }
+
+    for (uint32_t i = 0; i < engine->config.queue_depth; i++)
+    {
+        if (engine->requests[i].used && engine->requests[i].slot == slot)
+        {
+            return IO_ERROR_CONFIG;
+        }
+    }
+
+    io_file * file = &engine->files[slot];
+
+#ifdef KUBOS_HAL_IO_URING
+    if (engine->backend == IO_BACKEND_URING)
+    {
+        struct io_uring_files_update update;
+        int                          none = -1;
+
+        memset(&update, 0, sizeof(update));
+        update.offset = (uint32_t) slot;
+        update.fds    = (uint64_t) (uintptr_t) &none;
+
+        kprv_io_uring_register(engine->ring_fd, IORING_REGISTER_FILES_UPDATE,
+                               &update, 1);
+    }
+#endif
+
+    if (engine->backend == IO_BACKEND_EPOLL && !file->always_ready)
+    {
+        epoll_ctl(engine->epoll_fd, EPOLL_CTL_DEL, file->fd, NULL);
+    }
+
+    file->fd = -1;
+
+    return IO_OK;
+}
+
+KIOStatus k_io_buffer_acquire(k_io_engine * engine, int * index, uint8_t ** data)
+{
+    if (engine == NULL || index == NULL)
+    {
+        return IO_ERROR_CONFIG;
+    }
+
+    if (engine->free_count == 0)
+    {
+        return IO_ERROR_FULL;
+    }
+
+    *index = engine->free_buffers[--engine->free_count];
+    if (data != NULL)
+    {
+        *data = kprv_io_buffer(engine, *index);
+    }
+
+    return IO_OK;
+}
+
+void k_io_buffer_release(k_io_engine * engine, int index)
+{
+    if (engine == NULL || index < 0
+        || (uint32_t) index >= engine->config.buffer_count)
+    {
+        return;
+    }
+
+    if (!kprv_io_is_recv_buffer(engine, index))
+    {
+        engine->free_buffers[engine->free_count++] = index;
+        return;
+    }
+
+#ifdef KUBOS_HAL_IO_URING
+    if (engine->backend == IO_BACKEND_URING)
+    {
+        kprv_io_uring_provide(engine, index);
+    }
+#endif
+    if (engine->backend == IO_BACKEND_EPOLL)
+    {
+        engine->free_recv[engine->free_recv_count++] = index;
+    }
+
+    /* Wake up any receive which stalled for lack of buffers */
+    for (uint32_t i = 0; i < engine->config.queue_depth; i++)
+    {
+        io_request * req = &engine->requests[i];
+        if (req->used && req->starved)
+        {
+            req->starved = false;
+#ifdef KUBOS_HAL_IO_URING
+            if (engine->backend == IO_BACKEND_URING)
+            {
+                kprv_io_uring_arm(engine, req);
+            }
+#endif
+        }
+    }
+}
+
+uint8_t * k_io_buffer_data(k_io_engine * engine, int index)
+{
+    if (engine == NULL || index < 0
+        || (uint32_t) index >= engine->config.buffer_count)
+    {
+        return NULL;
+    }
+
+    return kprv_io_buffer(engine, index);
+}
+
+static KIOStatus kprv_io_queue_rw(k_io_engine * engine, io_op op, int slot,
+                                  int buffer, uint32_t len, int64_t offset,
+                                  uint64_t user_data)
+{
+    if (engine == NULL || !kprv_io_valid_slot(engine, slot) || buffer < 0
+        || (uint32_t) buffer >= engine->config.buffer_count
+        || len > engine->config.buffer_size || offset < K_IO_OFFSET_CURRENT)
+    {
+        return IO_ERROR_CONFIG;
+    }
+
+    io_request * req = kprv_io_new_request(engine, op, slot, user_data);
+    if (req == NULL)
+    {
+        return IO_ERROR_FULL;
+    }
+
+    req->buffer = buffer;
+    req->len    = len;
+    req->offset = offset;
+
+#ifdef KUBOS_HAL_IO_URING
+    if (engine->backend == IO_BACKEND_URING)
+    {
+        KIOStatus status = kprv_io_uring_arm(engine, req);
+        if (status != IO_OK)
+        {
+            req->used = false;
+        }
+        return status;
+    }
+#endif
+
+    req->armed = true;
+
+    return IO_OK;
+}
+
+KIOStatus k_io_queue_read(k_io_engine * engine, int slot, int buffer,
+                          uint32_t len, int64_t offset, uint64_t user_data)
+{
+    return kprv_io_queue_rw(engine, IO_OP_READ, slot, buffer, len, offset,
+                            user_data);
+}
+
+KIOStatus k_io_queue_write(k_io_engine * engine, int slot, int buffer,
+                           uint32_t len, int64_t offset, uint64_t user_data)
+{
+    return kprv_io_queue_rw(engine, IO_OP_WRITE, slot, buffer, len, offset,
+                            user_data);
+}
+
+KIOStatus k_io_queue_recv(k_io_engine * engine, int slot, uint64_t user_data)
+{
+    if (engine == NULL || !kprv_io_valid_slot(engine, slot)
+        || engine->config.recv_buffers == 0)
+    {
+        return IO_ERROR_CONFIG;
+    }
+
+    io_request * req = kprv_io_new_request(engine, IO_OP_RECV, slot, user_data);
+    if (req == NULL)
+    {
+        return IO_ERROR_FULL;
+    }
+
+#ifdef KUBOS_HAL_IO_URING
+    if (engine->backend == IO_BACKEND_URING)
+    {
+        req->multishot   = engine->files[slot].socket;
+        KIOStatus status = kprv_io_uring_arm(engine, req);
+        if (status != IO_OK)
+        {
+            req->used = false;
+        }
+        return status;
+    }
+#endif
+
+    req->armed = true;
+
+    return IO_OK;
+}
+
+KIOStatus k_io_queue_cancel(k_io_engine * engine, uint64_t user_data)
+{
+    if (engine == NULL)
+    {
+        return IO_ERROR_CONFIG;
+    }
+
+    for (uint32_t i = 0; i < engine->config.queue_depth; i++)
+    {
+        io_request * req = &engine->requests[i];
+        if (!req->used || req->cancelled || req->user_data != user_data)
+        {
+            continue;
+        }
+
+        req->cancelled = true;
+
+#ifdef KUBOS_HAL_IO_URING
+        if (engine->backend == IO_BACKEND_URING && req->armed)
+        {
+            return kprv_io_uring_cancel(engine, req);
+        }
+#endif
+
+        /* Nothing in the kernel to cancel; finished on the next wait */
+        req->armed = false;
+
+        return IO_OK;
+    }
+
+    return IO_ERROR_CONFIG;
+}
+
+KIOStatus k_io_wait(k_io_engine * engine, k_io_completion * events, int max,
+                    int timeout_ms, int * count)
+{
+    if (engine == NULL || events == NULL || count == NULL || max < 2)
+    {
+        return IO_ERROR_CONFIG;
+    }
+
+    *count = 0;
+
+    /* Cancelled requests which never reached the kernel finish here */
+    for (uint32_t i = 0; i < engine->config.queue_depth && *count + 2 <= max;
+         i++)
+    {
+        io_request * req = &engine->requests[i];
+        if (req->used && req->cancelled && !req->armed)
+        {
+            kprv_io_finish(req, events, count, -ECANCELED);
+        }
+    }
+
+#ifdef KUBOS_HAL_IO_URING
+    if (engine->backend == IO_BACKEND_URING)
+    {
+        return kprv_io_uring_wait(engine, events, max, timeout_ms, count);
+    }
+#endif
+
+    return kprv_io_epoll_wait(engine, events, max, timeout_ms, count);
+}
@@ -0,0 +1,471 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "metrics.h"
+#include "clock.h"
+#include <pthread.h>
+#include <string.h>
+
+/* Bus addresses counted for a device (e.g. a radio's TX and RX sides) */
+#define METRICS_ATTACH_MAX (K_METRICS_DEVICES * 2)
+
+typedef struct {
+    int      bus;
+    uint16_t addr;
+    int      device;
+} metrics_attachment;
+
+static uint32_t           counts[K_METRICS_DEVICES][K_METRICS_COMMANDS][K_METRIC_EVENTS];
+static char               names[K_METRICS_DEVICES][K_METRICS_NAME_LEN];
+static metrics_attachment attachments[METRICS_ATTACH_MAX];
+
+/* Entries are filled in before the counts are raised, so readers need no lock */
+static int             device_count = 0;
+static int             attach_count = 0;
+static pthread_mutex_t metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Command each thread last sent each device */
+static __thread uint8_t current_command[K_METRICS_DEVICES];
+
+KMetricsStatus k_metrics_device(const char * name, int * device)
+{
+    KMetricsStatus status = METRICS_OK;
+    int            index;
+
+    if (name == NULL || name[0] == '\0' || device == NULL)
+    {
+        return METRICS_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&metrics_mutex);
+
+    for (index = 0; index < device_count; index++)
+    {
+        if (strncmp(names[index], name, K_METRICS_NAME_LEN - 1) == 0)
+        {
+            break;
+        }
+    }
+
+    if (index == device_count)
+    {
+        if (device_count == K_METRICS_DEVICES)
+        {
+            status = METRICS_ERROR_FULL;
+        }
+        else
+        {
+            strncpy(names[index], name, K_METRICS_NAME_LEN - 1);
+            __atomic_store_n(&device_count, index + 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    if (status == METRICS_OK)
+    {
+        *device = index;
+    }
+
+    pthread_mutex_unlock(&metrics_mutex);
+
+    return status;
+}
+
+KMetricsStatus k_metrics_attach(int device, int bus, uint16_t addr)
+{
+    KMetricsStatus status = METRICS_OK;
+    int            i;
+
+    pthread_mutex_lock(&metrics_mutex);
+
+    if (device < 0 || device >= device_count)
+    {
+        pthread_mutex_unlock(&metrics_mutex);
+        return METRICS_ERROR_CONFIG;
+    }
+
+    for (i = 0; i < attach_count; i++)
+    {
+        if (attachments[i].bus == bus && attachments[i].addr == addr)
+        {
+            __atomic_store_n(&attachments[i].device, device, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+
+    if (i == attach_count)
+    {
+        if (attach_count == METRICS_ATTACH_MAX)
+        {
+            status = METRICS_ERROR_FULL;
+        }
+        else
+        {
+            attachments[i].bus    = bus;
+            attachments[i].addr   = addr;
+            attachments[i].device = device;
+            __atomic_store_n(&attach_count, i + 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    pthread_mutex_unlock(&metrics_mutex);
+
+    return status;
+}
+
+void k_metrics_record(int device, uint8_t command, KMetricsEvent event)
+{
+    if ((unsigned) device >= K_METRICS_DEVICES
+        || (unsigned) event >= K_METRIC_EVENTS)
+    {
+        return;
+    }
+
+    __atomic_fetch_add(&counts[device][command][event], 1, __ATOMIC_RELAXED);
+}
+
+void kprv_metrics_transfer(int bus, uint16_t addr, const uint8_t * tx,
+                           KMetricsEvent event)
+{
+    int total = __atomic_load_n(&attach_count, __ATOMIC_ACQUIRE);
+
+    for (int i = 0; i < total; i++)
+    {
+        if (attachments[i].bus == bus && attachments[i].addr == addr)
+        {
+            int device = __atomic_load_n(&attachments[i].device, __ATOMIC_RELAXED);
+
+            if (tx != NULL)
+            {
+                current_command[device] = tx[0];
+            }
+
+            k_metrics_record(device, current_command[device], event);
+            return;
+        }
+    }
+}
+
+KMetricsStatus k_metrics_snapshot(k_metrics_table * table)
+{
+    if (table == NULL)
+    {
+        return METRICS_ERROR_CONFIG;
+    }
+
+    memset(table, 0, sizeof(*table));
+
+    table->time_ns = k_clock_now();
+    table->devices = __atomic_load_n(&device_count, __ATOMIC_ACQUIRE);
+    memcpy(table->names, names, sizeof(names[0]) * table->devices);
+
+    for (int device = 0; device < table->devices; device++)
+    {
+        for (int command = 0; command < K_METRICS_COMMANDS; command++)
+        {
+            for (int event = 0; event < K_METRIC_EVENTS; event++)
+            {
+                table->counts[device][command][event]
+                    = __atomic_load_n(&counts[device][command][event],
+                                      __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    return METRICS_OK;
+}
+
+/* Output cursor for encoding */
+typedef struct {
+    uint8_t * buffer;
+    size_t    size;
+    size_t    used;
+    bool      overflow;
+} metrics_writer;
+
+static void kprv_metrics_put(metrics_writer * out, uint8_t byte)
+{
+    if (out->used == out->size)
+    {
+        out->overflow = true;
+        return;
+    }
+
+    out->buffer[out->used++] = byte;
+}
+
+static void kprv_metrics_put_u64(metrics_writer * out, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+    {
+        kprv_metrics_put(out, (uint8_t) (value >> (8 * i)));
+    }
+}
+
+static void kprv_metrics_put_varint(metrics_writer * out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        kprv_metrics_put(out, (uint8_t) (value | 0x80));
+        value >>= 7;
+    }
+    kprv_metrics_put(out, (uint8_t) value);
+}
+
+/* Counts of one command, less the earlier table's if there is one */
+static uint8_t kprv_metrics_row(const k_metrics_table * now,
+                                const k_metrics_table * since, int device,
+                                int command, uint32_t row[K_METRIC_EVENTS])
+{
+    uint8_t mask = 0;
+
+    for (int event = 0; event < K_METRIC_EVENTS; event++)
+    {
+        row[event] = now->counts[device][command][event];
+        if (since != NULL && device < since->devices)
+        {
+            row[event] -= since->counts[device][command][event];
+        }
+        if (row[event] != 0)
+        {
+            mask |= (uint8_t) (1U << event);
+        }
+    }
+
+    return mask;
+}
+
+KMetricsStatus k_metrics_encode(const k_metrics_table * now,
+                                const k_metrics_table * since,
+                                uint8_t * buffer, size_t size, size_t * len)
+{
+    metrics_writer out = {.buffer = buffer, .size = size };
+    uint32_t       row[K_METRIC_EVENTS];
+    int            active[K_METRICS_DEVICES] = { 0 };
+    int            devices = 0;
+
+    if (now == NULL || buffer == NULL || len == NULL
+        || now->devices < 0 || now->devices > K_METRICS_DEVICES)
+    {
+        return METRICS_ERROR_CONFIG;
+    }
+
+    /* Leave out devices with nothing to report */
+    for (int device = 0; device < now->devices; device++)
+    {
+        for (int command = 0; command < K_METRICS_COMMANDS; command++)
+        {
+            if (kprv_metrics_row(now, since, device, command, row) != 0)
+            {
+                active[device]++;
+            }
+        }
+        if (active[device] != 0)
+        {
+            devices++;
+        }
+    }
+
+    kprv_metrics_put(&out, 'K');
+    kprv_metrics_put(&out, 'M');
+    kprv_metrics_put(&out, K_METRICS_VERSION);
+    kprv_metrics_put(&out, (since != NULL) ? 1 : 0);
+    kprv_metrics_put_u64(&out, now->time_ns);
+    kprv_metrics_put_u64(&out, (since != NULL) ? since->time_ns : 0);
+    kprv_metrics_put(&out, (uint8_t) devices);
+
+    for (int device = 0; device < now->devices; device++)
+    {
+        size_t name_len = strnlen(now->names[device], K_METRICS_NAME_LEN - 1);
+
+        if (active[device] == 0)
+        {
+            continue;
+        }
+
+        kprv_metrics_put(&out, (uint8_t) name_len);
+        for (size_t i = 0; i < name_len; i++)
+        {
+            kprv_metrics_put(&out, (uint8_t) now->names[device][i]);
+        }
+        kprv_metrics_put_varint(&out, (uint32_t) active[device]);
+
+        for (int command = 0; command < K_METRICS_COMMANDS; command++)
+        {
+            uint8_t mask = kprv_metrics_row(now, since, device, command, row);
+
+            if (mask == 0)
+            {
+                continue;
+            }
+
+            kprv_metrics_put(&out, (uint8_t) command);
+            kprv_metrics_put(&out, mask);
+            for (int event = 0; event < K_METRIC_EVENTS; event++)
+            {
+                if (mask & (1U << event))
+                {
+                    kprv_metrics_put_varint(&out, row[event]);
+                }
+            }
+        }
+    }
+
+    if (out.overflow)
+    {
+        return METRICS_ERROR_FULL;
+    }
+
+    *len = out.used;
+
+    return METRICS_OK;
+}
+
+/* Input cursor for decoding */
+typedef struct {
+    const uint8_t * buffer;
+    size_t          len;
+    size_t          used;
+    bool            bad;
+} metrics_reader;
+
+static uint8_t kprv_metrics_get(metrics_reader * in)
+{
+    if (in->used == in->len)
+    {
+        in->bad = true;
+        return 0;
+    }
+
+    return in->buffer[in->used++];
+}
+
+static uint64_t kprv_metrics_get_u64(metrics_reader * in)
+{
+    uint64_t value = 0;
+
+    for (int i = 0; i < 8; i++)
+    {
+        value |= (uint64_t) kprv_metrics_get(in) << (8 * i);
+    }
+
+    return value;
+}
+
+static uint32_t kprv_metrics_get_varint(metrics_reader * in)
+{
+    uint64_t value = 0;
+    uint8_t  byte;
+    int      shift = 0;
+
+    do
+    {
+        byte = kprv_metrics_get(in);
+        value |= (uint64_t) (byte & 0x7F) << shift;
+        shift += 7;
+    } while ((byte & 0x80) && shift < 35 && !in->bad);
+
+    if ((byte & 0x80) || value > UINT32_MAX)
+    {
+        in->bad = true;
+    }
+
+    return (uint32_t) value;
+}
+
+KMetricsStatus k_metrics_decode(const uint8_t * buffer, size_t len,
+                                k_metrics_header * header,
+                                k_metrics_row_fn fn, void * arg)
+{
+    metrics_reader   in = {.buffer = buffer, .len = len };
+    k_metrics_header head;
+    uint8_t          devices;
+
+    if (buffer == NULL)
+    {
+        return METRICS_ERROR_CONFIG;
+    }
+
+    if (kprv_metrics_get(&in) != 'K' || kprv_metrics_get(&in) != 'M')
+    {
+        return METRICS_ERROR;
+    }
+
+    head.version = kprv_metrics_get(&in);
+    head.delta = (kprv_metrics_get(&in) & 1) != 0;
+    head.time_ns = kprv_metrics_get_u64(&in);
+    head.since_ns = kprv_metrics_get_u64(&in);
+    devices = kprv_metrics_get(&in);
+
+    if (in.bad || head.version != K_METRICS_VERSION)
+    {
+        return METRICS_ERROR;
+    }
+
+    for (int device = 0; device < devices && !in.bad; device++)
+    {
+        char     name[K_METRICS_NAME_LEN] = { 0 };
+        uint8_t  name_len = kprv_metrics_get(&in);
+        uint32_t rows;
+
+        if (name_len >= K_METRICS_NAME_LEN)
+        {
+            return METRICS_ERROR;
+        }
+        for (int i = 0; i < name_len; i++)
+        {
+            name[i] = (char) kprv_metrics_get(&in);
+        }
+
+        rows = kprv_metrics_get_varint(&in);
+        if (rows > K_METRICS_COMMANDS)
+        {
+            return METRICS_ERROR;
+        }
+
+        for (uint32_t r = 0; r < rows && !in.bad; r++)
+        {
+            uint32_t row[K_METRIC_EVENTS] = { 0 };
+            uint8_t  command = kprv_metrics_get(&in);
+            uint8_t  mask = kprv_metrics_get(&in);
+
+            for (int event = 0; event < K_METRIC_EVENTS; event++)
+            {
+                if (mask & (1U << event))
+                {
+                    row[event] = kprv_metrics_get_varint(&in);
+                }
+            }
+
+            if (!in.bad && fn != NULL)
+            {
+                fn(arg, name, command, row);
+            }
+        }
+    }
+
+    if (in.bad || in.used != len)
+    {
+        return METRICS_ERROR;
+    }
+
+    if (header != NULL)
+    {
+        *header = head;
+    }
+
+    return METRICS_OK;
+}
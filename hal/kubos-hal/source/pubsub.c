@@ -0,0 +1,410 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Each topic is a ring of slots laid out as { sequence, length, data... }.
+ * Publishers take tickets from the topic's head; ticket t goes in slot
+ * t % capacity, whose sequence is 2t + 1 while it is being written and
+ * 2t + 2 once it is complete. Subscribers read the slot for their cursor
+ * and check the sequence before and after copying, so a slot overwritten
+ * mid-read is noticed and counted as lost rather than returned torn.
+ */
+
+#include "pubsub.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+
+#define SLOT_HEADER_WORDS 2
+
+typedef struct {
+    int fd;         /* eventfd, kept for the slot's next subscriber */
+    int active;
+    int armed;      /* Subscriber found the ring empty and wants waking */
+} subscriber;
+
+typedef struct {
+    char       name[K_PUBSUB_NAME_LEN];
+    uint32_t   size;
+    uint32_t   capacity;
+    size_t     stride;      /* Words per slot */
+    uint64_t * slots;
+    uint64_t   head;        /* Next ticket */
+    subscriber subs[K_PUBSUB_MAX_SUBSCRIBERS];
+} topic_record;
+
+static topic_record    topics[K_PUBSUB_MAX_TOPICS];
+static int             topic_count = 0;
+static pthread_mutex_t topics_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static topic_record * kprv_pubsub_get(int topic)
+{
+    if (topic < 0 || topic >= __atomic_load_n(&topic_count, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+
+    return &topics[topic];
+}
+
+static uint64_t * kprv_pubsub_slot(const topic_record * record,
+                                   uint64_t ticket)
+{
+    return record->slots + (ticket & (record->capacity - 1)) * record->stride;
+}
+
+static int kprv_pubsub_find(const char * name)
+{
+    for (int i = 0; i < topic_count; i++)
+    {
+        if (strncmp(topics[i].name, name, K_PUBSUB_NAME_LEN - 1) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+KPubSubStatus k_pubsub_topic(const char * name, uint32_t size,
+                             uint32_t capacity, uint64_t * storage,
+                             size_t words, int * topic)
+{
+    if (name == NULL || name[0] == '\0' || size == 0 || topic == NULL)
+    {
+        return PUBSUB_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&topics_mutex);
+
+    int id = kprv_pubsub_find(name);
+    if (id >= 0)
+    {
+        pthread_mutex_unlock(&topics_mutex);
+        if (topics[id].size != size)
+        {
+            fprintf(stderr, "Topic %s already has %u byte messages\n", name,
+                    topics[id].size);
+            return PUBSUB_ERROR_CONFIG;
+        }
+        *topic = id;
+        return PUBSUB_OK;
+    }
+
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0 || storage == NULL
+        || words < K_PUBSUB_STORAGE(size, capacity))
+    {
+        pthread_mutex_unlock(&topics_mutex);
+        return PUBSUB_ERROR_CONFIG;
+    }
+
+    if (topic_count == K_PUBSUB_MAX_TOPICS)
+    {
+        pthread_mutex_unlock(&topics_mutex);
+        fprintf(stderr, "No room for topic %s\n", name);
+        return PUBSUB_ERROR_FULL;
+    }
+
+    topic_record * record = &topics[topic_count];
+
+    memset(record, 0, sizeof(*record));
+    snprintf(record->name, sizeof(record->name), "%s", name);
+    record->size     = size;
+    record->capacity = capacity;
+    record->stride   = K_PUBSUB_STORAGE(size, 1);
+    record->slots    = storage;
+    memset(storage, 0, K_PUBSUB_STORAGE(size, capacity) * sizeof(uint64_t));
+    for (int i = 0; i < K_PUBSUB_MAX_SUBSCRIBERS; i++)
+    {
+        record->subs[i].fd = -1;
+    }
+
+    *topic = topic_count;
+
+    /* Publishers look records up without the mutex */
+    __atomic_store_n(&topic_count, topic_count + 1, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&topics_mutex);
+
+    return PUBSUB_OK;
+}
+
+KPubSubStatus k_pubsub_find(const char * name, int * topic)
+{
+    if (name == NULL || topic == NULL)
+    {
+        return PUBSUB_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&topics_mutex);
+    int id = kprv_pubsub_find(name);
+    pthread_mutex_unlock(&topics_mutex);
+
+    if (id < 0)
+    {
+        return PUBSUB_ERROR;
+    }
+
+    *topic = id;
+
+    return PUBSUB_OK;
+}
+
+KPubSubStatus k_pubsub_publish(int topic, const void * data, uint32_t len)
+{
+    topic_record * record = kprv_pubsub_get(topic);
+
+    if (record == NULL || (data == NULL && len > 0) || len > record->size)
+    {
+        return PUBSUB_ERROR_CONFIG;
+    }
+
+    uint64_t   ticket = __atomic_fetch_add(&record->head, 1, __ATOMIC_RELAXED);
+    uint64_t * slot   = kprv_pubsub_slot(record, ticket);
+    uint64_t   busy   = ticket * 2 + 1;
+    uint64_t   seq    = __atomic_load_n(&slot[0], __ATOMIC_RELAXED);
+
+    while (1)
+    {
+        if (seq >= busy)
+        {
+            /*
+             * A publisher a whole ring ahead already has this slot, so this
+             * message is one every subscriber would have lost anyway
+             */
+            return PUBSUB_OK;
+        }
+
+        if (seq & 1)
+        {
+            /* A publisher a ring behind is still copying in */
+            sched_yield();
+            seq = __atomic_load_n(&slot[0], __ATOMIC_RELAXED);
+            continue;
+        }
+
+        if (__atomic_compare_exchange_n(&slot[0], &seq, busy, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+    }
+
+    __atomic_store_n(&slot[1], len, __ATOMIC_RELAXED);
+    memcpy(&slot[SLOT_HEADER_WORDS], data, len);
+    __atomic_store_n(&slot[0], busy + 1, __ATOMIC_SEQ_CST);
+
+    for (int i = 0; i < K_PUBSUB_MAX_SUBSCRIBERS; i++)
+    {
+        subscriber * sub = &record->subs[i];
+
+        if (__atomic_load_n(&sub->armed, __ATOMIC_SEQ_CST)
+            && __atomic_exchange_n(&sub->armed, 0, __ATOMIC_ACQ_REL))
+        {
+            /* Only fails if the counter is saturated, i.e. already readable */
+            eventfd_write(__atomic_load_n(&sub->fd, __ATOMIC_RELAXED), 1);
+        }
+    }
+
+    return PUBSUB_OK;
+}
+
+KPubSubStatus k_pubsub_subscribe(int topic, k_pubsub_sub * sub)
+{
+    topic_record * record = kprv_pubsub_get(topic);
+
+    if (record == NULL || sub == NULL)
+    {
+        return PUBSUB_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&topics_mutex);
+
+    int index;
+    for (index = 0; index < K_PUBSUB_MAX_SUBSCRIBERS; index++)
+    {
+        if (!record->subs[index].active)
+        {
+            break;
+        }
+    }
+
+    if (index == K_PUBSUB_MAX_SUBSCRIBERS)
+    {
+        pthread_mutex_unlock(&topics_mutex);
+        fprintf(stderr, "No room for another subscriber to topic %s\n",
+                record->name);
+        return PUBSUB_ERROR_FULL;
+    }
+
+    subscriber * slot = &record->subs[index];
+
+    /*
+     * Descriptors are never closed, so a publisher racing an unsubscribe
+     * can at worst wake the slot's next subscriber spuriously
+     */
+    if (slot->fd < 0)
+    {
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0)
+        {
+            pthread_mutex_unlock(&topics_mutex);
+            perror("Failed to create subscriber eventfd");
+            return PUBSUB_ERROR;
+        }
+        __atomic_store_n(&slot->fd, fd, __ATOMIC_RELEASE);
+    }
+
+    slot->active = 1;
+    __atomic_store_n(&slot->armed, 0, __ATOMIC_RELAXED);
+
+    sub->topic  = topic;
+    sub->index  = index;
+    sub->fd     = slot->fd;
+    sub->cursor = __atomic_load_n(&record->head, __ATOMIC_ACQUIRE);
+
+    pthread_mutex_unlock(&topics_mutex);
+
+    return PUBSUB_OK;
+}
+
+void k_pubsub_unsubscribe(k_pubsub_sub * sub)
+{
+    topic_record * record;
+    eventfd_t      count;
+
+    if (sub == NULL || (record = kprv_pubsub_get(sub->topic)) == NULL
+        || sub->index < 0 || sub->index >= K_PUBSUB_MAX_SUBSCRIBERS)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&topics_mutex);
+
+    subscriber * slot = &record->subs[sub->index];
+
+    __atomic_store_n(&slot->armed, 0, __ATOMIC_RELAXED);
+    slot->active = 0;
+    eventfd_read(slot->fd, &count);
+
+    pthread_mutex_unlock(&topics_mutex);
+
+    sub->topic = -1;
+    sub->index = -1;
+    sub->fd    = -1;
+}
+
+KPubSubStatus k_pubsub_read(k_pubsub_sub * sub, void * data, uint32_t * len,
+                            uint32_t * lost)
+{
+    topic_record * record;
+
+    if (sub == NULL || data == NULL
+        || (record = kprv_pubsub_get(sub->topic)) == NULL
+        || sub->index < 0 || sub->index >= K_PUBSUB_MAX_SUBSCRIBERS)
+    {
+        return PUBSUB_ERROR_CONFIG;
+    }
+
+    subscriber * waker   = &record->subs[sub->index];
+    uint64_t     skipped = 0;
+    bool         armed   = false;
+
+    if (lost != NULL)
+    {
+        *lost = 0;
+    }
+
+    while (1)
+    {
+        uint64_t * slot = kprv_pubsub_slot(record, sub->cursor);
+        uint64_t   want = sub->cursor * 2 + 2;
+        uint64_t   seq  = __atomic_load_n(&slot[0], __ATOMIC_SEQ_CST);
+
+        if (seq < want)
+        {
+            if (armed)
+            {
+                break;
+            }
+
+            /*
+             * Drain stale wakeups, ask for the next one, then look again
+             * in case a publish landed in between
+             */
+            eventfd_t count;
+            eventfd_read(waker->fd, &count);
+            __atomic_store_n(&waker->armed, 1, __ATOMIC_SEQ_CST);
+            armed = true;
+            continue;
+        }
+
+        if (seq == want)
+        {
+            uint32_t size = (uint32_t) __atomic_load_n(&slot[1],
+                                                       __ATOMIC_RELAXED);
+            if (size > record->size)
+            {
+                size = record->size;
+            }
+
+            memcpy(data, &slot[SLOT_HEADER_WORDS], size);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+            if (__atomic_load_n(&slot[0], __ATOMIC_RELAXED) == seq)
+            {
+                sub->cursor++;
+                if (len != NULL)
+                {
+                    *len = size;
+                }
+                if (lost != NULL)
+                {
+                    *lost = (uint32_t) skipped;
+                }
+                return PUBSUB_OK;
+            }
+            /* Overwritten while copying: fall behind like below */
+        }
+
+        /* Lapped: jump to the oldest message still in the ring */
+        uint64_t head   = __atomic_load_n(&record->head, __ATOMIC_ACQUIRE);
+        uint64_t oldest = head > record->capacity ? head - record->capacity : 0;
+
+        if (oldest <= sub->cursor)
+        {
+            oldest = sub->cursor + 1;
+        }
+        skipped += oldest - sub->cursor;
+        sub->cursor = oldest;
+    }
+
+    if (lost != NULL)
+    {
+        *lost = (uint32_t) skipped;
+    }
+
+    return PUBSUB_EMPTY;
+}
+
+int k_pubsub_fd(const k_pubsub_sub * sub)
+{
+    return (sub != NULL) ? sub->fd : -1;
+}
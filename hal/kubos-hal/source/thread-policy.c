@@ -0,0 +1,537 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include "thread-policy.h"
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+typedef struct {
+    char            name[K_THREAD_POLICY_NAME_LEN];
+    k_thread_policy policy;
+} policy_entry;
+
+/* Arguments handed to a new thread, which names itself */
+typedef struct {
+    char name[K_THREAD_POLICY_NAME_LEN];
+    void * (*start)(void *);
+    void * arg;
+} thread_start;
+
+static policy_entry    entries[K_THREAD_POLICY_MAX];
+static int             entry_count = 0;
+static k_thread_policy default_policy;
+static bool            memory_locked = false;
+static pthread_mutex_t entries_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  env_once = PTHREAD_ONCE_INIT;
+
+static KThreadPolicyStatus kprv_thread_policy_parse(const char * spec);
+
+static void kprv_thread_policy_env(void)
+{
+    const char * spec = getenv(K_THREAD_POLICY_ENV);
+
+    if (spec != NULL && kprv_thread_policy_parse(spec) != THREAD_POLICY_OK)
+    {
+        fprintf(stderr, "Ignoring bad %s: %s\n", K_THREAD_POLICY_ENV, spec);
+    }
+}
+
+static bool kprv_thread_policy_valid(const k_thread_policy * policy)
+{
+    switch (policy->sched)
+    {
+        case THREAD_SCHED_INHERIT:
+        case THREAD_SCHED_OTHER:
+            return true;
+        case THREAD_SCHED_FIFO:
+        case THREAD_SCHED_RR:
+            return policy->priority >= sched_get_priority_min(SCHED_FIFO)
+                   && policy->priority <= sched_get_priority_max(SCHED_FIFO);
+        default:
+            return false;
+    }
+}
+
+/* Named entry, or NULL. Caller must hold entries_mutex. */
+static policy_entry * kprv_thread_policy_find(const char * name)
+{
+    for (int i = 0; i < entry_count; i++)
+    {
+        if (strncmp(entries[i].name, name, K_THREAD_POLICY_NAME_LEN - 1) == 0)
+        {
+            return &entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Caller must hold entries_mutex */
+static KThreadPolicyStatus kprv_thread_policy_set(const char * name,
+                                                  const k_thread_policy * policy)
+{
+    policy_entry * entry;
+
+    if (name == NULL)
+    {
+        if (policy == NULL)
+        {
+            memset(&default_policy, 0, sizeof(default_policy));
+        }
+        else
+        {
+            default_policy = *policy;
+        }
+        return THREAD_POLICY_OK;
+    }
+
+    entry = kprv_thread_policy_find(name);
+
+    if (policy == NULL)
+    {
+        if (entry != NULL)
+        {
+            *entry = entries[--entry_count];
+        }
+        return THREAD_POLICY_OK;
+    }
+
+    if (entry == NULL)
+    {
+        if (entry_count == K_THREAD_POLICY_MAX)
+        {
+            return THREAD_POLICY_ERROR_FULL;
+        }
+        entry = &entries[entry_count++];
+        memset(entry, 0, sizeof(*entry));
+        strncpy(entry->name, name, K_THREAD_POLICY_NAME_LEN - 1);
+    }
+
+    entry->policy = *policy;
+
+    return THREAD_POLICY_OK;
+}
+
+KThreadPolicyStatus k_thread_policy_set(const char * name,
+                                        const k_thread_policy * policy)
+{
+    KThreadPolicyStatus status;
+
+    if ((name != NULL && name[0] == '\0')
+        || (policy != NULL && !kprv_thread_policy_valid(policy)))
+    {
+        return THREAD_POLICY_ERROR_CONFIG;
+    }
+
+    pthread_once(&env_once, kprv_thread_policy_env);
+
+    pthread_mutex_lock(&entries_mutex);
+    status = kprv_thread_policy_set(name, policy);
+    pthread_mutex_unlock(&entries_mutex);
+
+    return status;
+}
+
+KThreadPolicyStatus k_thread_policy_get(const char * name,
+                                        k_thread_policy * policy)
+{
+    policy_entry * entry = NULL;
+
+    if (policy == NULL)
+    {
+        return THREAD_POLICY_ERROR_CONFIG;
+    }
+
+    pthread_once(&env_once, kprv_thread_policy_env);
+
+    pthread_mutex_lock(&entries_mutex);
+    if (name != NULL)
+    {
+        entry = kprv_thread_policy_find(name);
+    }
+    *policy = (entry != NULL) ? entry->policy : default_policy;
+    pthread_mutex_unlock(&entries_mutex);
+
+    return THREAD_POLICY_OK;
+}
+
+static bool kprv_thread_policy_number(const char * text, uint64_t max,
+                                      uint64_t * value)
+{
+    char *             end;
+    unsigned long long parsed;
+
+    if (text == NULL || *text == '\0' || *text == '-')
+    {
+        return false;
+    }
+
+    errno = 0;
+    parsed = strtoull(text, &end, 0);
+    if (errno != 0 || *end != '\0' || parsed > max)
+    {
+        return false;
+    }
+
+    *value = parsed;
+    return true;
+}
+
+/* Apply one `key[=value]` setting to a policy */
+static bool kprv_thread_policy_setting(char * setting, k_thread_policy * policy)
+{
+    char *   value = strchr(setting, '=');
+    uint64_t number;
+
+    if (value != NULL)
+    {
+        *value++ = '\0';
+    }
+
+    if (strcmp(setting, "stack") == 0)
+    {
+        if (!kprv_thread_policy_number(value, UINT32_MAX / 1024, &number))
+        {
+            return false;
+        }
+        policy->stack_kb = (uint32_t) number;
+    }
+    else if (strcmp(setting, "sched") == 0)
+    {
+        if (value == NULL)
+        {
+            return false;
+        }
+        else if (strcmp(value, "inherit") == 0)
+        {
+            policy->sched = THREAD_SCHED_INHERIT;
+        }
+        else if (strcmp(value, "other") == 0)
+        {
+            policy->sched = THREAD_SCHED_OTHER;
+        }
+        else if (strcmp(value, "fifo") == 0)
+        {
+            policy->sched = THREAD_SCHED_FIFO;
+        }
+        else if (strcmp(value, "rr") == 0)
+        {
+            policy->sched = THREAD_SCHED_RR;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    else if (strcmp(setting, "priority") == 0)
+    {
+        if (!kprv_thread_policy_number(value, INT_MAX, &number))
+        {
+            return false;
+        }
+        policy->priority = (int) number;
+    }
+    else if (strcmp(setting, "cpus") == 0)
+    {
+        if (!kprv_thread_policy_number(value, UINT64_MAX, &number))
+        {
+            return false;
+        }
+        policy->cpu_mask = number;
+    }
+    else if (strcmp(setting, "mlock") == 0)
+    {
+        if (value == NULL)
+        {
+            policy->mlock = true;
+        }
+        else if (kprv_thread_policy_number(value, 1, &number))
+        {
+            policy->mlock = (number == 1);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+static KThreadPolicyStatus kprv_thread_policy_parse(const char * spec)
+{
+    policy_entry        parsed[K_THREAD_POLICY_MAX + 1];
+    int                 count = 0;
+    char *              copy;
+    char *              entry_save;
+    char *              text;
+    KThreadPolicyStatus status = THREAD_POLICY_OK;
+
+    copy = strdup(spec);
+    if (copy == NULL)
+    {
+        return THREAD_POLICY_ERROR;
+    }
+
+    /* Check the whole spec before changing anything */
+    for (text = strtok_r(copy, ";", &entry_save); text != NULL;
+         text = strtok_r(NULL, ";", &entry_save))
+    {
+        char * settings = strchr(text, ':');
+        char * setting_save;
+        char * setting;
+
+        if (settings == NULL || settings == text
+            || settings - text >= K_THREAD_POLICY_NAME_LEN)
+        {
+            status = THREAD_POLICY_ERROR_CONFIG;
+            break;
+        }
+        if (count == K_THREAD_POLICY_MAX + 1)
+        {
+            status = THREAD_POLICY_ERROR_FULL;
+            break;
+        }
+        *settings++ = '\0';
+
+        memset(&parsed[count], 0, sizeof(parsed[count]));
+        strcpy(parsed[count].name, text);
+
+        for (setting = strtok_r(settings, ",", &setting_save);
+             setting != NULL && status == THREAD_POLICY_OK;
+             setting = strtok_r(NULL, ",", &setting_save))
+        {
+            if (!kprv_thread_policy_setting(setting, &parsed[count].policy))
+            {
+                status = THREAD_POLICY_ERROR_CONFIG;
+            }
+        }
+
+        if (status != THREAD_POLICY_OK)
+        {
+            break;
+        }
+        if (!kprv_thread_policy_valid(&parsed[count].policy))
+        {
+            status = THREAD_POLICY_ERROR_CONFIG;
+            break;
+        }
+        count++;
+    }
+
+    free(copy);
+
+    if (status != THREAD_POLICY_OK)
+    {
+        return status;
+    }
+
+    pthread_mutex_lock(&entries_mutex);
+    for (int i = 0; i < count && status == THREAD_POLICY_OK; i++)
+    {
+        const char * name = parsed[i].name;
+
+        status = kprv_thread_policy_set(
+            strcmp(name, "default") == 0 ? NULL : name, &parsed[i].policy);
+    }
+    pthread_mutex_unlock(&entries_mutex);
+
+    return status;
+}
+
+KThreadPolicyStatus k_thread_policy_parse(const char * spec)
+{
+    if (spec == NULL)
+    {
+        return THREAD_POLICY_ERROR_CONFIG;
+    }
+
+    pthread_once(&env_once, kprv_thread_policy_env);
+
+    return kprv_thread_policy_parse(spec);
+}
+
+static void * kprv_thread_policy_start(void * data)
+{
+    thread_start start = *(thread_start *) data;
+
+    free(data);
+    pthread_setname_np(pthread_self(), start.name);
+
+    return start.start(start.arg);
+}
+
+/* Stack size in bytes: at least PTHREAD_STACK_MIN, rounded up to a page */
+static size_t kprv_thread_policy_stack(uint32_t stack_kb)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t size = (size_t)(stack_kb ? stack_kb : K_THREAD_POLICY_STACK_KB) * 1024;
+
+    if (size < (size_t) PTHREAD_STACK_MIN)
+    {
+        size = (size_t) PTHREAD_STACK_MIN;
+    }
+
+    return (size + page - 1) / page * page;
+}
+
+/* Thread attributes for a policy. With `full` unset, only the stack size. */
+static void kprv_thread_policy_attr(pthread_attr_t * attr,
+                                    const k_thread_policy * policy,
+                                    bool detached, bool full)
+{
+    pthread_attr_init(attr);
+    pthread_attr_setstacksize(attr, kprv_thread_policy_stack(policy->stack_kb));
+
+    if (detached)
+    {
+        pthread_attr_setdetachstate(attr, PTHREAD_CREATE_DETACHED);
+    }
+
+    if (!full)
+    {
+        return;
+    }
+
+    if (policy->sched != THREAD_SCHED_INHERIT)
+    {
+        struct sched_param param = { 0 };
+        int                sched = SCHED_OTHER;
+
+        if (policy->sched == THREAD_SCHED_FIFO)
+        {
+            sched = SCHED_FIFO;
+            param.sched_priority = policy->priority;
+        }
+        else if (policy->sched == THREAD_SCHED_RR)
+        {
+            sched = SCHED_RR;
+            param.sched_priority = policy->priority;
+        }
+
+        pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(attr, sched);
+        pthread_attr_setschedparam(attr, &param);
+    }
+
+    if (policy->cpu_mask != 0)
+    {
+        cpu_set_t cpus;
+
+        CPU_ZERO(&cpus);
+        for (int cpu = 0; cpu < 64; cpu++)
+        {
+            if (policy->cpu_mask & (1ULL << cpu))
+            {
+                CPU_SET(cpu, &cpus);
+            }
+        }
+        pthread_attr_setaffinity_np(attr, sizeof(cpus), &cpus);
+    }
+}
+
+static void kprv_thread_policy_mlock(void)
+{
+    bool lock;
+
+    pthread_mutex_lock(&entries_mutex);
+    lock = !memory_locked;
+    memory_locked = true;
+    pthread_mutex_unlock(&entries_mutex);
+
+    /* Small thread stacks keep what this pins down small too */
+    if (lock && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        perror("Warning: failed to lock memory for real-time threads");
+    }
+}
+
+KThreadPolicyStatus k_thread_create(const char * name, pthread_t * thread,
+                                    void * (*start)(void *), void * arg)
+{
+    k_thread_policy policy;
+    pthread_attr_t  attr;
+    pthread_t       handle;
+    thread_start *  data;
+    int             ret;
+
+    if (name == NULL || name[0] == '\0' || start == NULL)
+    {
+        errno = EINVAL;
+        return THREAD_POLICY_ERROR_CONFIG;
+    }
+
+    k_thread_policy_get(name, &policy);
+
+    if (policy.mlock)
+    {
+        kprv_thread_policy_mlock();
+    }
+
+    data = malloc(sizeof(*data));
+    if (data == NULL)
+    {
+        return THREAD_POLICY_ERROR;
+    }
+    memset(data->name, 0, sizeof(data->name));
+    strncpy(data->name, name, K_THREAD_POLICY_NAME_LEN - 1);
+    data->start = start;
+    data->arg = arg;
+
+    kprv_thread_policy_attr(&attr, &policy, thread == NULL, true);
+    ret = pthread_create(&handle, &attr, kprv_thread_policy_start, data);
+    pthread_attr_destroy(&attr);
+
+    if ((ret == EPERM || ret == EINVAL)
+        && (policy.sched != THREAD_SCHED_INHERIT || policy.cpu_mask != 0))
+    {
+        fprintf(stderr,
+                "Warning: can't apply scheduling policy to %s (%s), "
+                "starting it with inherited scheduling\n",
+                data->name, strerror(ret));
+
+        kprv_thread_policy_attr(&attr, &policy, thread == NULL, false);
+        ret = pthread_create(&handle, &attr, kprv_thread_policy_start, data);
+        pthread_attr_destroy(&attr);
+    }
+
+    if (ret != 0)
+    {
+        free(data);
+        errno = ret;
+        return THREAD_POLICY_ERROR;
+    }
+
+    if (thread != NULL)
+    {
+        *thread = handle;
+    }
+
+    return THREAD_POLICY_OK;
+}
@@ -0,0 +1,252 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "thread-stats.h"
+#include "clock.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    k_thread_stats  stats;
+    clockid_t       clock;       /* CPU clock of the registered thread */
+    uint64_t        cpu_base_ns; /* CPU time carried over from earlier runs */
+    uint64_t        last_wakeup;
+    bool            woken;       /* last_wakeup is valid for this run */
+} thread_record;
+
+static thread_record   records[K_THREAD_STATS_MAX];
+static int             record_count = 0;
+static pthread_mutex_t records_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Record of the calling thread, or NULL if it isn't registered */
+static __thread thread_record * self = NULL;
+
+static uint64_t kprv_thread_stats_ns(const struct timespec * ts)
+{
+    return (uint64_t) ts->tv_sec * 1000000000ULL + (uint64_t) ts->tv_nsec;
+}
+
+/* CPU time of the record's thread. Caller must hold records_mutex. */
+static uint64_t kprv_thread_stats_cpu(const thread_record * record)
+{
+    struct timespec ts;
+
+    if (!record->stats.active || clock_gettime(record->clock, &ts) != 0)
+    {
+        return record->cpu_base_ns;
+    }
+
+    return record->cpu_base_ns + kprv_thread_stats_ns(&ts);
+}
+
+KThreadStatsStatus k_thread_stats_register(const char * name, uint32_t period_ms)
+{
+    thread_record * record = NULL;
+    clockid_t       clock;
+
+    if (name == NULL || name[0] == '\0' || self != NULL)
+    {
+        return THREAD_STATS_ERROR_CONFIG;
+    }
+
+    if (pthread_getcpuclockid(pthread_self(), &clock) != 0)
+    {
+        perror("Failed to get thread CPU clock");
+        return THREAD_STATS_ERROR;
+    }
+
+    pthread_mutex_lock(&records_mutex);
+
+    for (int i = 0; i < record_count; i++)
+    {
+        if (strncmp(records[i].stats.name, name, K_THREAD_STATS_NAME_LEN - 1) == 0)
+        {
+            record = &records[i];
+            break;
+        }
+    }
+
+    if (record != NULL && record->stats.active)
+    {
+        pthread_mutex_unlock(&records_mutex);
+        fprintf(stderr, "Thread '%s' is already registered\n", name);
+        return THREAD_STATS_ERROR_CONFIG;
+    }
+
+    if (record == NULL)
+    {
+        if (record_count == K_THREAD_STATS_MAX)
+        {
+            pthread_mutex_unlock(&records_mutex);
+            fprintf(stderr, "No room to register thread '%s'\n", name);
+            return THREAD_STATS_ERROR_FULL;
+        }
+
+        record = &records[record_count++];
+        memset(record, 0, sizeof(*record));
+        strncpy(record->stats.name, name, K_THREAD_STATS_NAME_LEN - 1);
+    }
+
+    /* Previous runs' CPU time is already folded into cpu_base_ns */
+    record->clock               = clock;
+    record->stats.active        = true;
+    record->stats.period_ms     = period_ms;
+    record->woken               = false;
+
+    pthread_mutex_unlock(&records_mutex);
+
+    self = record;
+
+    return THREAD_STATS_OK;
+}
+
+void k_thread_stats_unregister(void * arg)
+{
+    (void) arg;
+
+    if (self == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&records_mutex);
+
+    self->cpu_base_ns  = kprv_thread_stats_cpu(self);
+    self->stats.active = false;
+
+    pthread_mutex_unlock(&records_mutex);
+
+    self = NULL;
+}
+
+void k_thread_stats_wakeup(void)
+{
+    uint64_t now;
+
+    if (self == NULL)
+    {
+        return;
+    }
+
+    now = k_clock_now();
+
+    pthread_mutex_lock(&records_mutex);
+
+    self->stats.wakeups++;
+
+    if (self->stats.period_ms != 0 && self->woken)
+    {
+        uint64_t due = self->last_wakeup
+                       + (uint64_t) self->stats.period_ms * 1000000ULL;
+        uint64_t actual = now;
+
+        if (actual > due)
+        {
+            uint64_t lateness = actual - due;
+
+            if (lateness > self->stats.max_lateness_ns)
+            {
+                self->stats.max_lateness_ns = lateness;
+            }
+
+            if (lateness > (uint64_t) K_THREAD_STATS_SLACK_MS * 1000000ULL)
+            {
+                self->stats.missed_deadlines++;
+            }
+        }
+    }
+
+    self->last_wakeup = now;
+    self->woken       = true;
+
+    pthread_mutex_unlock(&records_mutex);
+}
+
+void k_thread_stats_period(uint32_t period_ms)
+{
+    if (self == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&records_mutex);
+    self->stats.period_ms = period_ms;
+    pthread_mutex_unlock(&records_mutex);
+}
+
+KThreadStatsStatus k_thread_stats_snapshot(k_thread_stats * buffer, int max,
+                                           int * count)
+{
+    if (buffer == NULL || count == NULL || max < 0)
+    {
+        return THREAD_STATS_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&records_mutex);
+
+    int total = (record_count < max) ? record_count : max;
+
+    for (int i = 0; i < total; i++)
+    {
+        buffer[i]        = records[i].stats;
+        buffer[i].cpu_ns = kprv_thread_stats_cpu(&records[i]);
+    }
+
+    pthread_mutex_unlock(&records_mutex);
+
+    *count = total;
+
+    return THREAD_STATS_OK;
+}
+
+bool kprv_thread_stats_tracked(void)
+{
+    return self != NULL;
+}
+
+void kprv_thread_stats_bus(uint64_t elapsed_ns)
+{
+    if (self == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&records_mutex);
+
+    self->stats.bus_transfers++;
+    self->stats.bus_ns += elapsed_ns;
+
+    pthread_mutex_unlock(&records_mutex);
+}
+
+uint64_t kprv_thread_stats_bus_ns(void)
+{
+    uint64_t bus_ns;
+
+    if (self == NULL)
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&records_mutex);
+    bus_ns = self->stats.bus_ns;
+    pthread_mutex_unlock(&records_mutex);
+
+    return bus_ns;
+}
@@ -0,0 +1,236 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "watchdog.h"
+#include "clock.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MS 1000000ULL
+
+/*
+ * The I2C write path reads `active`, `bus`, `addr`, `implicit` and
+ * `timeout_ns` without the mutex, so they're only changed with atomics
+ */
+typedef struct {
+    k_wdt_stats stats;
+    bool        active;
+    int         bus;
+    uint16_t    addr;
+    bool        implicit;
+    uint64_t    timeout_ns;
+    uint64_t    margin_ns;
+    uint64_t    expires_ns;     /* 0 until known */
+} wdt_record;
+
+static wdt_record      records[K_WDT_MAX];
+static int             record_count = 0;
+static pthread_mutex_t records_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static wdt_record * kprv_wdt_get(int wdt)
+{
+    if (wdt < 0 || wdt >= __atomic_load_n(&record_count, __ATOMIC_ACQUIRE))
+    {
+        return NULL;
+    }
+
+    return &records[wdt];
+}
+
+static void kprv_wdt_expires(wdt_record * record, uint64_t expires_ns)
+{
+    __atomic_store_n(&record->expires_ns, expires_ns, __ATOMIC_RELEASE);
+}
+
+KWDTStatus k_wdt_attach(const char * name, int bus, uint16_t addr,
+                        const k_wdt_config * config, int * wdt)
+{
+    wdt_record * record = NULL;
+
+    if (name == NULL || config == NULL || wdt == NULL
+        || config->timeout_ms == 0 || config->margin_ms >= config->timeout_ms)
+    {
+        return WDT_ERROR_CONFIG;
+    }
+
+    pthread_mutex_lock(&records_mutex);
+
+    for (int i = 0; i < record_count; i++)
+    {
+        if (strncmp(records[i].stats.name, name, K_WDT_NAME_LEN - 1) == 0)
+        {
+            record = &records[i];
+            break;
+        }
+    }
+
+    if (record == NULL)
+    {
+        if (record_count == K_WDT_MAX)
+        {
+            pthread_mutex_unlock(&records_mutex);
+            return WDT_ERROR_FULL;
+        }
+
+        record = &records[record_count];
+        memset(record, 0, sizeof(*record));
+        snprintf(record->stats.name, sizeof(record->stats.name), "%s", name);
+        __atomic_store_n(&record_count, record_count + 1, __ATOMIC_RELEASE);
+    }
+
+    /* Hide the record from the write path while it changes */
+    __atomic_store_n(&record->active, false, __ATOMIC_RELEASE);
+    record->bus = bus;
+    record->addr = addr;
+    record->implicit = config->implicit;
+    record->timeout_ns = (uint64_t) config->timeout_ms * MS;
+    record->margin_ns = (uint64_t) config->margin_ms * MS;
+    kprv_wdt_expires(record, 0);
+    record->stats.active = true;
+    __atomic_store_n(&record->active, true, __ATOMIC_RELEASE);
+
+    *wdt = record - records;
+
+    pthread_mutex_unlock(&records_mutex);
+
+    return WDT_OK;
+}
+
+void k_wdt_detach(int wdt)
+{
+    wdt_record * record = kprv_wdt_get(wdt);
+
+    if (record == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&records_mutex);
+    __atomic_store_n(&record->active, false, __ATOMIC_RELEASE);
+    record->stats.active = false;
+    kprv_wdt_expires(record, 0);
+    pthread_mutex_unlock(&records_mutex);
+}
+
+void k_wdt_kicked(int wdt)
+{
+    wdt_record * record = kprv_wdt_get(wdt);
+
+    if (record == NULL || !__atomic_load_n(&record->active, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+
+    kprv_wdt_expires(record, k_clock_now() + record->timeout_ns);
+    __atomic_add_fetch(&record->stats.kicks, 1, __ATOMIC_RELAXED);
+}
+
+void k_wdt_report(int wdt, uint32_t time_left_ms)
+{
+    wdt_record * record = kprv_wdt_get(wdt);
+
+    if (record == NULL || !__atomic_load_n(&record->active, __ATOMIC_ACQUIRE))
+    {
+        return;
+    }
+
+    kprv_wdt_expires(record, k_clock_now() + (uint64_t) time_left_ms * MS);
+    __atomic_add_fetch(&record->stats.reports, 1, __ATOMIC_RELAXED);
+}
+
+uint64_t k_wdt_due(int wdt)
+{
+    wdt_record * record = kprv_wdt_get(wdt);
+    uint64_t     expires;
+
+    if (record == NULL || !__atomic_load_n(&record->active, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+
+    expires = __atomic_load_n(&record->expires_ns, __ATOMIC_ACQUIRE);
+    if (expires <= record->margin_ns)
+    {
+        return 0;
+    }
+
+    return expires - record->margin_ns;
+}
+
+KWDTStatus k_wdt_snapshot(k_wdt_stats * buffer, int max, int * count)
+{
+    uint64_t now;
+
+    if (buffer == NULL || count == NULL || max < 0)
+    {
+        return WDT_ERROR_CONFIG;
+    }
+
+    now = k_clock_now();
+
+    pthread_mutex_lock(&records_mutex);
+
+    *count = 0;
+    for (int i = 0; i < record_count && *count < max; i++)
+    {
+        wdt_record * record = &records[i];
+        uint64_t     expires
+            = __atomic_load_n(&record->expires_ns, __ATOMIC_ACQUIRE);
+
+        buffer[*count] = record->stats;
+        buffer[*count].kicks
+            = __atomic_load_n(&record->stats.kicks, __ATOMIC_RELAXED);
+        buffer[*count].implicit
+            = __atomic_load_n(&record->stats.implicit, __ATOMIC_RELAXED);
+        buffer[*count].reports
+            = __atomic_load_n(&record->stats.reports, __ATOMIC_RELAXED);
+        buffer[*count].known = (expires != 0);
+        buffer[*count].time_left_ms
+            = (expires > now) ? (uint32_t) ((expires - now) / MS) : 0;
+        (*count)++;
+    }
+
+    pthread_mutex_unlock(&records_mutex);
+
+    return WDT_OK;
+}
+
+void kprv_wdt_traffic(int bus, uint16_t addr)
+{
+    int      count = __atomic_load_n(&record_count, __ATOMIC_ACQUIRE);
+    uint64_t now = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        wdt_record * record = &records[i];
+
+        if (!__atomic_load_n(&record->active, __ATOMIC_ACQUIRE)
+            || !record->implicit || record->bus != bus || record->addr != addr)
+        {
+            continue;
+        }
+
+        if (now == 0)
+        {
+            now = k_clock_now();
+        }
+
+        kprv_wdt_expires(record, now + record->timeout_ns);
+        __atomic_add_fetch(&record->stats.implicit, 1, __ATOMIC_RELAXED);
+    }
+}
@@ -0,0 +1,238 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmocka.h>
+#include <string.h>
+#include <time.h>
+#include "bus-budget.h"
+#include "i2c.h"
+
+#define TEST_BUS  1
+#define TEST_ADDR 0x20
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000;
+}
+
+static k_budget_stats find(const char * name)
+{
+    k_budget_stats buffer[K_BUDGET_MAX];
+    int            count = 0;
+
+    assert_int_equal(k_budget_snapshot(buffer, K_BUDGET_MAX, &count), BUDGET_OK);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(buffer[i].name, name) == 0)
+        {
+            return buffer[i];
+        }
+    }
+
+    fail_msg("No record for %s", name);
+
+    k_budget_stats empty = { 0 };
+    return empty;
+}
+
+static void write_ok(void)
+{
+    uint8_t data = 'A';
+
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_write, 1);
+
+    assert_int_equal(k_i2c_write(TEST_BUS, TEST_ADDR, &data, 1), I2C_OK);
+}
+
+static void test_register(void ** arg)
+{
+    k_budget_config config = {.rate_us = 5000 };
+    k_budget_stats  stats;
+    int             id;
+    int             again;
+
+    assert_int_equal(k_budget_register(NULL, NULL, &id), BUDGET_ERROR_CONFIG);
+    assert_int_equal(k_budget_register("", NULL, &id), BUDGET_ERROR_CONFIG);
+    assert_int_equal(k_budget_register("reg", NULL, NULL), BUDGET_ERROR_CONFIG);
+
+    assert_int_equal(k_budget_register("reg", NULL, &id), BUDGET_OK);
+    stats = find("reg");
+    assert_int_equal(stats.rate_us, 100000);
+    assert_int_equal(stats.burst_us, 100000);
+    assert_int_equal(stats.tokens_us, 100000);
+
+    /* Same name, same id, new settings */
+    assert_int_equal(k_budget_register("reg", &config, &again), BUDGET_OK);
+    assert_int_equal(again, id);
+    stats = find("reg");
+    assert_int_equal(stats.rate_us, 5000);
+    assert_int_equal(stats.burst_us, 5000);
+    assert_true(stats.tokens_us <= 5000);
+}
+
+static void test_enter_leave(void ** arg)
+{
+    int a;
+    int b;
+
+    k_budget_register("nest-a", NULL, &a);
+    k_budget_register("nest-b", NULL, &b);
+
+    assert_false(kprv_budget_active());
+
+    int outer = k_budget_enter(a);
+    assert_int_equal(outer, -1);
+    assert_true(kprv_budget_active());
+
+    int inner = k_budget_enter(b);
+    assert_int_equal(inner, a);
+
+    k_budget_leave(inner);
+    k_budget_leave(outer);
+    assert_false(kprv_budget_active());
+}
+
+static void test_unbudgeted(void ** arg)
+{
+    /* No budget entered: nothing to wait for, nothing charged */
+    write_ok();
+    assert_int_equal(kprv_budget_admit(1000000), I2C_OK);
+}
+
+static void test_charge(void ** arg)
+{
+    k_budget_stats stats;
+    int            id;
+
+    k_budget_register("charge", NULL, &id);
+    int previous = k_budget_enter(id);
+
+    write_ok();
+    kprv_budget_charge(30000000ULL);
+
+    stats = find("charge");
+    assert_int_equal(stats.transfers, 1);
+    assert_true(stats.bus_us >= 30000);
+    assert_true(stats.tokens_us <= 100000 - 30000 + 1000);
+
+    k_budget_leave(previous);
+}
+
+static void test_refused(void ** arg)
+{
+    k_budget_config config = {.rate_us = 100000, .burst_us = 10000, .max_wait_ms = 5 };
+    uint8_t         data   = 'A';
+    int             id;
+
+    k_budget_register("refused", &config, &id);
+    int previous = k_budget_enter(id);
+
+    /* 20ms over budget takes 200ms to earn back: too long to wait */
+    kprv_budget_charge(30000000ULL);
+
+    /* Never reaches the bus (no ioctl/write expected) */
+    assert_int_equal(k_i2c_write(TEST_BUS, TEST_ADDR, &data, 1),
+                     I2C_ERROR_BUDGET);
+    assert_int_equal(find("refused").refused, 1);
+
+    k_budget_leave(previous);
+}
+
+static void test_wait(void ** arg)
+{
+    k_budget_config config = {.rate_us = 1000000, .burst_us = 1000 };
+    k_budget_stats  stats;
+    int             id;
+
+    k_budget_register("wait", &config, &id);
+    int previous = k_budget_enter(id);
+
+    /* 2ms of debt at 1s per second, plus the transfer's own cost */
+    kprv_budget_charge(3000000ULL);
+
+    uint64_t start = now_us();
+    write_ok();
+    uint64_t elapsed = now_us() - start;
+
+    assert_true(elapsed >= 2000);
+
+    stats = find("wait");
+    assert_int_equal(stats.waits, 1);
+    assert_true(stats.wait_us >= 2000);
+
+    k_budget_leave(previous);
+}
+
+static void test_critical(void ** arg)
+{
+    k_budget_config config = {.rate_us = 1000, .burst_us = 1000,
+                              .max_wait_ms = 1, .critical = true };
+    k_budget_stats  stats;
+    int             id;
+
+    k_budget_register("critical", &config, &id);
+    int previous = k_budget_enter(id);
+
+    /* Far into debt, but critical traffic still goes straight through */
+    kprv_budget_charge(1000000000ULL);
+
+    uint64_t start = now_us();
+    write_ok();
+    assert_true(now_us() - start < 1000);
+
+    stats = find("critical");
+    assert_true(stats.critical);
+    assert_int_equal(stats.transfers, 1);
+    assert_int_equal(stats.waits, 0);
+    assert_true(stats.tokens_us < 0);
+
+    k_budget_leave(previous);
+}
+
+static void test_snapshot_bad_args(void ** arg)
+{
+    k_budget_stats buffer[1];
+    int            count;
+
+    assert_int_equal(k_budget_snapshot(NULL, 1, &count), BUDGET_ERROR_CONFIG);
+    assert_int_equal(k_budget_snapshot(buffer, 1, NULL), BUDGET_ERROR_CONFIG);
+
+    assert_int_equal(k_budget_snapshot(buffer, 1, &count), BUDGET_OK);
+    assert_int_equal(count, 1);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_register),
+        cmocka_unit_test(test_enter_leave),
+        cmocka_unit_test(test_unbudgeted),
+        cmocka_unit_test(test_charge),
+        cmocka_unit_test(test_refused),
+        cmocka_unit_test(test_wait),
+        cmocka_unit_test(test_critical),
+        cmocka_unit_test(test_snapshot_bad_args),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
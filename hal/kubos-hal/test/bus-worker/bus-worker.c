@@ -0,0 +1,415 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmocka.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include "bus-budget.h"
+#include "bus-worker.h"
+#include "clock.h"
+
+#define MS 1000000ULL
+
+/*
+ * One bus's requests in a timed sweep. Virtual time is only moved on once
+ * every bus with requests left is asleep in one, so a sweep's timing
+ * doesn't depend on how the workers get scheduled.
+ */
+typedef struct {
+    int      left;          /* Requests still to finish */
+    uint64_t wake_ns;       /* Deadline of the one asleep, or 0 */
+} lane;
+
+/* What a request saw while it ran */
+typedef struct {
+    uint64_t  sleep_ns;
+    int       result;
+    pthread_t thread;
+    int       budget;
+    lane *    lane;         /* Needed if sleep_ns is set */
+} probe;
+
+static int probe_fn(void * arg)
+{
+    probe * p = arg;
+
+    p->thread = pthread_self();
+    p->budget = k_budget_enter(-1);
+    k_budget_leave(p->budget);
+
+    if (p->sleep_ns != 0)
+    {
+        uint64_t deadline = k_clock_now() + p->sleep_ns;
+
+        __atomic_store_n(&p->lane->wake_ns, deadline, __ATOMIC_RELEASE);
+        k_clock_sleep_until(deadline);
+        __atomic_store_n(&p->lane->wake_ns, 0, __ATOMIC_RELEASE);
+    }
+
+    if (p->lane != NULL)
+    {
+        __atomic_sub_fetch(&p->lane->left, 1, __ATOMIC_RELEASE);
+    }
+
+    return p->result;
+}
+
+/* Move virtual time to the next deadline once every busy lane is asleep */
+static bool step_lanes(lane * lanes, int count)
+{
+    uint64_t now  = k_clock_now();
+    uint64_t next = UINT64_MAX;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (__atomic_load_n(&lanes[i].left, __ATOMIC_ACQUIRE) == 0)
+        {
+            continue;
+        }
+
+        uint64_t wake = __atomic_load_n(&lanes[i].wake_ns, __ATOMIC_ACQUIRE);
+        if (wake <= now)
+        {
+            return false;
+        }
+        if (wake < next)
+        {
+            next = wake;
+        }
+    }
+
+    if (next == UINT64_MAX)
+    {
+        return false;
+    }
+
+    k_clock_advance(next - now);
+    return true;
+}
+
+/* A k_bus_run made from its own thread, so this one can drive the clock */
+typedef struct {
+    const k_bus_request * requests;
+    int                   count;
+    k_bus_completion *    completions;
+    KBusStatus            status;
+    uint64_t              elapsed;
+    pthread_t             thread;
+    bool                  done;
+} sweep;
+
+static void * sweep_fn(void * arg)
+{
+    sweep *  s     = arg;
+    uint64_t start = k_clock_now();
+
+    s->status  = k_bus_run(s->requests, s->count, s->completions);
+    s->elapsed = k_clock_now() - start;
+    __atomic_store_n(&s->done, true, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static k_bus_stats find(const char * path)
+{
+    k_bus_stats buffer[K_BUS_MAX];
+    int         count = 0;
+
+    assert_int_equal(k_bus_snapshot(buffer, K_BUS_MAX, &count), BUS_OK);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(buffer[i].path, path) == 0)
+        {
+            return buffer[i];
+        }
+    }
+
+    fail_msg("No record for %s", path);
+
+    k_bus_stats empty = { 0 };
+    return empty;
+}
+
+static void test_attach_bad_args(void ** arg)
+{
+    char path[K_BUS_PATH_LEN + 1];
+
+    memset(path, 'x', K_BUS_PATH_LEN);
+    path[K_BUS_PATH_LEN] = '\0';
+
+    assert_int_equal(k_bus_attach(NULL, "/dev/i2c-0"), BUS_ERROR_CONFIG);
+    assert_int_equal(k_bus_attach("", "/dev/i2c-0"), BUS_ERROR_CONFIG);
+    assert_int_equal(k_bus_attach("dev", NULL), BUS_ERROR_CONFIG);
+    assert_int_equal(k_bus_attach("dev", path), BUS_ERROR_CONFIG);
+}
+
+static void test_run_bad_args(void ** arg)
+{
+    k_bus_request    requests[K_BUS_RUN_MAX + 1] = { { 0 } };
+    k_bus_completion completions[K_BUS_RUN_MAX + 1];
+    probe            p = { .result = 7 };
+
+    assert_int_equal(k_bus_run(NULL, 1, completions), BUS_ERROR_CONFIG);
+    assert_int_equal(k_bus_run(requests, 1, NULL), BUS_ERROR_CONFIG);
+    assert_int_equal(k_bus_run(requests, K_BUS_RUN_MAX + 1, completions),
+                     BUS_ERROR_FULL);
+    assert_int_equal(k_bus_run(requests, 0, completions), BUS_OK);
+
+    /* A device with no bus stops the whole run */
+    assert_int_equal(k_bus_attach("known", "/dev/i2c-0"), BUS_OK);
+    requests[0] = (k_bus_request) { "known", probe_fn, &p, 1 };
+    requests[1] = (k_bus_request) { "unknown", probe_fn, &p, 2 };
+    completions[0].result = -1;
+
+    assert_int_equal(k_bus_run(requests, 2, completions), BUS_ERROR_CONFIG);
+    assert_int_equal(completions[0].result, -1);
+}
+
+static void test_parallel_sweep(void ** arg)
+{
+    const uint64_t   sleep_ns = 30 * MS;
+    probe            probes[6];
+    k_bus_request    requests[6];
+    k_bus_completion completions[6];
+    const char *     device[6] = { "eps", "imu", "eps", "imu", "eps", "radio" };
+    lane             lanes[2]  = { { .left = 4 }, { .left = 2 } };
+    sweep            run = {
+        .requests = requests, .count = 6, .completions = completions
+    };
+
+    assert_int_equal(k_bus_attach("eps", "/dev/i2c-0"), BUS_OK);
+    assert_int_equal(k_bus_attach("radio", "/dev/i2c-0"), BUS_OK);
+    assert_int_equal(k_bus_attach("imu", "/dev/i2c-1"), BUS_OK);
+
+    for (int i = 0; i < 6; i++)
+    {
+        probes[i]   = (probe) { .sleep_ns = sleep_ns, .result = 100 + i,
+                                .lane = &lanes[i == 1 || i == 3] };
+        requests[i] = (k_bus_request) { device[i], probe_fn, &probes[i],
+                                        (uint64_t) i };
+    }
+    /* imu's requests are short so i2c-0 is the busiest bus */
+    probes[1].sleep_ns = probes[3].sleep_ns = sleep_ns / 2;
+
+    assert_int_equal(pthread_create(&run.thread, NULL, sweep_fn, &run), 0);
+    while (!__atomic_load_n(&run.done, __ATOMIC_ACQUIRE))
+    {
+        if (!step_lanes(lanes, 2))
+        {
+            sched_yield();
+        }
+    }
+    assert_int_equal(pthread_join(run.thread, NULL), 0);
+    assert_int_equal(run.status, BUS_OK);
+
+    /* The sweep takes as long as i2c-0 alone (4 x 30ms), not both */
+    assert_int_equal(run.elapsed, 4 * sleep_ns);
+
+    for (int i = 0; i < 6; i++)
+    {
+        assert_int_equal(completions[i].user_data, i);
+        assert_int_equal(completions[i].result, 100 + i);
+        assert_int_equal(completions[i].end_ns - completions[i].start_ns,
+                         probes[i].sleep_ns);
+        assert_false(pthread_equal(probes[i].thread, run.thread));
+    }
+
+    /* One thread per bus, running its requests in order */
+    assert_true(pthread_equal(probes[0].thread, probes[2].thread));
+    assert_true(pthread_equal(probes[0].thread, probes[5].thread));
+    assert_true(pthread_equal(probes[1].thread, probes[3].thread));
+    assert_false(pthread_equal(probes[0].thread, probes[1].thread));
+    assert_true(completions[0].end_ns <= completions[2].start_ns);
+    assert_true(completions[2].end_ns <= completions[4].start_ns);
+    assert_true(completions[4].end_ns <= completions[5].start_ns);
+    assert_int_equal(completions[0].bus, completions[5].bus);
+    assert_int_not_equal(completions[0].bus, completions[1].bus);
+
+    /* The buses overlapped */
+    assert_true(completions[1].start_ns < completions[0].end_ns);
+
+    k_bus_stats i2c0 = find("/dev/i2c-0");
+    k_bus_stats i2c1 = find("/dev/i2c-1");
+    assert_true(i2c0.running);
+    assert_int_equal(i2c0.requests, 4);
+    assert_int_equal(i2c1.requests, 2);
+    assert_int_equal(i2c0.busy_ns, 4 * sleep_ns);
+    assert_int_equal(i2c1.busy_ns, sleep_ns);
+}
+
+static void test_budget_carried(void ** arg)
+{
+    probe            p = { 0 };
+    k_bus_request    request = { "eps", probe_fn, &p, 0 };
+    k_bus_completion completion;
+    int              budget;
+
+    assert_int_equal(k_budget_register("sweep", NULL, &budget), BUDGET_OK);
+
+    int previous = k_budget_enter(budget);
+    assert_int_equal(k_bus_run(&request, 1, &completion), BUS_OK);
+    k_budget_leave(previous);
+
+    assert_int_equal(p.budget, budget);
+}
+
+static void test_terminate_restart(void ** arg)
+{
+    probe            p = { .result = 5 };
+    k_bus_request    request = { "radio", probe_fn, &p, 9 };
+    k_bus_completion completion;
+
+    k_bus_terminate();
+    assert_false(find("/dev/i2c-0").running);
+    assert_false(find("/dev/i2c-1").running);
+
+    /* Routes survive, and the worker comes back */
+    assert_int_equal(k_bus_run(&request, 1, &completion), BUS_OK);
+    assert_int_equal(completion.result, 5);
+    assert_int_equal(completion.user_data, 9);
+    assert_true(find("/dev/i2c-0").running);
+
+    k_bus_terminate();
+}
+
+/* Several callers sweeping the same buses at once */
+static void * sweep_thread(void * arg)
+{
+    probe            probes[4];
+    k_bus_request    requests[4];
+    k_bus_completion completions[4];
+
+    for (int i = 0; i < 4; i++)
+    {
+        probes[i]   = (probe) { .result = i };
+        requests[i] = (k_bus_request) { (i % 2) ? "imu" : "eps", probe_fn,
+                                        &probes[i], (uint64_t) i };
+    }
+
+    for (int round = 0; round < 50; round++)
+    {
+        if (k_bus_run(requests, 4, completions) != BUS_OK)
+        {
+            return (void *) 1;
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            if (completions[i].result != i)
+            {
+                return (void *) 1;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void test_concurrent_callers(void ** arg)
+{
+    pthread_t threads[K_BUS_QUEUE_DEPTH + 2];
+    void *    result;
+
+    for (int i = 0; i < K_BUS_QUEUE_DEPTH + 2; i++)
+    {
+        assert_int_equal(pthread_create(&threads[i], NULL, sweep_thread, NULL), 0);
+    }
+    for (int i = 0; i < K_BUS_QUEUE_DEPTH + 2; i++)
+    {
+        assert_int_equal(pthread_join(threads[i], &result), 0);
+        assert_null(result);
+    }
+
+    k_bus_terminate();
+}
+
+static int sweeps_done;
+
+static void * counted_sweep_thread(void * arg)
+{
+    void * result = sweep_thread(arg);
+
+    __atomic_add_fetch(&sweeps_done, 1, __ATOMIC_RELEASE);
+
+    return result;
+}
+
+/* Stopping the workers under callers waiting for room in their queues */
+static void test_terminate_under_load(void ** arg)
+{
+    pthread_t threads[K_BUS_QUEUE_DEPTH + 2];
+    void *    result;
+
+    for (int i = 0; i < K_BUS_QUEUE_DEPTH + 2; i++)
+    {
+        assert_int_equal(pthread_create(&threads[i], NULL,
+                                        counted_sweep_thread, NULL),
+                         0);
+    }
+
+    /* A caller left queued on a stopped worker would never finish */
+    while (__atomic_load_n(&sweeps_done, __ATOMIC_ACQUIRE)
+           < K_BUS_QUEUE_DEPTH + 2)
+    {
+        k_bus_terminate();
+    }
+
+    for (int i = 0; i < K_BUS_QUEUE_DEPTH + 2; i++)
+    {
+        assert_int_equal(pthread_join(threads[i], &result), 0);
+        assert_null(result);
+    }
+
+    k_bus_terminate();
+}
+
+static void test_attach_full(void ** arg)
+{
+    char       name[K_BUS_NAME_LEN];
+    KBusStatus status = BUS_OK;
+
+    for (int i = 0; i <= K_BUS_MAX && status == BUS_OK; i++)
+    {
+        snprintf(name, sizeof(name), "/dev/full-%d", i);
+        status = k_bus_attach(name, name);
+    }
+    assert_int_equal(status, BUS_ERROR_FULL);
+
+    /* A known bus still takes new devices */
+    assert_int_equal(k_bus_attach("late", "/dev/i2c-1"), BUS_OK);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_attach_bad_args),
+        cmocka_unit_test(test_run_bad_args),
+        cmocka_unit_test(test_parallel_sweep),
+        cmocka_unit_test(test_budget_carried),
+        cmocka_unit_test(test_terminate_restart),
+        cmocka_unit_test(test_concurrent_callers),
+        cmocka_unit_test(test_terminate_under_load),
+        cmocka_unit_test(test_attach_full),
+    };
+
+    /* Requests' sleeps take no real time */
+    k_clock_use_virtual(0);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
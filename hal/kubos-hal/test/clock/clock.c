@@ -0,0 +1,229 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmocka.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <time.h>
+#include "clock.h"
+
+#define MS 1000000ULL
+
+/* Real time, for checking that virtual sleeps don't take any */
+static uint64_t real_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * K_CLOCK_NS_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+static void real_sleep_ms(long ms)
+{
+    struct timespec delay = {.tv_sec = 0, .tv_nsec = ms * MS };
+
+    nanosleep(&delay, NULL);
+}
+
+static int reset(void ** state)
+{
+    k_clock_set(NULL);
+
+    return 0;
+}
+
+static void test_system(void ** arg)
+{
+    uint64_t start = k_clock_now();
+    uint64_t real = real_now();
+
+    k_clock_sleep(2 * MS);
+
+    assert_true(k_clock_now() - start >= 2 * MS);
+    assert_true(real_now() - real >= 2 * MS);
+
+    /* A deadline in the past returns at once */
+    k_clock_sleep_until(start);
+}
+
+static void test_virtual_driver(void ** arg)
+{
+    uint64_t real = real_now();
+
+    k_clock_use_virtual(1000);
+    assert_int_equal(k_clock_now(), 1000);
+
+    k_clock_sleep(3600 * K_CLOCK_NS_PER_SEC);
+    assert_int_equal(k_clock_now(), 1000 + 3600 * K_CLOCK_NS_PER_SEC);
+
+    const struct timespec delay = {.tv_sec = 1, .tv_nsec = 500 };
+    k_clock_nanosleep(&delay);
+    assert_int_equal(k_clock_now(),
+                     1000 + 3601 * K_CLOCK_NS_PER_SEC + 500);
+
+    /* Time never goes backwards */
+    k_clock_sleep_until(0);
+    assert_int_equal(k_clock_now(),
+                     1000 + 3601 * K_CLOCK_NS_PER_SEC + 500);
+
+    k_clock_advance(MS);
+    assert_int_equal(k_clock_now(),
+                     1000 + 3601 * K_CLOCK_NS_PER_SEC + 500 + MS);
+
+    /* An hour of virtual time costs next to no real time */
+    assert_true(real_now() - real < 500 * MS);
+}
+
+static bool background_done;
+
+static void * background(void * arg)
+{
+    k_clock_sleep(K_CLOCK_NS_PER_SEC);
+    __atomic_store_n(&background_done, true, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void test_virtual_background(void ** arg)
+{
+    pthread_t thread;
+
+    k_clock_use_virtual(0);
+    background_done = false;
+
+    assert_int_equal(pthread_create(&thread, NULL, background, NULL), 0);
+
+    /* Give the thread time to start its sleep */
+    real_sleep_ms(20);
+    assert_false(__atomic_load_n(&background_done, __ATOMIC_ACQUIRE));
+
+    k_clock_advance(500 * MS);
+    real_sleep_ms(20);
+    assert_false(__atomic_load_n(&background_done, __ATOMIC_ACQUIRE));
+
+    /* The driver's own sleeps move time for everyone */
+    k_clock_sleep(600 * MS);
+    assert_int_equal(pthread_join(thread, NULL), 0);
+    assert_true(background_done);
+}
+
+static void test_virtual_cancel(void ** arg)
+{
+    pthread_t thread;
+
+    k_clock_use_virtual(0);
+    background_done = false;
+
+    assert_int_equal(pthread_create(&thread, NULL, background, NULL), 0);
+    real_sleep_ms(20);
+
+    /* Threads waiting on virtual time can still be stopped */
+    pthread_cancel(thread);
+    assert_int_equal(pthread_join(thread, NULL), 0);
+    assert_false(background_done);
+
+    /* And the clock is still usable afterwards */
+    k_clock_sleep(MS);
+    assert_int_equal(k_clock_now(), MS);
+}
+
+static void test_virtual_release(void ** arg)
+{
+    pthread_t thread;
+
+    k_clock_use_virtual(0);
+    background_done = false;
+
+    assert_int_equal(pthread_create(&thread, NULL, background, NULL), 0);
+    real_sleep_ms(20);
+
+    /* Going back to the system clock lets waiting threads go */
+    k_clock_set(NULL);
+    assert_int_equal(pthread_join(thread, NULL), 0);
+    assert_true(background_done);
+
+    /* Advancing has no effect on the system clock */
+    uint64_t before = k_clock_now();
+    k_clock_advance(3600 * K_CLOCK_NS_PER_SEC);
+    assert_true(k_clock_now() - before < 3600 * K_CLOCK_NS_PER_SEC);
+}
+
+typedef struct {
+    uint64_t now;
+    uint64_t last_deadline;
+    int      sleeps;
+} custom_state;
+
+static uint64_t custom_now(void * context)
+{
+    return ((custom_state *) context)->now;
+}
+
+static void custom_sleep_until(void * context, uint64_t deadline_ns)
+{
+    custom_state * state = context;
+
+    state->last_deadline = deadline_ns;
+    state->sleeps++;
+}
+
+static void test_custom(void ** arg)
+{
+    custom_state state = {.now = 5 * K_CLOCK_NS_PER_SEC };
+    const k_clock_ops ops = {
+        .now         = custom_now,
+        .sleep_until = custom_sleep_until,
+        .context     = &state,
+    };
+
+    k_clock_set(&ops);
+
+    assert_int_equal(k_clock_now(), 5 * K_CLOCK_NS_PER_SEC);
+
+    k_clock_sleep(MS);
+    assert_int_equal(state.last_deadline, 5 * K_CLOCK_NS_PER_SEC + MS);
+
+    const struct timespec delay = {.tv_sec = 2, .tv_nsec = 1000001 };
+    k_clock_nanosleep(&delay);
+    assert_int_equal(state.last_deadline,
+                     7 * K_CLOCK_NS_PER_SEC + 1000001);
+
+    k_clock_sleep_until(42);
+    assert_int_equal(state.last_deadline, 42);
+    assert_int_equal(state.sleeps, 3);
+
+    /* Bad delays are ignored */
+    const struct timespec bad = {.tv_sec = -1, .tv_nsec = 0 };
+    k_clock_nanosleep(&bad);
+    k_clock_nanosleep(NULL);
+    assert_int_equal(state.sleeps, 3);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_teardown(test_system, reset),
+        cmocka_unit_test_teardown(test_virtual_driver, reset),
+        cmocka_unit_test_teardown(test_virtual_background, reset),
+        cmocka_unit_test_teardown(test_virtual_cancel, reset),
+        cmocka_unit_test_teardown(test_virtual_release, reset),
+        cmocka_unit_test_teardown(test_custom, reset),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
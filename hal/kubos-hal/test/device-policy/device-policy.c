@@ -0,0 +1,357 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmocka.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include "device-policy.h"
+#include "i2c.h"
+
+#define TEST_BUS 1
+
+/* errno for failed writes, from the mock */
+extern int test_write_errno;
+
+/* Retry quickly, trip after two failed operations, trial after 20ms */
+static const k_policy_config fast = {
+    .max_attempts      = 3,
+    .base_delay_us     = 10,
+    .max_delay_us      = 100,
+    .failure_threshold = 2,
+    .open_ms           = 20,
+};
+
+static k_policy_stats find(const char * name)
+{
+    k_policy_stats buffer[K_POLICY_MAX];
+    int            count = 0;
+
+    assert_int_equal(k_policy_snapshot(buffer, K_POLICY_MAX, &count), POLICY_OK);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(buffer[i].name, name) == 0)
+        {
+            return buffer[i];
+        }
+    }
+
+    fail_msg("No record for %s", name);
+
+    k_policy_stats empty = { 0 };
+    return empty;
+}
+
+static void fail_write(uint16_t addr)
+{
+    uint8_t data = 'A';
+
+    for (uint32_t i = 0; i < fast.max_attempts; i++)
+    {
+        will_return(__wrap_ioctl, 0);
+        will_return(__wrap_write, -1);
+    }
+
+    assert_int_equal(k_i2c_write(TEST_BUS, addr, &data, 1), I2C_ERROR_NACK);
+}
+
+static void test_attach_bad_args(void ** arg)
+{
+    assert_int_equal(k_policy_attach(NULL, TEST_BUS, 0x10, NULL, NULL),
+                     POLICY_ERROR_CONFIG);
+    assert_int_equal(k_policy_attach("nobus", 0, 0x10, NULL, NULL),
+                     POLICY_ERROR_CONFIG);
+    assert_int_equal(k_policy_configure("missing", NULL), POLICY_ERROR_CONFIG);
+
+    assert_int_equal(k_policy_attach("twice", TEST_BUS, 0x10, NULL, NULL),
+                     POLICY_OK);
+    assert_int_equal(k_policy_attach("other", TEST_BUS, 0x10, NULL, NULL),
+                     POLICY_ERROR_CONFIG);
+
+    /* Attaching the same name again moves it */
+    assert_int_equal(k_policy_attach("twice", TEST_BUS, 0x11, NULL, NULL),
+                     POLICY_OK);
+    k_policy_detach(TEST_BUS, 0x10);
+    assert_true(find("twice").active);
+    k_policy_detach(TEST_BUS, 0x11);
+
+    assert_false(find("twice").active);
+}
+
+static void test_retry_succeeds(void ** arg)
+{
+    uint8_t data = 'A';
+
+    assert_int_equal(k_policy_attach("retry", TEST_BUS, 0x20, &fast, NULL),
+                     POLICY_OK);
+
+    /* One address NACK, then through */
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_write, -1);
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_write, 1);
+    assert_int_equal(k_i2c_write(TEST_BUS, 0x20, &data, 1), I2C_OK);
+
+    k_policy_stats stats = find("retry");
+    assert_int_equal(stats.operations, 1);
+    assert_int_equal(stats.retries, 1);
+    assert_int_equal(stats.failures, 0);
+    assert_int_equal(stats.state, POLICY_CLOSED);
+
+    k_policy_detach(TEST_BUS, 0x20);
+}
+
+static void test_write_not_repeated(void ** arg)
+{
+    uint8_t         data  = 'A';
+    k_policy_config retry = fast;
+
+    assert_int_equal(k_policy_attach("reset", TEST_BUS, 0x23, &fast, NULL),
+                     POLICY_OK);
+
+    /* NACKed after the address: the device may have acted on it */
+    test_write_errno = EREMOTEIO;
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_write, -1);
+    assert_int_equal(k_i2c_write(TEST_BUS, 0x23, &data, 1), I2C_ERROR);
+
+    k_policy_stats stats = find("reset");
+    assert_int_equal(stats.retries, 0);
+    assert_int_equal(stats.failures, 1);
+
+    /* Unless the device says its writes can be repeated */
+    retry.retry_writes = true;
+    assert_int_equal(k_policy_configure("reset", &retry), POLICY_OK);
+    for (uint32_t i = 0; i < fast.max_attempts; i++)
+    {
+        will_return(__wrap_ioctl, 0);
+        will_return(__wrap_write, -1);
+    }
+    assert_int_equal(k_i2c_write(TEST_BUS, 0x23, &data, 1), I2C_ERROR);
+    assert_int_equal(find("reset").retries, fast.max_attempts - 1);
+
+    /* Reads are always retried */
+    assert_int_equal(k_policy_configure("reset", &fast), POLICY_OK);
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_read, -1);
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_read, 1);
+    assert_int_equal(k_i2c_read(TEST_BUS, 0x23, &data, 1), I2C_OK);
+
+    test_write_errno = ENXIO;
+    k_policy_detach(TEST_BUS, 0x23);
+}
+
+static void test_other_devices_untouched(void ** arg)
+{
+    uint8_t data = 'A';
+
+    assert_int_equal(k_policy_attach("policed", TEST_BUS, 0x21, &fast, NULL),
+                     POLICY_OK);
+
+    /* A device without a policy gets exactly one attempt */
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_read, 0);
+    assert_int_equal(k_i2c_read(TEST_BUS, 0x22, &data, 1), I2C_ERROR);
+
+    assert_int_equal(find("policed").operations, 0);
+
+    k_policy_detach(TEST_BUS, 0x21);
+}
+
+static void test_trip_fails_fast(void ** arg)
+{
+    uint8_t data = 'A';
+
+    assert_int_equal(k_policy_attach("dead", TEST_BUS, 0x30, &fast, NULL),
+                     POLICY_OK);
+
+    fail_write(0x30);
+    assert_int_equal(find("dead").state, POLICY_CLOSED);
+    fail_write(0x30);
+
+    k_policy_stats stats = find("dead");
+    assert_int_equal(stats.state, POLICY_OPEN);
+    assert_int_equal(stats.trips, 1);
+    assert_int_equal(stats.failures, 2);
+    assert_int_equal(stats.retries, 4);
+
+    /* No mocks queued: the bus must not be touched */
+    assert_int_equal(k_i2c_read(TEST_BUS, 0x30, &data, 1),
+                     I2C_ERROR_UNAVAILABLE);
+    assert_int_equal(find("dead").rejected, 1);
+
+    k_policy_detach(TEST_BUS, 0x30);
+}
+
+static void test_caller_trial(void ** arg)
+{
+    uint8_t               data = 'A';
+    const struct timespec wait = {.tv_sec = 0, .tv_nsec = 30000000 };
+
+    assert_int_equal(k_policy_attach("trial", TEST_BUS, 0x40, &fast, NULL),
+                     POLICY_OK);
+
+    fail_write(0x40);
+    fail_write(0x40);
+    assert_int_equal(find("trial").state, POLICY_OPEN);
+
+    nanosleep(&wait, NULL);
+
+    /* The trial gets a single attempt; failing it re-opens the breaker */
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_write, -1);
+    assert_int_equal(k_i2c_write(TEST_BUS, 0x40, &data, 1), I2C_ERROR_NACK);
+    assert_int_equal(find("trial").state, POLICY_OPEN);
+    assert_int_equal(k_i2c_write(TEST_BUS, 0x40, &data, 1),
+                     I2C_ERROR_UNAVAILABLE);
+
+    nanosleep(&wait, NULL);
+
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_write, 1);
+    assert_int_equal(k_i2c_write(TEST_BUS, 0x40, &data, 1), I2C_OK);
+    assert_int_equal(find("trial").state, POLICY_CLOSED);
+
+    k_policy_detach(TEST_BUS, 0x40);
+}
+
+static void probe(void)
+{
+    uint8_t data = 'P';
+
+    k_i2c_write(TEST_BUS, 0x50, &data, 1);
+}
+
+static void test_background_probe(void ** arg)
+{
+    uint8_t               data = 'A';
+    const struct timespec poll = {.tv_sec = 0, .tv_nsec = 5000000 };
+
+    assert_int_equal(k_policy_attach("probed", TEST_BUS, 0x50, &fast, probe),
+                     POLICY_OK);
+
+    fail_write(0x50);
+    fail_write(0x50);
+
+    /* Callers are turned away even once the open period has passed */
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_write, 1);
+
+    k_policy_stats stats;
+    for (int i = 0; i < 200; i++)
+    {
+        stats = find("probed");
+        if (stats.state == POLICY_CLOSED)
+        {
+            break;
+        }
+        assert_int_equal(k_i2c_write(TEST_BUS, 0x50, &data, 1),
+                         I2C_ERROR_UNAVAILABLE);
+        nanosleep(&poll, NULL);
+    }
+
+    assert_int_equal(stats.state, POLICY_CLOSED);
+    assert_int_equal(stats.probes, 1);
+    assert_true(stats.rejected > 0);
+
+    k_policy_detach(TEST_BUS, 0x50);
+}
+
+static int slow_probe_started;
+static int slow_probe_finished;
+
+/* Holds the device for a while without touching the bus */
+static void slow_probe(void)
+{
+    const struct timespec hold = {.tv_sec = 0, .tv_nsec = 50000000 };
+
+    __atomic_store_n(&slow_probe_started, 1, __ATOMIC_SEQ_CST);
+    nanosleep(&hold, NULL);
+    __atomic_store_n(&slow_probe_finished, 1, __ATOMIC_SEQ_CST);
+}
+
+static void test_detach_waits_for_probe(void ** arg)
+{
+    const struct timespec poll = {.tv_sec = 0, .tv_nsec = 1000000 };
+
+    assert_int_equal(
+        k_policy_attach("slow", TEST_BUS, 0x58, &fast, slow_probe),
+        POLICY_OK);
+
+    fail_write(0x58);
+    fail_write(0x58);
+
+    for (int i = 0; i < 1000; i++)
+    {
+        if (__atomic_load_n(&slow_probe_started, __ATOMIC_SEQ_CST))
+        {
+            break;
+        }
+        nanosleep(&poll, NULL);
+    }
+    assert_true(__atomic_load_n(&slow_probe_started, __ATOMIC_SEQ_CST));
+
+    /* Once detached, the caller may close the bus under the probe */
+    k_policy_detach(TEST_BUS, 0x58);
+    assert_true(__atomic_load_n(&slow_probe_finished, __ATOMIC_SEQ_CST));
+}
+
+static void test_reattach_keeps_history(void ** arg)
+{
+    assert_int_equal(k_policy_attach("history", TEST_BUS, 0x60, &fast, NULL),
+                     POLICY_OK);
+    fail_write(0x60);
+    k_policy_detach(TEST_BUS, 0x60);
+
+    assert_int_equal(k_policy_attach("history", TEST_BUS, 0x60, &fast, NULL),
+                     POLICY_OK);
+
+    k_policy_stats stats = find("history");
+    assert_true(stats.active);
+    assert_int_equal(stats.failures, 1);
+
+    /* Reconfiguring closes the breaker */
+    fail_write(0x60);
+    fail_write(0x60);
+    assert_int_equal(find("history").state, POLICY_OPEN);
+    assert_int_equal(k_policy_configure("history", NULL), POLICY_OK);
+    assert_int_equal(find("history").state, POLICY_CLOSED);
+
+    k_policy_detach(TEST_BUS, 0x60);
+}
+
+int main(void)
+{
+    /* Failed writes are address NACKs unless a test says otherwise */
+    test_write_errno = ENXIO;
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_attach_bad_args),
+        cmocka_unit_test(test_retry_succeeds),
+        cmocka_unit_test(test_write_not_repeated),
+        cmocka_unit_test(test_other_devices_untouched),
+        cmocka_unit_test(test_trip_fails_fast),
+        cmocka_unit_test(test_caller_trial),
+        cmocka_unit_test(test_background_probe),
+        cmocka_unit_test(test_detach_waits_for_probe),
+        cmocka_unit_test(test_reattach_keeps_history),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,336 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmocka.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include "clock.h"
+#include "governor.h"
+#include "pubsub.h"
+#include "thread-stats.h"
+
+#define MS 1000000ULL
+
+static void real_sleep_ms(long ms)
+{
+    struct timespec delay = {.tv_sec = 0, .tv_nsec = ms * MS };
+
+    nanosleep(&delay, NULL);
+}
+
+static k_gov_stats find(const char * name)
+{
+    k_gov_stats buffer[K_GOV_MAX];
+    int         count = 0;
+
+    assert_int_equal(k_gov_snapshot(buffer, K_GOV_MAX, &count), GOV_OK);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(buffer[i].name, name) == 0)
+        {
+            return buffer[i];
+        }
+    }
+
+    fail_msg("No record for %s", name);
+
+    k_gov_stats empty = { 0 };
+    return empty;
+}
+
+static int reset(void ** state)
+{
+    k_gov_set_mode(GOV_MODE_NORMAL);
+    k_clock_set(NULL);
+
+    return 0;
+}
+
+static void test_bad_args(void ** arg)
+{
+    int activity;
+    int condition;
+
+    assert_int_equal(k_gov_register(NULL, 100, 0, &activity), GOV_ERROR_CONFIG);
+    assert_int_equal(k_gov_register("", 100, 0, &activity), GOV_ERROR_CONFIG);
+    assert_int_equal(k_gov_register("zero", 0, 0, &activity), GOV_ERROR_CONFIG);
+    assert_int_equal(k_gov_register("null", 100, 0, NULL), GOV_ERROR_CONFIG);
+    assert_int_equal(k_gov_find("unknown", &activity), GOV_ERROR);
+
+    assert_int_equal(k_gov_condition(NULL, &condition), GOV_ERROR_CONFIG);
+    assert_int_equal(k_gov_set_condition(K_GOV_MAX_CONDITIONS, true), GOV_ERROR_CONFIG);
+    assert_int_equal(k_gov_set_condition_period("any", 7, 10), GOV_ERROR_CONFIG);
+
+    assert_int_equal(k_gov_set_mode(GOV_MODES), GOV_ERROR_CONFIG);
+    assert_int_equal(k_gov_follow(0, 0, NULL), GOV_ERROR_CONFIG);
+    assert_int_equal(k_gov_snapshot(NULL, 1, &activity), GOV_ERROR_CONFIG);
+}
+
+static void test_mode_periods(void ** arg)
+{
+    k_gov_profile profile = { .period_ms = {[GOV_MODE_FULL] = 50 } };
+    int           plain;
+    int           tuned;
+    int           kicked;
+
+    assert_int_equal(k_gov_register("plain", 100, 0, &plain), GOV_OK);
+    /* Tuned before it registers, as a service would */
+    assert_int_equal(k_gov_set_profile("tuned", &profile), GOV_OK);
+    assert_int_equal(k_gov_register("tuned", 100, 0, &tuned), GOV_OK);
+    assert_int_equal(k_gov_register("kicked", 1000, 1500, &kicked), GOV_OK);
+
+    assert_int_equal(k_gov_mode(), GOV_MODE_NORMAL);
+    assert_int_equal(k_gov_period(plain), 100);
+    assert_int_equal(k_gov_period(tuned), 100);
+    assert_int_equal(k_gov_period(kicked), 1000);
+
+    assert_int_equal(k_gov_set_mode(GOV_MODE_CRITICAL), GOV_OK);
+    assert_int_equal(k_gov_period(plain), 100 * K_GOV_SCALE_CRITICAL);
+    assert_int_equal(k_gov_period(tuned), 100 * K_GOV_SCALE_CRITICAL);
+    /* Never slower than its limit */
+    assert_int_equal(k_gov_period(kicked), 1500);
+
+    assert_int_equal(k_gov_set_mode(GOV_MODE_SAFE), GOV_OK);
+    assert_int_equal(k_gov_period(plain), 100 * K_GOV_SCALE_SAFE);
+
+    assert_int_equal(k_gov_set_mode(GOV_MODE_FULL), GOV_OK);
+    assert_int_equal(k_gov_period(plain), 100);
+    assert_int_equal(k_gov_period(tuned), 50);
+
+    /* Back to the defaults */
+    assert_int_equal(k_gov_set_profile("tuned", NULL), GOV_OK);
+    assert_int_equal(k_gov_period(tuned), 100);
+
+    /* Re-registering keeps the slot */
+    int again;
+    assert_int_equal(k_gov_register("plain", 100, 0, &again), GOV_OK);
+    assert_int_equal(again, plain);
+    assert_int_equal(k_gov_find("plain", &again), GOV_OK);
+    assert_int_equal(again, plain);
+}
+
+static void test_conditions(void ** arg)
+{
+    int pass;
+    int eclipse;
+    int again;
+    int rx;
+
+    assert_int_equal(k_gov_register("rx-poll", 200, 0, &rx), GOV_OK);
+    assert_int_equal(k_gov_condition("ground-pass", &pass), GOV_OK);
+    assert_int_equal(k_gov_condition("eclipse", &eclipse), GOV_OK);
+    assert_int_equal(k_gov_condition("ground-pass", &again), GOV_OK);
+    assert_int_equal(again, pass);
+
+    assert_int_equal(k_gov_set_condition_period("rx-poll", pass, 20), GOV_OK);
+    assert_int_equal(k_gov_set_condition_period("rx-poll", eclipse, 5000), GOV_OK);
+
+    k_gov_set_mode(GOV_MODE_CRITICAL);
+    assert_int_equal(k_gov_period(rx), 200 * K_GOV_SCALE_CRITICAL);
+
+    /* A condition's period replaces the mode's, slower or faster */
+    assert_int_equal(k_gov_set_condition(eclipse, true), GOV_OK);
+    assert_int_equal(k_gov_period(rx), 5000);
+
+    /* The shortest active one wins */
+    assert_int_equal(k_gov_set_condition(pass, true), GOV_OK);
+    assert_int_equal(k_gov_period(rx), 20);
+
+    k_gov_set_condition(pass, false);
+    k_gov_set_condition(eclipse, false);
+    assert_int_equal(k_gov_period(rx), 200 * K_GOV_SCALE_CRITICAL);
+}
+
+static int      poller;
+static uint32_t passes;
+
+static void * poller_thread(void * arg)
+{
+    volatile uint32_t work = 0;
+
+    k_thread_stats_register("poller", 100);
+    pthread_cleanup_push(k_thread_stats_unregister, NULL);
+
+    while (1)
+    {
+        k_thread_stats_wakeup();
+        __atomic_add_fetch(&passes, 1, __ATOMIC_RELEASE);
+
+        for (int i = 0; i < 200000; i++)
+        {
+            work += i;
+        }
+
+        k_gov_sleep(poller);
+    }
+
+    pthread_cleanup_pop(1);
+
+    return NULL;
+}
+
+/* Move virtual time on in steps, letting the poller keep up */
+static void run_for(uint64_t ns)
+{
+    for (uint64_t t = 0; t < ns; t += 50 * MS)
+    {
+        k_clock_advance(50 * MS);
+        real_sleep_ms(5);
+    }
+}
+
+static void test_sleep_follows_mode(void ** arg)
+{
+    pthread_t      thread;
+    k_thread_stats stats[K_THREAD_STATS_MAX];
+    int            count;
+    uint32_t       seen;
+
+    k_clock_use_virtual(0);
+    assert_int_equal(k_gov_register("poller", 100, 0, &poller), GOV_OK);
+    passes = 0;
+
+    assert_int_equal(pthread_create(&thread, NULL, poller_thread, NULL), 0);
+    real_sleep_ms(20);
+
+    run_for(1000 * MS);
+    seen = __atomic_load_n(&passes, __ATOMIC_ACQUIRE);
+    assert_in_range(seen, 10, 12);
+
+    /* Eight times fewer wakeups in critical mode */
+    k_gov_set_mode(GOV_MODE_CRITICAL);
+    real_sleep_ms(20);
+    run_for(1600 * MS);
+    assert_in_range(__atomic_load_n(&passes, __ATOMIC_ACQUIRE) - seen, 1, 3);
+
+    k_thread_stats_snapshot(stats, K_THREAD_STATS_MAX, &count);
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(stats[i].name, "poller") == 0)
+        {
+            assert_int_equal(stats[i].period_ms, 100 * K_GOV_SCALE_CRITICAL);
+            assert_int_equal(stats[i].missed_deadlines, 0);
+        }
+    }
+
+    /* Leaving it cuts the current sleep short, without time moving */
+    run_for(200 * MS);
+    seen = __atomic_load_n(&passes, __ATOMIC_ACQUIRE);
+    k_gov_set_mode(GOV_MODE_NORMAL);
+    real_sleep_ms(20);
+    assert_true(__atomic_load_n(&passes, __ATOMIC_ACQUIRE) > seen);
+
+    pthread_cancel(thread);
+    pthread_join(thread, NULL);
+
+    k_gov_stats gov = find("poller");
+    assert_true(gov.active);
+    assert_true(gov.base_wakeups > gov.wakeups + 10);
+    assert_true(gov.cpu_ns > 0);
+    assert_true(gov.cpu_saved_ns > 0);
+    assert_int_equal(gov.bus_saved_ns, 0);
+}
+
+static int power_mode(const void * data, uint32_t len)
+{
+    return (len == 1) ? *(const uint8_t *) data : -1;
+}
+
+static void test_follow(void ** arg)
+{
+    static uint64_t storage[K_PUBSUB_STORAGE(1, 4)];
+    int             topic;
+    uint8_t         value;
+
+    assert_int_equal(k_pubsub_topic("power", 1, 4, storage,
+                                    sizeof(storage) / sizeof(storage[0]), &topic),
+                     PUBSUB_OK);
+    assert_int_equal(k_gov_follow(topic, K_GOV_FOLLOW_SIZE + 1, power_mode),
+                     GOV_ERROR_CONFIG);
+    assert_int_equal(k_gov_follow(topic, 1, power_mode), GOV_OK);
+    assert_int_equal(k_gov_follow(topic, 1, power_mode), GOV_OK);
+    assert_int_equal(k_gov_follow(topic + 1, 1, power_mode), GOV_ERROR_CONFIG);
+
+    value = GOV_MODE_SAFE;
+    k_pubsub_publish(topic, &value, 1);
+    for (int i = 0; i < 100 && k_gov_mode() != GOV_MODE_SAFE; i++)
+    {
+        real_sleep_ms(10);
+    }
+    assert_int_equal(k_gov_mode(), GOV_MODE_SAFE);
+
+    /* Out-of-range modes are ignored */
+    value = 42;
+    k_pubsub_publish(topic, &value, 1);
+    value = GOV_MODE_FULL;
+    k_pubsub_publish(topic, &value, 1);
+    for (int i = 0; i < 100 && k_gov_mode() != GOV_MODE_FULL; i++)
+    {
+        real_sleep_ms(10);
+    }
+    assert_int_equal(k_gov_mode(), GOV_MODE_FULL);
+
+    k_gov_unfollow();
+
+    value = GOV_MODE_CRITICAL;
+    k_pubsub_publish(topic, &value, 1);
+    real_sleep_ms(20);
+    assert_int_equal(k_gov_mode(), GOV_MODE_FULL);
+
+    /* Can follow again afterwards */
+    assert_int_equal(k_gov_follow(topic, 1, power_mode), GOV_OK);
+    k_gov_unfollow();
+}
+
+static void test_full(void ** arg)
+{
+    char name[K_GOV_NAME_LEN];
+    int  activity;
+    int  condition;
+    KGovStatus status = GOV_OK;
+
+    for (int i = 0; i < K_GOV_MAX && status == GOV_OK; i++)
+    {
+        snprintf(name, sizeof(name), "filler-%d", i);
+        status = k_gov_register(name, 10, 0, &activity);
+    }
+    assert_int_equal(status, GOV_ERROR_FULL);
+
+    status = GOV_OK;
+    for (int i = 0; i < K_GOV_MAX_CONDITIONS && status == GOV_OK; i++)
+    {
+        snprintf(name, sizeof(name), "cond-%d", i);
+        status = k_gov_condition(name, &condition);
+    }
+    assert_int_equal(k_gov_condition("one-more", &condition), GOV_ERROR_FULL);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_bad_args),
+        cmocka_unit_test_teardown(test_mode_periods, reset),
+        cmocka_unit_test_teardown(test_conditions, reset),
+        cmocka_unit_test_teardown(test_sleep_follows_mode, reset),
+        cmocka_unit_test_teardown(test_follow, reset),
+        cmocka_unit_test(test_full),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -21,6 +21,7 @@
 #include <errno.h>
 
 char test_char;
+int  test_write_errno;
 
 //TODO: Add param checking
 
@@ -43,6 +44,10 @@ int __wrap_ioctl(int fd, unsigned long request, ...)
 ssize_t __wrap_write(int fd, const char *buf, size_t count)
 {
     test_char = *buf;
+
+    /* Only relevant when we make the write call fail */
+    errno = test_write_errno;
+
     return mock_type(ssize_t);
 }
 
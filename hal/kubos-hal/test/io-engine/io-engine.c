@@ -0,0 +1,364 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmocka.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "io-engine.h"
+
+#define MAX_EVENTS 8
+
+/* Each test runs once per backend; the io_uring run skips if unavailable */
+static int setup(void ** state, bool force_epoll)
+{
+    k_io_config   config = { 0 };
+    k_io_engine * engine = NULL;
+
+    config.force_epoll = force_epoll;
+    config.buffer_count = 8;
+    config.recv_buffers = 2;
+
+    assert_int_equal(k_io_init(&config, &engine), IO_OK);
+
+    if (!force_epoll && k_io_backend(engine) != IO_BACKEND_URING)
+    {
+        k_io_terminate(&engine);
+    }
+
+    *state = engine;
+
+    return 0;
+}
+
+static int setup_uring(void ** state)
+{
+    return setup(state, false);
+}
+
+static int setup_epoll(void ** state)
+{
+    return setup(state, true);
+}
+
+static int teardown(void ** state)
+{
+    k_io_engine * engine = *state;
+
+    k_io_terminate(&engine);
+
+    return 0;
+}
+
+static k_io_engine * get_engine(void ** state)
+{
+    if (*state == NULL)
+    {
+        skip();
+    }
+
+    return *state;
+}
+
+/* Wait until at least `want` completions have arrived (or give up) */
+static int collect(k_io_engine * engine, k_io_completion * events, int want)
+{
+    int total = 0;
+
+    for (int tries = 0; tries < 20 && total < want; tries++)
+    {
+        int count = 0;
+
+        assert_int_equal(k_io_wait(engine, events + total, MAX_EVENTS - total,
+                                   50, &count),
+                         IO_OK);
+        total += count;
+    }
+
+    return total;
+}
+
+static void test_init_bad_config(void ** state)
+{
+    k_io_config   config = { 0 };
+    k_io_engine * engine = NULL;
+
+    config.recv_buffers = 3;
+    assert_int_equal(k_io_init(&config, &engine), IO_ERROR_CONFIG);
+
+    config.recv_buffers = 16;
+    config.buffer_count = 16;
+    assert_int_equal(k_io_init(&config, &engine), IO_ERROR_CONFIG);
+
+    assert_int_equal(k_io_init(NULL, NULL), IO_ERROR_CONFIG);
+    assert_null(engine);
+}
+
+static void test_bad_args(void ** state)
+{
+    k_io_engine *   engine = get_engine(state);
+    k_io_completion events[MAX_EVENTS];
+    int             fds[2];
+    int             slot;
+    int             count;
+    int             buffer;
+
+    assert_int_equal(k_io_register_file(engine, -1, &slot), IO_ERROR_CONFIG);
+    assert_int_equal(k_io_queue_recv(engine, 5, 1), IO_ERROR_CONFIG);
+    assert_int_equal(k_io_queue_cancel(engine, 99), IO_ERROR_CONFIG);
+    assert_int_equal(k_io_wait(engine, events, 1, 0, &count), IO_ERROR_CONFIG);
+
+    assert_int_equal(pipe(fds), 0);
+    assert_int_equal(k_io_register_file(engine, fds[0], &slot), IO_OK);
+    assert_int_equal(k_io_buffer_acquire(engine, &buffer, NULL), IO_OK);
+
+    /* Receive buffers can't be borrowed, and reads can't overrun a buffer */
+    assert_true(buffer >= 2);
+    assert_int_equal(k_io_queue_read(engine, slot, buffer, 257,
+                                     K_IO_OFFSET_CURRENT, 1),
+                     IO_ERROR_CONFIG);
+
+    /* Can't pull a file out from under a request */
+    assert_int_equal(k_io_queue_read(engine, slot, buffer, 16,
+                                     K_IO_OFFSET_CURRENT, 1),
+                     IO_OK);
+    assert_int_equal(k_io_unregister_file(engine, slot), IO_ERROR_CONFIG);
+
+    assert_int_equal(k_io_queue_cancel(engine, 1), IO_OK);
+    assert_int_equal(collect(engine, events, 1), 1);
+    assert_int_equal(events[0].user_data, 1);
+    assert_int_equal(events[0].result, -ECANCELED);
+    assert_int_equal(events[0].buffer, buffer);
+    assert_false(events[0].more);
+
+    assert_int_equal(k_io_unregister_file(engine, slot), IO_OK);
+    k_io_buffer_release(engine, buffer);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_batched_pipes(void ** state)
+{
+    k_io_engine *   engine = get_engine(state);
+    k_io_completion events[MAX_EVENTS];
+    int             a[2], b[2];
+    int             slots[4];
+    int             bufs[4];
+    uint8_t *       data[4];
+
+    assert_int_equal(pipe(a), 0);
+    assert_int_equal(pipe(b), 0);
+
+    assert_int_equal(k_io_register_file(engine, a[1], &slots[0]), IO_OK);
+    assert_int_equal(k_io_register_file(engine, b[1], &slots[1]), IO_OK);
+    assert_int_equal(k_io_register_file(engine, a[0], &slots[2]), IO_OK);
+    assert_int_equal(k_io_register_file(engine, b[0], &slots[3]), IO_OK);
+
+    for (int i = 0; i < 4; i++)
+    {
+        assert_int_equal(k_io_buffer_acquire(engine, &bufs[i], &data[i]), IO_OK);
+    }
+
+    memcpy(data[0], "first", 5);
+    memcpy(data[1], "second", 6);
+
+    /* Two devices' writes go out in the same batch */
+    assert_int_equal(k_io_queue_write(engine, slots[0], bufs[0], 5,
+                                      K_IO_OFFSET_CURRENT, 10),
+                     IO_OK);
+    assert_int_equal(k_io_queue_write(engine, slots[1], bufs[1], 6,
+                                      K_IO_OFFSET_CURRENT, 11),
+                     IO_OK);
+    assert_int_equal(collect(engine, events, 2), 2);
+    for (int i = 0; i < 2; i++)
+    {
+        assert_true(events[i].user_data == 10 || events[i].user_data == 11);
+        assert_int_equal(events[i].result, (events[i].user_data == 10) ? 5 : 6);
+    }
+
+    assert_int_equal(k_io_queue_read(engine, slots[2], bufs[2], 16,
+                                     K_IO_OFFSET_CURRENT, 20),
+                     IO_OK);
+    assert_int_equal(k_io_queue_read(engine, slots[3], bufs[3], 16,
+                                     K_IO_OFFSET_CURRENT, 21),
+                     IO_OK);
+    assert_int_equal(collect(engine, events, 2), 2);
+    for (int i = 0; i < 2; i++)
+    {
+        uint8_t * got = k_io_buffer_data(engine, events[i].buffer);
+        if (events[i].user_data == 20)
+        {
+            assert_int_equal(events[i].result, 5);
+            assert_memory_equal(got, "first", 5);
+        }
+        else
+        {
+            assert_int_equal(events[i].user_data, 21);
+            assert_int_equal(events[i].result, 6);
+            assert_memory_equal(got, "second", 6);
+        }
+    }
+
+    for (int i = 0; i < 4; i++)
+    {
+        k_io_buffer_release(engine, bufs[i]);
+        assert_int_equal(k_io_unregister_file(engine, slots[i]), IO_OK);
+    }
+
+    close(a[0]);
+    close(a[1]);
+    close(b[0]);
+    close(b[1]);
+}
+
+static void test_file_offsets(void ** state)
+{
+    k_io_engine *   engine = get_engine(state);
+    k_io_completion events[MAX_EVENTS];
+    char            path[] = "/tmp/kubos-io-engine-XXXXXX";
+    int             fd     = mkstemp(path);
+    int             slot;
+    int             buffer;
+    uint8_t *       data;
+
+    assert_true(fd >= 0);
+    unlink(path);
+
+    assert_int_equal(k_io_register_file(engine, fd, &slot), IO_OK);
+    assert_int_equal(k_io_buffer_acquire(engine, &buffer, &data), IO_OK);
+
+    memcpy(data, "telemetry", 9);
+    assert_int_equal(k_io_queue_write(engine, slot, buffer, 9, 100, 1), IO_OK);
+    assert_int_equal(collect(engine, events, 1), 1);
+    assert_int_equal(events[0].result, 9);
+
+    memset(data, 0, 9);
+    assert_int_equal(k_io_queue_read(engine, slot, buffer, 4, 104, 2), IO_OK);
+    assert_int_equal(collect(engine, events, 1), 1);
+    assert_int_equal(events[0].result, 4);
+    assert_memory_equal(data, "metr", 4);
+
+    k_io_buffer_release(engine, buffer);
+    assert_int_equal(k_io_unregister_file(engine, slot), IO_OK);
+    close(fd);
+}
+
+static void test_recv_socket(void ** state)
+{
+    k_io_engine *   engine = get_engine(state);
+    k_io_completion events[MAX_EVENTS];
+    int             sv[2];
+    int             slot;
+    int             held[2];
+
+    assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+    assert_int_equal(k_io_register_file(engine, sv[0], &slot), IO_OK);
+    assert_int_equal(k_io_queue_recv(engine, slot, 7), IO_OK);
+
+    /* One armed receive delivers every chunk */
+    const char * chunks[] = { "ping", "pong", "ack" };
+    for (int i = 0; i < 2; i++)
+    {
+        assert_int_equal(write(sv[1], chunks[i], strlen(chunks[i])),
+                         strlen(chunks[i]));
+        assert_int_equal(collect(engine, events, 1), 1);
+        assert_int_equal(events[0].user_data, 7);
+        assert_true(events[0].more);
+        assert_int_equal(events[0].result, 4);
+        assert_memory_equal(k_io_buffer_data(engine, events[0].buffer),
+                            chunks[i], 4);
+        held[i] = events[0].buffer;
+    }
+
+    /* Both receive buffers are held, so the next chunk waits */
+    assert_int_equal(write(sv[1], chunks[2], 3), 3);
+    int count = 0;
+    assert_int_equal(k_io_wait(engine, events, MAX_EVENTS, 50, &count), IO_OK);
+    assert_int_equal(count, 0);
+
+    k_io_buffer_release(engine, held[0]);
+    assert_int_equal(collect(engine, events, 1), 1);
+    assert_true(events[0].more);
+    assert_int_equal(events[0].result, 3);
+    assert_memory_equal(k_io_buffer_data(engine, events[0].buffer), "ack", 3);
+    k_io_buffer_release(engine, events[0].buffer);
+    k_io_buffer_release(engine, held[1]);
+
+    assert_int_equal(k_io_queue_cancel(engine, 7), IO_OK);
+    assert_int_equal(collect(engine, events, 1), 1);
+    assert_int_equal(events[0].user_data, 7);
+    assert_false(events[0].more);
+    assert_int_equal(events[0].result, -ECANCELED);
+    assert_int_equal(events[0].buffer, -1);
+
+    assert_int_equal(k_io_unregister_file(engine, slot), IO_OK);
+    close(sv[0]);
+    close(sv[1]);
+}
+
+static void test_recv_pipe_eof(void ** state)
+{
+    k_io_engine *   engine = get_engine(state);
+    k_io_completion events[MAX_EVENTS];
+    int             fds[2];
+    int             slot;
+
+    assert_int_equal(pipe(fds), 0);
+    assert_int_equal(k_io_register_file(engine, fds[0], &slot), IO_OK);
+    assert_int_equal(k_io_queue_recv(engine, slot, 3), IO_OK);
+
+    for (int i = 0; i < 3; i++)
+    {
+        assert_int_equal(write(fds[1], "x", 1), 1);
+        assert_int_equal(collect(engine, events, 1), 1);
+        assert_true(events[0].more);
+        assert_int_equal(events[0].result, 1);
+        k_io_buffer_release(engine, events[0].buffer);
+    }
+
+    /* Closing the writer ends the receive */
+    close(fds[1]);
+    assert_int_equal(collect(engine, events, 1), 1);
+    assert_false(events[0].more);
+    assert_int_equal(events[0].result, 0);
+
+    assert_int_equal(k_io_unregister_file(engine, slot), IO_OK);
+    close(fds[0]);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_init_bad_config),
+        cmocka_unit_test_setup_teardown(test_bad_args, setup_uring, teardown),
+        cmocka_unit_test_setup_teardown(test_bad_args, setup_epoll, teardown),
+        cmocka_unit_test_setup_teardown(test_batched_pipes, setup_uring, teardown),
+        cmocka_unit_test_setup_teardown(test_batched_pipes, setup_epoll, teardown),
+        cmocka_unit_test_setup_teardown(test_file_offsets, setup_uring, teardown),
+        cmocka_unit_test_setup_teardown(test_file_offsets, setup_epoll, teardown),
+        cmocka_unit_test_setup_teardown(test_recv_socket, setup_uring, teardown),
+        cmocka_unit_test_setup_teardown(test_recv_socket, setup_epoll, teardown),
+        cmocka_unit_test_setup_teardown(test_recv_pipe_eof, setup_uring, teardown),
+        cmocka_unit_test_setup_teardown(test_recv_pipe_eof, setup_epoll, teardown),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
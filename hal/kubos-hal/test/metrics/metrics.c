@@ -0,0 +1,296 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include "device-policy.h"
+#include "i2c.h"
+#include "metrics.h"
+
+#define TEST_BUS 1
+
+/* Tables are large, so keep them out of the stack */
+static k_metrics_table before;
+static k_metrics_table after;
+static uint8_t         encoded[K_METRICS_ENCODED_MAX];
+
+/* Rows collected by decode_row */
+typedef struct {
+    int      rows;
+    char     device[K_METRICS_NAME_LEN];
+    uint8_t  command;
+    uint32_t counts[K_METRIC_EVENTS];
+} decoded;
+
+static void decode_row(void * arg, const char * device, uint8_t command,
+                       const uint32_t counts[K_METRIC_EVENTS])
+{
+    decoded * out = arg;
+
+    out->rows++;
+    strncpy(out->device, device, K_METRICS_NAME_LEN - 1);
+    out->command = command;
+    memcpy(out->counts, counts, sizeof(out->counts));
+}
+
+static void test_record_snapshot(void ** arg)
+{
+    int device, again;
+
+    assert_int_equal(k_metrics_device("record", &device), METRICS_OK);
+    assert_int_equal(k_metrics_device("record", &again), METRICS_OK);
+    assert_int_equal(again, device);
+
+    k_metrics_record(device, 0x42, METRIC_SUCCESS);
+    k_metrics_record(device, 0x42, METRIC_SUCCESS);
+    k_metrics_record(device, 0x42, METRIC_ECHO_MISMATCH);
+
+    /* Out of range ids are ignored */
+    k_metrics_record(-1, 0x42, METRIC_SUCCESS);
+    k_metrics_record(K_METRICS_DEVICES, 0x42, METRIC_SUCCESS);
+    k_metrics_record(device, 0x42, K_METRIC_EVENTS);
+
+    assert_int_equal(k_metrics_snapshot(&after), METRICS_OK);
+    assert_string_equal(after.names[device], "record");
+    assert_int_equal(after.counts[device][0x42][METRIC_SUCCESS], 2);
+    assert_int_equal(after.counts[device][0x42][METRIC_ECHO_MISMATCH], 1);
+    assert_int_equal(after.counts[device][0x43][METRIC_SUCCESS], 0);
+}
+
+static void test_bad_args(void ** arg)
+{
+    int    device;
+    size_t len;
+
+    assert_int_equal(k_metrics_device(NULL, &device), METRICS_ERROR_CONFIG);
+    assert_int_equal(k_metrics_device("", &device), METRICS_ERROR_CONFIG);
+    assert_int_equal(k_metrics_device("bad", NULL), METRICS_ERROR_CONFIG);
+    assert_int_equal(k_metrics_attach(K_METRICS_DEVICES, TEST_BUS, 0x10),
+                     METRICS_ERROR_CONFIG);
+    assert_int_equal(k_metrics_snapshot(NULL), METRICS_ERROR_CONFIG);
+    assert_int_equal(k_metrics_encode(NULL, NULL, encoded, sizeof(encoded),
+                                      &len),
+                     METRICS_ERROR_CONFIG);
+    assert_int_equal(k_metrics_decode(NULL, 0, NULL, NULL, NULL),
+                     METRICS_ERROR_CONFIG);
+}
+
+static void test_encode_absolute(void ** arg)
+{
+    decoded          out = { 0 };
+    k_metrics_header header;
+    size_t           len;
+    int              device;
+
+    assert_int_equal(k_metrics_device("absolute", &device), METRICS_OK);
+    for (int i = 0; i < 300; i++)
+    {
+        k_metrics_record(device, 0x07, METRIC_TIMEOUT);
+    }
+
+    assert_int_equal(k_metrics_snapshot(&after), METRICS_OK);
+    assert_int_equal(k_metrics_encode(&after, NULL, encoded, sizeof(encoded),
+                                      &len),
+                     METRICS_OK);
+
+    assert_int_equal(k_metrics_decode(encoded, len, &header, decode_row, &out),
+                     METRICS_OK);
+    assert_int_equal(header.version, K_METRICS_VERSION);
+    assert_false(header.delta);
+    assert_true(header.time_ns == after.time_ns);
+
+    /* Every recorded command comes back, the last being ours */
+    assert_true(out.rows >= 2);
+    assert_string_equal(out.device, "absolute");
+    assert_int_equal(out.command, 0x07);
+    assert_int_equal(out.counts[METRIC_TIMEOUT], 300);
+    assert_int_equal(out.counts[METRIC_SUCCESS], 0);
+}
+
+static void test_encode_delta(void ** arg)
+{
+    decoded          out = { 0 };
+    k_metrics_header header;
+    size_t           len;
+    int              device;
+
+    assert_int_equal(k_metrics_device("delta", &device), METRICS_OK);
+    k_metrics_record(device, 0x10, METRIC_SUCCESS);
+
+    assert_int_equal(k_metrics_snapshot(&before), METRICS_OK);
+    k_metrics_record(device, 0x10, METRIC_SUCCESS);
+    k_metrics_record(device, 0x10, METRIC_CHECKSUM);
+    assert_int_equal(k_metrics_snapshot(&after), METRICS_OK);
+
+    assert_int_equal(k_metrics_encode(&after, &before, encoded,
+                                      sizeof(encoded), &len),
+                     METRICS_OK);
+    assert_int_equal(k_metrics_decode(encoded, len, &header, decode_row, &out),
+                     METRICS_OK);
+
+    assert_true(header.delta);
+    assert_true(header.since_ns == before.time_ns);
+
+    /* Only the change since the earlier table is sent */
+    assert_int_equal(out.rows, 1);
+    assert_string_equal(out.device, "delta");
+    assert_int_equal(out.command, 0x10);
+    assert_int_equal(out.counts[METRIC_SUCCESS], 1);
+    assert_int_equal(out.counts[METRIC_CHECKSUM], 1);
+
+    /* Header plus one device of one row */
+    assert_int_equal(len, 21 + (1 + 5 + 1) + (2 + 2));
+
+    /* Deltas survive the counters wrapping */
+    before.counts[device][0x10][METRIC_SUCCESS] = UINT32_MAX;
+    after.counts[device][0x10][METRIC_SUCCESS]  = 1;
+    memset(&out, 0, sizeof(out));
+    assert_int_equal(k_metrics_encode(&after, &before, encoded,
+                                      sizeof(encoded), &len),
+                     METRICS_OK);
+    assert_int_equal(k_metrics_decode(encoded, len, NULL, decode_row, &out),
+                     METRICS_OK);
+    assert_int_equal(out.counts[METRIC_SUCCESS], 2);
+}
+
+static void test_encode_full(void ** arg)
+{
+    size_t len;
+
+    assert_int_equal(k_metrics_snapshot(&after), METRICS_OK);
+    assert_int_equal(k_metrics_encode(&after, NULL, encoded, 21, &len),
+                     METRICS_ERROR_FULL);
+    assert_int_equal(k_metrics_encode(&after, NULL, encoded, 4, &len),
+                     METRICS_ERROR_FULL);
+}
+
+static void test_decode_malformed(void ** arg)
+{
+    size_t len;
+
+    assert_int_equal(k_metrics_snapshot(&after), METRICS_OK);
+    assert_int_equal(k_metrics_encode(&after, NULL, encoded, sizeof(encoded),
+                                      &len),
+                     METRICS_OK);
+
+    /* Every truncation is caught */
+    for (size_t cut = 0; cut < len; cut++)
+    {
+        assert_int_equal(k_metrics_decode(encoded, cut, NULL, NULL, NULL),
+                         METRICS_ERROR);
+    }
+
+    /* As are trailing bytes, and a bad magic or version */
+    assert_int_equal(k_metrics_decode(encoded, len + 1, NULL, NULL, NULL),
+                     METRICS_ERROR);
+
+    encoded[2] = K_METRICS_VERSION + 1;
+    assert_int_equal(k_metrics_decode(encoded, len, NULL, NULL, NULL),
+                     METRICS_ERROR);
+    encoded[2] = K_METRICS_VERSION;
+
+    encoded[0] = 'X';
+    assert_int_equal(k_metrics_decode(encoded, len, NULL, NULL, NULL),
+                     METRICS_ERROR);
+}
+
+static void test_i2c_transfers(void ** arg)
+{
+    const k_policy_config policy = {
+        .max_attempts      = 3,
+        .base_delay_us     = 10,
+        .max_delay_us      = 100,
+        .failure_threshold = 10,
+        .open_ms           = 20,
+    };
+    uint8_t command[] = { 0x33, 0x01 };
+    uint8_t response[2];
+    int     device;
+
+    assert_int_equal(k_metrics_device("i2c", &device), METRICS_OK);
+    assert_int_equal(k_metrics_attach(device, TEST_BUS, 0x20), METRICS_OK);
+    assert_int_equal(k_metrics_attach(device, TEST_BUS, 0x20), METRICS_OK);
+    assert_int_equal(k_policy_attach("i2c", TEST_BUS, 0x20, &policy, NULL),
+                     POLICY_OK);
+
+    assert_int_equal(k_metrics_snapshot(&before), METRICS_OK);
+
+    /* A write that works */
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_write, sizeof(command));
+    assert_int_equal(k_i2c_write(TEST_BUS, 0x20, command, sizeof(command)),
+                     I2C_OK);
+
+    /* A read NACKed on every attempt, counted under the command sent */
+    for (uint32_t i = 0; i < policy.max_attempts; i++)
+    {
+        will_return(__wrap_ioctl, 0);
+        will_return(__wrap_read, -1);
+    }
+    assert_int_equal(k_i2c_read(TEST_BUS, 0x20, response, sizeof(response)),
+                     I2C_ERROR);
+
+    /* Another address on the bus isn't counted */
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_write, sizeof(command));
+    assert_int_equal(k_i2c_write(TEST_BUS, 0x21, command, sizeof(command)),
+                     I2C_OK);
+
+    assert_int_equal(k_metrics_snapshot(&after), METRICS_OK);
+
+    const uint32_t * now  = after.counts[device][0x33];
+    const uint32_t * then = before.counts[device][0x33];
+
+    assert_int_equal(now[METRIC_SUCCESS] - then[METRIC_SUCCESS], 1);
+    assert_int_equal(now[METRIC_NACK] - then[METRIC_NACK], policy.max_attempts);
+    assert_int_equal(now[METRIC_RETRY] - then[METRIC_RETRY],
+                     policy.max_attempts - 1);
+
+    k_policy_detach(TEST_BUS, 0x20);
+}
+
+static void test_device_full(void ** arg)
+{
+    char   name[K_METRICS_NAME_LEN];
+    int    device;
+    KMetricsStatus status = METRICS_OK;
+
+    for (int i = 0; i <= K_METRICS_DEVICES && status == METRICS_OK; i++)
+    {
+        snprintf(name, sizeof(name), "full-%d", i);
+        status = k_metrics_device(name, &device);
+    }
+
+    assert_int_equal(status, METRICS_ERROR_FULL);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_record_snapshot),
+        cmocka_unit_test(test_bad_args),
+        cmocka_unit_test(test_encode_absolute),
+        cmocka_unit_test(test_encode_delta),
+        cmocka_unit_test(test_encode_full),
+        cmocka_unit_test(test_decode_malformed),
+        cmocka_unit_test(test_i2c_transfers),
+        cmocka_unit_test(test_device_full),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
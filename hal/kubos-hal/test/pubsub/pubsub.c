@@ -0,0 +1,348 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmocka.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include "pubsub.h"
+
+#define PRODUCERS         4
+#define CONSUMERS         2
+#define PER_PRODUCER      20000
+#define STRESS_CAPACITY   64
+
+typedef struct {
+    uint32_t producer;
+    uint32_t seq;
+} stress_msg;
+
+static uint64_t small_storage[K_PUBSUB_STORAGE(16, 4)];
+static uint64_t basic_storage[K_PUBSUB_STORAGE(16, 8)];
+static uint64_t wake_storage[K_PUBSUB_STORAGE(16, 8)];
+static uint64_t subs_storage[K_PUBSUB_STORAGE(16, 8)];
+static uint64_t stress_storage[K_PUBSUB_STORAGE(sizeof(stress_msg),
+                                                STRESS_CAPACITY)];
+
+static int readable(const k_pubsub_sub * sub)
+{
+    struct pollfd pfd = {.fd = k_pubsub_fd(sub), .events = POLLIN };
+
+    return poll(&pfd, 1, 0);
+}
+
+static void test_topic_bad_args(void ** arg)
+{
+    int topic;
+
+    assert_int_equal(k_pubsub_topic(NULL, 16, 8, basic_storage,
+                                    K_PUBSUB_STORAGE(16, 8), &topic),
+                     PUBSUB_ERROR_CONFIG);
+    assert_int_equal(k_pubsub_topic("bad", 0, 8, basic_storage,
+                                    K_PUBSUB_STORAGE(16, 8), &topic),
+                     PUBSUB_ERROR_CONFIG);
+    /* Capacity must be a power of two */
+    assert_int_equal(k_pubsub_topic("bad", 16, 6, basic_storage,
+                                    K_PUBSUB_STORAGE(16, 8), &topic),
+                     PUBSUB_ERROR_CONFIG);
+    /* Storage too small */
+    assert_int_equal(k_pubsub_topic("bad", 16, 8, small_storage,
+                                    K_PUBSUB_STORAGE(16, 4), &topic),
+                     PUBSUB_ERROR_CONFIG);
+    assert_int_equal(k_pubsub_find("bad", &topic), PUBSUB_ERROR);
+    assert_int_equal(k_pubsub_publish(-1, "x", 1), PUBSUB_ERROR_CONFIG);
+}
+
+static void test_fan_out(void ** arg)
+{
+    int          topic, again;
+    k_pubsub_sub first, second;
+    char         data[16];
+    uint32_t     len, lost;
+
+    assert_int_equal(k_pubsub_topic("basic", 16, 8, basic_storage,
+                                    K_PUBSUB_STORAGE(16, 8), &topic),
+                     PUBSUB_OK);
+
+    /* Same name, same topic; a different size is refused */
+    assert_int_equal(k_pubsub_topic("basic", 16, 8, NULL, 0, &again),
+                     PUBSUB_OK);
+    assert_int_equal(again, topic);
+    assert_int_equal(k_pubsub_topic("basic", 12, 8, NULL, 0, &again),
+                     PUBSUB_ERROR_CONFIG);
+    assert_int_equal(k_pubsub_find("basic", &again), PUBSUB_OK);
+    assert_int_equal(again, topic);
+
+    /* Only messages published after subscribing are seen */
+    assert_int_equal(k_pubsub_publish(topic, "early", 6), PUBSUB_OK);
+
+    assert_int_equal(k_pubsub_subscribe(topic, &first), PUBSUB_OK);
+    assert_int_equal(k_pubsub_subscribe(topic, &second), PUBSUB_OK);
+
+    assert_int_equal(k_pubsub_publish(topic, "hello", 6), PUBSUB_OK);
+    assert_int_equal(k_pubsub_publish(topic, "world!", 7), PUBSUB_OK);
+    assert_int_equal(k_pubsub_publish(topic, data, 17), PUBSUB_ERROR_CONFIG);
+
+    /* Each subscriber reads every message */
+    assert_int_equal(k_pubsub_read(&first, data, &len, &lost), PUBSUB_OK);
+    assert_string_equal(data, "hello");
+    assert_int_equal(len, 6);
+    assert_int_equal(lost, 0);
+    assert_int_equal(k_pubsub_read(&first, data, &len, NULL), PUBSUB_OK);
+    assert_string_equal(data, "world!");
+    assert_int_equal(k_pubsub_read(&first, data, &len, NULL), PUBSUB_EMPTY);
+
+    assert_int_equal(k_pubsub_read(&second, data, NULL, NULL), PUBSUB_OK);
+    assert_string_equal(data, "hello");
+    assert_int_equal(k_pubsub_read(&second, data, NULL, NULL), PUBSUB_OK);
+    assert_string_equal(data, "world!");
+    assert_int_equal(k_pubsub_read(&second, data, NULL, NULL), PUBSUB_EMPTY);
+
+    k_pubsub_unsubscribe(&first);
+    k_pubsub_unsubscribe(&second);
+    assert_int_equal(k_pubsub_read(&first, data, NULL, NULL),
+                     PUBSUB_ERROR_CONFIG);
+}
+
+static void test_lapped(void ** arg)
+{
+    int          topic;
+    k_pubsub_sub sub;
+    uint32_t     data[4];
+    uint32_t     lost;
+
+    assert_int_equal(k_pubsub_topic("small", 16, 4, small_storage,
+                                    K_PUBSUB_STORAGE(16, 4), &topic),
+                     PUBSUB_OK);
+    assert_int_equal(k_pubsub_subscribe(topic, &sub), PUBSUB_OK);
+
+    for (uint32_t i = 0; i < 10; i++)
+    {
+        assert_int_equal(k_pubsub_publish(topic, &i, sizeof(i)), PUBSUB_OK);
+    }
+
+    /* Only the last four are left; the reader is told about the rest */
+    assert_int_equal(k_pubsub_read(&sub, data, NULL, &lost), PUBSUB_OK);
+    assert_int_equal(data[0], 6);
+    assert_int_equal(lost, 6);
+
+    for (uint32_t i = 7; i < 10; i++)
+    {
+        assert_int_equal(k_pubsub_read(&sub, data, NULL, &lost), PUBSUB_OK);
+        assert_int_equal(data[0], i);
+        assert_int_equal(lost, 0);
+    }
+    assert_int_equal(k_pubsub_read(&sub, data, NULL, &lost), PUBSUB_EMPTY);
+
+    k_pubsub_unsubscribe(&sub);
+}
+
+static void test_wakeup(void ** arg)
+{
+    int          topic;
+    k_pubsub_sub sub;
+    char         data[16];
+
+    assert_int_equal(k_pubsub_topic("wake", 16, 8, wake_storage,
+                                    K_PUBSUB_STORAGE(16, 8), &topic),
+                     PUBSUB_OK);
+    assert_int_equal(k_pubsub_subscribe(topic, &sub), PUBSUB_OK);
+    assert_true(k_pubsub_fd(&sub) >= 0);
+    assert_int_equal(readable(&sub), 0);
+
+    /* Not armed yet, so no wakeup is needed */
+    assert_int_equal(k_pubsub_publish(topic, "a", 2), PUBSUB_OK);
+    assert_int_equal(readable(&sub), 0);
+    assert_int_equal(k_pubsub_read(&sub, data, NULL, NULL), PUBSUB_OK);
+
+    /* Finding the ring empty arms the descriptor */
+    assert_int_equal(k_pubsub_read(&sub, data, NULL, NULL), PUBSUB_EMPTY);
+    assert_int_equal(readable(&sub), 0);
+    assert_int_equal(k_pubsub_publish(topic, "b", 2), PUBSUB_OK);
+    assert_int_equal(readable(&sub), 1);
+
+    assert_int_equal(k_pubsub_read(&sub, data, NULL, NULL), PUBSUB_OK);
+    assert_string_equal(data, "b");
+    assert_int_equal(k_pubsub_read(&sub, data, NULL, NULL), PUBSUB_EMPTY);
+    assert_int_equal(readable(&sub), 0);
+
+    k_pubsub_unsubscribe(&sub);
+}
+
+static void test_subscriber_limit(void ** arg)
+{
+    int          topic;
+    k_pubsub_sub subs[K_PUBSUB_MAX_SUBSCRIBERS];
+    k_pubsub_sub extra;
+    int          fd;
+
+    assert_int_equal(k_pubsub_topic("subs", 16, 8, subs_storage,
+                                    K_PUBSUB_STORAGE(16, 8), &topic),
+                     PUBSUB_OK);
+
+    for (int i = 0; i < K_PUBSUB_MAX_SUBSCRIBERS; i++)
+    {
+        assert_int_equal(k_pubsub_subscribe(topic, &subs[i]), PUBSUB_OK);
+    }
+    assert_int_equal(k_pubsub_subscribe(topic, &extra), PUBSUB_ERROR_FULL);
+
+    /* A freed slot is reused, descriptor and all */
+    fd = k_pubsub_fd(&subs[3]);
+    k_pubsub_unsubscribe(&subs[3]);
+    assert_int_equal(k_pubsub_subscribe(topic, &extra), PUBSUB_OK);
+    assert_int_equal(k_pubsub_fd(&extra), fd);
+
+    k_pubsub_unsubscribe(&extra);
+    for (int i = 0; i < K_PUBSUB_MAX_SUBSCRIBERS; i++)
+    {
+        k_pubsub_unsubscribe(&subs[i]);
+    }
+}
+
+static int stress_topic;
+static int producers_done;
+
+static void * stress_producer(void * arg)
+{
+    stress_msg msg = {.producer = (uint32_t) (uintptr_t) arg };
+
+    for (msg.seq = 0; msg.seq < PER_PRODUCER; msg.seq++)
+    {
+        k_pubsub_publish(stress_topic, &msg, sizeof(msg));
+    }
+
+    __atomic_add_fetch(&producers_done, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+typedef struct {
+    k_pubsub_sub sub;
+    uint64_t     received;
+    uint64_t     lost;
+    int          out_of_order;
+} stress_consumer;
+
+static void * stress_reader(void * arg)
+{
+    stress_consumer * consumer = arg;
+    int64_t           last[PRODUCERS];
+    stress_msg        msg;
+    uint32_t          len, lost;
+
+    for (int i = 0; i < PRODUCERS; i++)
+    {
+        last[i] = -1;
+    }
+
+    while (consumer->received + consumer->lost
+           < (uint64_t) PRODUCERS * PER_PRODUCER)
+    {
+        KPubSubStatus status = k_pubsub_read(&consumer->sub, &msg, &len, &lost);
+
+        consumer->lost += lost;
+        if (status == PUBSUB_OK)
+        {
+            if (len != sizeof(msg) || msg.producer >= PRODUCERS
+                || (int64_t) msg.seq <= last[msg.producer])
+            {
+                consumer->out_of_order++;
+            }
+            else
+            {
+                last[msg.producer] = msg.seq;
+            }
+            consumer->received++;
+        }
+        else
+        {
+            struct pollfd pfd = {.fd = k_pubsub_fd(&consumer->sub),
+                                 .events = POLLIN };
+
+            if (poll(&pfd, 1, 1000) == 0
+                && __atomic_load_n(&producers_done, __ATOMIC_ACQUIRE)
+                       == PRODUCERS)
+            {
+                /* Everything published has been accounted for, or never will be */
+                break;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void test_stress(void ** arg)
+{
+    pthread_t       producers[PRODUCERS];
+    pthread_t       readers[CONSUMERS];
+    stress_consumer consumers[CONSUMERS];
+
+    memset(consumers, 0, sizeof(consumers));
+
+    assert_int_equal(k_pubsub_topic("stress", sizeof(stress_msg),
+                                    STRESS_CAPACITY, stress_storage,
+                                    sizeof(stress_storage)
+                                        / sizeof(stress_storage[0]),
+                                    &stress_topic),
+                     PUBSUB_OK);
+
+    for (int i = 0; i < CONSUMERS; i++)
+    {
+        assert_int_equal(k_pubsub_subscribe(stress_topic, &consumers[i].sub),
+                         PUBSUB_OK);
+        assert_int_equal(pthread_create(&readers[i], NULL, stress_reader,
+                                        &consumers[i]),
+                         0);
+    }
+    for (int i = 0; i < PRODUCERS; i++)
+    {
+        assert_int_equal(pthread_create(&producers[i], NULL, stress_producer,
+                                        (void *) (uintptr_t) i),
+                         0);
+    }
+
+    for (int i = 0; i < PRODUCERS; i++)
+    {
+        pthread_join(producers[i], NULL);
+    }
+    for (int i = 0; i < CONSUMERS; i++)
+    {
+        pthread_join(readers[i], NULL);
+        k_pubsub_unsubscribe(&consumers[i].sub);
+
+        /* Every message was either delivered in order or reported lost */
+        assert_int_equal(consumers[i].out_of_order, 0);
+        assert_true(consumers[i].received > 0);
+        assert_int_equal(consumers[i].received + consumers[i].lost,
+                         (uint64_t) PRODUCERS * PER_PRODUCER);
+    }
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_topic_bad_args),
+        cmocka_unit_test(test_fan_out),
+        cmocka_unit_test(test_lapped),
+        cmocka_unit_test(test_wakeup),
+        cmocka_unit_test(test_subscriber_limit),
+        cmocka_unit_test(test_stress),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
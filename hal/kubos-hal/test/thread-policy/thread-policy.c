@@ -0,0 +1,270 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+
+#include <cmocka.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "thread-policy.h"
+
+/* What a started thread found out about itself */
+typedef struct {
+    char      name[K_THREAD_POLICY_NAME_LEN];
+    size_t    stack;
+    cpu_set_t cpus;
+    sem_t     done;
+} thread_report;
+
+static void * report_thread(void * arg)
+{
+    thread_report * report = arg;
+    pthread_attr_t  attr;
+
+    pthread_getname_np(pthread_self(), report->name, sizeof(report->name));
+    pthread_getaffinity_np(pthread_self(), sizeof(report->cpus), &report->cpus);
+    pthread_getattr_np(pthread_self(), &attr);
+    pthread_attr_getstacksize(&attr, &report->stack);
+    pthread_attr_destroy(&attr);
+
+    sem_post(&report->done);
+
+    return NULL;
+}
+
+static void run_thread(const char * name, thread_report * report)
+{
+    pthread_t thread;
+
+    memset(report, 0, sizeof(*report));
+    sem_init(&report->done, 0, 0);
+
+    assert_int_equal(k_thread_create(name, &thread, report_thread, report),
+                     THREAD_POLICY_OK);
+    pthread_join(thread, NULL);
+    sem_destroy(&report->done);
+}
+
+static void test_env_spec(void ** arg)
+{
+    k_thread_policy policy;
+
+    /* Set up by main() before anything else ran */
+    assert_int_equal(k_thread_policy_get("env-thread", &policy), THREAD_POLICY_OK);
+    assert_int_equal(policy.stack_kb, 96);
+    assert_true(policy.mlock);
+
+    assert_int_equal(k_thread_policy_set("env-thread", NULL), THREAD_POLICY_OK);
+}
+
+static void test_bad_args(void ** arg)
+{
+    k_thread_policy policy = { .sched = THREAD_SCHED_FIFO, .priority = 0 };
+
+    assert_int_equal(k_thread_policy_set("fifo", &policy), THREAD_POLICY_ERROR_CONFIG);
+    policy.sched = 42;
+    assert_int_equal(k_thread_policy_set("bad", &policy), THREAD_POLICY_ERROR_CONFIG);
+    policy.sched = THREAD_SCHED_OTHER;
+    assert_int_equal(k_thread_policy_set("", &policy), THREAD_POLICY_ERROR_CONFIG);
+
+    assert_int_equal(k_thread_policy_get("any", NULL), THREAD_POLICY_ERROR_CONFIG);
+    assert_int_equal(k_thread_policy_parse(NULL), THREAD_POLICY_ERROR_CONFIG);
+
+    assert_int_equal(k_thread_create(NULL, NULL, report_thread, NULL),
+                     THREAD_POLICY_ERROR_CONFIG);
+    assert_int_equal(k_thread_create("null", NULL, NULL, NULL),
+                     THREAD_POLICY_ERROR_CONFIG);
+}
+
+static void test_set_and_get(void ** arg)
+{
+    k_thread_policy fallback = { .stack_kb = 32 };
+    k_thread_policy named = { .stack_kb = 48, .sched = THREAD_SCHED_RR, .priority = 5 };
+    k_thread_policy policy;
+
+    assert_int_equal(k_thread_policy_set(NULL, &fallback), THREAD_POLICY_OK);
+    assert_int_equal(k_thread_policy_set("named", &named), THREAD_POLICY_OK);
+
+    k_thread_policy_get("named", &policy);
+    assert_memory_equal(&policy, &named, sizeof(policy));
+    k_thread_policy_get("other", &policy);
+    assert_memory_equal(&policy, &fallback, sizeof(policy));
+
+    /* Removing a named policy falls back to the default one */
+    assert_int_equal(k_thread_policy_set("named", NULL), THREAD_POLICY_OK);
+    k_thread_policy_get("named", &policy);
+    assert_int_equal(policy.stack_kb, 32);
+
+    assert_int_equal(k_thread_policy_set(NULL, NULL), THREAD_POLICY_OK);
+    k_thread_policy_get(NULL, &policy);
+    assert_int_equal(policy.stack_kb, 0);
+    assert_int_equal(policy.sched, THREAD_SCHED_INHERIT);
+}
+
+static void test_full(void ** arg)
+{
+    k_thread_policy policy = { .stack_kb = 64 };
+    char            name[K_THREAD_POLICY_NAME_LEN];
+
+    for (int i = 0; i < K_THREAD_POLICY_MAX; i++)
+    {
+        snprintf(name, sizeof(name), "thread-%d", i);
+        assert_int_equal(k_thread_policy_set(name, &policy), THREAD_POLICY_OK);
+    }
+
+    assert_int_equal(k_thread_policy_set("one-more", &policy), THREAD_POLICY_ERROR_FULL);
+    /* Replacing an existing one still works */
+    assert_int_equal(k_thread_policy_set("thread-0", &policy), THREAD_POLICY_OK);
+
+    for (int i = 0; i < K_THREAD_POLICY_MAX; i++)
+    {
+        snprintf(name, sizeof(name), "thread-%d", i);
+        k_thread_policy_set(name, NULL);
+    }
+}
+
+static void test_parse(void ** arg)
+{
+    k_thread_policy policy;
+
+    assert_int_equal(
+        k_thread_policy_parse("default:stack=64;"
+                              "imtq-watchdog:sched=fifo,priority=40,cpus=0x3,mlock=0"),
+        THREAD_POLICY_OK);
+
+    k_thread_policy_get(NULL, &policy);
+    assert_int_equal(policy.stack_kb, 64);
+    k_thread_policy_get("imtq-watchdog", &policy);
+    assert_int_equal(policy.stack_kb, 0);
+    assert_int_equal(policy.sched, THREAD_SCHED_FIFO);
+    assert_int_equal(policy.priority, 40);
+    assert_int_equal(policy.cpu_mask, 3);
+    assert_false(policy.mlock);
+
+    /* A bad spec changes nothing, not even its good entries */
+    const char * bad[] = {
+        "default:stack=32;imtq-watchdog:sched=idle",
+        "default:stack=32;imtq-watchdog:priority=-1",
+        "default:stack=32;imtq-watchdog:sched=fifo",
+        "default:stack=32;imtq-watchdog",
+        "default:stack=32;:stack=8",
+        "default:stack=32;a-very-long-thread-name:stack=8",
+        "default:stack=32,colour=red",
+        "default:stack=32;imtq-watchdog:mlock=2",
+    };
+
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    {
+        assert_int_equal(k_thread_policy_parse(bad[i]), THREAD_POLICY_ERROR_CONFIG);
+    }
+
+    k_thread_policy_get(NULL, &policy);
+    assert_int_equal(policy.stack_kb, 64);
+    k_thread_policy_get("imtq-watchdog", &policy);
+    assert_int_equal(policy.priority, 40);
+
+    k_thread_policy_set(NULL, NULL);
+    k_thread_policy_set("imtq-watchdog", NULL);
+}
+
+static void test_create_applies_policy(void ** arg)
+{
+    k_thread_policy policy = { .stack_kb = 256, .cpu_mask = 0x1 };
+    thread_report   report;
+
+    assert_int_equal(k_thread_policy_set("policy-test", &policy), THREAD_POLICY_OK);
+
+    run_thread("policy-test", &report);
+    assert_string_equal(report.name, "policy-test");
+    assert_true(report.stack >= 256 * 1024);
+    assert_true(report.stack < 512 * 1024);
+    assert_int_equal(CPU_COUNT(&report.cpus), 1);
+    assert_true(CPU_ISSET(0, &report.cpus));
+
+    k_thread_policy_set("policy-test", NULL);
+
+    /* Without a policy: the small default stack instead of the 8 MB one */
+    run_thread("a-long-thread-name", &report);
+    assert_string_equal(report.name, "a-long-thread-n");
+    assert_true(report.stack >= K_THREAD_POLICY_STACK_KB * 1024);
+    /* glibc may hand back the cached stack of the last thread */
+    assert_true(report.stack <= 1024 * 1024);
+}
+
+static void test_create_falls_back(void ** arg)
+{
+    k_thread_policy policy = { .cpu_mask = 1ULL << 63 };
+    thread_report   report;
+
+    if (sysconf(_SC_NPROCESSORS_CONF) >= 64)
+    {
+        skip();
+    }
+
+    /* The affinity can't be met, but the thread still runs */
+    assert_int_equal(k_thread_policy_set("fallback", &policy), THREAD_POLICY_OK);
+    run_thread("fallback", &report);
+    assert_string_equal(report.name, "fallback");
+    assert_false(CPU_ISSET(63, &report.cpus));
+
+    /* Real-time: applied if we're allowed, inherited otherwise */
+    policy.cpu_mask = 0;
+    policy.sched = THREAD_SCHED_FIFO;
+    policy.priority = 10;
+    assert_int_equal(k_thread_policy_set("fallback", &policy), THREAD_POLICY_OK);
+    run_thread("fallback", &report);
+    assert_string_equal(report.name, "fallback");
+
+    k_thread_policy_set("fallback", NULL);
+}
+
+static void test_create_detached(void ** arg)
+{
+    thread_report report;
+
+    memset(&report, 0, sizeof(report));
+    sem_init(&report.done, 0, 0);
+
+    assert_int_equal(k_thread_create("detached", NULL, report_thread, &report),
+                     THREAD_POLICY_OK);
+    sem_wait(&report.done);
+    assert_string_equal(report.name, "detached");
+
+    sem_destroy(&report.done);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_env_spec),
+        cmocka_unit_test(test_bad_args),
+        cmocka_unit_test(test_set_and_get),
+        cmocka_unit_test(test_full),
+        cmocka_unit_test(test_parse),
+        cmocka_unit_test(test_create_applies_policy),
+        cmocka_unit_test(test_create_falls_back),
+        cmocka_unit_test(test_create_detached),
+    };
+
+    setenv(K_THREAD_POLICY_ENV, "env-thread:stack=96,mlock", 1);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,196 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmocka.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "i2c.h"
+#include "thread-stats.h"
+
+#define TEST_ADDR 0x50
+
+/* Find a record by name in a fresh snapshot */
+static k_thread_stats find(const char * name)
+{
+    k_thread_stats buffer[K_THREAD_STATS_MAX];
+    int            count = 0;
+
+    assert_int_equal(k_thread_stats_snapshot(buffer, K_THREAD_STATS_MAX, &count),
+                     THREAD_STATS_OK);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(buffer[i].name, name) == 0)
+        {
+            return buffer[i];
+        }
+    }
+
+    fail_msg("No record for %s", name);
+
+    k_thread_stats empty = { 0 };
+    return empty;
+}
+
+static void test_register_bad_args(void ** arg)
+{
+    assert_int_equal(k_thread_stats_register(NULL, 0), THREAD_STATS_ERROR_CONFIG);
+    assert_int_equal(k_thread_stats_register("", 0), THREAD_STATS_ERROR_CONFIG);
+
+    assert_int_equal(k_thread_stats_register("twice", 0), THREAD_STATS_OK);
+    assert_int_equal(k_thread_stats_register("twice", 0), THREAD_STATS_ERROR_CONFIG);
+    k_thread_stats_unregister(NULL);
+}
+
+static void test_snapshot_bad_args(void ** arg)
+{
+    k_thread_stats buffer[1];
+    int            count;
+
+    assert_int_equal(k_thread_stats_snapshot(NULL, 1, &count),
+                     THREAD_STATS_ERROR_CONFIG);
+    assert_int_equal(k_thread_stats_snapshot(buffer, 1, NULL),
+                     THREAD_STATS_ERROR_CONFIG);
+}
+
+static void test_wakeups_and_bus(void ** arg)
+{
+    uint8_t data = 'A';
+
+    assert_int_equal(k_thread_stats_register("counting", 0), THREAD_STATS_OK);
+
+    k_thread_stats_wakeup();
+    k_thread_stats_wakeup();
+
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_write, 1);
+    assert_int_equal(k_i2c_write(1, TEST_ADDR, &data, 1), I2C_OK);
+
+    /* Failed transfers still used the bus */
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_read, 0);
+    assert_int_equal(k_i2c_read(1, TEST_ADDR, &data, 1), I2C_ERROR);
+
+    k_thread_stats record = find("counting");
+    assert_true(record.active);
+    assert_int_equal(record.wakeups, 2);
+    assert_int_equal(record.bus_transfers, 2);
+    assert_int_equal(record.missed_deadlines, 0);
+
+    k_thread_stats_unregister(NULL);
+
+    record = find("counting");
+    assert_false(record.active);
+    assert_true(record.cpu_ns > 0);
+}
+
+static void test_untracked_bus(void ** arg)
+{
+    uint8_t data = 'A';
+
+    /* Nothing is registered on this thread, so nothing is charged */
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_write, 1);
+    assert_int_equal(k_i2c_write(1, TEST_ADDR, &data, 1), I2C_OK);
+
+    assert_false(kprv_thread_stats_tracked());
+}
+
+static void test_missed_deadline(void ** arg)
+{
+    const struct timespec late = {.tv_sec = 0, .tv_nsec = 150000000 };
+
+    assert_int_equal(k_thread_stats_register("late", 10), THREAD_STATS_OK);
+
+    k_thread_stats_wakeup();
+    nanosleep(&late, NULL);
+    k_thread_stats_wakeup();
+
+    k_thread_stats record = find("late");
+    assert_int_equal(record.wakeups, 2);
+    assert_int_equal(record.missed_deadlines, 1);
+    assert_true(record.max_lateness_ns
+                > (uint64_t) K_THREAD_STATS_SLACK_MS * 1000000ULL);
+
+    k_thread_stats_unregister(NULL);
+}
+
+static void test_reregister_keeps_history(void ** arg)
+{
+    assert_int_equal(k_thread_stats_register("restart", 0), THREAD_STATS_OK);
+    k_thread_stats_wakeup();
+    k_thread_stats_unregister(NULL);
+
+    assert_int_equal(k_thread_stats_register("restart", 0), THREAD_STATS_OK);
+    k_thread_stats_wakeup();
+    k_thread_stats_unregister(NULL);
+
+    assert_int_equal(find("restart").wakeups, 2);
+}
+
+/* Same shape as the API watchdog threads */
+static void * watchdog(void * args)
+{
+    k_thread_stats_register("cancelled", 1000);
+    pthread_cleanup_push(k_thread_stats_unregister, NULL);
+
+    while (1)
+    {
+        k_thread_stats_wakeup();
+
+        sleep(1);
+    }
+
+    pthread_cleanup_pop(1);
+
+    return NULL;
+}
+
+static void test_cancelled_thread(void ** arg)
+{
+    const struct timespec settle = {.tv_sec = 0, .tv_nsec = 10000000 };
+    pthread_t             thread;
+
+    assert_int_equal(pthread_create(&thread, NULL, watchdog, NULL), 0);
+    nanosleep(&settle, NULL);
+
+    assert_true(find("cancelled").active);
+
+    pthread_cancel(thread);
+    pthread_join(thread, NULL);
+
+    k_thread_stats record = find("cancelled");
+    assert_false(record.active);
+    assert_int_equal(record.wakeups, 1);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_register_bad_args),
+        cmocka_unit_test(test_snapshot_bad_args),
+        cmocka_unit_test(test_wakeups_and_bus),
+        cmocka_unit_test(test_untracked_bus),
+        cmocka_unit_test(test_missed_deadline),
+        cmocka_unit_test(test_reregister_keeps_history),
+        cmocka_unit_test(test_cancelled_thread),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
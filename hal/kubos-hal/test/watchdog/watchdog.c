@@ -0,0 +1,247 @@
+/*
+ * KubOS HAL
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+#include "clock.h"
+#include "i2c.h"
+#include "watchdog.h"
+
+#define TEST_BUS 1
+#define MS       1000000ULL
+
+static const k_wdt_config implicit = {
+    .timeout_ms = 60000,
+    .margin_ms  = 20000,
+    .implicit   = true,
+};
+
+static const k_wdt_config explicit = {
+    .timeout_ms = 10000,
+    .margin_ms  = 1000,
+    .implicit   = false,
+};
+
+static k_wdt_stats find(const char * name)
+{
+    k_wdt_stats buffer[K_WDT_MAX];
+    int         count = 0;
+
+    assert_int_equal(k_wdt_snapshot(buffer, K_WDT_MAX, &count), WDT_OK);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (strcmp(buffer[i].name, name) == 0)
+        {
+            return buffer[i];
+        }
+    }
+
+    fail_msg("No record for %s", name);
+
+    k_wdt_stats empty = { 0 };
+    return empty;
+}
+
+static void write_ok(uint16_t addr)
+{
+    uint8_t data = 'A';
+
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_write, 1);
+    assert_int_equal(k_i2c_write(TEST_BUS, addr, &data, 1), I2C_OK);
+}
+
+static void test_attach_bad_args(void ** arg)
+{
+    k_wdt_config bad = implicit;
+    int          wdt;
+
+    assert_int_equal(k_wdt_attach(NULL, TEST_BUS, 0x10, &implicit, &wdt),
+                     WDT_ERROR_CONFIG);
+    assert_int_equal(k_wdt_attach("bad", TEST_BUS, 0x10, NULL, &wdt),
+                     WDT_ERROR_CONFIG);
+    assert_int_equal(k_wdt_attach("bad", TEST_BUS, 0x10, &implicit, NULL),
+                     WDT_ERROR_CONFIG);
+
+    bad.timeout_ms = 0;
+    assert_int_equal(k_wdt_attach("bad", TEST_BUS, 0x10, &bad, &wdt),
+                     WDT_ERROR_CONFIG);
+
+    bad.timeout_ms = bad.margin_ms;
+    assert_int_equal(k_wdt_attach("bad", TEST_BUS, 0x10, &bad, &wdt),
+                     WDT_ERROR_CONFIG);
+
+    assert_int_equal(k_wdt_snapshot(NULL, 1, &wdt), WDT_ERROR_CONFIG);
+
+    /* Unknown ids are ignored */
+    k_wdt_kicked(-1);
+    k_wdt_report(K_WDT_MAX, 1000);
+    assert_int_equal(k_wdt_due(-1), 0);
+}
+
+static void test_explicit(void ** arg)
+{
+    int wdt;
+
+    assert_int_equal(k_wdt_attach("explicit", TEST_BUS, 0x20, &explicit, &wdt),
+                     WDT_OK);
+
+    /* Due at once until something tells us the time left */
+    assert_int_equal(k_wdt_due(wdt), 0);
+    assert_false(find("explicit").known);
+
+    uint64_t start = k_clock_now();
+    k_wdt_kicked(wdt);
+    assert_int_equal(k_wdt_due(wdt), start + 9000 * MS);
+
+    /* Traffic doesn't count for it */
+    k_clock_sleep(5000 * MS);
+    write_ok(0x20);
+    assert_int_equal(k_wdt_due(wdt), start + 9000 * MS);
+
+    k_wdt_stats stats = find("explicit");
+    assert_true(stats.known);
+    assert_int_equal(stats.time_left_ms, 5000);
+    assert_int_equal(stats.kicks, 1);
+    assert_int_equal(stats.implicit, 0);
+
+    k_wdt_detach(wdt);
+    assert_int_equal(k_wdt_due(wdt), 0);
+    assert_false(find("explicit").active);
+}
+
+static void test_implicit(void ** arg)
+{
+    uint8_t data = 'A';
+    int     wdt;
+
+    assert_int_equal(k_wdt_attach("implicit", TEST_BUS, 0x30, &implicit, &wdt),
+                     WDT_OK);
+
+    uint64_t start = k_clock_now();
+    write_ok(0x30);
+    assert_int_equal(k_wdt_due(wdt), start + 40000 * MS);
+
+    /* Each write pushes the deadline out */
+    k_clock_sleep(30000 * MS);
+    write_ok(0x30);
+    assert_int_equal(k_wdt_due(wdt), start + 70000 * MS);
+
+    /* Failed writes, reads and other devices don't */
+    k_clock_sleep(1000 * MS);
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_write, -1);
+    assert_int_equal(k_i2c_write(TEST_BUS, 0x30, &data, 1), I2C_ERROR);
+    will_return(__wrap_ioctl, 0);
+    will_return(__wrap_read, 1);
+    assert_int_equal(k_i2c_read(TEST_BUS, 0x30, &data, 1), I2C_OK);
+    write_ok(0x31);
+    assert_int_equal(k_wdt_due(wdt), start + 70000 * MS);
+
+    k_wdt_stats stats = find("implicit");
+    assert_int_equal(stats.implicit, 2);
+    assert_int_equal(stats.kicks, 0);
+    assert_int_equal(stats.time_left_ms, 59000);
+
+    k_wdt_detach(wdt);
+    write_ok(0x30);
+    assert_int_equal(find("implicit").implicit, 2);
+}
+
+static void test_report(void ** arg)
+{
+    int wdt;
+
+    assert_int_equal(k_wdt_attach("report", TEST_BUS, 0x40, &implicit, &wdt),
+                     WDT_OK);
+
+    uint64_t start = k_clock_now();
+
+    /* The device's word replaces the estimate, even when it's shorter */
+    write_ok(0x40);
+    k_wdt_report(wdt, 25000);
+    assert_int_equal(k_wdt_due(wdt), start + 5000 * MS);
+
+    k_wdt_report(wdt, 50000);
+    assert_int_equal(k_wdt_due(wdt), start + 30000 * MS);
+
+    /* Inside the margin: due now */
+    k_wdt_report(wdt, 10000);
+    assert_true(k_wdt_due(wdt) <= k_clock_now());
+
+    assert_int_equal(find("report").reports, 3);
+}
+
+static void test_reattach(void ** arg)
+{
+    int wdt;
+    int again;
+
+    assert_int_equal(k_wdt_attach("again", TEST_BUS, 0x50, &explicit, &wdt),
+                     WDT_OK);
+    k_wdt_kicked(wdt);
+    k_wdt_kicked(wdt);
+
+    /* Same name: same record, new settings, counters kept, time left unknown */
+    assert_int_equal(k_wdt_attach("again", TEST_BUS, 0x51, &implicit, &again),
+                     WDT_OK);
+    assert_int_equal(again, wdt);
+    assert_int_equal(k_wdt_due(wdt), 0);
+    assert_int_equal(find("again").kicks, 2);
+
+    write_ok(0x51);
+    assert_int_equal(find("again").implicit, 1);
+}
+
+static void test_full(void ** arg)
+{
+    char name[K_WDT_NAME_LEN];
+    int  wdt;
+    int  count = 0;
+
+    for (int i = 0; i < K_WDT_MAX; i++)
+    {
+        snprintf(name, sizeof(name), "full-%d", i);
+        if (k_wdt_attach(name, TEST_BUS, 0x60 + i, &explicit, &wdt) != WDT_OK)
+        {
+            break;
+        }
+        count++;
+    }
+
+    assert_true(count < K_WDT_MAX);
+    assert_int_equal(k_wdt_attach("one-more", TEST_BUS, 0x70, &explicit, &wdt),
+                     WDT_ERROR_FULL);
+}
+
+int main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_attach_bad_args),
+        cmocka_unit_test(test_explicit),
+        cmocka_unit_test(test_implicit),
+        cmocka_unit_test(test_report),
+        cmocka_unit_test(test_reattach),
+        cmocka_unit_test(test_full),
+    };
+
+    k_clock_use_virtual(0);
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
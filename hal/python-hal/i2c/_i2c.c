@@ -0,0 +1,543 @@
+/*
+ * Copyright (C) 2018 Kubos Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Native I2C bus access for the Python I2C library.
+ *
+ * The bus is opened once through kubos-hal and kept open. Where the adapter
+ * supports it, every operation is a single I2C_RDWR ioctl which carries the
+ * slave address with it, so a write-then-read is one syscall with a repeated
+ * start. Otherwise the slave address is set once and cached. The GIL is
+ * released for the duration of the bus I/O.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include <errno.h>
+#include <i2c.h>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <stdbool.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+typedef struct {
+    PyObject_HEAD
+    int                fd;   /* 0 once closed, matching kubos-hal */
+    int                addr; /* Slave address last set with I2C_SLAVE, or -1 */
+    bool               rdwr; /* Adapter supports I2C_RDWR */
+    PyThread_type_lock lock; /* Held for every transfer and to open or close */
+} BusObject;
+
+/*
+ * Take the bus lock with the GIL released, so a transfer holding it can
+ * finish. Nothing waits for the lock while holding the GIL.
+ */
+static void bus_lock(BusObject * self)
+{
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    Py_END_ALLOW_THREADS
+}
+
+/* Close the bus once no transfer is using it */
+static void bus_close(BusObject * self)
+{
+    if (self->lock == NULL)
+    {
+        return;
+    }
+
+    bus_lock(self);
+    k_i2c_terminate(&self->fd);
+    self->addr = -1;
+    PyThread_release_lock(self->lock);
+}
+
+static int bus_check_open(BusObject * self)
+{
+    if (self->fd == 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "I2C bus is closed");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int bus_check_addr(int addr)
+{
+    if (addr < 0 || addr > 0x7F)
+    {
+        PyErr_Format(PyExc_ValueError, "Invalid I2C address: %d", addr);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Run a write and/or read against a device. Called without the GIL and with
+ * the bus lock held. Returns 0 or an errno value.
+ */
+static int bus_io(BusObject * self, int addr, const uint8_t * tx,
+                  Py_ssize_t tx_len, uint8_t * rx, Py_ssize_t rx_len)
+{
+    int ret = 0;
+
+    /* Closed by another thread since the caller checked */
+    if (self->fd == 0)
+    {
+        return EBADF;
+    }
+
+    if (self->rdwr)
+    {
+        struct i2c_msg             msgs[2];
+        struct i2c_rdwr_ioctl_data data = {.msgs = msgs, .nmsgs = 0 };
+
+        if (tx_len > 0)
+        {
+            msgs[data.nmsgs].addr  = (uint16_t) addr;
+            msgs[data.nmsgs].flags = 0;
+            msgs[data.nmsgs].len   = (uint16_t) tx_len;
+            msgs[data.nmsgs].buf   = (uint8_t *) tx;
+            data.nmsgs++;
+        }
+        if (rx_len > 0)
+        {
+            msgs[data.nmsgs].addr  = (uint16_t) addr;
+            msgs[data.nmsgs].flags = I2C_M_RD;
+            msgs[data.nmsgs].len   = (uint16_t) rx_len;
+            msgs[data.nmsgs].buf   = rx;
+            data.nmsgs++;
+        }
+
+        if (ioctl(self->fd, I2C_RDWR, &data) < 0)
+        {
+            return errno;
+        }
+
+        return 0;
+    }
+
+    if (self->addr != addr)
+    {
+        if (ioctl(self->fd, I2C_SLAVE, addr) < 0)
+        {
+            ret = errno;
+            self->addr = -1;
+        }
+        else
+        {
+            self->addr = addr;
+        }
+    }
+
+    if (ret == 0 && tx_len > 0 && write(self->fd, tx, tx_len) != tx_len)
+    {
+        ret = (errno != 0) ? errno : EIO;
+    }
+
+    if (ret == 0 && rx_len > 0 && read(self->fd, rx, rx_len) != rx_len)
+    {
+        ret = (errno != 0) ? errno : EIO;
+    }
+
+    return ret;
+}
+
+/* Release the GIL and run the transfer, raising OSError on failure */
+static int bus_run(BusObject * self, int addr, const uint8_t * tx,
+                   Py_ssize_t tx_len, uint8_t * rx, Py_ssize_t rx_len)
+{
+    int err;
+
+    if (tx_len > 0xFFFF || rx_len > 0xFFFF)
+    {
+        PyErr_SetString(PyExc_ValueError, "I2C transfers are limited to 65535 bytes");
+        return -1;
+    }
+
+    errno = 0;
+
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    err = bus_io(self, addr, tx, tx_len, rx, rx_len);
+    PyThread_release_lock(self->lock);
+    Py_END_ALLOW_THREADS
+
+    if (err != 0)
+    {
+        errno = err;
+        PyErr_SetFromErrno(PyExc_OSError);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int Bus_init(BusObject * self, PyObject * args, PyObject * kwds)
+{
+    static char * kwlist[] = { "bus", NULL };
+    PyObject *    bus;
+    char          path[32];
+    unsigned long funcs = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &bus))
+    {
+        return -1;
+    }
+
+    if (PyLong_Check(bus))
+    {
+        long num = PyLong_AsLong(bus);
+        if (num < 0 || num > 9)
+        {
+            PyErr_Format(PyExc_ValueError, "Invalid I2C bus number: %ld", num);
+            return -1;
+        }
+        snprintf(path, sizeof(path), "/dev/i2c-%ld", num);
+    }
+    else if (PyUnicode_Check(bus))
+    {
+        const char * str = PyUnicode_AsUTF8(bus);
+        if (str == NULL)
+        {
+            return -1;
+        }
+        snprintf(path, sizeof(path), "%s", str);
+    }
+    else
+    {
+        PyErr_SetString(PyExc_TypeError, "Bus must be a number or a device path");
+        return -1;
+    }
+
+    if (self->lock == NULL)
+    {
+        self->lock = PyThread_allocate_lock();
+        if (self->lock == NULL)
+        {
+            PyErr_NoMemory();
+            return -1;
+        }
+    }
+
+    /* Reopening must not pull the bus out from under a transfer */
+    bus_lock(self);
+
+    if (self->fd != 0)
+    {
+        k_i2c_terminate(&self->fd);
+    }
+
+    errno = 0;
+    if (k_i2c_init(path, &self->fd) != I2C_OK)
+    {
+        int err = (errno != 0) ? errno : ENODEV;
+
+        PyThread_release_lock(self->lock);
+        errno = err;
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+        return -1;
+    }
+
+    self->addr = -1;
+    self->rdwr = ioctl(self->fd, I2C_FUNCS, &funcs) == 0
+                 && (funcs & I2C_FUNC_I2C) != 0;
+
+    PyThread_release_lock(self->lock);
+
+    return 0;
+}
+
+static void Bus_dealloc(BusObject * self)
+{
+    bus_close(self);
+
+    if (self->lock != NULL)
+    {
+        PyThread_free_lock(self->lock);
+    }
+
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject * Bus_close(BusObject * self, PyObject * Py_UNUSED(ignored))
+{
+    bus_close(self);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject * Bus_fileno(BusObject * self, PyObject * Py_UNUSED(ignored))
+{
+    if (bus_check_open(self) < 0)
+    {
+        return NULL;
+    }
+
+    return PyLong_FromLong(self->fd);
+}
+
+static PyObject * Bus_enter(BusObject * self, PyObject * Py_UNUSED(ignored))
+{
+    Py_INCREF(self);
+
+    return (PyObject *) self;
+}
+
+static PyObject * Bus_exit(BusObject * self, PyObject * args)
+{
+    bus_close(self);
+
+    Py_RETURN_FALSE;
+}
+
+static PyObject * Bus_write(BusObject * self, PyObject * args)
+{
+    int       addr;
+    Py_buffer data;
+
+    if (!PyArg_ParseTuple(args, "iy*", &addr, &data))
+    {
+        return NULL;
+    }
+
+    int ret = -1;
+    if (bus_check_open(self) == 0 && bus_check_addr(addr) == 0)
+    {
+        ret = bus_run(self, addr, data.buf, data.len, NULL, 0);
+    }
+
+    Py_ssize_t len = data.len;
+    PyBuffer_Release(&data);
+
+    if (ret < 0)
+    {
+        return NULL;
+    }
+
+    return PyLong_FromSsize_t(len);
+}
+
+/* Shared body of read() and transfer() */
+static PyObject * bus_read_bytes(BusObject * self, int addr, Py_buffer * tx,
+                                 Py_ssize_t count)
+{
+    if (bus_check_open(self) < 0 || bus_check_addr(addr) < 0)
+    {
+        return NULL;
+    }
+
+    if (count < 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "Read count must not be negative");
+        return NULL;
+    }
+
+    PyObject * result = PyBytes_FromStringAndSize(NULL, count);
+    if (result == NULL)
+    {
+        return NULL;
+    }
+
+    /* The new bytes object isn't visible to anyone else yet */
+    if (bus_run(self, addr, (tx != NULL) ? tx->buf : NULL,
+                (tx != NULL) ? tx->len : 0,
+                (uint8_t *) PyBytes_AS_STRING(result), count)
+        < 0)
+    {
+        Py_DECREF(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+/* Shared body of read_into() and transfer_into() */
+static PyObject * bus_read_buffer(BusObject * self, int addr, Py_buffer * tx,
+                                  Py_buffer * rx)
+{
+    if (bus_check_open(self) < 0 || bus_check_addr(addr) < 0)
+    {
+        return NULL;
+    }
+
+    if (bus_run(self, addr, (tx != NULL) ? tx->buf : NULL,
+                (tx != NULL) ? tx->len : 0, rx->buf, rx->len)
+        < 0)
+    {
+        return NULL;
+    }
+
+    return PyLong_FromSsize_t(rx->len);
+}
+
+static PyObject * Bus_read(BusObject * self, PyObject * args)
+{
+    int        addr;
+    Py_ssize_t count;
+
+    if (!PyArg_ParseTuple(args, "in", &addr, &count))
+    {
+        return NULL;
+    }
+
+    return bus_read_bytes(self, addr, NULL, count);
+}
+
+static PyObject * Bus_read_into(BusObject * self, PyObject * args)
+{
+    int       addr;
+    Py_buffer rx;
+
+    if (!PyArg_ParseTuple(args, "iw*", &addr, &rx))
+    {
+        return NULL;
+    }
+
+    PyObject * result = bus_read_buffer(self, addr, NULL, &rx);
+
+    PyBuffer_Release(&rx);
+
+    return result;
+}
+
+static PyObject * Bus_transfer(BusObject * self, PyObject * args)
+{
+    int        addr;
+    Py_buffer  tx;
+    Py_ssize_t count;
+
+    if (!PyArg_ParseTuple(args, "iy*n", &addr, &tx, &count))
+    {
+        return NULL;
+    }
+
+    PyObject * result = bus_read_bytes(self, addr, &tx, count);
+
+    PyBuffer_Release(&tx);
+
+    return result;
+}
+
+static PyObject * Bus_transfer_into(BusObject * self, PyObject * args)
+{
+    int       addr;
+    Py_buffer tx;
+    Py_buffer rx;
+
+    if (!PyArg_ParseTuple(args, "iy*w*", &addr, &tx, &rx))
+    {
+        return NULL;
+    }
+
+    PyObject * result = bus_read_buffer(self, addr, &tx, &rx);
+
+    PyBuffer_Release(&tx);
+    PyBuffer_Release(&rx);
+
+    return result;
+}
+
+static PyObject * Bus_get_combined(BusObject * self, void * closure)
+{
+    return PyBool_FromLong(self->rdwr);
+}
+
+static PyMethodDef Bus_methods[] = {
+    { "write", (PyCFunction) Bus_write, METH_VARARGS,
+      "write(addr, data) -> int\n\n"
+      "Write a bytes-like object to the device. Returns the bytes written." },
+    { "read", (PyCFunction) Bus_read, METH_VARARGS,
+      "read(addr, count) -> bytes\n\n"
+      "Read count bytes from the device." },
+    { "read_into", (PyCFunction) Bus_read_into, METH_VARARGS,
+      "read_into(addr, buffer) -> int\n\n"
+      "Fill a writable buffer (e.g. a bytearray) from the device." },
+    { "transfer", (PyCFunction) Bus_transfer, METH_VARARGS,
+      "transfer(addr, data, count) -> bytes\n\n"
+      "Write data, then read count bytes back, as one combined transfer\n"
+      "where the adapter supports it." },
+    { "transfer_into", (PyCFunction) Bus_transfer_into, METH_VARARGS,
+      "transfer_into(addr, data, buffer) -> int\n\n"
+      "Like transfer(), reading the reply into a writable buffer." },
+    { "fileno", (PyCFunction) Bus_fileno, METH_NOARGS,
+      "Bus file descriptor." },
+    { "close", (PyCFunction) Bus_close, METH_NOARGS,
+      "Close the bus. Further I/O raises ValueError." },
+    { "__enter__", (PyCFunction) Bus_enter, METH_NOARGS, NULL },
+    { "__exit__", (PyCFunction) Bus_exit, METH_VARARGS, NULL },
+    { NULL }
+};
+
+static PyGetSetDef Bus_getset[] = {
+    { "combined", (getter) Bus_get_combined, NULL,
+      "True if transfers are done as single I2C_RDWR requests", NULL },
+    { NULL }
+};
+
+static PyTypeObject BusType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name      = "_i2c.Bus",
+    .tp_doc       = "Bus(bus)\n\n"
+                    "Open I2C bus handle. bus is a bus number or device path.",
+    .tp_basicsize = sizeof(BusObject),
+    .tp_itemsize  = 0,
+    .tp_flags     = Py_TPFLAGS_DEFAULT,
+    .tp_new       = PyType_GenericNew,
+    .tp_init      = (initproc) Bus_init,
+    .tp_dealloc   = (destructor) Bus_dealloc,
+    .tp_methods   = Bus_methods,
+    .tp_getset    = Bus_getset,
+};
+
+static struct PyModuleDef i2c_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "_i2c",
+    .m_doc  = "Native I2C bus access backed by kubos-hal",
+    .m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit__i2c(void)
+{
+    PyObject * module;
+
+    if (PyType_Ready(&BusType) < 0)
+    {
+        return NULL;
+    }
+
+    module = PyModule_Create(&i2c_module);
+    if (module == NULL)
+    {
+        return NULL;
+    }
+
+    Py_INCREF(&BusType);
+    if (PyModule_AddObject(module, "Bus", (PyObject *) &BusType) < 0)
+    {
+        Py_DECREF(&BusType);
+        Py_DECREF(module);
+        return NULL;
+    }
+
+    return module;
+}
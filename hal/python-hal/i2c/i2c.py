@@ -13,6 +13,11 @@ import io
 import sys
 import fcntl
 
+try:
+    import _i2c
+except ImportError:
+    _i2c = None
+
 I2C_SLAVE = 0x0703
 
 
@@ -21,8 +26,27 @@ class I2C:
     def __init__(self, bus):
         """
         Retrieves the read/write file handle for the device
+
+        If the native extension is available the bus is opened once here and
+        kept open. Otherwise the bus is opened for each call.
         """
         self.filepath = "/dev/i2c-"+str(bus)
+        self._bus = None
+
+        if _i2c is not None:
+            try:
+                self._bus = _i2c.Bus(self.filepath)
+            except OSError:
+                self._bus = None
+
+    @staticmethod
+    def _format(data):
+        if type(data) is list:
+            return bytearray(data)
+        elif type(data) is bytes:
+            return data
+        raise TypeError('Invalid data format: ' +
+                        str(type(data))+', must be bytes or list')
 
     def write(self, device, data):
         """
@@ -31,18 +55,16 @@ class I2C:
         Input must be a string or a list.
         Returns True and the data (as written to the device) if successful
         """
+        data = self._format(data)
+
+        if self._bus is not None:
+            self._bus.write(device, data)
+            return True, data
 
         with io.open(self.filepath, "r+b", buffering=0) as file:
 
             fcntl.ioctl(file, I2C_SLAVE, device)
 
-            if type(data) is list:
-                data = bytearray(data)
-            elif type(data) is bytes:
-                pass
-            else:
-                raise TypeError('Invalid data format: ' +
-                                str(type(data))+', must be bytes or list')
             file.write(data)
             return True, data
 
@@ -50,7 +72,48 @@ class I2C:
         """
         Reads the specified number of bytes from the device.
         """
+        if self._bus is not None:
+            return self._bus.read(device, count)
+
         with io.open(self.filepath, "r+b", buffering=0) as file:
             fcntl.ioctl(file, I2C_SLAVE, device)
 
             return file.read(count)
+
+    def read_into(self, device, buffer):
+        """
+        Reads from the device into a preallocated buffer (e.g. a bytearray),
+        filling it completely. Returns the number of bytes read.
+        """
+        if self._bus is not None:
+            return self._bus.read_into(device, buffer)
+
+        with io.open(self.filepath, "r+b", buffering=0) as file:
+            fcntl.ioctl(file, I2C_SLAVE, device)
+
+            return file.readinto(buffer)
+
+    def transfer(self, device, data, count):
+        """
+        Writes the data to the device and reads count bytes of response.
+        With the native extension this is a single combined transfer where
+        the adapter supports it.
+        """
+        data = self._format(data)
+
+        if self._bus is not None:
+            return self._bus.transfer(device, data, count)
+
+        with io.open(self.filepath, "r+b", buffering=0) as file:
+            fcntl.ioctl(file, I2C_SLAVE, device)
+
+            file.write(data)
+            return file.read(count)
+
+    def close(self):
+        """
+        Releases the bus handle, if one is being kept open.
+        """
+        if self._bus is not None:
+            self._bus.close()
+            self._bus = None
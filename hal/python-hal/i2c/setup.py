@@ -5,10 +5,23 @@ See:
 https://github.com/pypa/sampleproject
 """
 
-from setuptools import setup
+from glob import glob
+from setuptools import setup, Extension
+
+hal = '../../kubos-hal'
+
+# Native bus access. Optional, so the pure Python module still installs
+# where there is no compiler. Built from the whole HAL so that anything the
+# bus code comes to depend on is always linked in.
+native = Extension('_i2c',
+                   sources=['_i2c.c'] + sorted(glob(hal + '/source/*.c')),
+                   include_dirs=[hal + '/kubos-hal'],
+                   libraries=['pthread'],
+                   optional=True)
 
 setup(name='i2c',
-      version='0.1.0',
+      version='0.2.0',
       description='I2C library for KubOS',
-      py_modules=["i2c"]
+      py_modules=["i2c"],
+      ext_modules=[native]
       )
@@ -8,6 +8,9 @@
 Unit testing for the I2C library.
 """
 
+import importlib
+import importlib.util
+import threading
 import unittest
 import i2c
 import mock
@@ -53,6 +56,127 @@ class TestI2C(unittest.TestCase):
             self.i2cdevice.read(fake_device, fake_count)
             mock_ioctl.assert_called_with(mock.ANY, i2c.I2C_SLAVE, fake_device)
 
+    def test_transfer_falls_back(self):
+        fake_device = 1
+
+        with mock.patch('io.open') as mock_open, \
+                mock.patch('fcntl.ioctl') as mock_ioctl:
+            self.i2cdevice.transfer(fake_device, [0x01], 4)
+            mock_ioctl.assert_called_with(mock.ANY, i2c.I2C_SLAVE, fake_device)
+            handle = mock_open.return_value.__enter__.return_value
+            handle.write.assert_called_with(bytearray([0x01]))
+            handle.read.assert_called_with(4)
+
+
+class TestI2CNative(unittest.TestCase):
+
+    def setUp(self):
+        self.bus = mock.MagicMock()
+        fake_module = mock.MagicMock()
+        fake_module.Bus.return_value = self.bus
+
+        with mock.patch('i2c._i2c', fake_module):
+            self.i2cdevice = i2c.I2C(1)
+
+        fake_module.Bus.assert_called_with("/dev/i2c-1")
+
+    def test_write_uses_open_bus(self):
+        with mock.patch('io.open') as mock_open:
+            self.assertEqual(self.i2cdevice.write(0x20, [0x73]),
+                             (True, bytearray([0x73])))
+            self.bus.write.assert_called_with(0x20, bytearray([0x73]))
+            mock_open.assert_not_called()
+
+    def test_wrong_datatype_raises_type_error(self):
+        with self.assertRaises(TypeError):
+            self.i2cdevice.write(0x20, 123)
+
+    def test_read_into(self):
+        buffer = bytearray(8)
+        self.bus.read_into.return_value = 8
+
+        self.assertEqual(self.i2cdevice.read_into(0x20, buffer), 8)
+        self.bus.read_into.assert_called_with(0x20, buffer)
+
+    def test_transfer(self):
+        self.bus.transfer.return_value = b'\x01\x02'
+
+        self.assertEqual(self.i2cdevice.transfer(0x20, b'\x10', 2), b'\x01\x02')
+        self.bus.transfer.assert_called_with(0x20, b'\x10', 2)
+
+    def test_close(self):
+        self.i2cdevice.close()
+        self.bus.close.assert_called_with()
+
+
+class TestNativeImport(unittest.TestCase):
+
+    def test_extension_loads(self):
+        # i2c falls back to the Python path on any ImportError, so a built
+        # extension which fails to load (e.g. on a missing HAL symbol) would
+        # otherwise only show up as skipped tests
+        if importlib.util.find_spec('_i2c') is None:
+            self.skipTest("native extension not built")
+        importlib.import_module('_i2c')
+
+
+@unittest.skipIf(i2c._i2c is None, "native extension not built")
+class TestNativeBus(unittest.TestCase):
+
+    def test_missing_bus_raises(self):
+        with self.assertRaises(OSError):
+            i2c._i2c.Bus("/dev/i2c-9")
+
+    def test_bad_arguments(self):
+        with self.assertRaises(ValueError):
+            i2c._i2c.Bus(42)
+        with self.assertRaises(TypeError):
+            i2c._i2c.Bus(1.5)
+
+    def test_io_errors_raise(self):
+        # Not an I2C adapter, so every request fails in the kernel
+        with i2c._i2c.Bus("/dev/null") as bus:
+            self.assertFalse(bus.combined)
+            with self.assertRaises(OSError):
+                bus.write(0x20, b'\x00')
+            with self.assertRaises(OSError):
+                bus.transfer_into(0x20, b'\x00', bytearray(2))
+            with self.assertRaises(ValueError):
+                bus.read(0x80, 1)
+            with self.assertRaises(TypeError):
+                bus.read_into(0x20, b'immutable')
+
+    def test_closed_bus(self):
+        bus = i2c._i2c.Bus("/dev/null")
+        bus.close()
+        with self.assertRaises(ValueError):
+            bus.read(0x20, 1)
+
+    def test_close_during_io(self):
+        bus = i2c._i2c.Bus("/dev/null")
+        errors = []
+
+        def hammer():
+            for _ in range(2000):
+                try:
+                    bus.write(0x20, b'\x00')
+                except OSError:
+                    pass
+                except ValueError:
+                    return
+                except Exception as error:
+                    errors.append(error)
+                    return
+
+        threads = [threading.Thread(target=hammer) for _ in range(4)]
+        for thread in threads:
+            thread.start()
+        bus.close()
+        for thread in threads:
+            thread.join()
+
+        self.assertEqual(errors, [])
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -234,8 +234,9 @@ KADCSStatus get_orientation()
     KADCSStatus status;
     adcs_orient data;
 
+    /* No position has been given, so there's no field model to compare to */
     status = k_adcs_get_orientation(&data);
-    if (status != ADCS_ERROR_NOT_IMPLEMENTED)
+    if (status != ADCS_ERROR_CONFIG)
     {
         fprintf(fp, "[Orientation Test] Received unexpected ADCS orientation RC: %d\n",
                 status);
@@ -254,14 +255,21 @@ KADCSStatus get_spin()
     KADCSStatus status;
     adcs_spin data;
 
+    /* The first sample only primes the estimator */
+    k_adcs_get_spin(&data);
+    sleep(1);
+
     status = k_adcs_get_spin(&data);
-    if (status != ADCS_ERROR_NOT_IMPLEMENTED)
+    if (status != ADCS_OK)
     {
         fprintf(fp, "[Spin Test] Received unexpected ADCS spin RC: %d\n", status);
         fprintf(stderr, "[Spin Test] Received unexpected ADCS spin RC: %d\n", status);
         return ADCS_ERROR;
     }
 
+    fprintf(fp, "[Spin Test] Spin rate: %f rad/s (%f, %f, %f)\n", data.rate,
+            data.x, data.y, data.z);
+
     fprintf(fp, "[Spin Test] Test completed successfully\n");
 
     return ADCS_OK;
@@ -28,17 +28,23 @@ projects = [
     "./apis/isis-imtq-api",
     "./apis/isis-trxvu-api",
     "./apis/isis-iobc-supervisor",
+    "./apis/kubos-cpp-api",
+]
+
+# Projects using ccan/json, tested again with it built without a heap
+no_heap_projects = [
+    "./apis/isis-imtq-api",
 ]
 
 def clean(dir):
     build_dir = "build"
     shutil.rmtree(build_dir, ignore_errors=True)
 
-def build(dir):
+def build(dir, options=[]):
     build_dir = "build"
     cmake_dir = "../{}".format(dir)
     os.mkdir(build_dir)
-    subprocess.run(["cmake", cmake_dir], cwd=build_dir, check=True)
+    subprocess.run(["cmake", cmake_dir] + options, cwd=build_dir, check=True)
     subprocess.run(["make"], cwd=build_dir, check=True)
 
 def run_test(dir):
@@ -46,11 +52,11 @@ def run_test(dir):
     os.environ["CTEST_OUTPUT_ON_FAILURE"] = "1"
     subprocess.run(["make", "test"], cwd=build_dir, check=True)
 
-def test(dir):
+def test(dir, options=[]):
     test_dir = "{}/test".format(dir)
     if os.path.isdir(test_dir):
         clean(test_dir)
-        build(test_dir)
+        build(test_dir, options)
         run_test(test_dir)
 
 def main():
@@ -60,6 +66,9 @@ def main():
         clean(dir)
         build(dir)
         test(dir)
+    for dir in no_heap_projects:
+        print("Testing {} without a heap".format(dir))
+        test(dir, ["-DKUBOS_NO_HEAP=ON"])
 
 if __name__ == '__main__':
     main()